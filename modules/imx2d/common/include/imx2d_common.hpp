@@ -18,9 +18,14 @@
 #define __OPENCV_IMX2D_COMMON_HPP__
 
 #include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <set>
+#include <string>
+#include <vector>
 
 #if __GNUC__ >= 4
     #define DSO_EXPORT __attribute__ ((visibility ("default")))
@@ -37,6 +42,8 @@
 #define IMX2D_ERROR(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
 
 
+struct g2d_buf;
+
 namespace cv {
 namespace imx2d {
 
@@ -49,12 +56,58 @@ typedef std::shared_ptr<G2dBufRepo> G2dBufRepoPtr;
 class G2dBufPool;
 typedef std::shared_ptr<G2dBufPool> G2dBufPoolPtr;
 
+class G2dBufImports;
+typedef std::shared_ptr<G2dBufImports> G2dBufImportsPtr;
+
 /**
 @brief Imx2dGAllocator class manages Graphic buffers allocations
 */
 class DSO_EXPORT Imx2dGAllocator
 {
 public:
+    /**
+     @brief Cache coherency state of a cacheable graphic buffer
+    */
+    enum Coherency {
+        COHERENCY_CPU_DIRTY, //!< CPU cache may hold dirty lines
+        COHERENCY_CLEAN,     //!< memory up to date, CPU cache may hold clean lines
+        COHERENCY_DEVICE,    //!< written by device, CPU cache holds no line
+    };
+
+    /**
+     @brief State of the 4 channels shadow of a 3 channels graphic buffer
+    */
+    enum ShadowState {
+        SHADOW_NONE,   //!< shadow content is stale
+        SHADOW_SYNCED, //!< shadow and buffer content are identical
+        SHADOW_AHEAD,  //!< shadow written by device, buffer content is stale
+    };
+
+    /**
+     @brief Level of CMA pressure, compared to configured watermarks
+    */
+    enum CmaPressure {
+        CMA_PRESSURE_NONE,      //!< free CMA above low watermark
+        CMA_PRESSURE_LOW,       //!< free CMA below low watermark
+        CMA_PRESSURE_CRITICAL,  //!< free CMA below critical watermark
+        CMA_PRESSURE_EXHAUSTED, //!< allocation failed after cache trim
+    };
+
+    /**
+     @brief Callback notified of CMA pressure level changes, with free CMA bytes
+    */
+    typedef std::function<void(CmaPressure, size_t)> CmaPressureCallback;
+
+    /**
+     @brief 4 channels shadow of a 3 channels graphic buffer
+    */
+    struct Shadow {
+        struct g2d_buf* buf;
+        int width;
+        int height;
+        ShadowState state;
+    };
+
     /**
      @brief Return a reference to class instance singleton.
     */
@@ -79,7 +132,9 @@ public:
 
     Allocation will be done either from buffers cache if one buffer matches the
     pending request - if no cached buffer is available a new buffer will be
-    allocated from underlying graphic buffer allocator.
+    allocated from underlying graphic buffer allocator. When the latter fails,
+    caches of both pools and idle scratch arena buffers are released and
+    allocation is retried once.
     @param size requested size in bytes
     @param cacheable buffer is cacheable
     @param [out] handle handle associated to the buffer - used for free()
@@ -87,6 +142,18 @@ public:
     */
     void* alloc(size_t size, bool cacheable, void*& handle);
 
+    /**
+    @brief Allocate graphic buffer from underlying graphic buffer allocator
+
+    Buffers cache is bypassed and buffer is not registered: used for reserved
+    and scratch arena buffers. Failed allocations are retried and accounted
+    as in alloc(), CMA pressure sampled when monitored.
+    @param size requested size in bytes
+    @param cacheable buffer is cacheable
+    @return buffer descriptor, to be freed by g2d_free(), nullptr on failure
+    */
+    struct g2d_buf* allocBuffer(size_t size, bool cacheable);
+
     /**
     @brief Free graphic buffer
 
@@ -131,6 +198,71 @@ public:
     */
     unsigned getCacheAllocations(bool cacheable);
 
+    /**
+    @brief Return number of allocations served from the cache
+
+    @param bool true for cacheable pool, false for non-cacheable
+    */
+    uint64_t getCacheHits(bool cacheable);
+
+    /**
+    @brief Return number of allocations not found in the cache
+
+    Allocations done while the cache is disabled are not accounted.
+    @param bool true for cacheable pool, false for non-cacheable
+    */
+    uint64_t getCacheMisses(bool cacheable);
+
+    /**
+    @brief Return number of cached buffers freed to make room for recent ones
+
+    @param bool true for cacheable pool, false for non-cacheable
+    */
+    uint64_t getCacheEvictions(bool cacheable);
+
+    /**
+    @brief Reserve graphic buffers ahead of time
+
+    Reserved buffers serve allocations of matching size (up to twice the
+    requested size) before the cache of deallocated buffers. They are pinned
+    in the pool: not accounted in cache limits, never evicted, and not freed
+    on deallocation until releaseReservedBuffers() is called.
+    @param size buffer size in bytes
+    @param count number of buffers to reserve
+    @param cacheable buffers cache configuration
+    @return number of buffers actually reserved
+    */
+    unsigned reserveBuffers(size_t size, unsigned count, bool cacheable);
+
+    /**
+    @brief Release buffers reserved by reserveBuffers()
+
+    Reserved buffers currently in use are freed when deallocated.
+    */
+    void releaseReservedBuffers();
+
+    /**
+    @brief Return total number of bytes reserved, in use or not
+
+    @param bool true for cacheable pool, false for non-cacheable
+    */
+    size_t getReservedUsage(bool cacheable);
+
+    /**
+    @brief Return number of reserved buffers available for allocation
+
+    @param bool true for cacheable pool, false for non-cacheable
+    */
+    unsigned getReservedAllocations(bool cacheable);
+
+    /**
+    @brief Return number of allocations served by reserved buffers
+
+    Those are not accounted as cache hits.
+    @param bool true for cacheable pool, false for non-cacheable
+    */
+    uint64_t getReservedHits(bool cacheable);
+
     /**
     @brief Configure the cache of deallocated buffers
 
@@ -143,6 +275,219 @@ public:
     */
     void setCacheConfig(size_t cacheUsageMax, unsigned cacheAllocCountMax);
 
+    /**
+    @brief Enable tracking of buffers cache coherency state
+
+    When enabled, cache maintenance operations are skipped for buffers whose
+    coherency state makes them unnecessary. It requires every CPU access to
+    graphic buffers to be declared beforehand via declareCpuAccess(), that
+    applications reach through cv::imx2d::syncForCpu().
+    Enabling tracking resets every buffer state to COHERENCY_CPU_DIRTY.
+    @param flag enable (true) or disable (false) tracking
+    */
+    void setCoherencyTracking(bool flag);
+
+    /**
+    @brief Return true if coherency tracking is enabled
+    */
+    bool getCoherencyTracking();
+
+    /**
+    @brief Return coherency state of a graphic buffer
+
+    Buffers are in COHERENCY_CPU_DIRTY state when allocated.
+    @param handle handle associated to the buffer
+    */
+    Coherency getCoherency(void* handle);
+
+    /**
+    @brief Update coherency state of a graphic buffer
+
+    @param handle handle associated to the buffer
+    @param state new coherency state
+    */
+    void setCoherency(void* handle, Coherency state);
+
+    /**
+    @brief Update coherency state of a graphic buffer accessed by the CPU
+
+    No-op when coherency tracking is disabled.
+    @param handle handle associated to the buffer
+    @param write CPU access is a write (true) or a read only (false)
+    */
+    void declareCpuAccess(void* handle, bool write);
+
+    /**
+    @brief Return physical description of graphic buffer containing vaddr
+
+    @param vaddr virtual address contained in the requested buffer
+    @param [out] handle handle associated to the buffer
+    @param [out] paddr buffer physical address
+    @param [out] size buffer size in bytes
+    @param [out] offset offset of vaddr in the buffer
+    @param [out] cacheable buffer is cacheable
+    @return true if graphic buffer matching virtual address was found
+    */
+    bool getBufferDescription(void* vaddr, void*& handle, uint64_t& paddr,
+                              size_t& size, size_t& offset, bool& cacheable);
+
+    /**
+    @brief Export graphic buffer as DMA-BUF
+
+    @param handle handle associated to the buffer
+    @return DMA-BUF file descriptor owned by the caller, negative on failure
+    */
+    int exportDmabuf(void* handle);
+
+    /**
+    @brief Make CPU writes to a graphic buffer visible to an external device
+
+    Buffer cache is cleaned, then also invalidated if the device writes the
+    buffer. Coherency state is updated accordingly.
+    @param handle handle associated to the buffer
+    @param deviceWrite device writes buffer content
+    @return 0 on success, G2D error code otherwise
+    */
+    int syncForDevice(void* handle, bool deviceWrite);
+
+    /**
+    @brief Import external DMA-BUF buffer
+
+    Imported buffer is mapped and registered as graphic buffer so that it is
+    processed by HAL without intermediate copy. It does not account in
+    allocator usage and allocations.
+    @param fd DMA-BUF file descriptor - not owned, shall remain valid until
+    releaseImport()
+    @param size buffer size in bytes
+    @param cacheable buffer CPU mapping is cacheable
+    @param [out] handle handle associated to the buffer - used for releaseImport()
+    @return virtual address of mapped buffer, nullptr on failure
+    */
+    void* importDmabuf(int fd, size_t size, bool cacheable, void*& handle);
+
+    /**
+    @brief Import external physically contiguous buffer
+
+    Buffer CPU mapping provided by the caller is considered as non cacheable:
+    caller is responsible for its cache maintenance. Physical and virtual
+    addresses shall be aligned on IMPORT_ALIGN bytes.
+    @param paddr buffer physical address
+    @param vaddr buffer virtual address
+    @param size buffer size in bytes
+    @param [out] handle handle associated to the buffer - used for releaseImport()
+    @return virtual address of buffer, nullptr on failure
+    */
+    void* importPhysical(uint64_t paddr, void* vaddr, size_t size, void*& handle);
+
+    /**
+    @brief Alignment in bytes of imported physical buffers addresses
+    */
+    static const size_t IMPORT_ALIGN = 64;
+
+    /**
+    @brief Release buffer imported by importDmabuf() or importPhysical()
+
+    @param handle handle associated to the buffer during import
+    */
+    void releaseImport(void* handle);
+
+    /**
+    @brief Enable 4 channels shadows of 3 channels graphic buffers
+
+    On hardware without 3 channels support, HAL keeps a 4 channels twin of 3
+    channels graphic buffers so that chained operations do not convert
+    channels for every call. Buffer content is only updated from its shadow
+    when CPU access is declared.
+    @param flag enable (true) or disable (false) shadows creation
+    */
+    void setShadowMode(bool flag);
+
+    /**
+    @brief Return true if shadows creation is enabled
+    */
+    bool getShadowMode();
+
+    /**
+    @brief Return shadow of a graphic buffer
+
+    @param handle handle associated to the buffer
+    @param [out] shadow shadow description
+    @return false if buffer has no shadow
+    */
+    bool getShadow(void* handle, Shadow& shadow);
+
+    /**
+    @brief Create (or resize) shadow of a graphic buffer
+
+    Shadow buffer is allocated from the cacheable pool, not registered as
+    graphic buffer. Shadow is created in SHADOW_NONE state.
+    @param handle handle associated to the buffer
+    @param width shadowed image width
+    @param height shadowed image height
+    @return shadow buffer, nullptr on allocation failure
+    */
+    struct g2d_buf* createShadow(void* handle, int width, int height);
+
+    /**
+    @brief Update state of a graphic buffer shadow
+
+    @param handle handle associated to the buffer
+    @param state new shadow state
+    */
+    void setShadowState(void* handle, ShadowState state);
+
+    /**
+    @brief Release shadow of a graphic buffer if any
+    */
+    void releaseShadow(void* handle);
+
+    /**
+    @brief Return handles of graphic buffers having a shadow
+    */
+    std::vector<void*> getShadowedBuffers();
+
+    /**
+    @brief Return true if any graphic buffer has a shadow
+    */
+    bool hasShadows();
+
+    /**
+    @brief Configure CMA watermarks
+
+    Free CMA is sampled from /proc/meminfo on allocations reaching the
+    underlying graphic allocator, and only when watermarks are configured.
+    @param low free bytes below which pressure is CMA_PRESSURE_LOW, 0 to
+    disable monitoring
+    @param critical free bytes below which pressure is CMA_PRESSURE_CRITICAL
+    */
+    void setCmaWatermarks(size_t low, size_t critical);
+
+    /**
+    @brief Set callback notified when CMA pressure level changes
+
+    Callback is called from the allocating thread, without allocator lock
+    held. Empty callback disables notifications.
+    */
+    void setCmaPressureCallback(const CmaPressureCallback& callback);
+
+    /**
+    @brief Return current CMA pressure level
+    */
+    CmaPressure getCmaPressure();
+
+    /**
+    @brief Read CMA total and free bytes from /proc/meminfo
+
+    @return false if CMA figures are not available
+    */
+    static bool readCmaInfo(size_t& total, size_t& free);
+
+    /**
+    @brief Return number of graphic buffer allocations that failed after cache
+    trim
+    */
+    uint64_t getAllocFailures();
+
 protected:
     Imx2dGAllocator();
     virtual ~Imx2dGAllocator();
@@ -152,13 +497,32 @@ protected:
     unsigned enableCount;
     G2dBufRepoPtr g2dBufRepoPtr;
     G2dBufPoolPtr g2dBufPoolPtr;
+    G2dBufImportsPtr g2dBufImportsPtr;
     std::mutex mutex;
     unsigned allocCount;
     size_t usage;
+    std::atomic<bool> coherencyTracking;
+    std::atomic<bool> shadowMode;
+    std::mutex shadowMutex;
+    std::map<struct g2d_buf*, Shadow> shadows;
+    std::atomic<unsigned> shadowCount;
+
+    void registerImport(struct g2d_buf* buf, bool cacheable);
+    void accountAlloc(struct g2d_buf* buf, bool fresh);
+    void updateCmaPressure(bool exhausted);
+
+    std::mutex cmaMutex;
+    size_t cmaLow;
+    size_t cmaCritical;
+    CmaPressure cmaPressure;
+    CmaPressureCallback cmaCallback;
+    std::atomic<bool> cmaMonitoring;
+    std::atomic<uint64_t> allocFailures;
 };
 
 /**
-@brief Imx2dHalCounters class manages HAL primitives counter
+@brief Imx2dHalCounters class manages HAL primitives counter, with telemetry of
+calls falling back to the software implementation and of buffers processed
 */
 
 class DSO_EXPORT Imx2dHalCounters
@@ -171,10 +535,43 @@ public:
         FLIP,
         RESIZE,
         ROTATE,
+        TRANSFORM,
+        CVT_COLOR,
+        FILL,
+        COPY,
         PRIMITIVES_MAX
     };
 
-    Imx2dHalCounters(): counters() {}
+    /**
+     @brief Reasons of calls falling back to the software implementation
+    */
+    enum Reason {
+        REASON_DISABLED,      // acceleration disabled
+        REASON_DEPTH,         // depth other than CV_8U
+        REASON_CHANNELS,      // number of channels not supported
+        REASON_INTERPOLATION, // interpolation other than bilinear
+        REASON_IN_PLACE,      // input and output buffers overlap
+        REASON_FLIP_BOTH,     // flip around both axes
+        REASON_FORMAT,        // geometry or layout not supported by G2D
+        REASON_BUFFERS,       // system memory buffers for graphic only paths
+        REASON_DISPATCH,      // image below the dispatch size threshold
+        REASON_ERROR,         // intermediate buffers or G2D failure
+        REASONS_MAX
+    };
+
+    /**
+     @brief Input and output buffers of accelerated calls: system memory ones
+     are copied from/to intermediate graphic buffers
+    */
+    enum Buffer {
+        BUFFER_INPUT_HEAP,
+        BUFFER_INPUT_GRAPHIC,
+        BUFFER_OUTPUT_HEAP,
+        BUFFER_OUTPUT_GRAPHIC,
+        BUFFERS_MAX
+    };
+
+    Imx2dHalCounters(): counters(), fallbacks(), buffers(), bytes() {}
     virtual ~Imx2dHalCounters() {}
 
     /**
@@ -187,13 +584,58 @@ public:
     */
     unsigned readCount(Primitive primitive);
 
+    /**
+     @brief Increment counter of primitive calls falling back to software
+    */
+    void incrementFallback(Primitive primitive, Reason reason);
+
+    /**
+     @brief Read counter of primitive calls falling back to software
+    */
+    uint64_t readFallback(Primitive primitive, Reason reason);
+
+    /**
+     @brief Account input and output buffers of an accelerated call
+     @param primitive primitive
+     @param inputGraphic input is a graphic buffer, ignored if inputBytes is 0
+     @param inputBytes input image size in bytes
+     @param outputGraphic output is a graphic buffer
+     @param outputBytes output image size in bytes
+    */
+    void accountBuffers(Primitive primitive,
+                        bool inputGraphic, size_t inputBytes,
+                        bool outputGraphic, size_t outputBytes);
+
+    /**
+     @brief Read number of accelerated calls per buffer type
+    */
+    uint64_t readBuffers(Primitive primitive, Buffer buffer);
+
+    /**
+     @brief Read bytes processed by accelerated calls, input and output
+    */
+    uint64_t readBytes(Primitive primitive);
+
+    /**
+     @brief Clear every counter
+    */
+    void reset();
+
 protected:
     std::atomic<unsigned>counters[PRIMITIVES_MAX];
+    std::atomic<uint64_t>fallbacks[PRIMITIVES_MAX][REASONS_MAX];
+    std::atomic<uint64_t>buffers[PRIMITIVES_MAX][BUFFERS_MAX];
+    std::atomic<uint64_t>bytes[PRIMITIVES_MAX];
 };
 
 
 /**
 @brief Describes hardware accelerator capabilities
+
+Capabilities of every blit engine of the SoC are looked up in a database.
+Queries report what every engine supports, so that any engine selected for a
+blit can process it, with the exception of 3 channels surfaces: blits
+involving them are restricted to engines supporting them.
 */
 
 class DSO_EXPORT HardwareCapabilities {
@@ -207,15 +649,224 @@ public:
         THREE_CHANNELS,
         CAPABILITY_MAX
     };
+
+    /**
+     @brief Surface formats, as bit masks
+    */
+    enum Formats {
+        FORMAT_RGBA = 1 << 0, //!< 4 channels
+        FORMAT_RGB  = 1 << 1, //!< 3 channels
+        FORMAT_NV12 = 1 << 2,
+        FORMAT_NV21 = 1 << 3,
+        FORMAT_I420 = 1 << 4,
+        FORMAT_YV12 = 1 << 5,
+        FORMAT_YUYV = 1 << 6,
+        FORMAT_YVYU = 1 << 7,
+        FORMAT_UYVY = 1 << 8,
+        FORMAT_VYUY = 1 << 9,
+        FORMAT_YUV = FORMAT_NV12 | FORMAT_NV21 | FORMAT_I420 | FORMAT_YV12 |
+                     FORMAT_YUYV | FORMAT_YVYU | FORMAT_UYVY | FORMAT_VYUY,
+    };
+
+    /**
+     @brief Capabilities of a blit engine
+    */
+    struct Engine {
+        int type;            //!< G2D hardware type (g2d_hardware_type)
+        unsigned formats;    //!< supported Formats
+    };
+
     bool hasSupport();
     bool hasCapability(Capabilities cap);
 
+    /**
+     @brief Returns SoC identifier (e.g. "i.MX8MP")
+    */
+    const std::string& getSocId();
+
+    /**
+     @brief Returns capabilities of every blit engine, empty if SoC is not
+     supported
+    */
+    const std::vector<Engine>& getEngines();
+
+    /**
+     @brief Returns true if every engine supports the format (any engine for
+     3 channels FORMAT_RGB)
+    */
+    bool hasFormat(Formats format);
+
 private:
     bool supported;
     bool caps[CAPABILITY_MAX];
+    std::string socId;
+    std::vector<Engine> engines;
+
+    // engines aggregated formats
+    unsigned formats;
+};
+
+
+/**
+@brief Imx2dDispatcher class selects hardware or software path of primitives
+
+Hardware submission has a fixed cost (cache maintenance, intermediate copies,
+G2D setup) that makes the software implementation faster on small images.
+Primitives are sent to the hardware from a size threshold in pixels, set per
+primitive, format and buffers type. Default thresholds send every supported
+call to the hardware, except grayscale resize and transform that are left to
+the software implementation until calibrated.
+*/
+
+class DSO_EXPORT Imx2dDispatcher
+{
+public:
+    /**
+     @brief Pixel formats
+    */
+    enum Format {
+        FORMAT_1CH,
+        FORMAT_3CH,
+        FORMAT_4CH,
+        FORMATS_MAX
+    };
+
+    /**
+     @brief Buffers types: graphic if both input and output are graphic buffers
+    */
+    enum Buffers {
+        BUFFERS_SYSTEM,
+        BUFFERS_GRAPHIC,
+        BUFFERS_MAX
+    };
+
+    /**
+     @brief Threshold of primitives never sent to the hardware
+    */
+    static const size_t THRESHOLD_NEVER = SIZE_MAX;
+
+    Imx2dDispatcher();
+    virtual ~Imx2dDispatcher() {}
+
+    /**
+     @brief Returns true if primitive shall be executed by the hardware
+     @param primitive primitive
+     @param cn number of channels
+     @param graphic input and output are graphic buffers
+     @param pixels image size in pixels (largest of input and output)
+    */
+    bool useHardware(Imx2dHalCounters::Primitive primitive, int cn,
+                     bool graphic, size_t pixels);
+
+    /**
+     @brief Set size threshold in pixels from which hardware is used
+    */
+    void setThreshold(Imx2dHalCounters::Primitive primitive, Format format,
+                      Buffers buffers, size_t pixels);
+
+    /**
+     @brief Returns size threshold in pixels from which hardware is used
+    */
+    size_t getThreshold(Imx2dHalCounters::Primitive primitive, Format format,
+                        Buffers buffers);
+
+    /**
+     @brief Restore default thresholds
+    */
+    void reset();
+
+protected:
+    std::atomic<size_t> thresholds[Imx2dHalCounters::PRIMITIVES_MAX]
+                                  [FORMATS_MAX][BUFFERS_MAX];
 };
 
 
+class Imx2dThreadProfile;
+class Imx2dThreadProfileSlot;
+
+/**
+@brief Runtime profiler of HAL primitives stages latency
+
+When enabled, durations of the stages of HAL primitives are accumulated into
+per thread latency histograms, with no locking on the measurement path.
+Histograms are log-linear with 8 buckets per power of two nanoseconds, so that
+quantiles are estimated within about 6% of their value.
+*/
+
+class DSO_EXPORT Imx2dProfiler
+{
+public:
+    /**
+     @brief HAL primitive stages
+    */
+    enum Stage {
+        STAGE_PREPRO,  // intermediate buffers preparation
+        STAGE_CACHE,   // cache maintenance
+        STAGE_G2D,     // G2D submission and completion
+        STAGE_POSTPRO, // intermediate buffers copy back
+        STAGES_MAX
+    };
+
+    /**
+     @brief Number of histogram buckets
+    */
+    static const int BUCKETS_MAX = 320;
+
+    /**
+     @brief Latency statistics of a stage, durations in nanoseconds
+    */
+    struct Stats {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t min;
+        uint64_t max;
+        uint64_t p50;
+        uint64_t p95;
+        uint64_t p99;
+    };
+
+    Imx2dProfiler();
+    virtual ~Imx2dProfiler();
+
+    /**
+     @brief Enable or disable latency measurement
+    */
+    void setEnabled(bool flag);
+
+    bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    /**
+     @brief Record duration of a stage executed by calling thread
+    */
+    void record(Imx2dHalCounters::Primitive primitive, Stage stage,
+                uint64_t duration);
+
+    /**
+     @brief Returns statistics of a stage, aggregated over every thread
+    */
+    Stats getStats(Imx2dHalCounters::Primitive primitive, Stage stage);
+
+    /**
+     @brief Clear recorded durations
+    */
+    void reset();
+
+protected:
+    friend class Imx2dThreadProfileSlot;
+
+    void registerThread(Imx2dThreadProfile* profile);
+    void unregisterThread(Imx2dThreadProfile* profile);
+
+    std::atomic<bool> enabled;
+    std::mutex mutex;
+    std::set<Imx2dThreadProfile*> threads;
+    // durations recorded by exited threads
+    Imx2dThreadProfile* retired;
+};
+
+
+class Imx2dThreadContexts;
+
 /**
 @brief Imx2dHal class manages HAL
 */
@@ -248,21 +899,257 @@ public:
     */
     void* getG2dHandle();
 
+    /**
+     @brief Returns calling thread G2D handle for the least loaded engine
+
+     Each thread uses its own G2D contexts, one per engine available, so that
+     concurrent HAL calls do not serialize onto a single context. Blits are
+     spread across engines according to their number of blits in flight.
+     Engine shall be released with releaseEngine() once blit has completed.
+     Contexts are owned by the thread: they are closed by the thread itself,
+     on its first access after HAL has been disabled, or on thread exit.
+     @param threeChannels blit involves 3 channels surfaces
+     @param [out] engine engine selected, for releaseEngine()
+     @return G2D handle, nullptr on failure
+    */
+    void* getThreadG2dHandle(bool threeChannels, int& engine);
+
+    /**
+     @brief Release engine selected by getThreadG2dHandle()
+    */
+    void releaseEngine(int engine);
+
+    /**
+     @brief Returns number of G2D engines blits are spread across
+    */
+    unsigned getNumberOfEngines();
+
+    /**
+     @brief Maximum number of G2D engines
+    */
+    static const int ENGINES_MAX = 4;
+
+    /**
+     @brief Returns G2D hardware types of the engines blits are spread across,
+     empty when default engine only is used
+
+     Returned list is immutable, replaced on HAL enablement.
+    */
+    std::shared_ptr<const std::vector<int>> getEngines();
+
+    /**
+     @brief Returns generation of G2D contexts, incremented when HAL is
+     disabled so that threads close their stale contexts
+    */
+    unsigned getContextsGeneration();
+
     /**
      @brief HAL counters for debug purpose
     */
     Imx2dHalCounters counters;
 
+    /**
+     @brief Hardware or software path selection of primitives
+    */
+    Imx2dDispatcher dispatcher;
+
+    /**
+     @brief Latency profiler of primitives stages
+    */
+    Imx2dProfiler profiler;
+
 protected:
     Imx2dHal();
     virtual ~Imx2dHal();
     Imx2dHal(Imx2dHal const& copy); /* not implemented */
     Imx2dHal& operator=(Imx2dHal const& copy);  /* not implemented */
 
+    Imx2dThreadContexts& getThreadContexts();
+    void detectEngines();
+
     bool enabled;
     std::mutex mutex;
     void* g2dHandle;
     HardwareCapabilities hwCapabilities;
+
+    // G2D hardware types of engines, empty when default engine only is used,
+    // accessed via std::atomic_load() / std::atomic_store()
+    std::shared_ptr<const std::vector<int>> engines;
+    std::atomic<unsigned> engineLoad[ENGINES_MAX];
+    std::atomic<unsigned> contextsGeneration;
+};
+
+
+
+/**
+@brief Imx2dStream class manages G2D contexts for asynchronous submissions
+
+Blits submitted on a stream are flushed to the hardware without waiting for
+their completion. Each submission is identified by a sequence number that can
+be waited for later on. G2D completion being tracked per context, waiting for
+a submission also completes every earlier submission of the same stream.
+A stream may be bound to the calling thread so that HAL uses its contexts
+instead of the thread ones.
+
+Stream has a context per engine, blits involving 3 channels surfaces being
+restricted to engines supporting them as for thread contexts. Submissions are
+kept in order across engines: pending blits of a context are completed before
+blits are submitted to another one.
+*/
+
+class DSO_EXPORT Imx2dStream
+{
+public:
+    Imx2dStream();
+    virtual ~Imx2dStream();
+
+    /**
+     @brief Returns true if stream G2D context could be opened
+    */
+    bool isOpen();
+
+    /**
+     @brief Returns G2D handle of the stream context for a blit
+
+     Blits pending on another context of the stream are completed first.
+     @param threeChannels blit involves 3 channels surfaces
+     @return G2D handle, nullptr on failure
+    */
+    void* getG2dHandle(bool threeChannels);
+
+    /**
+     @brief Flush blits pending on stream context to the hardware
+
+     @param [out] seq sequence number identifying the submission
+     @return 0 on success, G2D error code otherwise
+    */
+    int submit(uint64_t& seq);
+
+    /**
+     @brief Wait for completion of a submission
+
+     @param seq sequence number returned by submit()
+     @return 0 on success, G2D error code otherwise
+    */
+    int wait(uint64_t seq);
+
+    /**
+     @brief Wait for completion of every submission
+    */
+    int waitAll();
+
+    /**
+     @brief Returns true if submission is known as completed
+
+     G2D has no non-blocking completion query: a submission is reported as
+     completed only once it has been waited for.
+    */
+    bool isComplete(uint64_t seq);
+
+    /**
+     @brief Returns sequence number of the latest submission
+    */
+    uint64_t getLastSubmission();
+
+    /**
+     @brief Returns stream bound to calling thread, nullptr if none
+    */
+    static Imx2dStream* getCurrent();
+
+    /**
+     @brief Binds a stream to calling thread, nullptr to unbind
+    */
+    static void setCurrent(Imx2dStream* stream);
+
+protected:
+    Imx2dStream(Imx2dStream const& copy); /* not implemented */
+    Imx2dStream& operator=(Imx2dStream const& copy);  /* not implemented */
+
+    // indexed by engine, default engine context in its own slot
+    static const int DEFAULT_CONTEXT = Imx2dHal::ENGINES_MAX;
+
+    void* openNoLock(int idx);
+    int finishNoLock();
+
+    void* handles[Imx2dHal::ENGINES_MAX + 1];
+    // context of the latest blits, only one with blits not completed
+    int current;
+    std::mutex mutex;
+    uint64_t submitted;
+    uint64_t completed;
+};
+
+
+
+class Imx2dScratchSlots;
+
+/**
+@brief Imx2dScratchArena class serves HAL intermediate graphic buffers
+
+HAL primitives processing Mat buffers not backed by graphic memory need
+intermediate graphic buffers for the duration of the call. Arena keeps a few
+preallocated buffers per thread, grown to the largest recent request, so that
+those short lived allocations do not go through the allocator pool, repository
+and accounting. Arena buffers are not registered to Imx2dGAllocator, thus not
+visible from the application and not accounted in allocator statistics.
+*/
+class DSO_EXPORT Imx2dScratchArena
+{
+public:
+    /**
+     @brief Return a reference to class instance singleton.
+    */
+    static Imx2dScratchArena& getInstance();
+
+    /**
+     @brief Acquire a cacheable buffer from the calling thread arena
+
+     @param size buffer size in bytes
+     @return buffer descriptor, nullptr if size exceeds arena limits or if no
+     arena buffer is available
+    */
+    struct g2d_buf* acquire(size_t size);
+
+    /**
+     @brief Return a buffer to the calling thread arena
+
+     @param buf buffer descriptor
+     @return false if buffer was not acquired from the calling thread arena
+    */
+    bool release(struct g2d_buf* buf);
+
+    /**
+     @brief Free idle buffers held by every thread arena
+
+     @return number of bytes freed
+    */
+    size_t drain();
+
+    /**
+     @brief Return total number of bytes held by thread arenas
+    */
+    size_t getUsage();
+
+    /**
+     @brief Largest arena buffer size, bigger requests are not served
+    */
+    static const size_t BUF_SIZE_MAX = 16 * 1024 * 1024;
+
+protected:
+    friend class Imx2dScratchSlots;
+
+    Imx2dScratchArena();
+    virtual ~Imx2dScratchArena();
+    Imx2dScratchArena(Imx2dScratchArena const& copy); /* not implemented */
+    Imx2dScratchArena& operator=(Imx2dScratchArena const& copy);  /* not implemented */
+
+    Imx2dScratchSlots& getThreadSlots();
+    void registerSlots(Imx2dScratchSlots* slots);
+    void unregisterSlots(Imx2dScratchSlots* slots);
+
+    std::mutex mutex;
+    std::set<Imx2dScratchSlots*> slotsSet;
+    std::atomic<size_t> usage;
 };
 
 
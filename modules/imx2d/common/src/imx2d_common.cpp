@@ -15,11 +15,18 @@
  */
 
 #include <algorithm>
+#include <climits>
+#include <cmath>
 #include <iostream>
+#include <limits>
+#include <list>
 #include <fstream>
+#include <map>
 #include <sstream>
 #include <stdint.h>
 #include <string>
+#include <tuple>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <vector>
 
@@ -51,45 +58,36 @@ namespace imx2d {
 
 /**
 @brief container to store g2d_buf descriptor with attributes
+
+Buffer address range is copied at construction so that lookups never
+dereference a g2d_buf descriptor that may have been released concurrently.
 */
 class G2dBufContainer
 {
 public:
     G2dBufContainer(struct g2d_buf* _buf, bool _cacheable):
-                    g2dBuf(_buf), cacheable(_cacheable) {}
+                    g2dBuf(_buf), cacheable(_cacheable),
+                    begin(static_cast<char*>(_buf->buf_vaddr)),
+                    end(static_cast<char*>(_buf->buf_vaddr) + _buf->buf_size),
+                    coherency(Imx2dGAllocator::COHERENCY_CPU_DIRTY) {}
     virtual ~G2dBufContainer() {}
+
+    bool contains(const void* vaddr) const
+    {
+        const char* v = static_cast<const char*>(vaddr);
+        return (v >= begin) && (v < end);
+    }
+
     struct g2d_buf* g2dBuf;
     bool cacheable;
+    const char* begin;
+    const char* end;
+    std::atomic<Imx2dGAllocator::Coherency> coherency;
 };
 
 
 typedef std::shared_ptr<G2dBufContainer> GBCPtr;
 
-/**
-@brief G2dBufContainer by address comparison object for storage in a STL set.
-
-It is used to store objects in a set with ordered increasing addresses for
-faster access.
-Comparison is done on buffer address and size only, not on other attributes.
-*/
-struct G2dBufContainerVaddrCompare
-{
-    bool operator()(GBCPtr b1, GBCPtr b2)
-    {
-        char* v1 = static_cast<char*> (b1->g2dBuf->buf_vaddr);
-        char* v2 = static_cast<char*> (b2->g2dBuf->buf_vaddr);
-        int s1 = static_cast<int>(b1->g2dBuf->buf_size);
-        int s2 = static_cast<int>(b2->g2dBuf->buf_size);
-        bool overlap;
-
-        // make sure that b2 is not nested within b1 (same buffer)
-        // overlap computation principle inherited from IoU computation...
-        overlap = !! std::max(std::min(v1 + s1, v2 + s2) - std::max(v1, v2),
-                              0L);
-        return (v1 < v2) && !overlap;
-    }
-};
-
 
 //============================= G2dBufRepo ================================
 
@@ -98,15 +96,23 @@ struct G2dBufContainerVaddrCompare
 
 Class records g2d_buf allocations sorted by virtual address to allow matching
 a virtual addresses to one of the allocated g2d buffer.
-Public methods require lock to be held by the caller.
+
+Repository is read-mostly: lookups are done for every HAL call while
+registrations only happen on graphic buffer allocation and release. Records
+are kept in an immutable sorted array published copy-on-write by writers.
+Readers keep a thread-local reference to the current array, refreshed only when
+the publication generation changes, and a last-hit entry, so that lookups are
+done without locking nor allocation.
 */
 
 class G2dBufRepo
 {
 public:
-    G2dBufRepo(): allocCount(0) {}
+    G2dBufRepo(): allocCount(0), generation(0),
+                  snapshot(std::make_shared<G2dBufArray>()) {}
     // copy constructor as std::mutex is not copy-able
-    G2dBufRepo(const G2dBufRepo& obj) : allocCount(0) { (void)obj; };
+    G2dBufRepo(const G2dBufRepo& obj) : allocCount(0), generation(0),
+                  snapshot(std::make_shared<G2dBufArray>()) { (void)obj; };
     virtual ~G2dBufRepo() {}
 
     /**
@@ -144,71 +150,218 @@ public:
     */
     bool isVaddrG2dBuf(void* vaddr, g2d_buf*& b, bool& cacheable);
 
+    /**
+    @brief Return coherency state of a registered g2d_buf buffer.
+    */
+    Imx2dGAllocator::Coherency getCoherency(struct g2d_buf* b);
+
+    /**
+    @brief Update coherency state of a registered g2d_buf buffer.
+    */
+    void setCoherency(struct g2d_buf* b, Imx2dGAllocator::Coherency state);
+
+    /**
+    @brief Update coherency state of a buffer accessed by the CPU.
+    */
+    void declareCpuAccess(struct g2d_buf* b, bool write);
+
+    /**
+    @brief Set every registered buffer in COHERENCY_CPU_DIRTY state.
+    */
+    void resetCoherency();
+
 protected:
+    typedef std::vector<GBCPtr> G2dBufArray;
+    typedef std::shared_ptr<const G2dBufArray> G2dBufArrayPtr;
+
+    /**
+    @brief Per-thread lookup state.
+    */
+    struct LookupCache
+    {
+        const G2dBufRepo* repo;
+        uint64_t generation;
+        G2dBufArrayPtr snapshot;
+        G2dBufContainer* lastHit;
+    };
+
+    /**
+    @brief Return container of buffer including vaddr, nullptr if none.
+    */
+    G2dBufContainer* find(const void* vaddr);
+
+    /**
+    @brief Return index of first record beginning after vaddr.
+    */
+    static size_t upperBound(const G2dBufArray& array, const void* vaddr);
 
     /**
-    @brief Version of isVaddrG2dBuf() for class-internal usage.
+    @brief Publish a new records array. Lock shall be held by the caller.
     */
-    bool isVaddrG2dBufNoLock(void* vaddr, g2d_buf*& b, bool& cacheable);
+    void publishNoLock(const G2dBufArrayPtr& array);
 
-    std::set<GBCPtr, G2dBufContainerVaddrCompare> allocSet;
     unsigned allocCount;
+    std::atomic<uint64_t> generation;
+    G2dBufArrayPtr snapshot;
     std::mutex mutex;
 };
 
+size_t G2dBufRepo::upperBound(const G2dBufArray& array, const void* vaddr)
+{
+    const char* v = static_cast<const char*>(vaddr);
+    size_t lo = 0, hi = array.size();
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (array[mid]->begin <= v)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void G2dBufRepo::publishNoLock(const G2dBufArrayPtr& array)
+{
+    snapshot = array;
+    generation.fetch_add(1, std::memory_order_release);
+}
+
+G2dBufContainer* G2dBufRepo::find(const void* vaddr)
+{
+    static thread_local LookupCache cache = { nullptr, 0, nullptr, nullptr };
+    uint64_t gen = generation.load(std::memory_order_acquire);
+
+    if ((cache.repo != this) || (cache.generation != gen))
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cache.repo = this;
+        cache.snapshot = snapshot;
+        cache.generation = generation.load(std::memory_order_relaxed);
+        cache.lastHit = nullptr;
+    }
+
+    // consecutive calls from a thread generally involve the same buffers
+    if (cache.lastHit && cache.lastHit->contains(vaddr))
+        return cache.lastHit;
+
+    const G2dBufArray& array = *cache.snapshot;
+    size_t idx = upperBound(array, vaddr);
+    if ((idx == 0) || !array[idx - 1]->contains(vaddr))
+        return nullptr;
+
+    cache.lastHit = array[idx - 1].get();
+    return cache.lastHit;
+}
+
 void G2dBufRepo::registerDescriptor(struct g2d_buf* b, bool cacheable)
 {
-    struct g2d_buf* _buf;
-    bool _cacheable;
     GBCPtr bufContPtr(new G2dBufContainer(b, cacheable));
     std::unique_lock<std::mutex> lock(mutex);
 
-    IMX2D_Assert(!isVaddrG2dBufNoLock(b->buf_vaddr, _buf, _cacheable));
-    allocSet.insert(bufContPtr);
+    const G2dBufArray& current = *snapshot;
+    size_t idx = upperBound(current, bufContPtr->begin);
+
+    // new buffer shall not overlap its neighbours
+    IMX2D_Assert((idx == 0) || (current[idx - 1]->end <= bufContPtr->begin));
+    IMX2D_Assert((idx == current.size()) ||
+                 (bufContPtr->end <= current[idx]->begin));
+
+    std::shared_ptr<G2dBufArray> array =
+        std::make_shared<G2dBufArray>();
+    array->reserve(current.size() + 1);
+    array->insert(array->end(), current.begin(), current.begin() + idx);
+    array->push_back(bufContPtr);
+    array->insert(array->end(), current.begin() + idx, current.end());
+
     allocCount++;
-    IMX2D_Assert(allocCount == allocSet.size());
-    IMX2D_Assert(isVaddrG2dBufNoLock(b->buf_vaddr, _buf, _cacheable));
+#ifdef DEBUG
+    IMX2D_Assert(allocCount == array->size());
+#endif
+
+    publishNoLock(array);
 }
 
 void G2dBufRepo::unregisterDescriptor(struct g2d_buf* b)
 {
-    struct g2d_buf* _buf;
-    bool _cacheable;
-    GBCPtr bufContPtr(new G2dBufContainer(b, false /* unused for search */));
     std::unique_lock<std::mutex> lock(mutex);
 
-    IMX2D_Assert(isVaddrG2dBufNoLock(b->buf_vaddr, _buf, _cacheable));
-    allocSet.erase(bufContPtr);
+    const G2dBufArray& current = *snapshot;
+    size_t idx = upperBound(current, b->buf_vaddr);
+
+    IMX2D_Assert((idx > 0) && (current[idx - 1]->g2dBuf == b));
+
+    std::shared_ptr<G2dBufArray> array =
+        std::make_shared<G2dBufArray>();
+    array->reserve(current.size() - 1);
+    array->insert(array->end(), current.begin(), current.begin() + idx - 1);
+    array->insert(array->end(), current.begin() + idx, current.end());
+
     allocCount--;
-    IMX2D_Assert(allocCount == allocSet.size());
-    IMX2D_Assert(!isVaddrG2dBufNoLock(b->buf_vaddr, _buf, _cacheable));
+#ifdef DEBUG
+    IMX2D_Assert(allocCount == array->size());
+#endif
+
+    publishNoLock(array);
+}
+
+bool G2dBufRepo::isVaddrG2dBuf(void* vaddr, g2d_buf*& b, bool& cacheable)
+{
+    G2dBufContainer* container = find(vaddr);
+
+    if (!container)
+    {
+        b = nullptr;
+        return false;
+    }
+
+    b = container->g2dBuf;
+    cacheable = container->cacheable;
+    return true;
+}
+
+Imx2dGAllocator::Coherency G2dBufRepo::getCoherency(struct g2d_buf* b)
+{
+    G2dBufContainer* container = find(b->buf_vaddr);
+
+    IMX2D_Assert(container);
+    return container->coherency.load();
+}
+
+void G2dBufRepo::setCoherency(struct g2d_buf* b, Imx2dGAllocator::Coherency state)
+{
+    G2dBufContainer* container = find(b->buf_vaddr);
+
+    IMX2D_Assert(container);
+    container->coherency.store(state);
 }
 
-bool G2dBufRepo::isVaddrG2dBufNoLock(void* vaddr, g2d_buf*& b, bool& cacheable)
+void G2dBufRepo::declareCpuAccess(struct g2d_buf* b, bool write)
 {
-    struct g2d_buf buf { .buf_handle = nullptr, .buf_vaddr = vaddr,
-                       .buf_paddr = 0, .buf_size = 1 /* arbitrary */ };
-    GBCPtr bufContPtr(new G2dBufContainer(&buf, false /* unused for search */));
-    std::set<GBCPtr>::iterator it;
+    G2dBufContainer* container = find(b->buf_vaddr);
 
-    it = allocSet.find(bufContPtr);
-    bool found = (it != allocSet.end());
-    if (found)
+    IMX2D_Assert(container);
+
+    // CPU reads load clean lines into the cache, writes make them dirty
+    if (write)
     {
-        b = (*it)->g2dBuf;
-        cacheable = (*it)->cacheable;
+        container->coherency.store(Imx2dGAllocator::COHERENCY_CPU_DIRTY);
     }
     else
     {
-        b = nullptr;
+        Imx2dGAllocator::Coherency expected = Imx2dGAllocator::COHERENCY_DEVICE;
+        container->coherency.compare_exchange_strong(expected,
+                                         Imx2dGAllocator::COHERENCY_CLEAN);
     }
-    return found;
 }
 
-bool G2dBufRepo::isVaddrG2dBuf(void* vaddr, g2d_buf*& b, bool& cacheable)
+void G2dBufRepo::resetCoherency()
 {
     std::unique_lock<std::mutex> lock(mutex);
-    return isVaddrG2dBufNoLock(vaddr, b, cacheable);
+
+    for (auto it = snapshot->begin(); it != snapshot->end(); it++)
+        (*it)->coherency.store(Imx2dGAllocator::COHERENCY_CPU_DIRTY);
 }
 
 
@@ -226,6 +379,13 @@ When amount of preallocated (freed) buffers exceeds some thresholds,
 cache cleanup is operated to limit amount of memory used by cache.
 When the pool is disabled, cache is bypassed and memory allocation and
 deallocations are directly passed to the underlying allocator.
+
+Cached buffers are kept in a LRU list for eviction, and indexed by size so
+that best fit lookup does not scan the whole cache.
+
+Buffers may also be reserved ahead of time. Reserved buffers are pinned: they
+are not accounted in cache limits, never evicted, and return to the reserved
+set when deallocated until the reservation is released.
 */
 
 class G2dBufPoolInstance
@@ -236,15 +396,33 @@ public:
     G2dBufPoolInstance(const G2dBufPoolInstance& obj);
     virtual ~G2dBufPoolInstance();
 
-    struct g2d_buf* alloc(size_t size);
+    struct g2d_buf* alloc(size_t size, bool& fresh);
+    struct g2d_buf* allocFresh(size_t size);
+    size_t trimCache();
     void free(struct g2d_buf* buf);
     void setUseCache(bool flag);
     void setCacheConfig(size_t _cacheUsageMax, unsigned _cacheAllocCountMax);
     size_t getCacheUsage();
     unsigned getCacheAllocations();
+    uint64_t getCacheHits();
+    uint64_t getCacheMisses();
+    uint64_t getCacheEvictions();
+    void addReserved(struct g2d_buf* buf);
+    void releaseReserved();
+    size_t getReservedUsage();
+    unsigned getReservedAllocations();
+    uint64_t getReservedHits();
 
 protected:
+    typedef std::list<struct g2d_buf*> G2dBufList;
+    typedef std::multimap<size_t, G2dBufList::iterator> G2dBufSizeIndex;
+
+    void insertNoLock(struct g2d_buf* buf);
+    void removeNoLock(G2dBufSizeIndex::iterator it);
+    void evictOldestNoLock();
     void drainCacheNoLock();
+    struct g2d_buf* allocReservedNoLock(size_t size);
+    void drainReservedNoLock();
 
     bool cacheEnabled;
     bool cacheable;
@@ -253,8 +431,21 @@ protected:
     size_t cacheUsage;
     unsigned cacheAllocCount;
 
+    std::atomic<uint64_t> cacheHits;
+    std::atomic<uint64_t> cacheMisses;
+    std::atomic<uint64_t> cacheEvictions;
+    // allocations served by reserved buffers, not accounted as cache hits
+    std::atomic<uint64_t> reservedHits;
+
     std::mutex mutex;
-    std::vector<struct g2d_buf*> cacheVector;
+    // least recently released buffer first
+    G2dBufList lruList;
+    G2dBufSizeIndex sizeIndex;
+
+    // available reserved buffers, and every reserved buffer
+    std::multimap<size_t, struct g2d_buf*> reservedFree;
+    std::set<struct g2d_buf*> reservedAll;
+    size_t reservedUsage;
 
     static const size_t USAGE_MAX_DEFAULT = (64 * 1024 *1024);
     static const unsigned ALLOC_COUNT_MAX_DEFAULT = 16;
@@ -267,7 +458,12 @@ G2dBufPoolInstance::G2dBufPoolInstance(bool _cacheable) :
                        cacheUsageMax(USAGE_MAX_DEFAULT),
                        cacheAllocCountMax(ALLOC_COUNT_MAX_DEFAULT),
                        cacheUsage(0),
-                       cacheAllocCount(0)
+                       cacheAllocCount(0),
+                       cacheHits(0),
+                       cacheMisses(0),
+                       cacheEvictions(0),
+                       reservedHits(0),
+                       reservedUsage(0)
 {
 }
 
@@ -278,7 +474,12 @@ G2dBufPoolInstance::G2dBufPoolInstance(const G2dBufPoolInstance& obj) :
                        cacheUsageMax(obj.cacheUsageMax),
                        cacheAllocCountMax(obj.cacheAllocCountMax),
                        cacheUsage(0),
-                       cacheAllocCount(0)
+                       cacheAllocCount(0),
+                       cacheHits(0),
+                       cacheMisses(0),
+                       cacheEvictions(0),
+                       reservedHits(0),
+                       reservedUsage(0)
 {
     (void)obj;
 }
@@ -288,52 +489,101 @@ G2dBufPoolInstance:: ~G2dBufPoolInstance()
 {
     try {
         drainCacheNoLock(); // can throw
+        drainReservedNoLock();
     } catch (const std::exception &e) {
         std::cerr << "Exception: " << e.what() << std::endl;
     }
 }
 
 
-struct g2d_buf* G2dBufPoolInstance::alloc(size_t size)
+void G2dBufPoolInstance::insertNoLock(struct g2d_buf* buf)
+{
+    G2dBufList::iterator it = lruList.insert(lruList.end(), buf);
+    sizeIndex.insert(std::make_pair(static_cast<size_t>(buf->buf_size), it));
+    cacheUsage += buf->buf_size;
+    cacheAllocCount++;
+
+#ifdef DEBUG
+    IMX2D_Assert(cacheAllocCount == lruList.size());
+    IMX2D_Assert(cacheAllocCount == sizeIndex.size());
+#endif
+}
+
+
+void G2dBufPoolInstance::removeNoLock(G2dBufSizeIndex::iterator it)
+{
+    struct g2d_buf* buf = *(it->second);
+
+    lruList.erase(it->second);
+    sizeIndex.erase(it);
+    cacheUsage -= buf->buf_size;
+    cacheAllocCount--;
+
+#ifdef DEBUG
+    IMX2D_Assert(cacheAllocCount == lruList.size());
+    IMX2D_Assert(cacheAllocCount == sizeIndex.size());
+#endif
+}
+
+
+void G2dBufPoolInstance::evictOldestNoLock()
+{
+    struct g2d_buf* buf;
+    G2dBufSizeIndex::iterator it, end;
+    int ret;
+
+    IMX2D_Assert(!lruList.empty());
+    buf = lruList.front();
+
+    // locate index entry among buffers of the same size
+    std::tie(it, end) = sizeIndex.equal_range(static_cast<size_t>(buf->buf_size));
+    while ((it != end) && (it->second != lruList.begin()))
+        it++;
+    IMX2D_Assert(it != end);
+
+    removeNoLock(it);
+    cacheEvictions++;
+
+    CACHE_LOG("%s(%d) sz:%d u:%zu c:%d (cache purge)",
+              __func__, cacheable, buf->buf_size, cacheUsage, cacheAllocCount);
+    ret = g2d_free(buf);
+    IMX2D_Assert(ret == 0);
+}
+
+
+struct g2d_buf* G2dBufPoolInstance::alloc(size_t size, bool& fresh)
 {
     struct g2d_buf *buf;
-    std::vector<struct g2d_buf*>::iterator it, matchIt;
-    size_t matchHeadroom;
+    G2dBufSizeIndex::iterator it;
+    size_t headroom;
     std::unique_lock<std::mutex> lock(mutex);
 
-    if (!cacheEnabled)
-        goto alloc_buff;
-
-    if (cacheVector.empty())
-        goto alloc_buff;
+    fresh = false;
 
-    matchHeadroom = SIZE_MAX;
-    matchIt = cacheVector.end();
-    for (it = cacheVector.begin(); it != cacheVector.end(); it++)
+    buf = allocReservedNoLock(size);
+    if (buf)
     {
-        if ((size_t)((*it)->buf_size) >= size)
-        {
-            size_t headroom = size_t((*it)->buf_size) - size;
-            // reuse buffer if not bigger than twice the requested size
-            if ((headroom <= size) && (headroom < matchHeadroom))
-            {
-                matchHeadroom = headroom;
-                matchIt = it;
-            }
-            if (matchHeadroom == 0)
-                break;
-        }
+        reservedHits++;
+        return buf;
     }
 
-    if (matchIt == cacheVector.end())
+    if (!cacheEnabled)
         goto alloc_buff;
 
-    buf = *matchIt;
-    cacheVector.erase(matchIt);
-    cacheUsage -= buf->buf_size;
-    cacheAllocCount--;
+    // smallest cached buffer fitting the request
+    it = sizeIndex.lower_bound(size);
+    if (it == sizeIndex.end())
+        goto miss;
+
+    // reuse buffer if not bigger than twice the requested size
+    headroom = it->first - size;
+    if (headroom > size)
+        goto miss;
+
+    buf = *(it->second);
+    removeNoLock(it);
+    cacheHits++;
 
-    IMX2D_Assert(cacheAllocCount == cacheVector.size());
     IMX2D_Assert(cacheUsage < cacheUsageMax);
     IMX2D_Assert(cacheAllocCount < cacheAllocCountMax );
     CACHE_LOG("%s(%d) sz:%zu(%d) va:%p u:%zu c:%d (cached)",
@@ -342,9 +592,21 @@ struct g2d_buf* G2dBufPoolInstance::alloc(size_t size)
 
     return buf;
 
+miss:
+    cacheMisses++;
+
 alloc_buff:
     lock.unlock();
 
+    fresh = true;
+    return allocFresh(size);
+}
+
+// allocation from G2D, cache bypassed and not accounted
+struct g2d_buf* G2dBufPoolInstance::allocFresh(size_t size)
+{
+    struct g2d_buf *buf;
+
     buf = g2d_alloc(size, cacheable);
 
     if (buf) {
@@ -352,13 +614,21 @@ alloc_buff:
                   __func__, cacheable, size, buf->buf_size, buf->buf_vaddr,
                   cacheUsage, cacheAllocCount);
     }
-    else
-    {
-        IMX2D_ERROR("%s g2d allocation failed (%zu)", __func__, size);
-    }
     return buf;
 }
 
+// free every cached buffer, accounted as evictions
+size_t G2dBufPoolInstance::trimCache()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t freed = cacheUsage;
+
+    cacheEvictions += cacheAllocCount;
+    drainCacheNoLock();
+
+    return freed;
+}
+
 void G2dBufPoolInstance::free(struct g2d_buf* buf)
 {
     size_t size = (size_t)buf->buf_size;
@@ -366,6 +636,14 @@ void G2dBufPoolInstance::free(struct g2d_buf* buf)
 
     std::unique_lock<std::mutex> lock(mutex);
 
+    if (reservedAll.count(buf))
+    {
+        reservedFree.insert(std::make_pair(size, buf));
+        CACHE_LOG("%s(%d) sz:%d va:%p (reserved)",
+                  __func__, cacheable, buf->buf_size, buf->buf_vaddr);
+        return;
+    }
+
     if (!cacheEnabled)
         goto free_buf;
 
@@ -375,32 +653,13 @@ void G2dBufPoolInstance::free(struct g2d_buf* buf)
     if (size > cacheUsageMax)
         goto free_buf;
 
-    // pop oldest cache entries until buffer to be freed can fit in the cache
+    // evict least recently used entries until buffer to be freed can fit
     while ((cacheAllocCount + 1 > cacheAllocCountMax) ||
            (cacheUsage + size > cacheUsageMax))
-    {
-        struct g2d_buf* cachedBuf;
-        IMX2D_Assert(!cacheVector.empty());
-        std::vector<struct g2d_buf*>::iterator it;
+        evictOldestNoLock();
 
-        it = cacheVector.begin();
-        cachedBuf = *it;
-        cacheVector.erase(it);
-        cacheUsage -= cachedBuf->buf_size;
-        cacheAllocCount--;
-        IMX2D_Assert(cacheAllocCount == cacheVector.size());
+    insertNoLock(buf);
 
-        CACHE_LOG("%s(%d) sz:%d u:%zu c:%d (cache purge)",
-                  __func__, cacheable, cachedBuf->buf_size, cacheUsage, cacheAllocCount);
-        ret = g2d_free(cachedBuf);
-        IMX2D_Assert(ret == 0);
-    }
-
-    cacheVector.push_back(buf);
-    cacheUsage += buf->buf_size;
-    cacheAllocCount++;
-
-    IMX2D_Assert(cacheAllocCount == cacheVector.size());
     IMX2D_Assert(cacheUsage <= cacheUsageMax);
     IMX2D_Assert(cacheAllocCount <= cacheAllocCountMax );
 
@@ -423,16 +682,14 @@ free_buf:
 void G2dBufPoolInstance::drainCacheNoLock()
 {
     struct g2d_buf *buf;
-    size_t size;
     int ret;
 
-    while (!cacheVector.empty())
+    while (!lruList.empty())
     {
-        buf = cacheVector[cacheVector.size() - 1];
-        size = buf->buf_size;
-        cacheUsage -= size;
+        buf = lruList.back();
+        cacheUsage -= buf->buf_size;
         cacheAllocCount --;
-        cacheVector.pop_back();
+        lruList.pop_back();
 
         CACHE_LOG("%s(%d) sz:%d u:%zu c:%d (cache purge)",
                   __func__, cacheable, buf->buf_size, cacheUsage, cacheAllocCount);
@@ -440,11 +697,90 @@ void G2dBufPoolInstance::drainCacheNoLock()
         ret = g2d_free(buf);
         IMX2D_Assert(ret == 0);
     }
+    sizeIndex.clear();
 
     IMX2D_Assert(cacheAllocCount == 0);
     IMX2D_Assert(cacheUsage == 0);
 }
 
+struct g2d_buf* G2dBufPoolInstance::allocReservedNoLock(size_t size)
+{
+    struct g2d_buf* buf;
+    std::multimap<size_t, struct g2d_buf*>::iterator it;
+
+    it = reservedFree.lower_bound(size);
+    // same reuse criteria as cached buffers
+    if ((it == reservedFree.end()) || (it->first - size > size))
+        return nullptr;
+
+    buf = it->second;
+    reservedFree.erase(it);
+
+    CACHE_LOG("%s(%d) sz:%zu(%d) va:%p (reserved)",
+              __func__, cacheable, size, buf->buf_size, buf->buf_vaddr);
+
+    return buf;
+}
+
+void G2dBufPoolInstance::drainReservedNoLock()
+{
+    int ret;
+
+    for (auto it = reservedFree.begin(); it != reservedFree.end(); it++)
+    {
+        struct g2d_buf* buf = it->second;
+
+        reservedAll.erase(buf);
+        reservedUsage -= buf->buf_size;
+        ret = g2d_free(buf);
+        IMX2D_Assert(ret == 0);
+    }
+    reservedFree.clear();
+
+    // buffers in use are unpinned, and freed normally on deallocation
+    for (auto it = reservedAll.begin(); it != reservedAll.end(); it++)
+        reservedUsage -= (*it)->buf_size;
+    reservedAll.clear();
+
+    IMX2D_Assert(reservedUsage == 0);
+}
+
+// buffer allocated by allocFresh() pinned in the reserved set
+void G2dBufPoolInstance::addReserved(struct g2d_buf* buf)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    reservedAll.insert(buf);
+    reservedFree.insert(std::make_pair(static_cast<size_t>(buf->buf_size), buf));
+    reservedUsage += buf->buf_size;
+}
+
+void G2dBufPoolInstance::releaseReserved()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    drainReservedNoLock();
+}
+
+size_t G2dBufPoolInstance::getReservedUsage()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    return reservedUsage;
+}
+
+unsigned G2dBufPoolInstance::getReservedAllocations()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    return reservedFree.size();
+}
+
+uint64_t G2dBufPoolInstance::getReservedHits()
+{
+    return reservedHits;
+}
+
 void G2dBufPoolInstance::setUseCache(bool flag)
 {
     std::unique_lock<std::mutex> lock(mutex);
@@ -476,6 +812,21 @@ unsigned G2dBufPoolInstance::getCacheAllocations()
     return cacheAllocCount;
 }
 
+uint64_t G2dBufPoolInstance::getCacheHits()
+{
+    return cacheHits;
+}
+
+uint64_t G2dBufPoolInstance::getCacheMisses()
+{
+    return cacheMisses;
+}
+
+uint64_t G2dBufPoolInstance::getCacheEvictions()
+{
+    return cacheEvictions;
+}
+
 
 class G2dBufPool
 {
@@ -484,13 +835,24 @@ public:
     virtual ~G2dBufPool();
 
     void setUseCache(bool flag);
-    struct g2d_buf* alloc(size_t size, bool cacheable);
+    struct g2d_buf* alloc(size_t size, bool cacheable, bool& fresh);
+    struct g2d_buf* allocFresh(size_t size, bool cacheable);
     void free(g2d_buf* buf, bool cacheable);
     void setCacheConfig(size_t _cacheUsageMax, unsigned _cacheAllocCountMax);
     size_t getCacheUsage(bool cacheable);
     unsigned getCacheAllocations(bool cacheable);
+    uint64_t getCacheHits(bool cacheable);
+    uint64_t getCacheMisses(bool cacheable);
+    uint64_t getCacheEvictions(bool cacheable);
+    void addReserved(struct g2d_buf* buf, bool cacheable);
+    void releaseReserved();
+    size_t getReservedUsage(bool cacheable);
+    unsigned getReservedAllocations(bool cacheable);
+    uint64_t getReservedHits(bool cacheable);
 
 protected:
+    struct g2d_buf* allocRetry(G2dBufPoolInstance& pool, size_t size);
+
     G2dBufPoolInstance cachedPool;
     G2dBufPoolInstance uncachedPool;
 };
@@ -510,10 +872,53 @@ void G2dBufPool::setUseCache(bool flag)
     uncachedPool.setUseCache(flag);
 }
 
-struct g2d_buf* G2dBufPool::alloc(size_t size, bool cacheable)
+struct g2d_buf* G2dBufPool::alloc(size_t size, bool cacheable, bool& fresh)
+{
+    G2dBufPoolInstance& pool = cacheable ? cachedPool : uncachedPool;
+    struct g2d_buf* buf;
+
+    buf = pool.alloc(size, fresh);
+    if (buf)
+        return buf;
+
+    fresh = true;
+    return allocRetry(pool, size);
+}
+
+// allocation from G2D, cache bypassed, for reserved and scratch buffers
+struct g2d_buf* G2dBufPool::allocFresh(size_t size, bool cacheable)
 {
     G2dBufPoolInstance& pool = cacheable ? cachedPool : uncachedPool;
-    return pool.alloc(size);
+    struct g2d_buf* buf;
+
+    buf = pool.allocFresh(size);
+    if (buf)
+        return buf;
+
+    return allocRetry(pool, size);
+}
+
+// retry of a failed G2D allocation
+struct g2d_buf* G2dBufPool::allocRetry(G2dBufPoolInstance& pool, size_t size)
+{
+    struct g2d_buf* buf = nullptr;
+    size_t freed;
+
+    // CMA may be held by cached buffers of both pools and by idle scratch
+    // buffers, release it and retry
+    freed = cachedPool.trimCache() + uncachedPool.trimCache();
+    freed += Imx2dScratchArena::getInstance().drain();
+    if (freed)
+    {
+        IMX2D_DEBUG("%s cache trimmed (%zu) for allocation (%zu)",
+                    __func__, freed, size);
+        buf = pool.allocFresh(size);
+    }
+
+    if (!buf)
+        IMX2D_ERROR("%s g2d allocation failed (%zu)", __func__, size);
+
+    return buf;
 }
 
 void G2dBufPool::free(struct g2d_buf* buf, bool cacheable)
@@ -541,25 +946,223 @@ unsigned G2dBufPool::getCacheAllocations(bool cacheable)
     return pool.getCacheAllocations();
 }
 
-
-//================================= Imx2dGAllocator ====================================
-
-Imx2dGAllocator::Imx2dGAllocator(): enableCount(0), allocCount(0), usage(0)
+uint64_t G2dBufPool::getCacheHits(bool cacheable)
 {
-    g2dBufRepoPtr = std::make_shared<G2dBufRepo>(G2dBufRepo());
-    g2dBufPoolPtr = std::make_shared<G2dBufPool>(G2dBufPool());
+    G2dBufPoolInstance& pool = cacheable ? cachedPool : uncachedPool;
+    return pool.getCacheHits();
 }
 
-Imx2dGAllocator::~Imx2dGAllocator()
+uint64_t G2dBufPool::getCacheMisses(bool cacheable)
 {
+    G2dBufPoolInstance& pool = cacheable ? cachedPool : uncachedPool;
+    return pool.getCacheMisses();
 }
 
-void Imx2dGAllocator::enable()
+uint64_t G2dBufPool::getCacheEvictions(bool cacheable)
 {
-    std::unique_lock<std::mutex> lock(mutex);
-    enableCount++;
-    if (enableCount == 1)
-        g2dBufPoolPtr.get()->setUseCache(true);
+    G2dBufPoolInstance& pool = cacheable ? cachedPool : uncachedPool;
+    return pool.getCacheEvictions();
+}
+
+void G2dBufPool::addReserved(struct g2d_buf* buf, bool cacheable)
+{
+    G2dBufPoolInstance& pool = cacheable ? cachedPool : uncachedPool;
+    return pool.addReserved(buf);
+}
+
+void G2dBufPool::releaseReserved()
+{
+    cachedPool.releaseReserved();
+    uncachedPool.releaseReserved();
+}
+
+size_t G2dBufPool::getReservedUsage(bool cacheable)
+{
+    G2dBufPoolInstance& pool = cacheable ? cachedPool : uncachedPool;
+    return pool.getReservedUsage();
+}
+
+unsigned G2dBufPool::getReservedAllocations(bool cacheable)
+{
+    G2dBufPoolInstance& pool = cacheable ? cachedPool : uncachedPool;
+    return pool.getReservedAllocations();
+}
+
+uint64_t G2dBufPool::getReservedHits(bool cacheable)
+{
+    G2dBufPoolInstance& pool = cacheable ? cachedPool : uncachedPool;
+    return pool.getReservedHits();
+}
+
+
+//============================= G2dBufImports ================================
+
+/**
+@brief G2dBufImports class keeps track of external buffers imported as g2d_buf
+
+Imported buffers are described by g2d_buf descriptors owned by this class,
+distinct from the ones returned by G2D import functions, so that their virtual
+address refers to a valid CPU mapping.
+*/
+
+class G2dBufImports
+{
+public:
+    G2dBufImports() {}
+    virtual ~G2dBufImports();
+
+    struct g2d_buf* importDmabuf(int fd, size_t size);
+    struct g2d_buf* importPhysical(uint64_t paddr, void* vaddr, size_t size);
+    void release(struct g2d_buf* buf);
+
+protected:
+    struct Import {
+        struct g2d_buf buf;
+        struct g2d_buf* fdBuf;
+        void* mapping;
+        size_t mappingSize;
+    };
+
+    void releaseImport(Import* import);
+
+    std::map<struct g2d_buf*, Import*> imports;
+    std::mutex mutex;
+};
+
+G2dBufImports::~G2dBufImports()
+{
+    for (auto it = imports.begin(); it != imports.end(); it++)
+    {
+        IMX2D_ERROR("%s import not released va:%p", __func__, it->first->buf_vaddr);
+        releaseImport(it->second);
+    }
+}
+
+struct g2d_buf* G2dBufImports::importDmabuf(int fd, size_t size)
+{
+    Import* import = new Import();
+
+    import->fdBuf = g2d_buf_from_fd(fd);
+    if (!import->fdBuf)
+    {
+        IMX2D_ERROR("%s g2d import failed (fd:%d)", __func__, fd);
+        delete import;
+        return nullptr;
+    }
+
+    // caller size can't exceed the exported buffer, G2D size if lseek fails
+    off_t end = lseek(fd, 0, SEEK_END);
+    size_t fdSize = (end > 0) ? static_cast<size_t>(end) :
+                                static_cast<size_t>(std::max(import->fdBuf->buf_size, 0));
+    if (size > fdSize)
+    {
+        IMX2D_ERROR("%s size exceeds buffer (fd:%d size:%zu buffer:%zu)",
+                    __func__, fd, size, fdSize);
+        (void) g2d_free(import->fdBuf);
+        delete import;
+        return nullptr;
+    }
+
+    // buffer handle and physical address from G2D import
+    import->buf = *import->fdBuf; // struct copy
+    import->buf.buf_size = static_cast<int>(size);
+
+    if (!import->buf.buf_vaddr)
+    {
+        void* vaddr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (vaddr == MAP_FAILED)
+        {
+            IMX2D_ERROR("%s mmap failed (fd:%d size:%zu)", __func__, fd, size);
+            (void) g2d_free(import->fdBuf);
+            delete import;
+            return nullptr;
+        }
+        import->mapping = vaddr;
+        import->mappingSize = size;
+        import->buf.buf_vaddr = vaddr;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    imports[&import->buf] = import;
+
+    return &import->buf;
+}
+
+struct g2d_buf* G2dBufImports::importPhysical(uint64_t paddr, void* vaddr, size_t size)
+{
+    Import* import = new Import();
+
+    import->buf.buf_handle = nullptr;
+    import->buf.buf_vaddr = vaddr;
+    import->buf.buf_paddr = static_cast<long>(paddr);
+    import->buf.buf_size = static_cast<int>(size);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    imports[&import->buf] = import;
+
+    return &import->buf;
+}
+
+void G2dBufImports::release(struct g2d_buf* buf)
+{
+    Import* import;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = imports.find(buf);
+        IMX2D_Assert(it != imports.end());
+        import = it->second;
+        imports.erase(it);
+    }
+
+    releaseImport(import);
+}
+
+void G2dBufImports::releaseImport(Import* import)
+{
+    int ret;
+
+    if (import->mapping)
+    {
+        ret = munmap(import->mapping, import->mappingSize);
+        if (ret != 0)
+            IMX2D_ERROR("%s munmap failed", __func__);
+    }
+
+    if (import->fdBuf)
+    {
+        ret = g2d_free(import->fdBuf);
+        if (ret != 0)
+            IMX2D_ERROR("%s g2d free failed (%d)", __func__, ret);
+    }
+
+    delete import;
+}
+
+
+//================================= Imx2dGAllocator ====================================
+
+Imx2dGAllocator::Imx2dGAllocator(): enableCount(0), allocCount(0), usage(0),
+                                    coherencyTracking(false), shadowMode(false),
+                                    shadowCount(0), cmaLow(0), cmaCritical(0),
+                                    cmaPressure(CMA_PRESSURE_NONE),
+                                    cmaMonitoring(false), allocFailures(0)
+{
+    g2dBufRepoPtr = std::make_shared<G2dBufRepo>(G2dBufRepo());
+    g2dBufPoolPtr = std::make_shared<G2dBufPool>(G2dBufPool());
+    g2dBufImportsPtr = std::make_shared<G2dBufImports>();
+}
+
+Imx2dGAllocator::~Imx2dGAllocator()
+{
+}
+
+void Imx2dGAllocator::enable()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    enableCount++;
+    if (enableCount == 1)
+        g2dBufPoolPtr.get()->setUseCache(true);
 }
 
 void Imx2dGAllocator::disable()
@@ -574,8 +1177,10 @@ void Imx2dGAllocator::disable()
 void* Imx2dGAllocator::alloc(size_t size, bool cacheable, void*& handle)
 {
     struct g2d_buf* buf;
+    bool fresh;
 
-    buf = g2dBufPoolPtr.get()->alloc(size, cacheable);
+    buf = g2dBufPoolPtr.get()->alloc(size, cacheable, fresh);
+    accountAlloc(buf, fresh);
 
     if (!buf)
     {
@@ -610,6 +1215,7 @@ void Imx2dGAllocator::free(void* handle)
     IMX2D_Assert(isG2dBuf);
     IMX2D_Assert(buf == _buf);
 
+    releaseShadow(handle);
     g2dBufRepoPtr.get()->unregisterDescriptor(buf);
 
     {
@@ -624,7 +1230,6 @@ void Imx2dGAllocator::free(void* handle)
 bool Imx2dGAllocator::isGraphicBuffer(void* vaddr, void*& handle,
         bool& cacheable)
 {
-    std::unique_lock<std::mutex> lock(mutex);
     struct g2d_buf* buf;
     bool ret;
 
@@ -654,142 +1259,1529 @@ unsigned Imx2dGAllocator::getCacheAllocations(bool cacheable)
     return g2dBufPoolPtr.get()->getCacheAllocations(cacheable);
 }
 
-void Imx2dGAllocator::setCacheConfig(size_t cacheUsageMax,
-                                     unsigned cacheAllocCountMax)
+uint64_t Imx2dGAllocator::getCacheHits(bool cacheable)
 {
-    return g2dBufPoolPtr.get()->setCacheConfig(cacheUsageMax,
-                                               cacheAllocCountMax);
+    return g2dBufPoolPtr.get()->getCacheHits(cacheable);
 }
 
-Imx2dGAllocator& Imx2dGAllocator::getInstance()
+uint64_t Imx2dGAllocator::getCacheMisses(bool cacheable)
 {
-    static Imx2dGAllocator instance;
-    return instance;
+    return g2dBufPoolPtr.get()->getCacheMisses(cacheable);
 }
 
-
-//============================= Imx2dHalCounters ================================
-
-void Imx2dHalCounters::incrementCount(Imx2dHalCounters::Primitive primitive)
+uint64_t Imx2dGAllocator::getCacheEvictions(bool cacheable)
 {
-    counters[primitive]++;
+    return g2dBufPoolPtr.get()->getCacheEvictions(cacheable);
 }
 
-unsigned int Imx2dHalCounters::readCount(Imx2dHalCounters::Primitive primitive)
+struct g2d_buf* Imx2dGAllocator::allocBuffer(size_t size, bool cacheable)
 {
-    return counters[primitive];
-}
+    struct g2d_buf* buf;
 
+    buf = g2dBufPoolPtr.get()->allocFresh(size, cacheable);
+    accountAlloc(buf, true);
 
-//================================= HardwareCapabilities ====================================
+    return buf;
+}
 
-HardwareCapabilities::HardwareCapabilities(): supported(false),
-                                              caps()
+void Imx2dGAllocator::accountAlloc(struct g2d_buf* buf, bool fresh)
 {
-    const char *SYS_DEVICE_SOC_ID_FILE_PATH = "/sys/devices/soc0/soc_id";
-
-    std::ifstream ifs(SYS_DEVICE_SOC_ID_FILE_PATH);
-    if (ifs.fail())
+    if (!buf)
     {
-        std::cerr << "Can not open " << SYS_DEVICE_SOC_ID_FILE_PATH << std::endl;
+        allocFailures++;
+        if (cmaMonitoring)
+            updateCmaPressure(true);
         return;
     }
 
-    std::stringstream buf;
-    buf << ifs.rdbuf();
-    std::string soc = buf.str();
-    std::string trim ("\t\f\v\n\r");
-    size_t offset = soc.find_last_not_of(trim);
-    if (offset != std::string::npos)
-        soc.erase(offset + 1);
-    else
-        soc.clear();
+    // CMA only shrinks on allocations reaching G2D
+    if (fresh && cmaMonitoring)
+        updateCmaPressure(false);
+}
 
-    // supported SoCs
-    std::vector<std::string> socs = {"i.MX8MP", "i.MX93", "i.MX8QM", "i.MX8QXP"};
-    bool support = (std::find(socs.begin(), socs.end(), soc) != socs.end());
-    if (!support)
+unsigned Imx2dGAllocator::reserveBuffers(size_t size, unsigned count,
+                                         bool cacheable)
+{
+    unsigned i;
+
+    for (i = 0; i < count; i++)
     {
-        std::cerr << "SoC not supported [" << soc << "]" << std::endl;
-        return;
+        struct g2d_buf* buf = allocBuffer(size, cacheable);
+        if (!buf)
+            break;
+
+        g2dBufPoolPtr.get()->addReserved(buf, cacheable);
     }
-    supported = true;
 
-    // 3 channels support on DPU
-    std::vector<std::string> threeChans = {"i.MX8QM", "i.MX8QXP"};
-    support = (std::find(threeChans.begin(), threeChans.end(), soc) !=
-                   threeChans.end());
-    caps[THREE_CHANNELS] = support;
+    return i;
 }
 
-bool HardwareCapabilities::hasSupport()
+void Imx2dGAllocator::releaseReservedBuffers()
 {
-    return supported;
+    g2dBufPoolPtr.get()->releaseReserved();
 }
 
-bool HardwareCapabilities::hasCapability(Capabilities cap)
+size_t Imx2dGAllocator::getReservedUsage(bool cacheable)
 {
-    return caps[cap];
+    return g2dBufPoolPtr.get()->getReservedUsage(cacheable);
 }
 
+unsigned Imx2dGAllocator::getReservedAllocations(bool cacheable)
+{
+    return g2dBufPoolPtr.get()->getReservedAllocations(cacheable);
+}
 
-//================================= Imx2dHal ====================================
+uint64_t Imx2dGAllocator::getReservedHits(bool cacheable)
+{
+    return g2dBufPoolPtr.get()->getReservedHits(cacheable);
+}
 
-Imx2dHal::Imx2dHal(): enabled(false), g2dHandle(nullptr) {}
+void Imx2dGAllocator::setCacheConfig(size_t cacheUsageMax,
+                                     unsigned cacheAllocCountMax)
+{
+    return g2dBufPoolPtr.get()->setCacheConfig(cacheUsageMax,
+                                               cacheAllocCountMax);
+}
 
-Imx2dHal::~Imx2dHal() {}
+void Imx2dGAllocator::setCoherencyTracking(bool flag)
+{
+    std::unique_lock<std::mutex> lock(mutex);
 
-void Imx2dHal::setEnable(bool flag)
+    // CPU accesses were not tracked so far
+    if (flag && !coherencyTracking)
+        g2dBufRepoPtr.get()->resetCoherency();
+
+    coherencyTracking = flag;
+}
+
+bool Imx2dGAllocator::getCoherencyTracking()
 {
-    int ret;
-    Imx2dGAllocator& gAllocator = Imx2dGAllocator::getInstance();
+    return coherencyTracking;
+}
 
-    std::unique_lock<std::mutex> lock(mutex);
+Imx2dGAllocator::Coherency Imx2dGAllocator::getCoherency(void* handle)
+{
+    struct g2d_buf* buf = static_cast<struct g2d_buf*>(handle);
 
-    if (flag == enabled)
+    return g2dBufRepoPtr.get()->getCoherency(buf);
+}
+
+void Imx2dGAllocator::setCoherency(void* handle, Coherency state)
+{
+    struct g2d_buf* buf = static_cast<struct g2d_buf*>(handle);
+
+    g2dBufRepoPtr.get()->setCoherency(buf, state);
+}
+
+void Imx2dGAllocator::declareCpuAccess(void* handle, bool write)
+{
+    struct g2d_buf* buf = static_cast<struct g2d_buf*>(handle);
+
+    if (!coherencyTracking)
         return;
-    enabled = flag;
 
-    if (flag)
-    {
-        IMX2D_Assert(hwCapabilities.hasSupport());
+    g2dBufRepoPtr.get()->declareCpuAccess(buf, write);
+}
 
-        ret = g2d_open(&g2dHandle);
-        IMX2D_Assert(ret == 0);
+bool Imx2dGAllocator::getBufferDescription(void* vaddr, void*& handle,
+                                           uint64_t& paddr, size_t& size,
+                                           size_t& offset, bool& cacheable)
+{
+    struct g2d_buf* buf;
 
-        gAllocator.enable();
-    }
-    else
+    if (!g2dBufRepoPtr.get()->isVaddrG2dBuf(vaddr, buf, cacheable))
     {
-        ret = g2d_close(g2dHandle);
-        IMX2D_Assert(ret == 0);
-        g2dHandle = nullptr;
+        handle = nullptr;
+        return false;
+    }
 
-        gAllocator.disable();
+    handle = static_cast<void*>(buf);
+    paddr = static_cast<uint64_t>(buf->buf_paddr);
+    size = static_cast<size_t>(buf->buf_size);
+    offset = static_cast<char*>(vaddr) - static_cast<char*>(buf->buf_vaddr);
+
+    return true;
+}
+
+int Imx2dGAllocator::exportDmabuf(void* handle)
+{
+    struct g2d_buf* buf = static_cast<struct g2d_buf*>(handle);
+    int fd;
+
+    fd = g2d_buf_export_fd(buf);
+    if (fd < 0)
+        IMX2D_ERROR("%s g2d export failed (%d)", __func__, fd);
+
+    return fd;
+}
+
+int Imx2dGAllocator::syncForDevice(void* handle, bool deviceWrite)
+{
+    struct g2d_buf* buf = static_cast<struct g2d_buf*>(handle), * _buf;
+    bool cacheable;
+    int ret;
+
+    IMX2D_Assert(g2dBufRepoPtr.get()->isVaddrG2dBuf(buf->buf_vaddr, _buf, cacheable));
+    if (!cacheable)
+        return 0;
+
+    ret = g2d_cache_op(buf, deviceWrite ? G2D_CACHE_FLUSH : G2D_CACHE_CLEAN);
+    if ((ret != 0) && (ret != G2D_STATUS_NOT_SUPPORTED))
+        return ret;
+
+    if (coherencyTracking)
+    {
+        if (deviceWrite)
+            g2dBufRepoPtr.get()->setCoherency(buf, COHERENCY_DEVICE);
+        else if (g2dBufRepoPtr.get()->getCoherency(buf) == COHERENCY_CPU_DIRTY)
+            g2dBufRepoPtr.get()->setCoherency(buf, COHERENCY_CLEAN);
     }
+
+    return 0;
 }
 
-bool Imx2dHal::isEnabled()
+void* Imx2dGAllocator::importDmabuf(int fd, size_t size, bool cacheable,
+                                    void*& handle)
 {
-    return enabled;
+    struct g2d_buf* buf;
+
+    handle = nullptr;
+    if ((fd < 0) || (size == 0) || (size > INT_MAX))
+    {
+        IMX2D_ERROR("%s invalid buffer (fd:%d size:%zu)", __func__, fd, size);
+        return nullptr;
+    }
+
+    buf = g2dBufImportsPtr.get()->importDmabuf(fd, size);
+    if (!buf)
+        return nullptr;
+
+    registerImport(buf, cacheable);
+    handle = static_cast<void*>(buf);
+
+    return buf->buf_vaddr;
 }
 
-HardwareCapabilities& Imx2dHal::getHardwareCapabilities()
+void* Imx2dGAllocator::importPhysical(uint64_t paddr, void* vaddr, size_t size,
+                                      void*& handle)
 {
-    return hwCapabilities;
+    struct g2d_buf* buf;
+
+    handle = nullptr;
+    if ((paddr == 0) || (vaddr == nullptr) || (size == 0) ||
+        (size > INT_MAX) || (paddr % IMPORT_ALIGN) ||
+        (reinterpret_cast<uintptr_t>(vaddr) % IMPORT_ALIGN))
+    {
+        IMX2D_ERROR("%s invalid buffer (pa:0x%llx va:%p size:%zu)", __func__,
+                    static_cast<unsigned long long>(paddr), vaddr, size);
+        return nullptr;
+    }
+
+    buf = g2dBufImportsPtr.get()->importPhysical(paddr, vaddr, size);
+    if (!buf)
+        return nullptr;
+
+    // no G2D handle for cache maintenance
+    registerImport(buf, false);
+    handle = static_cast<void*>(buf);
+
+    return buf->buf_vaddr;
 }
 
-void* Imx2dHal::getG2dHandle()
+void Imx2dGAllocator::registerImport(struct g2d_buf* buf, bool cacheable)
 {
-    std::unique_lock<std::mutex> lock(mutex);
-    IMX2D_Assert(enabled);
-    return g2dHandle;
+    // import is not owned by the caller until registered
+    try {
+        g2dBufRepoPtr.get()->registerDescriptor(buf, cacheable);
+    } catch (...) {
+        g2dBufImportsPtr.get()->release(buf);
+        throw;
+    }
 }
 
-Imx2dHal& Imx2dHal::getInstance()
+void Imx2dGAllocator::releaseImport(void* handle)
 {
-    static Imx2dHal instance;
+    struct g2d_buf* buf = static_cast<struct g2d_buf*>(handle);
+
+    releaseShadow(handle);
+    g2dBufRepoPtr.get()->unregisterDescriptor(buf);
+    g2dBufImportsPtr.get()->release(buf);
+}
+
+void Imx2dGAllocator::setShadowMode(bool flag)
+{
+    shadowMode = flag;
+}
+
+bool Imx2dGAllocator::getShadowMode()
+{
+    return shadowMode;
+}
+
+bool Imx2dGAllocator::getShadow(void* handle, Shadow& shadow)
+{
+    struct g2d_buf* buf = static_cast<struct g2d_buf*>(handle);
+    std::unique_lock<std::mutex> lock(shadowMutex);
+
+    auto it = shadows.find(buf);
+    if (it == shadows.end())
+        return false;
+
+    shadow = it->second;
+    return true;
+}
+
+struct g2d_buf* Imx2dGAllocator::createShadow(void* handle, int width,
+                                              int height)
+{
+    struct g2d_buf* buf = static_cast<struct g2d_buf*>(handle);
+    size_t size = static_cast<size_t>(width) * height * 4;
+    struct g2d_buf* shadowBuf = nullptr;
+    std::unique_lock<std::mutex> lock(shadowMutex);
+
+    auto it = shadows.find(buf);
+    if (it != shadows.end())
+    {
+        // reuse shadow buffer if large enough for the new geometry
+        if ((size_t)it->second.buf->buf_size >= size)
+            shadowBuf = it->second.buf;
+        else
+            g2dBufPoolPtr.get()->free(it->second.buf, true);
+        shadows.erase(it);
+    }
+
+    if (!shadowBuf)
+    {
+        bool fresh;
+        shadowBuf = g2dBufPoolPtr.get()->alloc(size, true, fresh);
+    }
+    if (!shadowBuf)
+    {
+        shadowCount = shadows.size();
+        return nullptr;
+    }
+
+    shadows[buf] = { shadowBuf, width, height, SHADOW_NONE };
+    shadowCount = shadows.size();
+    return shadowBuf;
+}
+
+void Imx2dGAllocator::setShadowState(void* handle, ShadowState state)
+{
+    struct g2d_buf* buf = static_cast<struct g2d_buf*>(handle);
+    std::unique_lock<std::mutex> lock(shadowMutex);
+
+    auto it = shadows.find(buf);
+    IMX2D_Assert(it != shadows.end());
+    it->second.state = state;
+}
+
+void Imx2dGAllocator::releaseShadow(void* handle)
+{
+    struct g2d_buf* buf = static_cast<struct g2d_buf*>(handle);
+    std::unique_lock<std::mutex> lock(shadowMutex);
+
+    auto it = shadows.find(buf);
+    if (it == shadows.end())
+        return;
+
+    g2dBufPoolPtr.get()->free(it->second.buf, true);
+    shadows.erase(it);
+    shadowCount = shadows.size();
+}
+
+std::vector<void*> Imx2dGAllocator::getShadowedBuffers()
+{
+    std::vector<void*> handles;
+    std::unique_lock<std::mutex> lock(shadowMutex);
+
+    for (auto it = shadows.begin(); it != shadows.end(); it++)
+        handles.push_back(static_cast<void*>(it->first));
+
+    return handles;
+}
+
+bool Imx2dGAllocator::hasShadows()
+{
+    return shadowCount > 0;
+}
+
+void Imx2dGAllocator::setCmaWatermarks(size_t low, size_t critical)
+{
+    IMX2D_Assert(critical <= low);
+
+    std::unique_lock<std::mutex> lock(cmaMutex);
+    cmaLow = low;
+    cmaCritical = critical;
+    cmaPressure = CMA_PRESSURE_NONE;
+    cmaMonitoring = (low > 0);
+}
+
+void Imx2dGAllocator::setCmaPressureCallback(const CmaPressureCallback& callback)
+{
+    std::unique_lock<std::mutex> lock(cmaMutex);
+    cmaCallback = callback;
+}
+
+Imx2dGAllocator::CmaPressure Imx2dGAllocator::getCmaPressure()
+{
+    std::unique_lock<std::mutex> lock(cmaMutex);
+    return cmaPressure;
+}
+
+uint64_t Imx2dGAllocator::getAllocFailures()
+{
+    return allocFailures;
+}
+
+bool Imx2dGAllocator::readCmaInfo(size_t& total, size_t& free)
+{
+    std::ifstream ifs("/proc/meminfo");
+    std::string key;
+    size_t value;
+    int found = 0;
+
+    total = free = 0;
+    if (ifs.fail())
+        return false;
+
+    // "CmaTotal:  <value> kB" lines
+    while ((found < 2) && (ifs >> key >> value))
+    {
+        if (key == "CmaTotal:") {
+            total = value * 1024;
+            found++;
+        } else if (key == "CmaFree:") {
+            free = value * 1024;
+            found++;
+        }
+        ifs.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+
+    return (found == 2);
+}
+
+void Imx2dGAllocator::updateCmaPressure(bool exhausted)
+{
+    size_t total, free;
+    CmaPressure level;
+    CmaPressureCallback callback;
+
+    if (!readCmaInfo(total, free))
+        return;
+
+    std::unique_lock<std::mutex> lock(cmaMutex);
+    if (exhausted)
+        level = CMA_PRESSURE_EXHAUSTED;
+    else if (free < cmaCritical)
+        level = CMA_PRESSURE_CRITICAL;
+    else if (free < cmaLow)
+        level = CMA_PRESSURE_LOW;
+    else
+        level = CMA_PRESSURE_NONE;
+
+    // notify level transitions only
+    if (level == cmaPressure)
+        return;
+    cmaPressure = level;
+    callback = cmaCallback;
+    lock.unlock();
+
+    IMX2D_DEBUG("%s level:%d free:%zu total:%zu", __func__, level, free, total);
+    if (callback)
+        callback(level, free);
+}
+
+Imx2dGAllocator& Imx2dGAllocator::getInstance()
+{
+    static Imx2dGAllocator instance;
+    return instance;
+}
+
+
+//============================= Imx2dHalCounters ================================
+
+void Imx2dHalCounters::incrementCount(Imx2dHalCounters::Primitive primitive)
+{
+    counters[primitive]++;
+}
+
+unsigned int Imx2dHalCounters::readCount(Imx2dHalCounters::Primitive primitive)
+{
+    return counters[primitive];
+}
+
+void Imx2dHalCounters::incrementFallback(Imx2dHalCounters::Primitive primitive,
+                                         Imx2dHalCounters::Reason reason)
+{
+    fallbacks[primitive][reason].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Imx2dHalCounters::readFallback(Imx2dHalCounters::Primitive primitive,
+                                        Imx2dHalCounters::Reason reason)
+{
+    return fallbacks[primitive][reason];
+}
+
+void Imx2dHalCounters::accountBuffers(Imx2dHalCounters::Primitive primitive,
+                                      bool inputGraphic, size_t inputBytes,
+                                      bool outputGraphic, size_t outputBytes)
+{
+    const auto relaxed = std::memory_order_relaxed;
+
+    if (inputBytes)
+        buffers[primitive][inputGraphic ? BUFFER_INPUT_GRAPHIC :
+                                          BUFFER_INPUT_HEAP].fetch_add(1, relaxed);
+    buffers[primitive][outputGraphic ? BUFFER_OUTPUT_GRAPHIC :
+                                       BUFFER_OUTPUT_HEAP].fetch_add(1, relaxed);
+    bytes[primitive].fetch_add(inputBytes + outputBytes, relaxed);
+}
+
+uint64_t Imx2dHalCounters::readBuffers(Imx2dHalCounters::Primitive primitive,
+                                       Imx2dHalCounters::Buffer buffer)
+{
+    return buffers[primitive][buffer];
+}
+
+uint64_t Imx2dHalCounters::readBytes(Imx2dHalCounters::Primitive primitive)
+{
+    return bytes[primitive];
+}
+
+void Imx2dHalCounters::reset()
+{
+    for (int p = 0; p < PRIMITIVES_MAX; p++)
+    {
+        counters[p] = 0;
+        bytes[p] = 0;
+        for (int r = 0; r < REASONS_MAX; r++)
+            fallbacks[p][r] = 0;
+        for (int b = 0; b < BUFFERS_MAX; b++)
+            buffers[p][b] = 0;
+    }
+}
+
+
+//================================= HardwareCapabilities ====================================
+
+/**
+ Blit engines of supported SoCs and their surface formats. Surface size, stride
+ and rotation limits are not characterized per engine: they are left to G2D,
+ blits it rejects falling back to the CPU.
+*/
+#define HW_FORMATS (HardwareCapabilities::FORMAT_RGBA | HardwareCapabilities::FORMAT_YUV)
+
+static const struct {
+    const char* soc;
+    std::vector<HardwareCapabilities::Engine> engines;
+} hwEnginesDb[] = {
+    { "i.MX8MP", {
+        { G2D_HARDWARE_2D, HW_FORMATS },
+    }},
+    { "i.MX93", {
+        { G2D_HARDWARE_PXP, HW_FORMATS },
+    }},
+    // 3 channels support on DPU
+    { "i.MX8QM", {
+        { G2D_HARDWARE_DPU, HW_FORMATS | HardwareCapabilities::FORMAT_RGB },
+        { G2D_HARDWARE_2D, HW_FORMATS },
+    }},
+    { "i.MX8QXP", {
+        { G2D_HARDWARE_DPU, HW_FORMATS | HardwareCapabilities::FORMAT_RGB },
+        { G2D_HARDWARE_2D, HW_FORMATS },
+    }},
+};
+
+HardwareCapabilities::HardwareCapabilities(): supported(false),
+                                              caps(),
+                                              formats(0)
+{
+    const char *SYS_DEVICE_SOC_ID_FILE_PATH = "/sys/devices/soc0/soc_id";
+
+    std::ifstream ifs(SYS_DEVICE_SOC_ID_FILE_PATH);
+    if (ifs.fail())
+    {
+        std::cerr << "Can not open " << SYS_DEVICE_SOC_ID_FILE_PATH << std::endl;
+        return;
+    }
+
+    std::stringstream buf;
+    buf << ifs.rdbuf();
+    std::string soc = buf.str();
+    std::string trim ("\t\f\v\n\r");
+    size_t offset = soc.find_last_not_of(trim);
+    if (offset != std::string::npos)
+        soc.erase(offset + 1);
+    else
+        soc.clear();
+
+    // supported SoCs
+    for (const auto& entry : hwEnginesDb)
+    {
+        if (soc == entry.soc)
+        {
+            engines = entry.engines;
+            break;
+        }
+    }
+    if (engines.empty())
+    {
+        std::cerr << "SoC not supported [" << soc << "]" << std::endl;
+        return;
+    }
+    supported = true;
+    socId = soc;
+
+    // formats common to every engine, 3 channels on any of them
+    formats = ~0u;
+    unsigned anyFormats = 0;
+    for (const auto& engine : engines)
+    {
+        formats &= engine.formats;
+        anyFormats |= engine.formats;
+    }
+    formats |= (anyFormats & FORMAT_RGB);
+
+    caps[THREE_CHANNELS] = (formats & FORMAT_RGB) != 0;
+}
+
+bool HardwareCapabilities::hasSupport()
+{
+    return supported;
+}
+
+bool HardwareCapabilities::hasCapability(Capabilities cap)
+{
+    return caps[cap];
+}
+
+const std::string& HardwareCapabilities::getSocId()
+{
+    return socId;
+}
+
+const std::vector<HardwareCapabilities::Engine>& HardwareCapabilities::getEngines()
+{
+    return engines;
+}
+
+bool HardwareCapabilities::hasFormat(Formats format)
+{
+    return (formats & format) == static_cast<unsigned>(format);
+}
+
+
+//================================= Imx2dDispatcher ====================================
+
+Imx2dDispatcher::Imx2dDispatcher()
+{
+    reset();
+}
+
+bool Imx2dDispatcher::useHardware(Imx2dHalCounters::Primitive primitive,
+                                  int cn, bool graphic, size_t pixels)
+{
+    Format format = (cn == 1) ? FORMAT_1CH :
+                    (cn == 3) ? FORMAT_3CH : FORMAT_4CH;
+    Buffers buffers = graphic ? BUFFERS_GRAPHIC : BUFFERS_SYSTEM;
+
+    size_t threshold = thresholds[primitive][format][buffers].load(
+                                                    std::memory_order_relaxed);
+    return (threshold != THRESHOLD_NEVER) && (pixels >= threshold);
+}
+
+void Imx2dDispatcher::setThreshold(Imx2dHalCounters::Primitive primitive,
+                                   Format format, Buffers buffers,
+                                   size_t pixels)
+{
+    IMX2D_Assert(primitive < Imx2dHalCounters::PRIMITIVES_MAX);
+    IMX2D_Assert(format < FORMATS_MAX && buffers < BUFFERS_MAX);
+
+    thresholds[primitive][format][buffers] = pixels;
+}
+
+size_t Imx2dDispatcher::getThreshold(Imx2dHalCounters::Primitive primitive,
+                                     Format format, Buffers buffers)
+{
+    IMX2D_Assert(primitive < Imx2dHalCounters::PRIMITIVES_MAX);
+    IMX2D_Assert(format < FORMATS_MAX && buffers < BUFFERS_MAX);
+
+    return thresholds[primitive][format][buffers];
+}
+
+void Imx2dDispatcher::reset()
+{
+    for (int p = 0; p < Imx2dHalCounters::PRIMITIVES_MAX; p++)
+        for (int f = 0; f < FORMATS_MAX; f++)
+            for (int b = 0; b < BUFFERS_MAX; b++)
+                thresholds[p][f][b] = 0;
+
+    // grayscale resize and transform go through channel packing into an
+    // intermediate 4 channels buffer: hardware only used once calibrated
+    for (int b = 0; b < BUFFERS_MAX; b++)
+    {
+        thresholds[Imx2dHalCounters::RESIZE][FORMAT_1CH][b] = THRESHOLD_NEVER;
+        thresholds[Imx2dHalCounters::TRANSFORM][FORMAT_1CH][b] = THRESHOLD_NEVER;
+    }
+}
+
+
+//================================= Imx2dProfiler ====================================
+
+/**
+@brief Latency histograms of a thread, written by their thread only
+*/
+class Imx2dThreadProfile
+{
+public:
+    struct Histogram {
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> min;
+        std::atomic<uint64_t> max;
+        std::atomic<uint32_t> buckets[Imx2dProfiler::BUCKETS_MAX];
+    };
+
+    Imx2dThreadProfile() { reset(); }
+    virtual ~Imx2dThreadProfile() {}
+
+    void record(Imx2dHalCounters::Primitive primitive,
+                Imx2dProfiler::Stage stage, uint64_t duration);
+    void accumulate(Imx2dHalCounters::Primitive primitive,
+                    Imx2dProfiler::Stage stage, Histogram& acc);
+    // adds profile histograms to this profile
+    void merge(Imx2dThreadProfile& profile);
+    void reset();
+
+    static int bucketIndex(uint64_t duration);
+    static uint64_t bucketValue(int index);
+
+protected:
+    Histogram histograms[Imx2dHalCounters::PRIMITIVES_MAX][Imx2dProfiler::STAGES_MAX];
+};
+
+// 8 buckets per power of two: 3 bits of mantissa below the most significant bit
+int Imx2dThreadProfile::bucketIndex(uint64_t duration)
+{
+    if (duration < 8)
+        return static_cast<int>(duration);
+
+    int msb = 63 - __builtin_clzll(duration);
+    int index = (msb - 2) * 8 + static_cast<int>((duration >> (msb - 3)) & 7);
+    return std::min(index, Imx2dProfiler::BUCKETS_MAX - 1);
+}
+
+// middle of the bucket range
+uint64_t Imx2dThreadProfile::bucketValue(int index)
+{
+    if (index < 8)
+        return index;
+
+    int msb = index / 8 + 2;
+    uint64_t lower = static_cast<uint64_t>(index % 8 + 8) << (msb - 3);
+    return lower + ((1ULL << (msb - 3)) >> 1);
+}
+
+void Imx2dThreadProfile::record(Imx2dHalCounters::Primitive primitive,
+                                Imx2dProfiler::Stage stage, uint64_t duration)
+{
+    Histogram& h = histograms[primitive][stage];
+    const auto relaxed = std::memory_order_relaxed;
+
+    // single writer: no read-modify-write atomic operation needed
+    h.count.store(h.count.load(relaxed) + 1, relaxed);
+    h.sum.store(h.sum.load(relaxed) + duration, relaxed);
+    if (duration < h.min.load(relaxed))
+        h.min.store(duration, relaxed);
+    if (duration > h.max.load(relaxed))
+        h.max.store(duration, relaxed);
+
+    std::atomic<uint32_t>& bucket = h.buckets[bucketIndex(duration)];
+    bucket.store(bucket.load(relaxed) + 1, relaxed);
+}
+
+void Imx2dThreadProfile::accumulate(Imx2dHalCounters::Primitive primitive,
+                                    Imx2dProfiler::Stage stage, Histogram& acc)
+{
+    Histogram& h = histograms[primitive][stage];
+
+    acc.count += h.count.load();
+    acc.sum += h.sum.load();
+    acc.min = std::min(acc.min.load(), h.min.load());
+    acc.max = std::max(acc.max.load(), h.max.load());
+    for (int i = 0; i < Imx2dProfiler::BUCKETS_MAX; i++)
+        acc.buckets[i] += h.buckets[i].load();
+}
+
+void Imx2dThreadProfile::merge(Imx2dThreadProfile& profile)
+{
+    for (int p = 0; p < Imx2dHalCounters::PRIMITIVES_MAX; p++)
+        for (int s = 0; s < Imx2dProfiler::STAGES_MAX; s++)
+            profile.accumulate(static_cast<Imx2dHalCounters::Primitive>(p),
+                               static_cast<Imx2dProfiler::Stage>(s),
+                               histograms[p][s]);
+}
+
+void Imx2dThreadProfile::reset()
+{
+    for (int p = 0; p < Imx2dHalCounters::PRIMITIVES_MAX; p++)
+        for (int s = 0; s < Imx2dProfiler::STAGES_MAX; s++)
+        {
+            Histogram& h = histograms[p][s];
+            h.count = 0;
+            h.sum = 0;
+            h.min = UINT64_MAX;
+            h.max = 0;
+            for (int i = 0; i < Imx2dProfiler::BUCKETS_MAX; i++)
+                h.buckets[i] = 0;
+        }
+}
+
+/**
+@brief Owner of the calling thread profile, merged on thread exit
+*/
+class Imx2dThreadProfileSlot
+{
+public:
+    Imx2dThreadProfileSlot(Imx2dProfiler& _profiler) :
+        profiler(_profiler), profile(nullptr) {}
+
+    virtual ~Imx2dThreadProfileSlot()
+    {
+        if (profile)
+            profiler.unregisterThread(profile);
+    }
+
+    Imx2dThreadProfile* get()
+    {
+        if (!profile)
+        {
+            profile = new Imx2dThreadProfile();
+            profiler.registerThread(profile);
+        }
+        return profile;
+    }
+
+protected:
+    Imx2dProfiler& profiler;
+    Imx2dThreadProfile* profile;
+};
+
+Imx2dProfiler::Imx2dProfiler() : enabled(false),
+                                 retired(new Imx2dThreadProfile()) {}
+
+Imx2dProfiler::~Imx2dProfiler()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // profiles of threads still running are owned by their slot
+    threads.clear();
+    delete retired;
+    retired = nullptr;
+}
+
+void Imx2dProfiler::setEnabled(bool flag)
+{
+    enabled = flag;
+}
+
+void Imx2dProfiler::record(Imx2dHalCounters::Primitive primitive, Stage stage,
+                           uint64_t duration)
+{
+    static thread_local Imx2dThreadProfileSlot slot(*this);
+
+    IMX2D_Assert(primitive < Imx2dHalCounters::PRIMITIVES_MAX && stage < STAGES_MAX);
+    slot.get()->record(primitive, stage, duration);
+}
+
+Imx2dProfiler::Stats Imx2dProfiler::getStats(Imx2dHalCounters::Primitive primitive,
+                                             Stage stage)
+{
+    std::unique_ptr<Imx2dThreadProfile> acc(new Imx2dThreadProfile());
+    Stats stats = {};
+
+    IMX2D_Assert(primitive < Imx2dHalCounters::PRIMITIVES_MAX && stage < STAGES_MAX);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (auto it = threads.begin(); it != threads.end(); it++)
+            acc->merge(**it);
+        acc->merge(*retired);
+    }
+
+    Imx2dThreadProfile::Histogram h;
+    h.count = 0;
+    h.sum = 0;
+    h.min = UINT64_MAX;
+    h.max = 0;
+    for (int i = 0; i < BUCKETS_MAX; i++)
+        h.buckets[i] = 0;
+    acc->accumulate(primitive, stage, h);
+
+    stats.count = h.count;
+    if (stats.count == 0)
+        return stats;
+
+    stats.sum = h.sum;
+    stats.min = h.min;
+    stats.max = h.max;
+
+    // quantiles from the cumulative distribution, within recorded extrema
+    const double quantiles[] = { 0.50, 0.95, 0.99 };
+    uint64_t* values[] = { &stats.p50, &stats.p95, &stats.p99 };
+    for (int q = 0; q < 3; q++)
+    {
+        uint64_t rank = static_cast<uint64_t>(std::ceil(quantiles[q] * stats.count));
+        uint64_t cumulated = 0;
+        int i = 0;
+        for (; i < BUCKETS_MAX - 1; i++)
+        {
+            cumulated += h.buckets[i];
+            if (cumulated >= rank)
+                break;
+        }
+        *values[q] = std::min(std::max(Imx2dThreadProfile::bucketValue(i),
+                                       stats.min), stats.max);
+    }
+
+    return stats;
+}
+
+void Imx2dProfiler::reset()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for (auto it = threads.begin(); it != threads.end(); it++)
+        (*it)->reset();
+    retired->reset();
+}
+
+void Imx2dProfiler::registerThread(Imx2dThreadProfile* profile)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    threads.insert(profile);
+}
+
+void Imx2dProfiler::unregisterThread(Imx2dThreadProfile* profile)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (threads.erase(profile) && retired)
+            retired->merge(*profile);
+    }
+    delete profile;
+}
+
+
+//================================= Imx2dHal ====================================
+
+/**
+@brief Per-thread G2D contexts, one per engine
+
+Contexts are used and closed by the owner thread only. Disabling the HAL
+bumps the contexts generation: contexts opened under a previous generation
+are closed and reopened on the next get() from their thread.
+*/
+class Imx2dThreadContexts
+{
+public:
+    Imx2dThreadContexts(Imx2dHal& _hal) : hal(_hal), handles(),
+                                          generation(_hal.getContextsGeneration()) {}
+
+    virtual ~Imx2dThreadContexts()
+    {
+        close();
+    }
+
+    void* get(int engine);
+    void close();
+
+protected:
+    Imx2dHal& hal;
+    // indexed by engine, default engine context in its own slot
+    static const int DEFAULT_CONTEXT = Imx2dHal::ENGINES_MAX;
+    void* handles[Imx2dHal::ENGINES_MAX + 1];
+    // HAL contexts generation handles were opened in
+    unsigned generation;
+};
+
+/*
+ Contexts are only accessed by their owner thread, no lock needed. Contexts
+ opened before HAL was disabled are closed here rather than by the disabling
+ thread, which can not know whether blits are in progress on them.
+*/
+void* Imx2dThreadContexts::get(int engine)
+{
+    void* handle;
+    int ret;
+
+    unsigned current = hal.getContextsGeneration();
+    if (generation != current)
+    {
+        close();
+        generation = current;
+    }
+
+    int idx = (engine < 0) ? DEFAULT_CONTEXT : engine;
+    if (handles[idx])
+        return handles[idx];
+
+    ret = g2d_open(&handle);
+    if (ret != 0)
+    {
+        IMX2D_ERROR("%s g2d open failed (%d)", __func__, ret);
+        return nullptr;
+    }
+
+    if (engine >= 0)
+    {
+        ret = g2d_make_current(handle, static_cast<enum g2d_hardware_type>(engine));
+        if (ret != 0)
+        {
+            IMX2D_ERROR("%s g2d engine %d selection failed (%d)", __func__,
+                        engine, ret);
+            g2d_close(handle);
+            return nullptr;
+        }
+    }
+
+    handles[idx] = handle;
+    return handle;
+}
+
+void Imx2dThreadContexts::close()
+{
+    int ret;
+
+    for (int i = 0; i <= DEFAULT_CONTEXT; i++)
+    {
+        if (!handles[i])
+            continue;
+
+        ret = g2d_finish(handles[i]);
+        if (ret != 0)
+            IMX2D_ERROR("%s g2d completion failed (%d)", __func__, ret);
+        ret = g2d_close(handles[i]);
+        if (ret != 0)
+            IMX2D_ERROR("%s g2d close failed (%d)", __func__, ret);
+        handles[i] = nullptr;
+    }
+}
+
+Imx2dHal::Imx2dHal(): enabled(false), g2dHandle(nullptr),
+                      engines(std::make_shared<const std::vector<int>>()),
+                      engineLoad(), contextsGeneration(0) {}
+
+Imx2dHal::~Imx2dHal() {}
+
+void Imx2dHal::setEnable(bool flag)
+{
+    int ret;
+    Imx2dGAllocator& gAllocator = Imx2dGAllocator::getInstance();
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (flag == enabled)
+        return;
+    enabled = flag;
+
+    if (flag)
+    {
+        IMX2D_Assert(hwCapabilities.hasSupport());
+
+        ret = g2d_open(&g2dHandle);
+        IMX2D_Assert(ret == 0);
+
+        detectEngines();
+        gAllocator.enable();
+    }
+    else
+    {
+        // threads close their contexts on next access, or on exit
+        contextsGeneration++;
+
+        ret = g2d_close(g2dHandle);
+        IMX2D_Assert(ret == 0);
+        g2dHandle = nullptr;
+
+        Imx2dScratchArena::getInstance().drain();
+        gAllocator.disable();
+    }
+}
+
+bool Imx2dHal::isEnabled()
+{
+    return enabled;
+}
+
+HardwareCapabilities& Imx2dHal::getHardwareCapabilities()
+{
+    return hwCapabilities;
+}
+
+void* Imx2dHal::getG2dHandle()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    IMX2D_Assert(enabled);
+    return g2dHandle;
+}
+
+void Imx2dHal::detectEngines()
+{
+    // blit engines, 3 channels surfaces are supported by DPU only
+    const enum g2d_hardware_type types[] = {
+        G2D_HARDWARE_DPU, G2D_HARDWARE_2D, G2D_HARDWARE_PXP };
+    std::shared_ptr<std::vector<int>> detected = std::make_shared<std::vector<int>>();
+    int available;
+
+    for (auto type : types)
+    {
+        IMX2D_Assert(type < ENGINES_MAX);
+        available = 0;
+        if ((g2d_query_hardware(g2dHandle, type, &available) == 0) && available)
+            detected->push_back(type);
+    }
+
+    // no engine selection needed with a single engine
+    if (detected->size() < 2)
+        detected->clear();
+
+    // threads still scheduling blits keep the previous list
+    std::atomic_store(&engines, std::shared_ptr<const std::vector<int>>(detected));
+}
+
+std::shared_ptr<const std::vector<int>> Imx2dHal::getEngines()
+{
+    return std::atomic_load(&engines);
+}
+
+unsigned Imx2dHal::getContextsGeneration()
+{
+    return contextsGeneration;
+}
+
+Imx2dThreadContexts& Imx2dHal::getThreadContexts()
+{
+    static thread_local Imx2dThreadContexts contexts(*this);
+    return contexts;
+}
+
+void* Imx2dHal::getThreadG2dHandle(bool threeChannels, int& engine)
+{
+    std::shared_ptr<const std::vector<int>> types = getEngines();
+    engine = -1;
+
+    // least loaded engine able to process the blit
+    for (auto type : *types)
+    {
+        if (threeChannels && (type != G2D_HARDWARE_DPU))
+            continue;
+        if ((engine < 0) || (engineLoad[type] < engineLoad[engine]))
+            engine = type;
+    }
+
+    if (engine >= 0)
+        engineLoad[engine]++;
+
+    void* handle = getThreadContexts().get(engine);
+    if (!handle)
+        releaseEngine(engine);
+
+    return handle;
+}
+
+void Imx2dHal::releaseEngine(int engine)
+{
+    if (engine >= 0)
+        engineLoad[engine]--;
+}
+
+unsigned Imx2dHal::getNumberOfEngines()
+{
+    std::shared_ptr<const std::vector<int>> types = getEngines();
+    return types->empty() ? 1 : types->size();
+}
+
+Imx2dHal& Imx2dHal::getInstance()
+{
+    static Imx2dHal instance;
+    return instance;
+}
+
+
+//================================= Imx2dStream ====================================
+
+static thread_local Imx2dStream* currentStream = nullptr;
+
+Imx2dStream::Imx2dStream(): handles(), current(-1), submitted(0), completed(0)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // default context opened upfront to report failures on stream creation
+    (void) openNoLock(DEFAULT_CONTEXT);
+}
+
+Imx2dStream::~Imx2dStream()
+{
+    int ret;
+
+    ret = waitAll();
+    if (ret != 0)
+        IMX2D_ERROR("%s g2d completion failed (%d)", __func__, ret);
+
+    for (int i = 0; i <= DEFAULT_CONTEXT; i++)
+    {
+        if (!handles[i])
+            continue;
+
+        ret = g2d_close(handles[i]);
+        if (ret != 0)
+            IMX2D_ERROR("%s g2d close failed (%d)", __func__, ret);
+    }
+}
+
+void* Imx2dStream::openNoLock(int idx)
+{
+    void* handle;
+    int ret;
+
+    if (handles[idx])
+        return handles[idx];
+
+    ret = g2d_open(&handle);
+    if (ret != 0)
+    {
+        IMX2D_ERROR("%s g2d open failed (%d)", __func__, ret);
+        return nullptr;
+    }
+
+    if (idx != DEFAULT_CONTEXT)
+    {
+        ret = g2d_make_current(handle, static_cast<enum g2d_hardware_type>(idx));
+        if (ret != 0)
+        {
+            IMX2D_ERROR("%s g2d engine %d selection failed (%d)", __func__,
+                        idx, ret);
+            g2d_close(handle);
+            return nullptr;
+        }
+    }
+
+    handles[idx] = handle;
+    return handle;
+}
+
+// g2d_finish() waits for every blit flushed so far on the current context
+int Imx2dStream::finishNoLock()
+{
+    int ret;
+
+    if ((current < 0) || (completed == submitted))
+        return 0;
+
+    ret = g2d_finish(handles[current]);
+    if (ret == 0)
+        completed = submitted;
+
+    return ret;
+}
+
+bool Imx2dStream::isOpen()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return handles[DEFAULT_CONTEXT] != nullptr;
+}
+
+void* Imx2dStream::getG2dHandle(bool threeChannels)
+{
+    std::shared_ptr<const std::vector<int>> types =
+        Imx2dHal::getInstance().getEngines();
+    std::unique_lock<std::mutex> lock(mutex);
+    int idx = -1;
+
+    // same engine as previous blits whenever possible, to keep them pipelined
+    for (auto type : *types)
+    {
+        if (threeChannels && (type != G2D_HARDWARE_DPU))
+            continue;
+        if ((idx < 0) || (type == current))
+            idx = type;
+    }
+    if (idx < 0)
+        idx = DEFAULT_CONTEXT;
+
+    void* handle = openNoLock(idx);
+    if (!handle)
+        return nullptr;
+
+    // blits may depend on outputs of blits pending on the previous context
+    if ((current >= 0) && (current != idx))
+    {
+        int ret = finishNoLock();
+        if (ret != 0)
+        {
+            IMX2D_ERROR("%s g2d completion failed (%d)", __func__, ret);
+            return nullptr;
+        }
+    }
+    current = idx;
+
+    return handle;
+}
+
+int Imx2dStream::submit(uint64_t& seq)
+{
+    int ret;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    IMX2D_Assert(current >= 0);
+    ret = g2d_flush(handles[current]);
+    if (ret != 0)
+        return ret;
+
+    seq = ++submitted;
+    return 0;
+}
+
+int Imx2dStream::wait(uint64_t seq)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (seq <= completed)
+        return 0;
+
+    return finishNoLock();
+}
+
+int Imx2dStream::waitAll()
+{
+    return wait(getLastSubmission());
+}
+
+bool Imx2dStream::isComplete(uint64_t seq)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return (seq <= completed);
+}
+
+uint64_t Imx2dStream::getLastSubmission()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return submitted;
+}
+
+Imx2dStream* Imx2dStream::getCurrent()
+{
+    return currentStream;
+}
+
+void Imx2dStream::setCurrent(Imx2dStream* stream)
+{
+    currentStream = stream;
+}
+
+//================================= Imx2dScratchArena ====================================
+
+/**
+@brief Per-thread set of arena buffers
+
+Buffers are acquired and released by the owner thread only, the mutex
+(uncontended) protects against concurrent draining from another thread.
+*/
+class Imx2dScratchSlots
+{
+public:
+    Imx2dScratchSlots(Imx2dScratchArena& _arena) : arena(_arena)
+    {
+        for (unsigned i = 0; i < SLOTS; i++)
+            slots[i] = { nullptr, false };
+        arena.registerSlots(this);
+    }
+
+    virtual ~Imx2dScratchSlots()
+    {
+        arena.unregisterSlots(this);
+        try {
+            drain(); // can throw
+        } catch (const std::exception &e) {
+            std::cerr << "Exception: " << e.what() << std::endl;
+        }
+    }
+
+    struct g2d_buf* acquire(size_t size);
+    bool release(struct g2d_buf* buf);
+    size_t drain();
+
+protected:
+    struct Slot {
+        struct g2d_buf* buf;
+        bool busy;
+    };
+
+    // input and output intermediate buffers of one HAL call
+    static const unsigned SLOTS = 2;
+
+    size_t freeSlot(Slot& slot);
+
+    Imx2dScratchArena& arena;
+    std::mutex mutex;
+    Slot slots[SLOTS];
+};
+
+size_t Imx2dScratchSlots::freeSlot(Slot& slot)
+{
+    size_t size = slot.buf->buf_size;
+    int ret;
+
+    arena.usage -= size;
+    ret = g2d_free(slot.buf);
+    IMX2D_Assert(ret == 0);
+    slot.buf = nullptr;
+
+    return size;
+}
+
+struct g2d_buf* Imx2dScratchSlots::acquire(size_t size)
+{
+    Slot* match = nullptr;
+    Slot* idle = nullptr;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for (unsigned i = 0; i < SLOTS; i++)
+    {
+        Slot& slot = slots[i];
+        if (slot.busy)
+            continue;
+
+        if (slot.buf && ((size_t)slot.buf->buf_size >= size))
+        {
+            // smallest idle buffer fitting the request
+            if (!match || (match->buf->buf_size > slot.buf->buf_size))
+                match = &slot;
+        }
+        else if (!idle || (idle->buf && (!slot.buf ||
+                           (idle->buf->buf_size > slot.buf->buf_size))))
+        {
+            // empty or smallest idle buffer to be grown
+            idle = &slot;
+        }
+    }
+
+    if (!match)
+    {
+        if (!idle)
+            return nullptr;
+
+        if (idle->buf)
+            freeSlot(*idle);
+
+        // slot held busy while unlocked: allocation may drain the arenas
+        idle->busy = true;
+        lock.unlock();
+        struct g2d_buf* buf =
+            Imx2dGAllocator::getInstance().allocBuffer(size, true);
+        lock.lock();
+
+        idle->buf = buf;
+        if (!idle->buf)
+        {
+            idle->busy = false;
+            return nullptr;
+        }
+        arena.usage += idle->buf->buf_size;
+        match = idle;
+
+        CACHE_LOG("%s sz:%zu va:%p u:%zu (scratch grown)",
+                  __func__, size, match->buf->buf_vaddr, arena.usage.load());
+    }
+
+    match->busy = true;
+    return match->buf;
+}
+
+bool Imx2dScratchSlots::release(struct g2d_buf* buf)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for (unsigned i = 0; i < SLOTS; i++)
+    {
+        if (slots[i].busy && (slots[i].buf == buf))
+        {
+            slots[i].busy = false;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+size_t Imx2dScratchSlots::drain()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t freed = 0;
+
+    for (unsigned i = 0; i < SLOTS; i++)
+        if (!slots[i].busy && slots[i].buf)
+            freed += freeSlot(slots[i]);
+
+    return freed;
+}
+
+Imx2dScratchArena::Imx2dScratchArena() : usage(0) {}
+
+Imx2dScratchArena::~Imx2dScratchArena() {}
+
+Imx2dScratchArena& Imx2dScratchArena::getInstance()
+{
+    static Imx2dScratchArena instance;
     return instance;
 }
 
+Imx2dScratchSlots& Imx2dScratchArena::getThreadSlots()
+{
+    static thread_local Imx2dScratchSlots slots(*this);
+    return slots;
+}
+
+void Imx2dScratchArena::registerSlots(Imx2dScratchSlots* slots)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    slotsSet.insert(slots);
+}
+
+void Imx2dScratchArena::unregisterSlots(Imx2dScratchSlots* slots)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    slotsSet.erase(slots);
+}
+
+struct g2d_buf* Imx2dScratchArena::acquire(size_t size)
+{
+    if (size > BUF_SIZE_MAX)
+        return nullptr;
+
+    return getThreadSlots().acquire(size);
+}
+
+bool Imx2dScratchArena::release(struct g2d_buf* buf)
+{
+    return getThreadSlots().release(buf);
+}
+
+size_t Imx2dScratchArena::drain()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t freed = 0;
+
+    for (auto it = slotsSet.begin(); it != slotsSet.end(); it++)
+        freed += (*it)->drain();
+
+    return freed;
+}
+
+size_t Imx2dScratchArena::getUsage()
+{
+    return usage;
+}
+
 }} // cv::imx2d::
@@ -18,6 +18,24 @@
 #include "opencv2/core/hal/interface.h"
 
 
+/**
+ Record CPU accesses to graphic buffers when a primitive falls back onto the
+ software implementation, for buffers cache coherency tracking.
+*/
+void imx2d_cpu_fallback(const uchar *src_data, const uchar *dst_data);
+
+/**
+ Update 3 channels graphic buffer content from its 4 channels shadow before CPU
+ access. Shadow becomes stale on CPU write access.
+*/
+void imx2d_shadow_sync(const uchar *data, bool write);
+
+/**
+ Update graphic buffers content from their shadow, then release shadows.
+*/
+void imx2d_shadow_release_all();
+
+
 #undef  cv_hal_resize
 #define cv_hal_resize __imx2d_resize
 
@@ -35,6 +53,9 @@ inline int __imx2d_resize(int src_type, const uchar *src_data, size_t src_step,
                     dst_data, dst_step, dst_width, dst_height,
                     inv_scale_x, inv_scale_y, interpolation);
 
+    if (ret != CV_HAL_ERROR_OK)
+        imx2d_cpu_fallback(src_data, dst_data);
+
 #ifdef TEGRA_RESIZE
     if (ret == CV_HAL_ERROR_NOT_IMPLEMENTED)
         ret = TEGRA_RESIZE(src_type, src_data, src_step, src_width, src_height,
@@ -77,6 +98,9 @@ inline int __imx2d_flip(int src_type, const uchar* src_data, size_t src_step,
                      src_width, src_height,
                      dst_data, dst_step, flip_type);
 
+    if (ret != CV_HAL_ERROR_OK)
+        imx2d_cpu_fallback(src_data, dst_data);
+
     return ret;
 }
 
@@ -114,8 +138,188 @@ inline int __imx2d_rotate(int src_type, const uchar* src_data, size_t src_step,
                        src_width, src_height,
                        dst_data, dst_step, type);
 
+    if (ret != CV_HAL_ERROR_OK)
+        imx2d_cpu_fallback(src_data, dst_data);
+
+    return ret;
+}
+
+
+enum {
+    IMX2D_YUV_NV12,
+    IMX2D_YUV_NV21,
+    IMX2D_YUV_I420,
+    IMX2D_YUV_YV12,
+    IMX2D_YUV_YUYV,
+    IMX2D_YUV_YVYU,
+    IMX2D_YUV_UYVY,
+    IMX2D_YUV_VYUY,
+};
+
+/**
+ YUV to BGR(A) colour conversion. Luma plane is followed by chroma plane(s)
+ starting at uv_data: interleaved chroma for semi-planar formats, U (V for YV12)
+ plane followed by the other chroma plane for planar formats. uv_data is unused
+ for packed formats.
+*/
+int imx2d_cvt_yuv_to_bgr(int yuv_format,
+                         const uchar* y_data, size_t y_step,
+                         const uchar* uv_data, size_t uv_step,
+                         uchar* dst_data, size_t dst_step,
+                         int width, int height, int dcn, bool swap_blue);
+
+
+#undef cv_hal_cvtTwoPlaneYUVtoBGR
+#define cv_hal_cvtTwoPlaneYUVtoBGR __imx2d_cvtTwoPlaneYUVtoBGR
+
+inline int __imx2d_cvtTwoPlaneYUVtoBGR(const uchar* src_data, size_t src_step,
+                                       uchar* dst_data, size_t dst_step,
+                                       int dst_width, int dst_height,
+                                       int dcn, bool swapBlue, int uIdx)
+{
+    int ret;
+    const uchar* uv_data = src_data + src_step * static_cast<size_t>(dst_height);
+
+    ret = imx2d_cvt_yuv_to_bgr(uIdx ? IMX2D_YUV_NV21 : IMX2D_YUV_NV12,
+                               src_data, src_step, uv_data, src_step,
+                               dst_data, dst_step, dst_width, dst_height,
+                               dcn, swapBlue);
+
+    if (ret != CV_HAL_ERROR_OK)
+        imx2d_cpu_fallback(src_data, dst_data);
+
+    return ret;
+}
+
+
+#ifdef cv_hal_cvtTwoPlaneYUVtoBGREx
+#undef cv_hal_cvtTwoPlaneYUVtoBGREx
+#define cv_hal_cvtTwoPlaneYUVtoBGREx __imx2d_cvtTwoPlaneYUVtoBGREx
+
+inline int __imx2d_cvtTwoPlaneYUVtoBGREx(const uchar* y_data, size_t y_step,
+                                         const uchar* uv_data, size_t uv_step,
+                                         uchar* dst_data, size_t dst_step,
+                                         int dst_width, int dst_height,
+                                         int dcn, bool swapBlue, int uIdx)
+{
+    int ret;
+
+    ret = imx2d_cvt_yuv_to_bgr(uIdx ? IMX2D_YUV_NV21 : IMX2D_YUV_NV12,
+                               y_data, y_step, uv_data, uv_step,
+                               dst_data, dst_step, dst_width, dst_height,
+                               dcn, swapBlue);
+
+    if (ret != CV_HAL_ERROR_OK)
+    {
+        imx2d_cpu_fallback(y_data, dst_data);
+        imx2d_cpu_fallback(uv_data, nullptr);
+    }
+
     return ret;
 }
+#endif
+
+
+#undef cv_hal_cvtThreePlaneYUVtoBGR
+#define cv_hal_cvtThreePlaneYUVtoBGR __imx2d_cvtThreePlaneYUVtoBGR
+
+inline int __imx2d_cvtThreePlaneYUVtoBGR(const uchar* src_data, size_t src_step,
+                                         uchar* dst_data, size_t dst_step,
+                                         int dst_width, int dst_height,
+                                         int dcn, bool swapBlue, int uIdx)
+{
+    int ret;
+    const uchar* uv_data = src_data + src_step * static_cast<size_t>(dst_height);
+
+    ret = imx2d_cvt_yuv_to_bgr(uIdx ? IMX2D_YUV_YV12 : IMX2D_YUV_I420,
+                               src_data, src_step, uv_data, src_step / 2,
+                               dst_data, dst_step, dst_width, dst_height,
+                               dcn, swapBlue);
+
+    if (ret != CV_HAL_ERROR_OK)
+        imx2d_cpu_fallback(src_data, dst_data);
+
+    return ret;
+}
+
+
+#undef cv_hal_cvtOnePlaneYUVtoBGR
+#define cv_hal_cvtOnePlaneYUVtoBGR __imx2d_cvtOnePlaneYUVtoBGR
+
+inline int __imx2d_cvtOnePlaneYUVtoBGR(const uchar* src_data, size_t src_step,
+                                       uchar* dst_data, size_t dst_step,
+                                       int width, int height,
+                                       int dcn, bool swapBlue, int uIdx, int ycn)
+{
+    int ret, format;
+
+    // ycn: luma position in the 4 bytes macropixel, uIdx: U before V (0)
+    if (ycn == 0)
+        format = uIdx ? IMX2D_YUV_YVYU : IMX2D_YUV_YUYV;
+    else
+        format = uIdx ? IMX2D_YUV_VYUY : IMX2D_YUV_UYVY;
+
+    ret = imx2d_cvt_yuv_to_bgr(format, src_data, src_step, nullptr, 0,
+                               dst_data, dst_step, width, height,
+                               dcn, swapBlue);
+
+    if (ret != CV_HAL_ERROR_OK)
+        imx2d_cpu_fallback(src_data, dst_data);
+
+    return ret;
+}
+
+
+
+
+
+/**
+ Combined flip, rotation and scaling executed as a single 2D operation.
+ It is not an OpenCV HAL entry point: it is called by the imx2d module for
+ cv::imx2d::transform(). Flip is applied first, then rotation and scaling.
+*/
+int imx2d_transform(int src_type, const uchar* src_data, size_t src_step,
+                    int src_width, int src_height,
+                    uchar* dst_data, size_t dst_step, int dst_width, int dst_height,
+                    int flip_type, int rotate_type, int interpolation);
+
+
+/**
+ Resize of several regions of interest of a single source image, submitted at
+ once: source cache maintenance and blits completion are done once for the
+ batch. It is not an OpenCV HAL entry point: it is called by the imx2d module
+ for cv::imx2d::cropResizeBatch(). rois holds count (x, y, width, height)
+ rectangles, region i is resized to dst_data[i].
+*/
+int imx2d_crop_resize_batch(int src_type, const uchar* src_data, size_t src_step,
+                            int src_width, int src_height,
+                            const int* rois, int count,
+                            uchar* const* dst_data, const size_t* dst_step,
+                            int dst_width, int dst_height, int interpolation);
+
+
+/**
+ Fill of an image with a constant value (4 values in channels order), and copy
+ of an image to another one of the same size and type. Only graphic buffers
+ are processed. They are not OpenCV HAL entry points: they are called by the
+ imx2d module for cv::imx2d::setTo() and cv::imx2d::copyTo().
+*/
+int imx2d_fill(int type, uchar* data, size_t step, int width, int height,
+               const double* value);
 
+int imx2d_copy(int type, const uchar* src_data, size_t src_step,
+               uchar* dst_data, size_t dst_step, int width, int height);
 
 
+/**
+ Resize into a (x, y, width, height) rectangle of the output, the remaining
+ output area being filled with border_value (4 values in channels order).
+ It is not an OpenCV HAL entry point: it is called by the imx2d module for
+ cv::imx2d::resizeLetterbox().
+*/
+int imx2d_resize_letterbox(int src_type, const uchar* src_data, size_t src_step,
+                           int src_width, int src_height,
+                           uchar* dst_data, size_t dst_step,
+                           int dst_width, int dst_height,
+                           const int* rect, const double* border_value,
+                           int interpolation);
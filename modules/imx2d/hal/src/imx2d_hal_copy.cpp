@@ -0,0 +1,259 @@
+/*
+   Copyright 2023 NXP
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+//#define DEBUG
+
+#include <stdint.h>
+
+#include <algorithm>
+
+#include <opencv2/core/base.hpp>
+#include <opencv2/core/saturate.hpp>
+#include <opencv2/core/hal/interface.h>
+
+#include "imx2d_hal.hpp"
+#include "imx2d_hal_utils.hpp"
+#include "g2d.h"
+
+
+namespace cv {
+namespace imx2d {
+
+/**
+ Number of channels of the G2D surfaces used for a copy or a fill of a type
+ image, 0 if not supported. Grayscale images are processed as 4 channels
+ images of a quarter width, with no scaling involved bytes are kept as is.
+*/
+static int copy_surface_cn(int type, const uchar* data, size_t step, int width,
+                           Imx2dHalCounters::Reason& reason)
+{
+    int depth = CV_MAT_DEPTH(type);
+    int cn = CV_MAT_CN(type);
+
+    // integer matrixes only
+    if (depth != CV_8U) {
+        reason = Imx2dHalCounters::REASON_DEPTH;
+        return 0;
+    }
+
+    // no software CSC: CPU would be faster than emulation
+    if ((cn == 4) || ((cn == 3) && IMX2D_HW_SUPPORT_3CH()))
+        return cn;
+
+    if (cn == 1) {
+        if ((width % 4 == 0) && (step % 4 == 0) &&
+            (reinterpret_cast<uintptr_t>(data) % 4 == 0))
+            return 4;
+
+        reason = Imx2dHalCounters::REASON_FORMAT;
+        return 0;
+    }
+
+    reason = Imx2dHalCounters::REASON_CHANNELS;
+    return 0;
+}
+
+static int copy_failure(Imx2dHalCounters::Primitive primitive)
+{
+    (void) hal_fallback(primitive, Imx2dHalCounters::REASON_ERROR);
+    return CV_HAL_ERROR_UNKNOWN;
+}
+
+} // imx2d::
+} // cv::
+
+
+using namespace cv::imx2d;
+
+int imx2d_fill(int type, uchar* data, size_t step, int width, int height,
+               const double* value)
+{
+    int ret;
+    struct g2d_surface surface;
+    struct io_buffer dst, none = {};
+    struct io_cache_status cache_status = {};
+    struct g2d_context ctx;
+    int cn, surface_cn, clrcolor;
+    uint64_t pf_start;
+
+    Imx2dHal& imx2dHal = Imx2dHal::getInstance();
+    Imx2dHalCounters::Reason reason;
+
+    IMX2D_Assert(width > 0 && height > 0);
+
+    if (!imx2dHal.isEnabled())
+        return hal_fallback(Imx2dHalCounters::FILL, Imx2dHalCounters::REASON_DISABLED);
+
+    surface_cn = copy_surface_cn(type, data, step, width, reason);
+    if (surface_cn == 0)
+        return hal_fallback(Imx2dHalCounters::FILL, reason);
+
+    // system memory fills are not worth an intermediate copy
+    struct g2d_buf * dst_g2d_buf;
+    bool dst_cacheable;
+    (void) is_g2d_buffer(data, dst_g2d_buf, dst_cacheable);
+    if (dst_g2d_buf == nullptr)
+        return hal_fallback(Imx2dHalCounters::FILL, Imx2dHalCounters::REASON_BUFFERS);
+
+    cn = CV_MAT_CN(type);
+    if (!imx2dHal.dispatcher.useHardware(Imx2dHalCounters::FILL, cn, true,
+                                         static_cast<size_t>(width) * height))
+        return hal_fallback(Imx2dHalCounters::FILL, Imx2dHalCounters::REASON_DISPATCH);
+
+    dst = { .g2d_buf = dst_g2d_buf, .data = data, .step = step,
+            .width = (cn == 1) ? width / 4 : width, .height = height,
+            .cacheable = dst_cacheable, .scratch = false, .shadow = false };
+
+    // fill color as RGBA, grayscale value replicated on every byte
+    {
+        bool gray = (cn == 1);
+        int b = cv::saturate_cast<uchar>(value[0]);
+        int g = gray ? b : cv::saturate_cast<uchar>(value[1]);
+        int r = gray ? b : cv::saturate_cast<uchar>(value[2]);
+        int a = gray ? b : cv::saturate_cast<uchar>(value[3]);
+        clrcolor = r | (g << 8) | (b << 16) | (a << 24);
+    }
+
+    // content outside of the filled area may be held by the shadow
+    io_shadow_sync(dst.g2d_buf, true);
+
+    pf_start = profile_enter();
+    ret = io_cache_prepare_output(dst, surface_cn, cache_status.out_whole);
+    profile_exit(Imx2dHalCounters::FILL, Imx2dProfiler::STAGE_CACHE, pf_start);
+
+    if (ret != 0)
+        return copy_failure(Imx2dHalCounters::FILL);
+
+    g2d_surface_init(surface, surface_cn, dst.width, dst.height, dst.step,
+                     dst.g2d_buf, dst.data);
+
+    // channels order of the color is explicit for fills, unlike blits
+    surface.format = (surface_cn == 4) ? G2D_BGRA8888 : G2D_BGR888;
+    surface.clrcolor = clrcolor;
+
+    ret = g2d_context_get(ctx, surface_cn == 3);
+    if (ret != 0)
+        return copy_failure(Imx2dHalCounters::FILL);
+
+    pf_start = profile_enter();
+    ret = g2d_clear(ctx.handle, &surface);
+    if (ret == 0)
+        ret = g2d_context_submit(ctx, true);
+    g2d_context_put(ctx);
+    profile_exit(Imx2dHalCounters::FILL, Imx2dProfiler::STAGE_G2D, pf_start);
+
+    if (ret != 0)
+        return copy_failure(Imx2dHalCounters::FILL);
+
+    io_cache_complete(none, dst, cache_status);
+
+    imx2dHal.counters.incrementCount(Imx2dHalCounters::FILL);
+    hal_account(Imx2dHalCounters::FILL, nullptr, 0, dst, surface_cn);
+
+    return CV_HAL_ERROR_OK;
+}
+
+int imx2d_copy(int type, const uchar* src_data, size_t src_step,
+               uchar* dst_data, size_t dst_step, int width, int height)
+{
+    int ret;
+    struct g2d_surface in_surface, out_surface;
+    struct io_buffer src, dst;
+    struct io_cache_status cache_status;
+    struct g2d_context ctx;
+    int cn, surface_cn, surface_width;
+    uint64_t pf_start;
+
+    Imx2dHal& imx2dHal = Imx2dHal::getInstance();
+    Imx2dHalCounters::Reason reason;
+
+    IMX2D_Assert(width > 0 && height > 0);
+
+    if (!imx2dHal.isEnabled())
+        return hal_fallback(Imx2dHalCounters::COPY, Imx2dHalCounters::REASON_DISABLED);
+
+    surface_cn = copy_surface_cn(type, src_data, src_step, width, reason);
+    if ((surface_cn == 0) ||
+        (copy_surface_cn(type, dst_data, dst_step, width, reason) != surface_cn))
+        return hal_fallback(Imx2dHalCounters::COPY, reason);
+
+    // in place operation not supported
+    size_t src_sz = height * src_step;
+    size_t dst_sz = height * dst_step;
+    if (!((dst_data + dst_sz <= src_data) || (dst_data >= src_data + src_sz)))
+        return hal_fallback(Imx2dHalCounters::COPY, Imx2dHalCounters::REASON_IN_PLACE);
+
+    // system memory copies are not worth intermediate copies
+    struct g2d_buf * src_g2d_buf, * dst_g2d_buf;
+    bool src_cacheable, dst_cacheable;
+    (void) is_g2d_buffer(src_data, src_g2d_buf, src_cacheable);
+    (void) is_g2d_buffer(dst_data, dst_g2d_buf, dst_cacheable);
+    if ((src_g2d_buf == nullptr) || (dst_g2d_buf == nullptr))
+        return hal_fallback(Imx2dHalCounters::COPY, Imx2dHalCounters::REASON_BUFFERS);
+
+    cn = CV_MAT_CN(type);
+    if (!imx2dHal.dispatcher.useHardware(Imx2dHalCounters::COPY, cn, true,
+                                         static_cast<size_t>(width) * height))
+        return hal_fallback(Imx2dHalCounters::COPY, Imx2dHalCounters::REASON_DISPATCH);
+
+    surface_width = (cn == 1) ? width / 4 : width;
+
+    src = { .g2d_buf = src_g2d_buf, .data = const_cast<void *>(static_cast<const void *>(src_data)), .step = src_step,
+            .width = surface_width, .height = height, .cacheable = src_cacheable,
+            .scratch = false, .shadow = false };
+
+    dst = { .g2d_buf = dst_g2d_buf, .data = dst_data, .step = dst_step,
+            .width = surface_width, .height = height, .cacheable = dst_cacheable,
+            .scratch = false, .shadow = false };
+
+    // buffers content is copied, not their shadow
+    io_shadow_sync(src.g2d_buf, false);
+    io_shadow_sync(dst.g2d_buf, true);
+
+    pf_start = profile_enter();
+    ret = io_cache_prepare(src, dst, surface_cn, cache_status);
+    profile_exit(Imx2dHalCounters::COPY, Imx2dProfiler::STAGE_CACHE, pf_start);
+
+    if (ret != 0)
+        return copy_failure(Imx2dHalCounters::COPY);
+
+    g2d_surface_init(in_surface, surface_cn, src.width, src.height, src.step,
+                     src.g2d_buf, src.data);
+
+    g2d_surface_init(out_surface, surface_cn, dst.width, dst.height, dst.step,
+                     dst.g2d_buf, dst.data);
+
+    ret = g2d_context_get(ctx, surface_cn == 3);
+    if (ret != 0)
+        return copy_failure(Imx2dHalCounters::COPY);
+
+    pf_start = profile_enter();
+    ret = g2d_blit(ctx.handle, &in_surface, &out_surface);
+    if (ret == 0)
+        ret = g2d_context_submit(ctx, true);
+    g2d_context_put(ctx);
+    profile_exit(Imx2dHalCounters::COPY, Imx2dProfiler::STAGE_G2D, pf_start);
+
+    if (ret != 0)
+        return copy_failure(Imx2dHalCounters::COPY);
+
+    io_cache_complete(src, dst, cache_status);
+
+    imx2dHal.counters.incrementCount(Imx2dHalCounters::COPY);
+    hal_account(Imx2dHalCounters::COPY, &src, surface_cn, dst, surface_cn);
+
+    return CV_HAL_ERROR_OK;
+}
@@ -0,0 +1,218 @@
+/*
+   Copyright 2023 NXP
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <string.h>
+
+#include <opencv2/core/base.hpp>
+#include <opencv2/core/utility.hpp> // cv::parallel_for_()
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "imx2d_hal_utils.hpp"
+
+
+namespace cv {
+namespace imx2d {
+
+/**
+ Bytes of destination processed per parallel band, small frames are converted
+ by the calling thread only.
+*/
+#define CSC_BAND_BYTES (256 * 1024)
+
+static void bgr_to_bgra_row(const uchar* src, uchar* dst, int width)
+{
+    int x = 0;
+
+#if defined(__ARM_NEON)
+    uint8x16x4_t v4;
+    v4.val[3] = vdupq_n_u8(0xff);
+    for (; x <= width - 16; x += 16, src += 48, dst += 64)
+    {
+        uint8x16x3_t v3 = vld3q_u8(src);
+        v4.val[0] = v3.val[0];
+        v4.val[1] = v3.val[1];
+        v4.val[2] = v3.val[2];
+        vst4q_u8(dst, v4);
+    }
+#endif
+
+    for (; x < width; x++, src += 3, dst += 4)
+    {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = 0xff;
+    }
+}
+
+static void bgra_to_bgr_row(const uchar* src, uchar* dst, int width)
+{
+    int x = 0;
+
+#if defined(__ARM_NEON)
+    for (; x <= width - 16; x += 16, src += 64, dst += 48)
+    {
+        uint8x16x4_t v4 = vld4q_u8(src);
+        uint8x16x3_t v3;
+        v3.val[0] = v4.val[0];
+        v3.val[1] = v4.val[1];
+        v3.val[2] = v4.val[2];
+        vst3q_u8(dst, v3);
+    }
+#endif
+
+    for (; x < width; x++, src += 4, dst += 3)
+    {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+    }
+}
+
+static void gray_to_bgra_row(const uchar* src, uchar* dst, int width)
+{
+    int x = 0;
+
+#if defined(__ARM_NEON)
+    uint8x16x4_t v4;
+    v4.val[3] = vdupq_n_u8(0xff);
+    for (; x <= width - 16; x += 16, src += 16, dst += 64)
+    {
+        uint8x16_t v = vld1q_u8(src);
+        v4.val[0] = v;
+        v4.val[1] = v;
+        v4.val[2] = v;
+        vst4q_u8(dst, v4);
+    }
+#endif
+
+    for (; x < width; x++, src += 1, dst += 4)
+    {
+        dst[0] = src[0];
+        dst[1] = src[0];
+        dst[2] = src[0];
+        dst[3] = 0xff;
+    }
+}
+
+static void bgra_to_gray_row(const uchar* src, uchar* dst, int width)
+{
+    int x = 0;
+
+#if defined(__ARM_NEON)
+    for (; x <= width - 16; x += 16, src += 64, dst += 16)
+    {
+        uint8x16x4_t v4 = vld4q_u8(src);
+        vst1q_u8(dst, v4.val[0]);
+    }
+#endif
+
+    for (; x < width; x++, src += 4, dst += 1)
+        dst[0] = src[0];
+}
+
+typedef void (*csc_row_fn)(const uchar* src, uchar* dst, int width);
+
+static void csc_run(csc_row_fn fn,
+                    const uchar* src, size_t src_step,
+                    uchar* dst, size_t dst_step,
+                    int width, int height, int dst_cn)
+{
+    size_t bytes = static_cast<size_t>(width) * height * dst_cn;
+    double nstripes = static_cast<double>(bytes / CSC_BAND_BYTES);
+
+    auto rows = [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; y++)
+            fn(src + y * src_step, dst + y * dst_step, width);
+    };
+
+    if (nstripes <= 1.)
+        rows(cv::Range(0, height));
+    else
+        cv::parallel_for_(cv::Range(0, height), rows, nstripes);
+}
+
+void csc_bgr_to_bgra(const uchar* src, size_t src_step,
+                     uchar* dst, size_t dst_step, int width, int height)
+{
+    csc_run(bgr_to_bgra_row, src, src_step, dst, dst_step, width, height, 4);
+}
+
+void csc_bgra_to_bgr(const uchar* src, size_t src_step,
+                     uchar* dst, size_t dst_step, int width, int height)
+{
+    csc_run(bgra_to_bgr_row, src, src_step, dst, dst_step, width, height, 3);
+}
+
+void csc_gray_to_bgra(const uchar* src, size_t src_step,
+                      uchar* dst, size_t dst_step, int width, int height)
+{
+    csc_run(gray_to_bgra_row, src, src_step, dst, dst_step, width, height, 4);
+}
+
+void csc_bgra_to_gray(const uchar* src, size_t src_step,
+                      uchar* dst, size_t dst_step, int width, int height)
+{
+    csc_run(bgra_to_gray_row, src, src_step, dst, dst_step, width, height, 1);
+}
+
+void csc_to_bgra(int src_cn, const uchar* src, size_t src_step,
+                 uchar* dst, size_t dst_step, int width, int height)
+{
+    if (src_cn == 1)
+        csc_gray_to_bgra(src, src_step, dst, dst_step, width, height);
+    else
+        csc_bgr_to_bgra(src, src_step, dst, dst_step, width, height);
+}
+
+void csc_from_bgra(int dst_cn, const uchar* src, size_t src_step,
+                   uchar* dst, size_t dst_step, int width, int height)
+{
+    if (dst_cn == 1)
+        csc_bgra_to_gray(src, src_step, dst, dst_step, width, height);
+    else
+        csc_bgra_to_bgr(src, src_step, dst, dst_step, width, height);
+}
+
+void io_copy_rows(const uchar* src, size_t src_step,
+                  uchar* dst, size_t dst_step, size_t row_bytes, int height)
+{
+    size_t bytes = row_bytes * height;
+    double nstripes = static_cast<double>(bytes / CSC_BAND_BYTES);
+
+    // contiguous frames are copied as a single block per band
+    bool contiguous = (src_step == row_bytes) && (dst_step == row_bytes);
+
+    auto rows = [&](const cv::Range& range) {
+        if (contiguous)
+            memcpy(dst + range.start * dst_step, src + range.start * src_step,
+                   (range.end - range.start) * row_bytes);
+        else
+            for (int y = range.start; y < range.end; y++)
+                memcpy(dst + y * dst_step, src + y * src_step, row_bytes);
+    };
+
+    if (nstripes <= 1.)
+        rows(cv::Range(0, height));
+    else
+        cv::parallel_for_(cv::Range(0, height), rows, nstripes);
+}
+
+} // imx2d::
+} // cv::
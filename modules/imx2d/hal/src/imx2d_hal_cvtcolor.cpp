@@ -0,0 +1,410 @@
+/*
+   Copyright 2023 NXP
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+//#define DEBUG
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <opencv2/core/base.hpp>
+#include <opencv2/core/hal/interface.h>
+#include <opencv2/core.hpp>
+
+#include "imx2d_hal.hpp"
+#include "imx2d_hal_utils.hpp"
+#include "g2d.h"
+
+
+namespace cv {
+namespace imx2d {
+
+/**
+ Memory layout of a YUV frame: luma plane rows followed by chroma planes rows,
+ rows of planar formats chroma planes are half the luma row size.
+*/
+struct yuv_layout {
+    enum g2d_format format;
+    HardwareCapabilities::Formats hw_format;
+    int planes;       // 1: packed, 2: semi-planar, 3: planar
+    size_t row_bytes; // luma row size
+    int rows;         // luma and chroma rows
+};
+
+static bool yuv_layout_get(int yuv_format, int width, int height,
+                           struct yuv_layout& l)
+{
+    switch (yuv_format)
+    {
+    case IMX2D_YUV_NV12:
+        l.format = G2D_NV12;
+        l.hw_format = HardwareCapabilities::FORMAT_NV12;
+        l.planes = 2;
+        break;
+    case IMX2D_YUV_NV21:
+        l.format = G2D_NV21;
+        l.hw_format = HardwareCapabilities::FORMAT_NV21;
+        l.planes = 2;
+        break;
+    case IMX2D_YUV_I420:
+    case IMX2D_YUV_YV12:
+        // chroma planes order set via planes addresses
+        l.format = G2D_I420;
+        l.hw_format = (yuv_format == IMX2D_YUV_I420) ?
+            HardwareCapabilities::FORMAT_I420 : HardwareCapabilities::FORMAT_YV12;
+        l.planes = 3;
+        break;
+    case IMX2D_YUV_YUYV:
+        l.format = G2D_YUYV;
+        l.hw_format = HardwareCapabilities::FORMAT_YUYV;
+        l.planes = 1;
+        break;
+    case IMX2D_YUV_YVYU:
+        l.format = G2D_YVYU;
+        l.hw_format = HardwareCapabilities::FORMAT_YVYU;
+        l.planes = 1;
+        break;
+    case IMX2D_YUV_UYVY:
+        l.format = G2D_UYVY;
+        l.hw_format = HardwareCapabilities::FORMAT_UYVY;
+        l.planes = 1;
+        break;
+    case IMX2D_YUV_VYUY:
+        l.format = G2D_VYUY;
+        l.hw_format = HardwareCapabilities::FORMAT_VYUY;
+        l.planes = 1;
+        break;
+    default:
+        return false;
+    }
+
+    l.row_bytes = (l.planes == 1) ? width * 2 : width;
+    l.rows = (l.planes == 1) ? height : height + height / 2;
+
+    return true;
+}
+
+static bool is_cvt_yuv_supported(const struct yuv_layout& l,
+                                 size_t y_step, size_t uv_step,
+                                 int width, int height, int dcn,
+                                 Imx2dHalCounters::Reason& reason)
+{
+    reason = Imx2dHalCounters::REASON_FORMAT;
+
+    // 4:2:0 and 4:2:2 subsampling
+    if ((width % 2) || (height % 2))
+        return false;
+
+    if (dcn != 3 && dcn != 4) {
+        reason = Imx2dHalCounters::REASON_CHANNELS;
+        return false;
+    }
+
+    // formats supported by the engines
+    if (!IMX2D_HW_SUPPORT_FORMAT(l.hw_format))
+        return false;
+
+    // single stride for every plane of G2D surfaces
+    if ((l.planes == 2) && (uv_step != y_step))
+        return false;
+    if ((l.planes == 3) && (uv_step * 2 != y_step))
+        return false;
+
+    return true;
+}
+
+/**
+ YUV frame is processed in place if it is stored in a single graphic buffer,
+ with chroma planes following the luma plane.
+*/
+static bool is_yuv_in_place(const struct yuv_layout& l,
+                            const struct io_buffer& src, size_t src_step,
+                            const uchar* y_data, const uchar* uv_data,
+                            int height)
+{
+    if (src.g2d_buf == nullptr)
+        return false;
+
+    if ((l.planes > 1) && (uv_data != y_data + src_step * height))
+        return false;
+
+    size_t offset = static_cast<const uchar*>(src.data) -
+                    static_cast<const uchar*>(src.g2d_buf->buf_vaddr);
+    size_t size = (l.planes == 3) ? src_step * height * 3 / 2 :
+                                    src_step * l.rows;
+
+    return offset + size <= static_cast<size_t>(src.g2d_buf->buf_size);
+}
+
+/**
+ Copy YUV frame planes into a contiguous intermediate buffer.
+*/
+static void yuv_copy(const struct yuv_layout& l,
+                     const uchar* y_data, size_t y_step,
+                     const uchar* uv_data, size_t uv_step,
+                     int height, const struct io_buffer& in)
+{
+    uchar* dst = static_cast<uchar*>(in.data);
+    int y_rows = (l.planes == 1) ? l.rows : height;
+    int uv_rows = l.rows - y_rows;
+    size_t uv_bytes = (l.planes == 3) ? l.row_bytes / 2 : l.row_bytes;
+
+    io_copy_rows(y_data, y_step, dst, in.step, l.row_bytes, y_rows);
+    dst += y_rows * in.step;
+
+    // planar formats: 2 chroma rows per luma row size
+    if (l.planes == 3)
+        uv_rows *= 2;
+    io_copy_rows(uv_data, uv_step, dst, uv_bytes, uv_bytes, uv_rows);
+}
+
+static void g2d_surface_init_yuv(g2d_surface& s, const struct yuv_layout& l,
+                                 int yuv_format, int width, int height,
+                                 const struct io_buffer& in)
+{
+    long paddr = in.g2d_buf->buf_paddr +
+                 (static_cast<char*>(in.data) -
+                  static_cast<char*>(in.g2d_buf->buf_vaddr));
+    long chroma = paddr + in.step * height;
+
+    s.planes[0] = paddr;
+    s.planes[1] = chroma;
+    s.planes[2] = chroma + (in.step / 2) * (height / 2);
+
+    // G2D_I420 surface with V plane first
+    if (yuv_format == IMX2D_YUV_YV12)
+        std::swap(s.planes[1], s.planes[2]);
+
+    s.format = l.format;
+
+    s.top = 0;
+    s.bottom = height;
+    s.left = 0;
+    s.right = width;
+
+    // stride in pixels: 2 bytes per pixel for packed formats
+    s.stride = (l.planes == 1) ? in.step / 2 : in.step;
+    s.width = s.stride;
+    s.height = height;
+
+    s.rot = G2D_ROTATION_0;
+
+    s.blendfunc = G2D_ZERO;
+    s.global_alpha = 0;
+    s.clrcolor = 0;
+}
+
+} // imx2d::
+} // cv::
+
+
+using namespace cv::imx2d;
+
+int imx2d_cvt_yuv_to_bgr(int yuv_format,
+                         const uchar* y_data, size_t y_step,
+                         const uchar* uv_data, size_t uv_step,
+                         uchar* dst_data, size_t dst_step,
+                         int width, int height, int dcn, bool swap_blue)
+{
+    int ret;
+    struct yuv_layout layout;
+    struct g2d_surface in_surface, out_surface;
+    struct io_buffer src, dst, in, out;
+    struct io_cache_status cache_status;
+    struct g2d_context ctx;
+    bool csc, in_copy, out_copy, scratch;
+    int out_cn;
+    uint64_t pf_start;
+
+    Imx2dHal& imx2dHal = Imx2dHal::getInstance();
+    Imx2dHalCounters::Reason reason;
+
+    IMX2D_Assert(width > 0 && height > 0);
+
+    if (!imx2dHal.isEnabled())
+        return hal_fallback(Imx2dHalCounters::CVT_COLOR, Imx2dHalCounters::REASON_DISABLED);
+
+    if (!yuv_layout_get(yuv_format, width, height, layout))
+        return hal_fallback(Imx2dHalCounters::CVT_COLOR, Imx2dHalCounters::REASON_FORMAT);
+
+    if (!is_cvt_yuv_supported(layout, y_step, uv_step, width, height, dcn, reason))
+        return hal_fallback(Imx2dHalCounters::CVT_COLOR, reason);
+
+    struct g2d_buf * src_g2d_buf, * dst_g2d_buf;
+    bool src_cacheable, dst_cacheable;
+    (void) is_g2d_buffer(y_data, src_g2d_buf, src_cacheable);
+    (void) is_g2d_buffer(dst_data, dst_g2d_buf, dst_cacheable);
+
+    // small images are processed faster by the software implementation
+    if (!imx2dHal.dispatcher.useHardware(Imx2dHalCounters::CVT_COLOR, dcn,
+                                         src_g2d_buf && dst_g2d_buf,
+                                         static_cast<size_t>(width) * height))
+        return hal_fallback(Imx2dHalCounters::CVT_COLOR, Imx2dHalCounters::REASON_DISPATCH);
+
+    // YUV frame described as rows of bytes
+    src = { .g2d_buf = src_g2d_buf, .data = const_cast<void *>(static_cast<const void *>(y_data)), .step = y_step,
+            .width = static_cast<int>(layout.row_bytes), .height = layout.rows, .cacheable = src_cacheable,
+            .scratch = false, .shadow = false };
+
+    dst = { .g2d_buf = dst_g2d_buf, .data = dst_data, .step = dst_step,
+            .width = width, .height = height, .cacheable = dst_cacheable,
+            .scratch = false, .shadow = false };
+
+    // 3 chans output via 4 chans software CSC if not supported by hardware
+    csc = (dcn == 3) && !IMX2D_HW_SUPPORT_3CH();
+    out_cn = csc ? 4 : dcn;
+
+    in_copy = !is_yuv_in_place(layout, src, y_step, y_data, uv_data, height);
+    out_copy = (dst_g2d_buf == nullptr);
+
+    in.g2d_buf = nullptr;
+    out.g2d_buf = nullptr;
+
+    pf_start = profile_enter();
+
+    // destination content is produced from YUV, not from its shadow
+    io_shadow_sync(dst.g2d_buf, true);
+
+    if (in_copy)
+    {
+        size_t in_size = (layout.planes == 3) ? layout.row_bytes * height * 3 / 2 :
+                                                layout.row_bytes * layout.rows;
+        struct g2d_buf *in_buf = io_alloc_intermediate(in_size, scratch);
+        if (in_buf == nullptr) {
+            ret = CV_HAL_ERROR_UNKNOWN;
+            goto error;
+        }
+
+        in = { .g2d_buf = in_buf, .data = in_buf->buf_vaddr, .step = layout.row_bytes,
+               .width = src.width, .height = src.height, .cacheable = true,
+               .scratch = scratch, .shadow = false };
+
+        io_cpu_access(src, false);
+        yuv_copy(layout, y_data, y_step, uv_data, uv_step, height, in);
+    }
+    else
+    {
+        in = src; // struct copy
+    }
+
+    if (out_copy || csc)
+    {
+        size_t out_stride = width * out_cn;
+        struct g2d_buf *out_buf = io_alloc_intermediate(height * out_stride, scratch);
+        if (out_buf == nullptr) {
+            ret = CV_HAL_ERROR_UNKNOWN;
+            goto error;
+        }
+
+        out = { .g2d_buf = out_buf, .data = out_buf->buf_vaddr, .step = out_stride,
+                .width = width, .height = height, .cacheable = true,
+                .scratch = scratch, .shadow = false };
+    }
+    else
+    {
+        out = dst; // struct copy
+    }
+
+    profile_exit(Imx2dHalCounters::CVT_COLOR, Imx2dProfiler::STAGE_PREPRO, pf_start);
+
+    pf_start = profile_enter();
+    ret = io_cache_prepare(in, 1, out, out_cn, cache_status);
+    profile_exit(Imx2dHalCounters::CVT_COLOR, Imx2dProfiler::STAGE_CACHE, pf_start);
+
+    if (ret != 0) {
+        ret = CV_HAL_ERROR_UNKNOWN;
+        goto error;
+    }
+
+    g2d_surface_init_yuv(in_surface, layout, yuv_format, width, height, in);
+
+    g2d_surface_init(out_surface, out_cn,
+                     out.width, out.height, out.step,
+                     out.g2d_buf, out.data);
+
+    // CSC output: G2D formats named after memory bytes order
+    if (out_cn == 4)
+        out_surface.format = swap_blue ? G2D_RGBA8888 : G2D_BGRA8888;
+    else
+        out_surface.format = swap_blue ? G2D_RGB888 : G2D_BGR888;
+
+    ret = g2d_context_get(ctx, out_cn == 3);
+    if (ret != 0) {
+        ret = CV_HAL_ERROR_UNKNOWN;
+        goto error;
+    }
+
+    // OpenCV conversion coefficients: BT.601 limited range, enabled for this
+    // blit only as the context is shared with every blit of the thread or
+    // stream
+    ret = g2d_enable(ctx.handle, G2D_YUV_BT_601);
+    if (ret != 0) {
+        g2d_context_put(ctx);
+        ret = hal_fallback(Imx2dHalCounters::CVT_COLOR, Imx2dHalCounters::REASON_FORMAT);
+        goto release;
+    }
+
+    pf_start = profile_enter();
+    ret = g2d_blit(ctx.handle, &in_surface, &out_surface);
+    if (ret == 0)
+        ret = g2d_context_submit(ctx, !in_copy && !out_copy && !csc);
+    // mode is sampled at blit time, submission may still be pending
+    if (g2d_disable(ctx.handle, G2D_YUV_BT_601) != 0)
+        IMX2D_ERROR("%s g2d BT.601 mode disable failed", __func__);
+    g2d_context_put(ctx);
+    profile_exit(Imx2dHalCounters::CVT_COLOR, Imx2dProfiler::STAGE_G2D, pf_start);
+
+    if (ret != 0) {
+        ret = CV_HAL_ERROR_UNKNOWN;
+        goto error;
+    }
+
+    io_cache_complete(in, out, cache_status);
+
+    pf_start = profile_enter();
+    if (out_copy || csc)
+    {
+        io_cpu_access(out, false);
+        io_cpu_access(dst, true);
+    }
+
+    if (csc) // implies copy
+    {
+        csc_bgra_to_bgr(static_cast<const uchar *>(out.data), out.step,
+                        dst_data, dst_step, width, height);
+    }
+    else if (out_copy)
+    {
+        io_copy_rows(static_cast<const uchar *>(out.data), out.step,
+                     dst_data, dst_step, static_cast<size_t>(width) * dcn, height);
+    }
+    profile_exit(Imx2dHalCounters::CVT_COLOR, Imx2dProfiler::STAGE_POSTPRO, pf_start);
+
+    imx2dHal.counters.incrementCount(Imx2dHalCounters::CVT_COLOR);
+    hal_account(Imx2dHalCounters::CVT_COLOR, &src, 1, dst, dcn);
+
+error:
+    if (ret != CV_HAL_ERROR_OK)
+        (void) hal_fallback(Imx2dHalCounters::CVT_COLOR, Imx2dHalCounters::REASON_ERROR);
+
+release:
+    if (in_copy && (in.g2d_buf != nullptr))
+        io_free_intermediate(in);
+    if ((out_copy || csc) && (out.g2d_buf != nullptr))
+        io_free_intermediate(out);
+
+    return ret;
+}
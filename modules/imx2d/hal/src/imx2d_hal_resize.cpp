@@ -16,7 +16,11 @@
 
 //#define DEBUG
 
+#include <algorithm>
+#include <vector>
+
 #include <opencv2/core/base.hpp>
+#include <opencv2/core/saturate.hpp>
 #include <opencv2/imgproc/hal/interface.h>
 #include <opencv2/imgproc.hpp> // cv::cvtColor()
 
@@ -24,160 +28,16 @@
 #include "imx2d_hal_utils.hpp"
 #include "g2d.h"
 
-#include "profiler.hpp"
-
 
 namespace cv {
 namespace imx2d {
 
-// profiling points
-//#define PF_ENABLED
-PF_ENTRY(resize_prepro);
-PF_ENTRY(resize_cache);
-PF_ENTRY(resize_g2d);
-PF_ENTRY(resize_postpro);
-
-
-static void io_release_intermediate_csc(
-                   const struct io_buffer& src,
-                   const struct io_buffer& dst,
-                   int src_type, int inout_type,
-                   const struct io_buffer& in,
-                   const struct io_buffer& out)
-{
-    // Mat buffers are not g2d allocated - need copy
-    bool in_copy = (src.g2d_buf == nullptr);
-    bool out_copy = (dst.g2d_buf == nullptr);
-
-    // 3 chans support may have been emulated via software CSC
-    bool csc = (src_type != inout_type);
-
-    // free intermediate g2d buffers if any
-    if ((in_copy || csc) && (in.g2d_buf != nullptr))
-        gfree(in.g2d_buf);
-    if ((out_copy || csc) && (out.g2d_buf != nullptr))
-        gfree(out.g2d_buf);
-}
-
-
-static int io_preprocess_csc(
-                   const struct io_buffer& src,
-                   const struct io_buffer& dst,
-                   int src_type, int &inout_type,
-                   struct io_buffer& in,
-                   struct io_buffer& out)
-{
-    // Mat buffers are not g2d allocated - need copy
-    bool in_copy = (src.g2d_buf == nullptr);
-    bool out_copy = (dst.g2d_buf == nullptr);
-    bool csc;
-    int csc_type;
-
-    int cn = CV_MAT_CN(src_type);
-    IMX2D_Assert((cn >= 3) || (cn <=4));
-
-    // 3 chans support via 4 chans software CSC if not supported by hardware
-    if ((cn == 3) && (!IMX2D_HW_SUPPORT_3CH()))
-    {
-        inout_type = CV_8UC4;
-        csc = true;
-        csc_type = cv::COLOR_BGR2BGRA;
-    } else {
-        inout_type = src_type;
-        csc = false;
-        csc_type = cv::COLOR_COLORCVT_MAX;
-    }
-
-    int inout_cn = CV_MAT_CN(inout_type);
-
-    cv::Mat msrc, min, mout;
-    bool inout_cacheable = true;
-
-    in.g2d_buf = nullptr;
-    out.g2d_buf = nullptr;
-
-    if (in_copy || csc)
-    {
-        msrc = cv::Mat(src.height, src.width, src_type, src.data, src.step); // no alloc
-
-        size_t in_stride = src.width * inout_cn;
-        struct g2d_buf *in_buf = galloc(src.height * in_stride, inout_cacheable);
-        if (in_buf == nullptr)
-            return CV_HAL_ERROR_UNKNOWN;
-
-        in = { .g2d_buf = in_buf, .data = static_cast<uchar *>(in_buf->buf_vaddr), .step = in_stride,
-               .width = src.width, .height = src.height, .cacheable = inout_cacheable };
-
-        min = cv::Mat(in.height, in.width, inout_type, in.data, in.step); // no alloc
-        if (csc) // implies copy
-            cv::cvtColor(msrc, min, csc_type);
-        else // copy only
-            msrc.copyTo(min);
-    }
-    else
-    {
-        in = src; // struct copy
-    }
-
-    if (out_copy || csc)
-    {
-        size_t out_stride = dst.width * inout_cn;
-        struct g2d_buf *out_buf = galloc(dst.height * out_stride, inout_cacheable);
-        if (out_buf == nullptr)
-            return CV_HAL_ERROR_UNKNOWN;
-
-        out = { .g2d_buf = out_buf, .data = static_cast<uchar *>(out_buf->buf_vaddr), .step = out_stride,
-               .width = dst.width, .height = dst.height, .cacheable = inout_cacheable };
-    }
-    else
-    {
-        out = dst; // struct copy
-    }
-
-    return CV_HAL_ERROR_OK;
-}
-
-static int io_postprocess_csc(
-                    const struct io_buffer& src,
-                    const struct io_buffer& dst,
-                    int src_type, int inout_type,
-                    const struct io_buffer& in,
-                    const struct io_buffer& out)
-{
-    bool out_copy = (dst.g2d_buf == nullptr);
-    bool csc;
-    int csc_type;
-    CV_UNUSED(src);
-    CV_UNUSED(in);
-
-    // 3 chans support may have been emulated via software CSC
-    if (src_type != inout_type)
-    {
-        IMX2D_Assert((src_type == CV_8UC3) && (inout_type == CV_8UC4));
-        csc = true;
-        csc_type = cv::COLOR_BGRA2BGR;
-    } else {
-        csc = false;
-        csc_type = cv::COLOR_COLORCVT_MAX;
-    }
-
-    cv::Mat mdst, mout;
-    mout = cv::Mat(out.height, out.width, inout_type, out.data, out.step); // no alloc
-    mdst = cv::Mat(dst.height, dst.width, src_type, dst.data, dst.step); // no alloc
-
-    if (csc) // implies copy
-        cv::cvtColor(mout, mdst, csc_type);
-    else if (out_copy) // copy only
-        mout.copyTo(mdst);
-
-    return CV_HAL_ERROR_OK;
-}
-
 static bool is_resize_supported(
                   int src_type, const uchar *src_data, size_t src_step,
                   int src_width, int src_height,
                   uchar *dst_data, size_t dst_step, int dst_width, int dst_height,
-                  double inv_scale_x, double inv_scale_y, int interpolation)
+                  double inv_scale_x, double inv_scale_y, int interpolation,
+                  Imx2dHalCounters::Reason& reason)
 {
     CV_UNUSED(src_data);
     CV_UNUSED(src_step);
@@ -194,20 +54,46 @@ static bool is_resize_supported(
     int cn = CV_MAT_CN(src_type);
     IMX2D_LOG("depth:%d cn:%d interpolation:%d", depth, cn, interpolation);
 
-    if (interpolation != CV_HAL_INTER_LINEAR)
+    // G2D has no filter selection: scaling is bilinear only
+    if (interpolation != CV_HAL_INTER_LINEAR) {
+        reason = Imx2dHalCounters::REASON_INTERPOLATION;
         return false;
+    }
 
     // integer matrixes only
-    if (depth != CV_8U)
+    if (depth != CV_8U) {
+        reason = Imx2dHalCounters::REASON_DEPTH;
         return false;
+    }
 
-    // 3 and 4 channels matrixes only
-    if (cn < 3 || cn > 4)
+    // 3 and 4 channels matrixes, grayscale via 4 channels emulation
+    if (cn != 1 && cn != 3 && cn != 4) {
+        reason = Imx2dHalCounters::REASON_CHANNELS;
         return false;
+    }
 
     return true;
 }
 
+// fill a rectangle of a 3 or 4 channels graphic buffer with a constant color
+static int clear_area(void* handle, const struct io_buffer& buf, int cn,
+                      int x, int y, int width, int height, int clrcolor)
+{
+    struct g2d_surface surface;
+
+    if ((width <= 0) || (height <= 0))
+        return 0;
+
+    uchar* data = static_cast<uchar *>(buf.data) + y * buf.step + x * cn;
+    g2d_surface_init(surface, cn, width, height, buf.step, buf.g2d_buf, data);
+
+    // channels order of the color is explicit for fills, unlike blits
+    surface.format = (cn == 4) ? G2D_BGRA8888 : G2D_BGR888;
+    surface.clrcolor = clrcolor;
+
+    return g2d_clear(handle, &surface);
+}
+
 } // imx2d::
 } // cv::
 
@@ -223,48 +109,56 @@ int imx2d_resize(int src_type, const uchar* src_data, size_t src_step,
     struct g2d_surface in_surface, out_surface;
     struct io_buffer src, dst, in, out;
     int inout_type;
-    void* handle;
+    struct io_cache_status cache_status;
+    struct g2d_context ctx;
+    bool deferrable;
+    uint64_t pf_start;
 
     Imx2dHal& imx2dHal = Imx2dHal::getInstance();
+    Imx2dHalCounters::Reason reason;
 
     IMX2D_Assert(dst_width > 0 && dst_height > 0);
 
     if (!imx2dHal.isEnabled())
-        return CV_HAL_ERROR_NOT_IMPLEMENTED;
+        return hal_fallback(Imx2dHalCounters::RESIZE, Imx2dHalCounters::REASON_DISABLED);
 
     if (!is_resize_supported(src_type, src_data, src_step,
                              src_width, src_height,
                              dst_data, dst_step, dst_width, dst_height,
-                             inv_scale_x, inv_scale_y, interpolation))
-        return CV_HAL_ERROR_NOT_IMPLEMENTED;
+                             inv_scale_x, inv_scale_y, interpolation, reason))
+        return hal_fallback(Imx2dHalCounters::RESIZE, reason);
 
     struct g2d_buf * src_g2d_buf, * dst_g2d_buf;
     bool src_cacheable, dst_cacheable;
     (void) is_g2d_buffer(src_data, src_g2d_buf, src_cacheable);
     (void) is_g2d_buffer(dst_data, dst_g2d_buf, dst_cacheable);
 
+    // small images are processed faster by the software implementation
+    size_t pixels = std::max(static_cast<size_t>(src_width) * src_height,
+                             static_cast<size_t>(dst_width) * dst_height);
+    if (!imx2dHal.dispatcher.useHardware(Imx2dHalCounters::RESIZE,
+                                         CV_MAT_CN(src_type),
+                                         src_g2d_buf && dst_g2d_buf, pixels))
+        return hal_fallback(Imx2dHalCounters::RESIZE, Imx2dHalCounters::REASON_DISPATCH);
+
     src = { .g2d_buf = src_g2d_buf, .data = const_cast<void *>(static_cast<const void *>(src_data)), .step = src_step,
-            .width = src_width, .height = src_height, .cacheable = src_cacheable };
+            .width = src_width, .height = src_height, .cacheable = src_cacheable,
+            .scratch = false, .shadow = false };
 
     dst = { .g2d_buf = dst_g2d_buf, .data = dst_data, .step = dst_step,
-            .width = dst_width, .height = dst_height, .cacheable = dst_cacheable };
+            .width = dst_width, .height = dst_height, .cacheable = dst_cacheable,
+            .scratch = false, .shadow = false };
 
-    PF_ENTER(resize_prepro);
-    ret = io_preprocess_csc(src, dst, src_type, inout_type, in, out);
-    PF_EXIT(resize_prepro);
+    pf_start = profile_enter();
+    ret = io_preprocess(src, dst, src_type, inout_type, in, out);
+    profile_exit(Imx2dHalCounters::RESIZE, Imx2dProfiler::STAGE_PREPRO, pf_start);
 
     if (ret != CV_HAL_ERROR_OK)
         goto error;
 
-    PF_ENTER(resize_cache);
-    if (in.cacheable)
-        ret = g2d_cache_clean(in.g2d_buf);
-    else
-        ret = 0;
-
-    if ((ret == 0) && (out.cacheable))
-        ret = g2d_cache_invalidate(out.g2d_buf);
-    PF_EXIT(resize_cache);
+    pf_start = profile_enter();
+    ret = io_cache_prepare(in, out, CV_ELEM_SIZE(inout_type), cache_status);
+    profile_exit(Imx2dHalCounters::RESIZE, Imx2dProfiler::STAGE_CACHE, pf_start);
 
     if (ret != 0) {
         ret = CV_HAL_ERROR_UNKNOWN;
@@ -279,28 +173,367 @@ int imx2d_resize(int src_type, const uchar* src_data, size_t src_step,
                      out.width, out.height, out.step,
                      out.g2d_buf, out.data);
 
-    handle = imx2dHal.getG2dHandle();
+    ret = g2d_context_get(ctx, CV_MAT_CN(inout_type) == 3);
+    if (ret != 0) {
+        ret = CV_HAL_ERROR_UNKNOWN;
+        goto error;
+    }
 
-    PF_ENTER(resize_g2d);
-    ret = g2d_blit(handle, &in_surface, &out_surface);
+    // completion may be deferred when no intermediate buffer is involved
+    deferrable = (in.g2d_buf == src.g2d_buf) && (out.g2d_buf == dst.g2d_buf);
+
+    pf_start = profile_enter();
+    ret = g2d_blit(ctx.handle, &in_surface, &out_surface);
     if (ret == 0)
-        ret = g2d_finish(handle);
-    PF_EXIT(resize_g2d);
+        ret = g2d_context_submit(ctx, deferrable);
+    g2d_context_put(ctx);
+    profile_exit(Imx2dHalCounters::RESIZE, Imx2dProfiler::STAGE_G2D, pf_start);
 
     if (ret != 0) {
         ret = CV_HAL_ERROR_UNKNOWN;
         goto error;
     }
 
-    PF_ENTER(resize_postpro);
-    ret = io_postprocess_csc(src, dst, src_type, inout_type, in, out);
-    PF_EXIT(resize_postpro);
+    io_cache_complete(in, out, cache_status);
 
-    if (ret == CV_HAL_ERROR_OK)
+    pf_start = profile_enter();
+    ret = io_postprocess(src, dst, src_type, inout_type, in, out);
+    profile_exit(Imx2dHalCounters::RESIZE, Imx2dProfiler::STAGE_POSTPRO, pf_start);
+
+    if (ret == CV_HAL_ERROR_OK) {
         imx2dHal.counters.incrementCount(Imx2dHalCounters::RESIZE);
+        hal_account(Imx2dHalCounters::RESIZE, &src, CV_ELEM_SIZE(src_type),
+                    dst, CV_ELEM_SIZE(src_type));
+    }
 
 error:
-    io_release_intermediate_csc(src, dst, src_type, inout_type, in, out);
+    if (ret != CV_HAL_ERROR_OK)
+        (void) hal_fallback(Imx2dHalCounters::RESIZE, Imx2dHalCounters::REASON_ERROR);
+
+    io_release_intermediate(src, dst, src_type, inout_type, in, out);
+
+    return ret;
+}
+
+int imx2d_resize_letterbox(int src_type, const uchar* src_data, size_t src_step,
+                           int src_width, int src_height,
+                           uchar* dst_data, size_t dst_step,
+                           int dst_width, int dst_height,
+                           const int* rect, const double* border_value,
+                           int interpolation)
+{
+    int ret;
+    struct g2d_surface in_surface, out_surface;
+    struct io_buffer src, dst, in, out;
+    int inout_type, inout_cn, clrcolor;
+    struct io_cache_status cache_status;
+    struct g2d_context ctx;
+    bool deferrable;
+    uint64_t pf_start;
+
+    Imx2dHal& imx2dHal = Imx2dHal::getInstance();
+    Imx2dHalCounters::Reason reason;
+
+    IMX2D_Assert(dst_width > 0 && dst_height > 0);
+    IMX2D_Assert(rect[2] > 0 && rect[3] > 0);
+    IMX2D_Assert(rect[0] >= 0 && rect[0] + rect[2] <= dst_width);
+    IMX2D_Assert(rect[1] >= 0 && rect[1] + rect[3] <= dst_height);
+
+    if (!imx2dHal.isEnabled())
+        return hal_fallback(Imx2dHalCounters::RESIZE, Imx2dHalCounters::REASON_DISABLED);
+
+    if (!is_resize_supported(src_type, src_data, src_step,
+                             src_width, src_height,
+                             dst_data, dst_step, dst_width, dst_height,
+                             0, 0, interpolation, reason))
+        return hal_fallback(Imx2dHalCounters::RESIZE, reason);
+
+    struct g2d_buf * src_g2d_buf, * dst_g2d_buf;
+    bool src_cacheable, dst_cacheable;
+    (void) is_g2d_buffer(src_data, src_g2d_buf, src_cacheable);
+    (void) is_g2d_buffer(dst_data, dst_g2d_buf, dst_cacheable);
+
+    size_t pixels = std::max(static_cast<size_t>(src_width) * src_height,
+                             static_cast<size_t>(dst_width) * dst_height);
+    if (!imx2dHal.dispatcher.useHardware(Imx2dHalCounters::RESIZE,
+                                         CV_MAT_CN(src_type),
+                                         src_g2d_buf && dst_g2d_buf, pixels))
+        return hal_fallback(Imx2dHalCounters::RESIZE, Imx2dHalCounters::REASON_DISPATCH);
+
+    src = { .g2d_buf = src_g2d_buf, .data = const_cast<void *>(static_cast<const void *>(src_data)), .step = src_step,
+            .width = src_width, .height = src_height, .cacheable = src_cacheable,
+            .scratch = false, .shadow = false };
+
+    dst = { .g2d_buf = dst_g2d_buf, .data = dst_data, .step = dst_step,
+            .width = dst_width, .height = dst_height, .cacheable = dst_cacheable,
+            .scratch = false, .shadow = false };
+
+    // border color as RGBA, grayscale value replicated on color channels
+    {
+        bool gray = (CV_MAT_CN(src_type) == 1);
+        int b = cv::saturate_cast<uchar>(border_value[0]);
+        int g = gray ? b : cv::saturate_cast<uchar>(border_value[1]);
+        int r = gray ? b : cv::saturate_cast<uchar>(border_value[2]);
+        int a = gray ? 255 : cv::saturate_cast<uchar>(border_value[3]);
+        clrcolor = r | (g << 8) | (b << 16) | (a << 24);
+    }
+
+    pf_start = profile_enter();
+    ret = io_preprocess(src, dst, src_type, inout_type, in, out);
+    profile_exit(Imx2dHalCounters::RESIZE, Imx2dProfiler::STAGE_PREPRO, pf_start);
+
+    if (ret != CV_HAL_ERROR_OK)
+        goto error;
+
+    inout_cn = CV_MAT_CN(inout_type);
+
+    pf_start = profile_enter();
+    ret = io_cache_prepare(in, out, CV_ELEM_SIZE(inout_type), cache_status);
+    profile_exit(Imx2dHalCounters::RESIZE, Imx2dProfiler::STAGE_CACHE, pf_start);
+
+    if (ret != 0) {
+        ret = CV_HAL_ERROR_UNKNOWN;
+        goto error;
+    }
+
+    g2d_surface_init(in_surface, inout_cn,
+                     in.width, in.height, in.step,
+                     in.g2d_buf, in.data);
+
+    g2d_surface_init(out_surface, inout_cn,
+                     rect[2], rect[3], out.step, out.g2d_buf,
+                     static_cast<uchar *>(out.data) +
+                     rect[1] * out.step + rect[0] * inout_cn);
+
+    ret = g2d_context_get(ctx, inout_cn == 3);
+    if (ret != 0) {
+        ret = CV_HAL_ERROR_UNKNOWN;
+        goto error;
+    }
+
+    deferrable = (in.g2d_buf == src.g2d_buf) && (out.g2d_buf == dst.g2d_buf);
+
+    pf_start = profile_enter();
+    // top, bottom, left and right borders around the resized image
+    ret = clear_area(ctx.handle, out, inout_cn,
+                     0, 0, out.width, rect[1], clrcolor);
+    if (ret == 0)
+        ret = clear_area(ctx.handle, out, inout_cn,
+                         0, rect[1] + rect[3], out.width,
+                         out.height - rect[1] - rect[3], clrcolor);
+    if (ret == 0)
+        ret = clear_area(ctx.handle, out, inout_cn,
+                         0, rect[1], rect[0], rect[3], clrcolor);
+    if (ret == 0)
+        ret = clear_area(ctx.handle, out, inout_cn,
+                         rect[0] + rect[2], rect[1],
+                         out.width - rect[0] - rect[2], rect[3], clrcolor);
+    if (ret == 0)
+        ret = g2d_blit(ctx.handle, &in_surface, &out_surface);
+
+    // operations queued so far have to complete before buffers release
+    {
+        int submit_ret = g2d_context_submit(ctx, deferrable && (ret == 0));
+        if (ret == 0)
+            ret = submit_ret;
+    }
+    g2d_context_put(ctx);
+    profile_exit(Imx2dHalCounters::RESIZE, Imx2dProfiler::STAGE_G2D, pf_start);
+
+    if (ret != 0) {
+        ret = CV_HAL_ERROR_UNKNOWN;
+        goto error;
+    }
+
+    io_cache_complete(in, out, cache_status);
+
+    pf_start = profile_enter();
+    ret = io_postprocess(src, dst, src_type, inout_type, in, out);
+    profile_exit(Imx2dHalCounters::RESIZE, Imx2dProfiler::STAGE_POSTPRO, pf_start);
+
+    if (ret == CV_HAL_ERROR_OK) {
+        imx2dHal.counters.incrementCount(Imx2dHalCounters::RESIZE);
+        hal_account(Imx2dHalCounters::RESIZE, &src, CV_ELEM_SIZE(src_type),
+                    dst, CV_ELEM_SIZE(src_type));
+    }
+
+error:
+    if (ret != CV_HAL_ERROR_OK)
+        (void) hal_fallback(Imx2dHalCounters::RESIZE, Imx2dHalCounters::REASON_ERROR);
+
+    io_release_intermediate(src, dst, src_type, inout_type, in, out);
+
+    return ret;
+}
+
+int imx2d_crop_resize_batch(int src_type, const uchar* src_data, size_t src_step,
+                            int src_width, int src_height,
+                            const int* rois, int count,
+                            uchar* const* dst_data, const size_t* dst_step,
+                            int dst_width, int dst_height, int interpolation)
+{
+    int ret, submit_ret;
+    struct g2d_surface in_surface, out_surface;
+    struct io_buffer src, in;
+    std::vector<struct io_buffer> dst, out;
+    std::vector<struct io_cache_status> cache_status;
+    int inout_type, inout_cn;
+    struct g2d_context ctx;
+    bool csc, shadow, deferrable, in_whole;
+    uint64_t pf_start;
+
+    Imx2dHal& imx2dHal = Imx2dHal::getInstance();
+    Imx2dHalCounters::Reason reason;
+
+    IMX2D_Assert(count > 0);
+    IMX2D_Assert(dst_width > 0 && dst_height > 0);
+
+    if (!imx2dHal.isEnabled())
+        return hal_fallback(Imx2dHalCounters::RESIZE, Imx2dHalCounters::REASON_DISABLED);
+
+    if (!is_resize_supported(src_type, src_data, src_step,
+                             src_width, src_height,
+                             dst_data[0], dst_step[0], dst_width, dst_height,
+                             0, 0, interpolation, reason))
+        return hal_fallback(Imx2dHalCounters::RESIZE, reason);
+
+    struct g2d_buf * src_g2d_buf, * dst_g2d_buf;
+    bool src_cacheable, dst_cacheable;
+    (void) is_g2d_buffer(src_data, src_g2d_buf, src_cacheable);
+
+    src = { .g2d_buf = src_g2d_buf, .data = const_cast<void *>(static_cast<const void *>(src_data)), .step = src_step,
+            .width = src_width, .height = src_height, .cacheable = src_cacheable,
+            .scratch = false, .shadow = false };
+
+    dst.resize(count);
+    bool graphic = (src_g2d_buf != nullptr);
+    size_t pixels = static_cast<size_t>(dst_width) * dst_height;
+    for (int i = 0; i < count; i++)
+    {
+        (void) is_g2d_buffer(dst_data[i], dst_g2d_buf, dst_cacheable);
+
+        // outputs sharing the source buffer would alias its shadow
+        if ((dst_g2d_buf != nullptr) && (dst_g2d_buf == src_g2d_buf))
+            return hal_fallback(Imx2dHalCounters::RESIZE,
+                                Imx2dHalCounters::REASON_IN_PLACE);
+
+        dst[i] = { .g2d_buf = dst_g2d_buf, .data = dst_data[i], .step = dst_step[i],
+                   .width = dst_width, .height = dst_height, .cacheable = dst_cacheable,
+                   .scratch = false, .shadow = false };
+
+        graphic = graphic && (dst_g2d_buf != nullptr);
+        pixels = std::max(pixels, static_cast<size_t>(rois[4 * i + 2]) * rois[4 * i + 3]);
+    }
+
+    // small images are processed faster by the software implementation
+    if (!imx2dHal.dispatcher.useHardware(Imx2dHalCounters::RESIZE,
+                                         CV_MAT_CN(src_type), graphic, pixels))
+        return hal_fallback(Imx2dHalCounters::RESIZE, Imx2dHalCounters::REASON_DISPATCH);
+
+    inout_type = io_inout_type(src_type);
+    inout_cn = CV_MAT_CN(inout_type);
+    csc = (src_type != inout_type);
+    shadow = io_shadow_allowed(src_type, inout_type);
+
+    in.g2d_buf = nullptr;
+    out.resize(count);
+    cache_status.resize(count);
+    for (int i = 0; i < count; i++)
+        out[i].g2d_buf = nullptr;
+
+    // source prepared once for the batch
+    pf_start = profile_enter();
+    ret = io_preprocess_input(src, src_type, inout_type, shadow, in);
+    for (int i = 0; (ret == CV_HAL_ERROR_OK) && (i < count); i++)
+        ret = io_preprocess_output(dst[i], src_type, inout_type, shadow, out[i]);
+    profile_exit(Imx2dHalCounters::RESIZE, Imx2dProfiler::STAGE_PREPRO, pf_start);
+
+    if (ret != CV_HAL_ERROR_OK)
+        goto error;
+
+    pf_start = profile_enter();
+    ret = io_cache_prepare_input(in, CV_ELEM_SIZE(inout_type), in_whole);
+    for (int i = 0; (ret == 0) && (i < count); i++)
+    {
+        cache_status[i].in_whole = in_whole;
+        ret = io_cache_prepare_output(out[i], CV_ELEM_SIZE(inout_type),
+                                      cache_status[i].out_whole);
+    }
+    profile_exit(Imx2dHalCounters::RESIZE, Imx2dProfiler::STAGE_CACHE, pf_start);
+
+    if (ret != 0) {
+        ret = CV_HAL_ERROR_UNKNOWN;
+        goto error;
+    }
+
+    ret = g2d_context_get(ctx, inout_cn == 3);
+    if (ret != 0) {
+        ret = CV_HAL_ERROR_UNKNOWN;
+        goto error;
+    }
+
+    // completion may be deferred when no intermediate buffer is involved
+    deferrable = (in.g2d_buf == src.g2d_buf);
+    for (int i = 0; i < count; i++)
+        deferrable = deferrable && (out[i].g2d_buf == dst[i].g2d_buf);
+
+    pf_start = profile_enter();
+    for (int i = 0; (ret == 0) && (i < count); i++)
+    {
+        const int* roi = &rois[4 * i];
+        uchar* roi_data = static_cast<uchar *>(in.data) +
+                          roi[1] * in.step + roi[0] * inout_cn;
+
+        g2d_surface_init(in_surface, inout_cn,
+                         roi[2], roi[3], in.step,
+                         in.g2d_buf, roi_data);
+
+        g2d_surface_init(out_surface, inout_cn,
+                         out[i].width, out[i].height, out[i].step,
+                         out[i].g2d_buf, out[i].data);
+
+        ret = g2d_blit(ctx.handle, &in_surface, &out_surface);
+    }
+
+    // blits queued so far have to complete before buffers release
+    submit_ret = g2d_context_submit(ctx, deferrable && (ret == 0));
+    if (ret == 0)
+        ret = submit_ret;
+    g2d_context_put(ctx);
+    profile_exit(Imx2dHalCounters::RESIZE, Imx2dProfiler::STAGE_G2D, pf_start);
+
+    if (ret != 0) {
+        ret = CV_HAL_ERROR_UNKNOWN;
+        goto error;
+    }
+
+    for (int i = 0; i < count; i++)
+        io_cache_complete(in, out[i], cache_status[i]);
+
+    pf_start = profile_enter();
+    for (int i = 0; (ret == CV_HAL_ERROR_OK) && (i < count); i++)
+        ret = io_postprocess(src, dst[i], src_type, inout_type, in, out[i]);
+    profile_exit(Imx2dHalCounters::RESIZE, Imx2dProfiler::STAGE_POSTPRO, pf_start);
+
+    if (ret == CV_HAL_ERROR_OK)
+        for (int i = 0; i < count; i++) {
+            imx2dHal.counters.incrementCount(Imx2dHalCounters::RESIZE);
+            hal_account(Imx2dHalCounters::RESIZE,
+                        (i == 0) ? &src : nullptr, CV_ELEM_SIZE(src_type),
+                        dst[i], CV_ELEM_SIZE(src_type));
+        }
+
+error:
+    if (ret != CV_HAL_ERROR_OK)
+        (void) hal_fallback(Imx2dHalCounters::RESIZE, Imx2dHalCounters::REASON_ERROR);
+
+    // intermediate buffers if any, shadows are kept
+    if (((src.g2d_buf == nullptr) || csc) && (in.g2d_buf != nullptr) && !in.shadow)
+        io_free_intermediate(in);
+    for (int i = 0; i < count; i++)
+        if (((dst[i].g2d_buf == nullptr) || csc) &&
+            (out[i].g2d_buf != nullptr) && !out[i].shadow)
+            io_free_intermediate(out[i]);
 
     return ret;
 }
@@ -16,6 +16,8 @@
 
 //#define DEBUG
 
+#include <algorithm>
+
 #include <opencv2/core/base.hpp>
 #include <opencv2/core/hal/interface.h>
 #include <opencv2/core.hpp>
@@ -24,122 +26,12 @@
 #include "imx2d_hal_utils.hpp"
 #include "g2d.h"
 
-#include "profiler.hpp"
-
 
 namespace cv {
 namespace imx2d {
 
-// profiling points
-//#define PF_ENABLED
-PF_ENTRY(transform_prepro);
-PF_ENTRY(transform_cache);
-PF_ENTRY(transform_g2d);
-PF_ENTRY(transform_postpro);
-
-
-static void io_release_intermediate(const struct io_buffer& src,
-                    const struct io_buffer& dst,
-                    int src_type, int inout_type,
-                    const struct io_buffer& in,
-                    const struct io_buffer& out)
-{
-    CV_UNUSED(src_type);
-    CV_UNUSED(inout_type);
-    bool in_copy = (src.g2d_buf == nullptr);
-    bool out_copy = (dst.g2d_buf == nullptr);
-
-    // free intermediate g2d buffers if any
-    if (in_copy && (in.g2d_buf != nullptr))
-        gfree(in.g2d_buf);
-    if (out_copy && (out.g2d_buf != nullptr))
-        gfree(out.g2d_buf);
-}
-
-static int io_preprocess(const struct io_buffer& src,
-                   const struct io_buffer& dst,
-                   int src_type, int &inout_type,
-                   struct io_buffer& in,
-                   struct io_buffer& out)
-{
-    // Mat buffers are not g2d allocated - need copy
-    bool in_copy = (src.g2d_buf == nullptr);
-    bool out_copy = (dst.g2d_buf == nullptr);
-
-    int cn = CV_MAT_CN(src_type);
-    IMX2D_Assert((cn >= 3) || (cn <=4));
-    IMX2D_Assert((cn != 3) || IMX2D_HW_SUPPORT_3CH());
-
-    inout_type = src_type;
-
-    int inout_cn = CV_MAT_CN(inout_type);
-
-    cv::Mat msrc, min, mout;
-    bool inout_cacheable = true;
-
-    in.g2d_buf = nullptr;
-    out.g2d_buf = nullptr;
-
-    if (in_copy)
-    {
-        msrc = cv::Mat(src.height, src.width, src_type, src.data, src.step); // no alloc
-
-        size_t in_stride = src.width * inout_cn;
-        struct g2d_buf *in_buf = galloc(src.height * in_stride, inout_cacheable);
-        if (in_buf == nullptr)
-            return CV_HAL_ERROR_UNKNOWN;
-
-        in = { .g2d_buf = in_buf, .data = static_cast<uchar *>(in_buf->buf_vaddr), .step = in_stride,
-               .width = src.width, .height = src.height, .cacheable = inout_cacheable };
-
-        min = cv::Mat(in.height, in.width, inout_type, in.data, in.step); // no alloc
-        msrc.copyTo(min);
-    }
-    else
-    {
-        in = src; // struct copy
-    }
-
-    if (out_copy)
-    {
-        size_t out_stride = dst.width * inout_cn;
-        struct g2d_buf *out_buf = galloc(dst.height * out_stride, inout_cacheable);
-        if (out_buf == nullptr)
-            return CV_HAL_ERROR_UNKNOWN;
-
-
-        out = { .g2d_buf = out_buf, .data = static_cast<uchar *>(out_buf->buf_vaddr), .step = out_stride,
-               .width = dst.width, .height = dst.height, .cacheable = inout_cacheable };
-    }
-    else
-    {
-        out = dst; // struct copy
-    }
-
-    return CV_HAL_ERROR_OK;
-}
-
-static int io_postprocess(const struct io_buffer& src,
-                    const struct io_buffer& dst,
-                    int src_type, int inout_type,
-                    const struct io_buffer& in,
-                    const struct io_buffer& out)
-{
-    bool out_copy = (dst.g2d_buf == nullptr);
-    CV_UNUSED(src);
-    CV_UNUSED(in);
-
-    cv::Mat mdst, mout;
-    mout = cv::Mat(out.height, out.width, inout_type, out.data, out.step); // no alloc
-    mdst = cv::Mat(dst.height, dst.width, src_type, dst.data, dst.step); // no alloc
-
-    if (out_copy)
-        mout.copyTo(mdst);
-
-    return CV_HAL_ERROR_OK;
-}
-
-static int do_blit(struct io_buffer src,
+static int do_blit(Imx2dHalCounters::Primitive primitive,
+                   struct io_buffer src,
                    struct io_buffer dst,
                    int src_type,
                    int flip_type, int rotate_type)
@@ -149,29 +41,24 @@ static int do_blit(struct io_buffer src,
     struct io_buffer in, out;
     int inout_type;
     enum g2d_rotation rotation;
-    void* handle;
-
-    Imx2dHal& imx2dHal = Imx2dHal::getInstance();
+    struct io_cache_status cache_status;
+    struct g2d_context ctx;
+    bool deferrable;
+    uint64_t pf_start;
 
     // Flip V+H is to be submitted as 180 degrees rotation
     IMX2D_Assert(flip_type != IMX2D_FLIP_BOTH);
 
-    PF_ENTER(transform_prepro);
+    pf_start = profile_enter();
     ret = io_preprocess(src, dst, src_type, inout_type, in, out);
-    PF_EXIT(transform_prepro);
+    profile_exit(primitive, Imx2dProfiler::STAGE_PREPRO, pf_start);
 
     if (ret != CV_HAL_ERROR_OK)
         goto error;
 
-    PF_ENTER(transform_cache);
-    if (in.cacheable)
-        ret = g2d_cache_clean(in.g2d_buf);
-    else
-        ret = 0;
-
-    if ((ret == 0) && (out.cacheable))
-        g2d_cache_invalidate(out.g2d_buf);
-    PF_EXIT(transform_cache);
+    pf_start = profile_enter();
+    ret = io_cache_prepare(in, out, CV_ELEM_SIZE(inout_type), cache_status);
+    profile_exit(primitive, Imx2dProfiler::STAGE_CACHE, pf_start);
 
     if (ret != 0) {
         ret = CV_HAL_ERROR_UNKNOWN;
@@ -217,22 +104,32 @@ static int do_blit(struct io_buffer src,
                      out.g2d_buf, out.data,
                      rotation);
 
-    handle = imx2dHal.getG2dHandle();
+    ret = g2d_context_get(ctx, CV_MAT_CN(inout_type) == 3);
+    if (ret != 0) {
+        ret = CV_HAL_ERROR_UNKNOWN;
+        goto error;
+    }
+
+    // completion may be deferred when no intermediate buffer is involved
+    deferrable = (in.g2d_buf == src.g2d_buf) && (out.g2d_buf == dst.g2d_buf);
 
-    PF_ENTER(transform_g2d);
-    ret = g2d_blit(handle, &in_surface, &out_surface);
+    pf_start = profile_enter();
+    ret = g2d_blit(ctx.handle, &in_surface, &out_surface);
     if (ret == 0)
-        ret = g2d_finish(handle);
-    PF_EXIT(transform_g2d);
+        ret = g2d_context_submit(ctx, deferrable);
+    g2d_context_put(ctx);
+    profile_exit(primitive, Imx2dProfiler::STAGE_G2D, pf_start);
 
     if (ret != 0) {
         ret = CV_HAL_ERROR_UNKNOWN;
         goto error;
     }
 
-    PF_ENTER(transform_postpro);
+    io_cache_complete(in, out, cache_status);
+
+    pf_start = profile_enter();
     ret = io_postprocess(src, dst, src_type, inout_type, in, out);
-    PF_EXIT(transform_postpro);
+    profile_exit(primitive, Imx2dProfiler::STAGE_POSTPRO, pf_start);
 
 error:
     io_release_intermediate(src, dst, src_type, inout_type, in, out);
@@ -240,19 +137,9 @@ error:
     return ret;
 }
 
-static int transform_impl(int src_type, const uchar* src_data, size_t src_step,
-                          int src_width, int src_height,
-                          uchar* dst_data, size_t dst_step,
-                          int flip_type, int rotate_type)
+static void transform_dst_size(int src_width, int src_height, int rotate_type,
+                               int& dst_width, int& dst_height)
 {
-    int ret;
-    struct io_buffer src, dst;
-    struct g2d_buf * src_g2d_buf, * dst_g2d_buf;
-    bool src_cacheable, dst_cacheable;
-    (void) is_g2d_buffer(src_data, src_g2d_buf, src_cacheable);
-    (void) is_g2d_buffer(dst_data, dst_g2d_buf, dst_cacheable);
-
-    int dst_width, dst_height;
     switch(rotate_type)
     {
     case IMX2D_ROTATE_90:
@@ -265,14 +152,45 @@ static int transform_impl(int src_type, const uchar* src_data, size_t src_step,
         dst_height = src_height;
         break;
     }
+}
+
+static int transform_impl(Imx2dHalCounters::Primitive primitive,
+                          int src_type, const uchar* src_data, size_t src_step,
+                          int src_width, int src_height,
+                          uchar* dst_data, size_t dst_step,
+                          int dst_width, int dst_height,
+                          int flip_type, int rotate_type)
+{
+    int ret;
+    struct io_buffer src, dst;
+    struct g2d_buf * src_g2d_buf, * dst_g2d_buf;
+    bool src_cacheable, dst_cacheable;
+    (void) is_g2d_buffer(src_data, src_g2d_buf, src_cacheable);
+    (void) is_g2d_buffer(dst_data, dst_g2d_buf, dst_cacheable);
+
+    // small images are processed faster by the software implementation
+    Imx2dDispatcher& dispatcher = Imx2dHal::getInstance().dispatcher;
+    size_t pixels = std::max(static_cast<size_t>(src_width) * src_height,
+                             static_cast<size_t>(dst_width) * dst_height);
+    if (!dispatcher.useHardware(primitive, CV_MAT_CN(src_type),
+                                src_g2d_buf && dst_g2d_buf, pixels))
+        return hal_fallback(primitive, Imx2dHalCounters::REASON_DISPATCH);
 
     src = { .g2d_buf = src_g2d_buf, .data = const_cast<void *>(static_cast<const void *>(src_data)), .step = src_step,
-            .width = src_width, .height = src_height, .cacheable = src_cacheable };
+            .width = src_width, .height = src_height, .cacheable = src_cacheable,
+            .scratch = false, .shadow = false };
 
     dst = { .g2d_buf = dst_g2d_buf, .data = dst_data, .step = dst_step,
-            .width = dst_width, .height = dst_height, .cacheable = dst_cacheable };
+            .width = dst_width, .height = dst_height, .cacheable = dst_cacheable,
+            .scratch = false, .shadow = false };
 
-    ret = do_blit(src, dst, src_type, flip_type, rotate_type);
+    ret = do_blit(primitive, src, dst, src_type, flip_type, rotate_type);
+
+    if (ret == CV_HAL_ERROR_OK)
+        hal_account(primitive, &src, CV_ELEM_SIZE(src_type),
+                    dst, CV_ELEM_SIZE(src_type));
+    else
+        (void) hal_fallback(primitive, Imx2dHalCounters::REASON_ERROR);
 
     return ret;
 }
@@ -281,40 +199,43 @@ static bool is_transform_supported(
                   int src_type, const uchar *src_data, size_t src_step,
                   int src_width, int src_height,
                   uchar *dst_data, size_t dst_step,
-                  int flip_type, int rotate_type)
+                  int dst_width, int dst_height,
+                  int flip_type, int rotate_type, bool emulate_3ch,
+                  Imx2dHalCounters::Reason& reason)
 {
+    CV_UNUSED(src_width);
+    CV_UNUSED(dst_width);
+    CV_UNUSED(rotate_type);
+
     int depth = CV_MAT_DEPTH(src_type);
     int cn = CV_MAT_CN(src_type);
 
     // integer matrixes only
-    if (depth != CV_8U)
+    if (depth != CV_8U) {
+        reason = Imx2dHalCounters::REASON_DEPTH;
         return false;
+    }
 
     // flip on both axis not supported
-    if (flip_type == IMX2D_FLIP_BOTH)
+    if (flip_type == IMX2D_FLIP_BOTH) {
+        reason = Imx2dHalCounters::REASON_FLIP_BOTH;
         return false;
+    }
 
     // in place operation not supported
-    size_t dst_height;
-    switch(rotate_type)
-    {
-    case IMX2D_ROTATE_90:
-    case IMX2D_ROTATE_270:
-        dst_height = src_width;
-        break;
-    default:
-        dst_height = src_height;
-        break;
-    }
     size_t src_sz = src_height * src_step;
     size_t dst_sz = dst_height * dst_step;
-    if (!((dst_data + dst_sz <= src_data) || (dst_data >= src_data + src_sz)))
+    if (!((dst_data + dst_sz <= src_data) || (dst_data >= src_data + src_sz))) {
+        reason = Imx2dHalCounters::REASON_IN_PLACE;
         return false;
+    }
 
-    // 3 and 4 channels matrixes
-    if (((cn == 3) && (IMX2D_HW_SUPPORT_3CH())) || cn == 4)
+    // 3 and 4 channels matrixes, grayscale via 4 channels emulation
+    if (((cn == 3) && (IMX2D_HW_SUPPORT_3CH() || emulate_3ch)) || cn == 4 ||
+        ((cn == 1) && emulate_3ch))
         return true;
 
+    reason = Imx2dHalCounters::REASON_CHANNELS;
     return false;
 }
 
@@ -330,12 +251,14 @@ int imx2d_flip(int src_type, const uchar* src_data, size_t src_step,
 {
     int ret;
     Imx2dHal& imx2dHal = Imx2dHal::getInstance();
+    Imx2dHalCounters::Reason reason;
     int rotate_type;
+    int dst_width, dst_height;
 
     IMX2D_Assert(src_width > 0 && src_height > 0);
 
     if (!imx2dHal.isEnabled())
-        return CV_HAL_ERROR_NOT_IMPLEMENTED;
+        return hal_fallback(Imx2dHalCounters::FLIP, Imx2dHalCounters::REASON_DISABLED);
 
     // flip both handled as single step 180 degrees rotation
     rotate_type = IMX2D_ROTATE_NONE;
@@ -345,15 +268,20 @@ int imx2d_flip(int src_type, const uchar* src_data, size_t src_step,
         rotate_type = IMX2D_ROTATE_180;
     }
 
+    transform_dst_size(src_width, src_height, rotate_type, dst_width, dst_height);
+
     if (!is_transform_supported(src_type, src_data, src_step,
                                 src_width, src_height,
                                 dst_data, dst_step,
-                                flip_type, rotate_type))
-        return CV_HAL_ERROR_NOT_IMPLEMENTED;
+                                dst_width, dst_height,
+                                flip_type, rotate_type, false, reason))
+        return hal_fallback(Imx2dHalCounters::FLIP, reason);
 
-    ret = transform_impl(src_type, src_data, src_step,
+    ret = transform_impl(Imx2dHalCounters::FLIP,
+                         src_type, src_data, src_step,
                          src_width, src_height,
                          dst_data, dst_step,
+                         dst_width, dst_height,
                          flip_type, rotate_type);
 
     if (ret == CV_HAL_ERROR_OK)
@@ -368,22 +296,29 @@ int imx2d_rotate(int src_type, const uchar* src_data, size_t src_step,
 {
     int ret;
     Imx2dHal& imx2dHal = Imx2dHal::getInstance();
+    Imx2dHalCounters::Reason reason;
     int flip_type = IMX2D_FLIP_NONE;
+    int dst_width, dst_height;
 
     IMX2D_Assert(src_width > 0 && src_height > 0);
 
     if (!imx2dHal.isEnabled())
-        return CV_HAL_ERROR_NOT_IMPLEMENTED;
+        return hal_fallback(Imx2dHalCounters::ROTATE, Imx2dHalCounters::REASON_DISABLED);
+
+    transform_dst_size(src_width, src_height, rotate_type, dst_width, dst_height);
 
     if (!is_transform_supported(src_type, src_data, src_step,
                                 src_width, src_height,
                                 dst_data, dst_step,
-                                flip_type, rotate_type))
-        return CV_HAL_ERROR_NOT_IMPLEMENTED;
+                                dst_width, dst_height,
+                                flip_type, rotate_type, false, reason))
+        return hal_fallback(Imx2dHalCounters::ROTATE, reason);
 
-    ret = transform_impl(src_type, src_data, src_step,
+    ret = transform_impl(Imx2dHalCounters::ROTATE,
+                         src_type, src_data, src_step,
                          src_width, src_height,
                          dst_data, dst_step,
+                         dst_width, dst_height,
                          flip_type, rotate_type);
 
     if (ret == CV_HAL_ERROR_OK)
@@ -391,3 +326,50 @@ int imx2d_rotate(int src_type, const uchar* src_data, size_t src_step,
 
     return ret;
 }
+
+int imx2d_transform(int src_type, const uchar* src_data, size_t src_step,
+                    int src_width, int src_height,
+                    uchar* dst_data, size_t dst_step, int dst_width, int dst_height,
+                    int flip_type, int rotate_type, int interpolation)
+{
+    int ret;
+    Imx2dHal& imx2dHal = Imx2dHal::getInstance();
+    Imx2dHalCounters::Reason reason;
+
+    IMX2D_Assert(src_width > 0 && src_height > 0);
+    IMX2D_Assert(dst_width > 0 && dst_height > 0);
+
+    if (!imx2dHal.isEnabled())
+        return hal_fallback(Imx2dHalCounters::TRANSFORM, Imx2dHalCounters::REASON_DISABLED);
+
+    // scaling is bilinear only
+    if (interpolation != CV_HAL_INTER_LINEAR)
+        return hal_fallback(Imx2dHalCounters::TRANSFORM, Imx2dHalCounters::REASON_INTERPOLATION);
+
+    // flip both is equivalent to 180 degrees rotation, combined with the
+    // requested rotation
+    if (flip_type == IMX2D_FLIP_BOTH)
+    {
+        flip_type = IMX2D_FLIP_NONE;
+        rotate_type = (rotate_type + IMX2D_ROTATE_180) % (IMX2D_ROTATE_270 + 1);
+    }
+
+    if (!is_transform_supported(src_type, src_data, src_step,
+                                src_width, src_height,
+                                dst_data, dst_step,
+                                dst_width, dst_height,
+                                flip_type, rotate_type, true, reason))
+        return hal_fallback(Imx2dHalCounters::TRANSFORM, reason);
+
+    ret = transform_impl(Imx2dHalCounters::TRANSFORM,
+                         src_type, src_data, src_step,
+                         src_width, src_height,
+                         dst_data, dst_step,
+                         dst_width, dst_height,
+                         flip_type, rotate_type);
+
+    if (ret == CV_HAL_ERROR_OK)
+        imx2dHal.counters.incrementCount(Imx2dHalCounters::TRANSFORM);
+
+    return ret;
+}
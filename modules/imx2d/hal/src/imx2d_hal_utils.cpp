@@ -15,14 +15,64 @@
  */
 
 #include <opencv2/core/base.hpp>
-#include <opencv2/imgproc.hpp> // cv::cvtColor()
+#include <opencv2/core.hpp> // cv::Mat
 
 #include "g2d.h"
+#include "imx2d_hal.hpp"
 #include "imx2d_hal_utils.hpp"
 
 namespace cv {
 namespace imx2d {
 
+int g2d_context_get(struct g2d_context& ctx, bool three_channels)
+{
+    ctx.engine = -1;
+    ctx.stream = Imx2dStream::getCurrent();
+    if (ctx.stream)
+        ctx.handle = ctx.stream->getG2dHandle(three_channels);
+    else
+        ctx.handle = Imx2dHal::getInstance().getThreadG2dHandle(three_channels,
+                                                                ctx.engine);
+
+    return ctx.handle ? 0 : -1;
+}
+
+void io_stream_sync()
+{
+    Imx2dStream* stream = Imx2dStream::getCurrent();
+    int ret;
+
+    if (!stream)
+        return;
+
+    ret = stream->waitAll();
+    if (ret != 0)
+        IMX2D_ERROR("%s g2d completion failed (%d)", __func__, ret);
+}
+
+void g2d_context_put(struct g2d_context& ctx)
+{
+    Imx2dHal::getInstance().releaseEngine(ctx.engine);
+    ctx.engine = -1;
+}
+
+int g2d_context_submit(struct g2d_context& ctx, bool deferrable)
+{
+    uint64_t seq;
+    int ret;
+
+    if (!ctx.stream)
+        return g2d_finish(ctx.handle);
+
+    // stream submission completes asynchronously unless blit output has to be
+    // post-processed by the CPU or intermediate buffers released
+    ret = ctx.stream->submit(seq);
+    if ((ret == 0) && !deferrable)
+        ret = ctx.stream->wait(seq);
+
+    return ret;
+}
+
 bool is_g2d_buffer(const void* vaddr, struct g2d_buf*& g2dBuf, bool& cacheable)
 {
     bool ret;
@@ -60,6 +110,42 @@ void gfree(struct g2d_buf *buf)
     gAlloc.free(handle);
 }
 
+struct g2d_buf* io_alloc_intermediate(size_t size, bool& scratch)
+{
+    Imx2dScratchArena& arena = Imx2dScratchArena::getInstance();
+    struct g2d_buf* buf;
+
+    buf = arena.acquire(size);
+    scratch = (buf != nullptr);
+    if (!scratch)
+        buf = galloc(size, true);
+
+    return buf;
+}
+
+void io_free_intermediate(const struct io_buffer& b)
+{
+    Imx2dScratchArena& arena = Imx2dScratchArena::getInstance();
+
+    if (b.scratch)
+    {
+        bool released = arena.release(b.g2d_buf);
+        IMX2D_Assert(released);
+    }
+    else
+    {
+        gfree(b.g2d_buf);
+    }
+}
+
+/**
+ Internal buffers not registered to the allocator: no coherency tracking.
+*/
+static inline bool io_untracked(const struct io_buffer& b)
+{
+    return b.scratch || b.shadow;
+}
+
 int g2d_cache_clean(struct g2d_buf *buf)
 {
     int ret = g2d_cache_op(buf, G2D_CACHE_CLEAN);
@@ -82,6 +168,165 @@ int g2d_cache_invalidate(struct g2d_buf *buf)
     return -1;
 }
 
+#if defined(__aarch64__)
+static size_t read_ctr_dminline()
+{
+    uint64_t ctr;
+
+    // CTR_EL0.DminLine: log2 of the number of words in smallest line
+    asm volatile("mrs %0, ctr_el0" : "=r" (ctr));
+    return 4 << ((ctr >> 16) & 0xf);
+}
+
+// thread-safe initialization, HAL called from several threads
+static size_t cache_line_size()
+{
+    static const size_t line_size = read_ctr_dminline();
+
+    return line_size;
+}
+
+static void cache_op_lines(uintptr_t start, uintptr_t end, bool invalidate)
+{
+    size_t line_size = cache_line_size();
+    uintptr_t addr = start & ~(line_size - 1);
+
+    // dc ivac is not permitted from EL0: clean+invalidate to PoC instead,
+    // that also preserves CPU writes sharing lines at the ROI boundaries
+    if (invalidate)
+        for (; addr < end; addr += line_size)
+            asm volatile("dc civac, %0" : : "r" (addr) : "memory");
+    else
+        for (; addr < end; addr += line_size)
+            asm volatile("dc cvac, %0" : : "r" (addr) : "memory");
+}
+#endif
+
+/**
+ Cache maintenance restricted to the rows of the ROI described by io_buffer
+ when small compared to the backing graphic buffer. Whole buffer maintenance
+ via G2D is done otherwise.
+*/
+static int g2d_cache_op_roi(const struct io_buffer& b, size_t elem_size,
+                            bool invalidate, bool& whole)
+{
+#if defined(__aarch64__)
+    size_t row_size = b.width * elem_size;
+    size_t span = (b.height - 1) * b.step + row_size;
+
+    if (span * IMX2D_CACHE_RANGE_RATIO <= (size_t)b.g2d_buf->buf_size)
+    {
+        uintptr_t start = reinterpret_cast<uintptr_t>(b.data);
+
+        // row by row ROI when lines are sparse, single range otherwise
+        if (row_size * 2 <= b.step)
+            for (int row = 0; row < b.height; row++, start += b.step)
+                cache_op_lines(start, start + row_size, invalidate);
+        else
+            cache_op_lines(start, start + span, invalidate);
+
+        asm volatile("dsb sy" : : : "memory");
+
+        whole = false;
+        return 0;
+    }
+#else
+    CV_UNUSED(elem_size);
+#endif
+
+    whole = true;
+    if (invalidate)
+        return g2d_cache_invalidate(b.g2d_buf);
+    else
+        return g2d_cache_clean(b.g2d_buf);
+}
+
+int io_cache_prepare(const struct io_buffer& in, const struct io_buffer& out,
+                     size_t elem_size, struct io_cache_status& status)
+{
+    return io_cache_prepare(in, elem_size, out, elem_size, status);
+}
+
+int io_cache_prepare(const struct io_buffer& in, size_t in_elem_size,
+                     const struct io_buffer& out, size_t out_elem_size,
+                     struct io_cache_status& status)
+{
+    int ret;
+
+    ret = io_cache_prepare_input(in, in_elem_size, status.in_whole);
+
+    status.out_whole = true;
+    if (ret == 0)
+        ret = io_cache_prepare_output(out, out_elem_size, status.out_whole);
+
+    return ret;
+}
+
+int io_cache_prepare_input(const struct io_buffer& in, size_t elem_size,
+                           bool& whole)
+{
+    Imx2dGAllocator& gAlloc = Imx2dGAllocator::getInstance();
+    bool tracking = gAlloc.getCoherencyTracking();
+
+    whole = true;
+
+    // scratch buffers are not tracked
+    // device reads memory: CPU dirty lines have to be written back
+    if (in.cacheable &&
+        (!tracking || io_untracked(in) ||
+         (gAlloc.getCoherency(in.g2d_buf) == Imx2dGAllocator::COHERENCY_CPU_DIRTY)))
+        return g2d_cache_op_roi(in, elem_size, false, whole);
+
+    return 0;
+}
+
+int io_cache_prepare_output(const struct io_buffer& out, size_t elem_size,
+                            bool& whole)
+{
+    Imx2dGAllocator& gAlloc = Imx2dGAllocator::getInstance();
+    bool tracking = gAlloc.getCoherencyTracking();
+
+    whole = true;
+
+    // device writes memory: CPU cache lines shall not shadow its output
+    if (out.cacheable &&
+        (!tracking || io_untracked(out) ||
+         (gAlloc.getCoherency(out.g2d_buf) != Imx2dGAllocator::COHERENCY_DEVICE)))
+        return g2d_cache_op_roi(out, elem_size, true, whole);
+
+    return 0;
+}
+
+void io_cache_complete(const struct io_buffer& in, const struct io_buffer& out,
+                       const struct io_cache_status& status)
+{
+    Imx2dGAllocator& gAlloc = Imx2dGAllocator::getInstance();
+
+    if (!gAlloc.getCoherencyTracking())
+        return;
+
+    // buffer state only changes if maintenance covered it entirely
+    if (in.cacheable && !io_untracked(in) && status.in_whole &&
+        (gAlloc.getCoherency(in.g2d_buf) == Imx2dGAllocator::COHERENCY_CPU_DIRTY))
+        gAlloc.setCoherency(in.g2d_buf, Imx2dGAllocator::COHERENCY_CLEAN);
+
+    if (out.cacheable && !io_untracked(out) && status.out_whole)
+        gAlloc.setCoherency(out.g2d_buf, Imx2dGAllocator::COHERENCY_DEVICE);
+}
+
+void io_cpu_access(const struct io_buffer& b, bool write)
+{
+    Imx2dGAllocator& gAlloc = Imx2dGAllocator::getInstance();
+
+    // buffer may be written by blits deferred on the stream
+    io_stream_sync();
+
+    if ((b.g2d_buf == nullptr) || !b.cacheable || io_untracked(b))
+        return;
+
+    gAlloc.declareCpuAccess(b.g2d_buf, write);
+}
+
 void g2d_surface_init(g2d_surface& s, int cn,
                       int width, int height, int step,
                       struct g2d_buf* buf, void* vaddr,
@@ -131,5 +376,371 @@ void g2d_surface_init(g2d_surface& s, int cn,
     s.clrcolor = 0;
 }
 
+void io_release_intermediate(const struct io_buffer& src,
+                             const struct io_buffer& dst,
+                             int src_type, int inout_type,
+                             const struct io_buffer& in,
+                             const struct io_buffer& out)
+{
+    // Mat buffers are not g2d allocated - need copy
+    bool in_copy = (src.g2d_buf == nullptr);
+    bool out_copy = (dst.g2d_buf == nullptr);
+
+    // 3 chans support may have been emulated via software CSC
+    bool csc = (src_type != inout_type);
+
+    // free intermediate g2d buffers if any, shadows are kept
+    if ((in_copy || csc) && (in.g2d_buf != nullptr) && !in.shadow)
+        io_free_intermediate(in);
+    if ((out_copy || csc) && (out.g2d_buf != nullptr) && !out.shadow)
+        io_free_intermediate(out);
+}
+
+/**
+ Shadow covers 3 channels graphic buffers processed as a whole only.
+*/
+static bool io_shadow_eligible(const struct io_buffer& b)
+{
+    return (b.g2d_buf != nullptr) &&
+           (b.data == b.g2d_buf->buf_vaddr) &&
+           (b.step == static_cast<size_t>(b.width) * 3);
+}
+
+void io_shadow_sync(struct g2d_buf* buf, bool write)
+{
+    Imx2dGAllocator& gAlloc = Imx2dGAllocator::getInstance();
+    Imx2dGAllocator::Shadow shadow;
+
+    if (!gAlloc.hasShadows() || !gAlloc.getShadow(buf, shadow))
+        return;
+
+    if (shadow.state == Imx2dGAllocator::SHADOW_AHEAD)
+    {
+        io_stream_sync();
+        gAlloc.declareCpuAccess(buf, true);
+        csc_bgra_to_bgr(static_cast<const uchar *>(shadow.buf->buf_vaddr),
+                        shadow.width * 4,
+                        static_cast<uchar *>(buf->buf_vaddr), shadow.width * 3,
+                        shadow.width, shadow.height);
+        shadow.state = Imx2dGAllocator::SHADOW_SYNCED;
+    }
+
+    if (write)
+        shadow.state = Imx2dGAllocator::SHADOW_NONE;
+
+    gAlloc.setShadowState(buf, shadow.state);
+}
+
+/**
+ Return up to date shadow of 3 channels input buffer, created if needed.
+*/
+static int io_shadow_input(const struct io_buffer& src, struct io_buffer& in)
+{
+    Imx2dGAllocator& gAlloc = Imx2dGAllocator::getInstance();
+    Imx2dGAllocator::Shadow shadow;
+    bool valid;
+
+    valid = gAlloc.getShadow(src.g2d_buf, shadow) &&
+            (shadow.width == src.width) && (shadow.height == src.height);
+
+    if (!valid)
+    {
+        io_shadow_sync(src.g2d_buf, false); // previous geometry
+        shadow.buf = gAlloc.createShadow(src.g2d_buf, src.width, src.height);
+        if (shadow.buf == nullptr)
+            return CV_HAL_ERROR_UNKNOWN;
+        shadow.state = Imx2dGAllocator::SHADOW_NONE;
+    }
+
+    in = { .g2d_buf = shadow.buf, .data = shadow.buf->buf_vaddr,
+           .step = static_cast<size_t>(src.width) * 4,
+           .width = src.width, .height = src.height, .cacheable = true,
+           .scratch = false, .shadow = true };
+
+    if (shadow.state == Imx2dGAllocator::SHADOW_NONE)
+    {
+        io_cpu_access(src, false);
+        csc_bgr_to_bgra(static_cast<const uchar *>(src.data), src.step,
+                        static_cast<uchar *>(in.data), in.step,
+                        src.width, src.height);
+        gAlloc.setShadowState(src.g2d_buf, Imx2dGAllocator::SHADOW_SYNCED);
+    }
+
+    return CV_HAL_ERROR_OK;
+}
+
+/**
+ Return shadow of 3 channels output buffer, created if needed.
+*/
+static int io_shadow_output(const struct io_buffer& dst, struct io_buffer& out)
+{
+    Imx2dGAllocator& gAlloc = Imx2dGAllocator::getInstance();
+    Imx2dGAllocator::Shadow shadow;
+    bool valid;
+
+    valid = gAlloc.getShadow(dst.g2d_buf, shadow) &&
+            (shadow.width == dst.width) && (shadow.height == dst.height);
+
+    if (!valid)
+    {
+        shadow.buf = gAlloc.createShadow(dst.g2d_buf, dst.width, dst.height);
+        if (shadow.buf == nullptr)
+            return CV_HAL_ERROR_UNKNOWN;
+    }
+
+    out = { .g2d_buf = shadow.buf, .data = shadow.buf->buf_vaddr,
+            .step = static_cast<size_t>(dst.width) * 4,
+            .width = dst.width, .height = dst.height, .cacheable = true,
+            .scratch = false, .shadow = true };
+
+    return CV_HAL_ERROR_OK;
+}
+
+
+int io_inout_type(int src_type)
+{
+    int cn = CV_MAT_CN(src_type);
+    IMX2D_Assert((cn == 1) || (cn == 3) || (cn == 4));
+
+    // 3 chans support via 4 chans software CSC if not supported by hardware
+    if ((cn == 3) && (!IMX2D_HW_SUPPORT_3CH()))
+        return CV_8UC4;
+
+    // no 8 bits format: grayscale via 4 chans software CSC
+    if (cn == 1)
+        return CV_8UC4;
+
+    return src_type;
+}
+
+bool io_shadow_allowed(int src_type, int inout_type)
+{
+    // shadows of 3 channels buffers only
+    return (src_type == CV_8UC3) && (inout_type == CV_8UC4) &&
+           Imx2dGAllocator::getInstance().getShadowMode();
+}
+
+int io_preprocess(const struct io_buffer& src,
+                  const struct io_buffer& dst,
+                  int src_type, int &inout_type,
+                  struct io_buffer& in,
+                  struct io_buffer& out)
+{
+    bool shadow;
+    int ret;
+
+    inout_type = io_inout_type(src_type);
+
+    // in-place operations can not use the same shadow for input and output
+    shadow = io_shadow_allowed(src_type, inout_type) &&
+             (src.g2d_buf != dst.g2d_buf);
+
+    out.g2d_buf = nullptr;
+
+    ret = io_preprocess_input(src, src_type, inout_type, shadow, in);
+    if (ret != CV_HAL_ERROR_OK)
+        return ret;
+
+    return io_preprocess_output(dst, src_type, inout_type, shadow, out);
+}
+
+int io_preprocess_input(const struct io_buffer& src,
+                        int src_type, int inout_type, bool shadow,
+                        struct io_buffer& in)
+{
+    // Mat buffers are not g2d allocated - need copy
+    bool in_copy = (src.g2d_buf == nullptr);
+    bool csc = (src_type != inout_type);
+    int inout_cn = CV_MAT_CN(inout_type);
+
+    bool inout_cacheable = true;
+    bool scratch;
+    int ret;
+
+    in.g2d_buf = nullptr;
+
+    // graphic buffers not processed via their shadow have to be up to date
+    if (csc && (!shadow || !io_shadow_eligible(src)))
+        io_shadow_sync(src.g2d_buf, false);
+
+    if (shadow && io_shadow_eligible(src))
+    {
+        ret = io_shadow_input(src, in);
+        if (ret != CV_HAL_ERROR_OK)
+            return ret;
+    }
+    else if (in_copy || csc)
+    {
+        size_t in_stride = src.width * inout_cn;
+        struct g2d_buf *in_buf = io_alloc_intermediate(src.height * in_stride, scratch);
+        if (in_buf == nullptr)
+            return CV_HAL_ERROR_UNKNOWN;
+
+        in = { .g2d_buf = in_buf, .data = static_cast<uchar *>(in_buf->buf_vaddr), .step = in_stride,
+               .width = src.width, .height = src.height, .cacheable = inout_cacheable,
+               .scratch = scratch, .shadow = false };
+
+        io_cpu_access(src, false);
+        if (csc) // implies copy
+            csc_to_bgra(CV_MAT_CN(src_type),
+                        static_cast<const uchar *>(src.data), src.step,
+                        static_cast<uchar *>(in.data), in.step,
+                        src.width, src.height);
+        else // copy only
+            io_copy_rows(static_cast<const uchar *>(src.data), src.step,
+                         static_cast<uchar *>(in.data), in.step,
+                         src.width * CV_ELEM_SIZE(src_type), src.height);
+    }
+    else
+    {
+        in = src; // struct copy
+    }
+
+    return CV_HAL_ERROR_OK;
+}
+
+int io_preprocess_output(const struct io_buffer& dst,
+                         int src_type, int inout_type, bool shadow,
+                         struct io_buffer& out)
+{
+    // Mat buffers are not g2d allocated - need copy
+    bool out_copy = (dst.g2d_buf == nullptr);
+    bool csc = (src_type != inout_type);
+    int inout_cn = CV_MAT_CN(inout_type);
+
+    bool inout_cacheable = true;
+    bool scratch;
+    int ret;
+
+    out.g2d_buf = nullptr;
+
+    // graphic buffers not processed via their shadow have to be up to date
+    if (csc && (!shadow || !io_shadow_eligible(dst)))
+        io_shadow_sync(dst.g2d_buf, true);
+
+    if (shadow && io_shadow_eligible(dst))
+    {
+        ret = io_shadow_output(dst, out);
+        if (ret != CV_HAL_ERROR_OK)
+            return ret;
+    }
+    else if (out_copy || csc)
+    {
+        size_t out_stride = dst.width * inout_cn;
+        struct g2d_buf *out_buf = io_alloc_intermediate(dst.height * out_stride, scratch);
+        if (out_buf == nullptr)
+            return CV_HAL_ERROR_UNKNOWN;
+
+        out = { .g2d_buf = out_buf, .data = static_cast<uchar *>(out_buf->buf_vaddr), .step = out_stride,
+               .width = dst.width, .height = dst.height, .cacheable = inout_cacheable,
+               .scratch = scratch, .shadow = false };
+    }
+    else
+    {
+        out = dst; // struct copy
+    }
+
+    return CV_HAL_ERROR_OK;
+}
+
+int io_postprocess(const struct io_buffer& src,
+                   const struct io_buffer& dst,
+                   int src_type, int inout_type,
+                   const struct io_buffer& in,
+                   const struct io_buffer& out)
+{
+    bool out_copy = (dst.g2d_buf == nullptr);
+    bool csc;
+    CV_UNUSED(src);
+    CV_UNUSED(in);
+
+    // 1 or 3 chans support may have been emulated via software CSC
+    if (src_type != inout_type)
+    {
+        IMX2D_Assert(((src_type == CV_8UC1) || (src_type == CV_8UC3)) &&
+                     (inout_type == CV_8UC4));
+        csc = true;
+    } else {
+        csc = false;
+    }
+
+    // shadow ahead of its graphic buffer, converted on CPU access only
+    if (out.shadow)
+    {
+        Imx2dGAllocator& gAlloc = Imx2dGAllocator::getInstance();
+        gAlloc.setShadowState(dst.g2d_buf, Imx2dGAllocator::SHADOW_AHEAD);
+        return CV_HAL_ERROR_OK;
+    }
+
+    if (csc || out_copy)
+    {
+        io_cpu_access(out, false);
+        io_cpu_access(dst, true);
+    }
+
+    if (csc) // implies copy
+        csc_from_bgra(CV_MAT_CN(src_type),
+                      static_cast<const uchar *>(out.data), out.step,
+                      static_cast<uchar *>(dst.data), dst.step,
+                      dst.width, dst.height);
+    else if (out_copy) // copy only
+        io_copy_rows(static_cast<const uchar *>(out.data), out.step,
+                     static_cast<uchar *>(dst.data), dst.step,
+                     dst.width * CV_ELEM_SIZE(src_type), dst.height);
+
+    return CV_HAL_ERROR_OK;
+}
+
 } // imx2d::
-} // cv::
\ No newline at end of file
+} // cv::
+
+
+using namespace cv::imx2d;
+
+void imx2d_cpu_fallback(const uchar *src_data, const uchar *dst_data)
+{
+    Imx2dGAllocator& gAlloc = Imx2dGAllocator::getInstance();
+    struct io_buffer src = {}, dst = {};
+
+    // software implementation accesses outputs of blits deferred on the stream
+    io_stream_sync();
+
+    if (!gAlloc.getCoherencyTracking() && !gAlloc.hasShadows())
+        return;
+
+    (void) is_g2d_buffer(src_data, src.g2d_buf, src.cacheable);
+    (void) is_g2d_buffer(dst_data, dst.g2d_buf, dst.cacheable);
+
+    // software implementation processes buffers content, not their shadow
+    if (src.g2d_buf)
+        io_shadow_sync(src.g2d_buf, false);
+    if (dst.g2d_buf)
+        io_shadow_sync(dst.g2d_buf, true);
+
+    io_cpu_access(src, false);
+    io_cpu_access(dst, true);
+}
+
+void imx2d_shadow_sync(const uchar *data, bool write)
+{
+    struct g2d_buf* buf;
+    bool cacheable;
+
+    if (!Imx2dGAllocator::getInstance().hasShadows())
+        return;
+
+    if (is_g2d_buffer(data, buf, cacheable))
+        io_shadow_sync(buf, write);
+}
+
+void imx2d_shadow_release_all()
+{
+    Imx2dGAllocator& gAlloc = Imx2dGAllocator::getInstance();
+    std::vector<void*> handles = gAlloc.getShadowedBuffers();
+
+    for (auto it = handles.begin(); it != handles.end(); it++)
+    {
+        io_shadow_sync(static_cast<struct g2d_buf*>(*it), false);
+        gAlloc.releaseShadow(*it);
+    }
+}
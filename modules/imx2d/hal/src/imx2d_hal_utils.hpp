@@ -15,6 +15,10 @@
  */
 
 
+#include <chrono>
+
+#include <opencv2/core/hal/interface.h>
+
 #include "imx2d_common.hpp"
 #include "g2d.h"
 
@@ -45,6 +49,50 @@ inline bool IMX2D_HW_SUPPORT_3CH()
     return hwCaps.hasCapability(cv::imx2d::HardwareCapabilities::THREE_CHANNELS);
 }
 
+inline bool IMX2D_HW_SUPPORT_FORMAT(cv::imx2d::HardwareCapabilities::Formats format)
+{
+    cv::imx2d::Imx2dHal& hal = cv::imx2d::Imx2dHal::getInstance();
+    cv::imx2d::HardwareCapabilities& hwCaps = hal.getHardwareCapabilities();
+    return hwCaps.hasFormat(format);
+}
+
+/**
+ Account a call falling back to the software implementation for reason.
+ Returns CV_HAL_ERROR_NOT_IMPLEMENTED.
+*/
+inline int hal_fallback(cv::imx2d::Imx2dHalCounters::Primitive primitive,
+                        cv::imx2d::Imx2dHalCounters::Reason reason)
+{
+    cv::imx2d::Imx2dHal::getInstance().counters.incrementFallback(primitive, reason);
+    return CV_HAL_ERROR_NOT_IMPLEMENTED;
+}
+
+/**
+ Stage latency measurement for the runtime profiler: profile_enter() returns
+ the stage start time in nanoseconds, 0 if the profiler is disabled.
+*/
+inline uint64_t profile_enter()
+{
+    cv::imx2d::Imx2dHal& hal = cv::imx2d::Imx2dHal::getInstance();
+    if (!hal.profiler.isEnabled())
+        return 0;
+
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void profile_exit(cv::imx2d::Imx2dHalCounters::Primitive primitive,
+                         cv::imx2d::Imx2dProfiler::Stage stage, uint64_t start)
+{
+    if (start == 0)
+        return;
+
+    uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    cv::imx2d::Imx2dHal::getInstance().profiler.record(primitive, stage,
+                                                       now - start);
+}
+
 struct io_buffer {
     struct g2d_buf* g2d_buf;
     void* data;
@@ -52,8 +100,52 @@ struct io_buffer {
     int width;
     int height;
     bool cacheable;
+    bool scratch; // intermediate buffer from Imx2dScratchArena
+    bool shadow;  // 4 channels shadow of a 3 channels graphic buffer
+};
+
+/**
+ Account application buffers of an accelerated call, of elem_size bytes pixels.
+ src is null for output only primitives.
+*/
+inline void hal_account(cv::imx2d::Imx2dHalCounters::Primitive primitive,
+                        const struct io_buffer* src, size_t src_elem_size,
+                        const struct io_buffer& dst, size_t dst_elem_size)
+{
+    size_t src_bytes = src ? src->width * src->height * src_elem_size : 0;
+    size_t dst_bytes = dst.width * dst.height * dst_elem_size;
+
+    cv::imx2d::Imx2dHal::getInstance().counters.accountBuffers(primitive,
+                    src && src->g2d_buf, src_bytes, dst.g2d_buf, dst_bytes);
+}
+
+/**
+ G2D context used for blits submission: stream bound to calling thread if any,
+ calling thread context of the least loaded engine otherwise.
+*/
+struct g2d_context {
+    void* handle;
+    Imx2dStream* stream;
+    int engine; // engine selected, -1 if none
 };
 
+/**
+ Get blit submission context, to be released with g2d_context_put() once blit
+ is submitted. Blits involving 3 channels surfaces are restricted to engines
+ supporting them.
+*/
+int g2d_context_get(struct g2d_context& ctx, bool three_channels);
+
+void g2d_context_put(struct g2d_context& ctx);
+
+/**
+ Wait for blits deferred on the stream bound to calling thread, if any, before
+ CPU accesses buffers.
+*/
+void io_stream_sync();
+
+int g2d_context_submit(struct g2d_context& ctx, bool deferrable);
+
 bool is_g2d_buffer(const void* vaddr, struct g2d_buf*& g2dBuf, bool& cacheable);
 
 struct g2d_buf* galloc(size_t size, bool cacheable);
@@ -64,11 +156,168 @@ int g2d_cache_clean(struct g2d_buf *buf);
 
 int g2d_cache_invalidate(struct g2d_buf *buf);
 
+/**
+ Intermediate buffers are served by the calling thread scratch arena (scratch
+ set), or by the allocator pool when the arena can not serve the request.
+*/
+struct g2d_buf* io_alloc_intermediate(size_t size, bool& scratch);
+
+void io_free_intermediate(const struct io_buffer& b);
+
+/**
+ Ratio of graphic buffer size to ROI span below which cache maintenance is
+ restricted to the ROI range.
+*/
+#define IMX2D_CACHE_RANGE_RATIO 2
+
+/**
+ Coverage of cache maintenance done by io_cache_prepare(): false if restricted
+ to the ROI range.
+*/
+struct io_cache_status {
+    bool in_whole;
+    bool out_whole;
+};
+
+/**
+ Cache maintenance of blit input and output buffers before submission. With
+ coherency tracking enabled, operations not required by buffers coherency state
+ are skipped. Maintenance of small ROI is limited to their range.
+*/
+int io_cache_prepare(const struct io_buffer& in, const struct io_buffer& out,
+                     size_t elem_size, struct io_cache_status& status);
+
+/**
+ Same as above, for input and output buffers of different element sizes.
+*/
+int io_cache_prepare(const struct io_buffer& in, size_t in_elem_size,
+                     const struct io_buffer& out, size_t out_elem_size,
+                     struct io_cache_status& status);
+
+/**
+ Input and output halves of io_cache_prepare(), for blits sharing their input
+ buffer. whole is false if maintenance has been restricted to the ROI range.
+*/
+int io_cache_prepare_input(const struct io_buffer& in, size_t elem_size,
+                           bool& whole);
+
+int io_cache_prepare_output(const struct io_buffer& out, size_t elem_size,
+                            bool& whole);
+
+/**
+ Update coherency state of blit input and output buffers after submission.
+*/
+void io_cache_complete(const struct io_buffer& in, const struct io_buffer& out,
+                       const struct io_cache_status& status);
+
+/**
+ Update coherency state of a buffer accessed by the CPU.
+*/
+void io_cpu_access(const struct io_buffer& b, bool write);
+
 void g2d_surface_init(g2d_surface& s, int cn,
                       int width, int height, int step,
                       struct g2d_buf* buf, void* vaddr,
                       enum g2d_rotation rotation = G2D_ROTATION_0);
 
+/**
+ 3 channels emulation software CSC: copy with BGR to BGRA expansion (alpha set
+ to 255) and BGRA to BGR packing. Large frames are split in bands processed in
+ parallel.
+*/
+void csc_bgr_to_bgra(const uchar* src, size_t src_step,
+                     uchar* dst, size_t dst_step, int width, int height);
+
+void csc_bgra_to_bgr(const uchar* src, size_t src_step,
+                     uchar* dst, size_t dst_step, int width, int height);
+
+/**
+ Grayscale emulation software CSC: gray replicated over BGR channels (alpha set
+ to 255), first channel extracted back.
+*/
+void csc_gray_to_bgra(const uchar* src, size_t src_step,
+                      uchar* dst, size_t dst_step, int width, int height);
+
+void csc_bgra_to_gray(const uchar* src, size_t src_step,
+                      uchar* dst, size_t dst_step, int width, int height);
+
+/**
+ Emulation CSC of 1 or 3 channels images to and from 4 channels.
+*/
+void csc_to_bgra(int src_cn, const uchar* src, size_t src_step,
+                 uchar* dst, size_t dst_step, int width, int height);
+
+void csc_from_bgra(int dst_cn, const uchar* src, size_t src_step,
+                   uchar* dst, size_t dst_step, int width, int height);
+
+/**
+ Copy from and to intermediate buffers, split in bands processed in parallel
+ for large frames like the software CSC.
+*/
+void io_copy_rows(const uchar* src, size_t src_step,
+                  uchar* dst, size_t dst_step, size_t row_bytes, int height);
+
+/**
+ Update 3 channels graphic buffer content from its 4 channels shadow if the
+ shadow is ahead. Buffer is also flagged as modified by the CPU if
+ write is set, shadow becoming stale.
+*/
+void io_shadow_sync(struct g2d_buf* buf, bool write);
+
+/**
+ Prepare G2D compatible input and output buffers. Intermediate graphic buffers
+ are allocated for Mat buffers not backed by graphic memory, and for 3 channels
+ emulation via software CSC on hardware without 3 channels support. With
+shadows enabled, 4 channels shadows of 3 channels graphic buffers are used
+instead of intermediate buffers.
+*/
+int io_preprocess(const struct io_buffer& src,
+                  const struct io_buffer& dst,
+                  int src_type, int &inout_type,
+                  struct io_buffer& in,
+                  struct io_buffer& out);
+
+/**
+ Type of G2D input and output buffers: 4 channels for 1 and 3 channels
+ emulation.
+*/
+int io_inout_type(int src_type);
+
+/**
+ Returns true if 4 channels shadows may be used for an emulated src_type.
+*/
+bool io_shadow_allowed(int src_type, int inout_type);
+
+/**
+ Input and output halves of io_preprocess(), for blits sharing their input
+ buffer. shadow enables usage of 3 channels buffers shadows.
+*/
+int io_preprocess_input(const struct io_buffer& src,
+                        int src_type, int inout_type, bool shadow,
+                        struct io_buffer& in);
+
+int io_preprocess_output(const struct io_buffer& dst,
+                         int src_type, int inout_type, bool shadow,
+                         struct io_buffer& out);
+
+/**
+ Copy back (with CSC if needed) intermediate output buffer to destination.
+*/
+int io_postprocess(const struct io_buffer& src,
+                   const struct io_buffer& dst,
+                   int src_type, int inout_type,
+                   const struct io_buffer& in,
+                   const struct io_buffer& out);
+
+/**
+ Release intermediate buffers allocated by io_preprocess().
+*/
+void io_release_intermediate(const struct io_buffer& src,
+                             const struct io_buffer& dst,
+                             int src_type, int inout_type,
+                             const struct io_buffer& in,
+                             const struct io_buffer& out);
+
 } // imx2d::
 } // cv::
 
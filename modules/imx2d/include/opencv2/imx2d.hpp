@@ -17,8 +17,11 @@
 #ifndef __OPENCV_IMX2D_HPP__
 #define __OPENCV_IMX2D_HPP__
 
+#include <functional>
+
 #include "opencv2/core.hpp"
 #include "opencv2/core/utils/allocator_stats.hpp"
+#include "opencv2/imgproc.hpp"
 
 
 /** @defgroup imx2d i.MX 2D accelerated primitives
@@ -77,6 +80,10 @@ CV_EXPORTS void setGMatAllocatorParams(const GMatAllocatorParams &allocParams);
 /**
 @brief Enables the graphic memory MatAllocator.
 
+UMat of graphic memory backed Mat (Mat::getUMat()) wrap the graphic buffer
+instead of copying it: OpenCL kernels access it as an external device, CPU
+cache is maintained on UMat creation.
+
 @param flag enable (true) or disable (false) graphic memory MatAllocator.
 */
 CV_EXPORTS void setUseGMatAllocator(bool flag);
@@ -119,11 +126,693 @@ public:
 CV_EXPORTS_W void setBufferCacheParams(const BufferCacheParams& bufferCacheParams);
 
 
+/**
+@brief Statistics of the deallocated buffers cache.
+
+@param hits Number of allocations served from the cache.
+@param misses Number of allocations not matching any cached buffer.
+@param evictions Number of cached buffers freed to make room for recent ones.
+@param cacheUsage Total number of bytes pending in the cache.
+@param cacheAllocations Number of buffers pending in the cache.
+*/
+class CV_EXPORTS_W_SIMPLE BufferCacheStats
+{
+public:
+    CV_WRAP BufferCacheStats() :
+        hits(0), misses(0), evictions(0), cacheUsage(0), cacheAllocations(0) {}
+
+    CV_PROP_RW uint64 hits;
+    CV_PROP_RW uint64 misses;
+    CV_PROP_RW uint64 evictions;
+    CV_PROP_RW size_t cacheUsage;
+    CV_PROP_RW unsigned cacheAllocations;
+};
+
+
+/**
+@brief Return the deallocated buffers cache statistics.
+
+@param cacheable true for cacheable buffers cache, false for non-cacheable.
+*/
+CV_EXPORTS_W BufferCacheStats getBufferCacheStats(bool cacheable = true);
+
+
+/**
+@brief Parameters for graphic buffers reservation
+
+Graphic buffers may be reserved ahead of time so that first allocations of
+known sizes (e.g. pipeline resolutions) do not pay for graphic memory
+allocation. For an image, size is rows * step bytes.
+@param sizes Buffers sizes in bytes.
+@param counts Number of buffers to reserve for each size.
+@param cacheable Reserved buffers cache configuration.
+*/
+class CV_EXPORTS_W_SIMPLE BufferReservationParams
+{
+public:
+    CV_WRAP BufferReservationParams(const std::vector<size_t>& _sizes = std::vector<size_t>(),
+                                    const std::vector<int>& _counts = std::vector<int>(),
+                                    bool _cacheable = true) :
+        sizes(_sizes), counts(_counts), cacheable(_cacheable) {}
+
+    CV_PROP_RW std::vector<size_t> sizes;
+    CV_PROP_RW std::vector<int> counts;
+    CV_PROP_RW bool cacheable;
+};
+
+
+/**
+@brief Reserve graphic buffers in the buffers pool.
+
+Reserved buffers serve allocations of matching size before the cache of
+deallocated buffers. They are pinned in the pool, not accounted in cache
+limits and never evicted, until released by releaseReservedBuffers().
+Error is raised if a buffer can not be allocated, buffers already reserved are
+kept.
+@param params reservation parameters.
+*/
+CV_EXPORTS_W void reserveBuffers(const BufferReservationParams& params);
+
+
+/**
+@brief Release every graphic buffer reserved by reserveBuffers().
+
+Reserved buffers in use are freed when deallocated.
+*/
+CV_EXPORTS_W void releaseReservedBuffers();
+
+
+/**
+@brief Levels of CMA pressure
+
+Graphic buffers are allocated from the CMA area (contiguous memory allocator)
+of the kernel, free CMA is compared to watermarks set by setCmaWatermarks().
+*/
+enum CmaPressureLevel {
+    CMA_PRESSURE_NONE = 0,      //!< free CMA above low watermark
+    CMA_PRESSURE_LOW = 1,       //!< free CMA below low watermark
+    CMA_PRESSURE_CRITICAL = 2,  //!< free CMA below critical watermark
+    CMA_PRESSURE_EXHAUSTED = 3, //!< graphic buffer allocation failed
+};
+
+
+/**
+@brief CMA watermarks, in bytes of free CMA
+
+Zero low watermark disables CMA monitoring.
+@param low Free CMA below which pressure is CMA_PRESSURE_LOW.
+@param critical Free CMA below which pressure is CMA_PRESSURE_CRITICAL, not
+above low.
+*/
+class CV_EXPORTS_W_SIMPLE CmaWatermarks
+{
+public:
+    CV_WRAP CmaWatermarks(size_t _low = 0, size_t _critical = 0) :
+        low(_low), critical(_critical) {}
+
+    CV_PROP_RW size_t low;
+    CV_PROP_RW size_t critical;
+};
+
+
+/**
+@brief Configure CMA pressure monitoring.
+
+Free CMA is sampled from /proc/meminfo when graphic buffers are allocated from
+the kernel, i.e. not served by reserved or cached buffers. When a graphic
+buffer can not be allocated, deallocated buffers cache is released and the
+allocation is retried before falling back to heap memory.
+@param watermarks watermarks to be applied.
+*/
+CV_EXPORTS_W void setCmaWatermarks(const CmaWatermarks& watermarks);
+
+
+/**
+@brief Callback notified of CMA pressure level changes
+
+@param level new level, see CmaPressureLevel.
+@param cmaFree free CMA in bytes.
+*/
+typedef std::function<void(int level, size_t cmaFree)> CmaPressureCallback;
+
+
+/**
+@brief Set callback notified when CMA pressure level changes.
+
+Callback is called from the allocating thread: it may release buffers (e.g.
+drop frames, releaseReservedBuffers()) but shall not allocate Mat. Empty
+callback disables notifications.
+*/
+CV_EXPORTS void setCmaPressureCallback(const CmaPressureCallback& callback);
+
+
+/**
+@brief CMA status
+
+@param total CMA area size in bytes, 0 if not reported by the kernel.
+@param free Free CMA in bytes.
+@param level Last pressure level, see CmaPressureLevel.
+@param allocFailures Number of graphic buffer allocations that failed.
+*/
+class CV_EXPORTS_W_SIMPLE CmaStatus
+{
+public:
+    CV_WRAP CmaStatus() : total(0), free(0), level(CMA_PRESSURE_NONE), allocFailures(0) {}
+
+    CV_PROP_RW size_t total;
+    CV_PROP_RW size_t free;
+    CV_PROP_RW int level;
+    CV_PROP_RW uint64 allocFailures;
+};
+
+
+/**
+@brief Return the CMA status.
+*/
+CV_EXPORTS_W CmaStatus getCmaStatus();
+
+
 /**
 @brief Return AllocatorStatisticsInterface reference to graphic MatAllocator.
 */
 CV_EXPORTS cv::utils::AllocatorStatisticsInterface& getGMatAllocatorStats();
 
+
+/**
+@brief Wraps an external DMA-BUF buffer as a Mat backed by graphic memory.
+
+Buffer is mapped and registered so that 2D accelerated primitives process it
+without intermediate copy, e.g. for frames from V4L2 or GStreamer already in
+contiguous memory. Mat does not own the buffer: DMA-BUF file descriptor shall
+remain valid until release callback is invoked.
+
+@param bufSize DMA-BUF buffer size in bytes, at most the exported buffer size.
+@param bufSize DMA-BUF buffer size in bytes.
+@param size Mat size.
+@param type Mat type.
+@param step Mat row stride in bytes, Mat::AUTO_STEP for a continuous Mat.
+@param offset offset of Mat data in the buffer.
+@param cacheable buffer CPU mapping is cacheable.
+@param release callback invoked once Mat buffer is not referenced anymore.
+*/
+CV_EXPORTS Mat importDmabuf(int fd, size_t bufSize, Size size, int type,
+                            size_t step = Mat::AUTO_STEP, size_t offset = 0,
+                            bool cacheable = true,
+                            const std::function<void()>& release = std::function<void()>());
+
+
+/**
+@brief Wraps an external physically contiguous buffer as a Mat.
+
+Similar to importDmabuf() for buffers described by physical and virtual
+address. CPU mapping is considered as non cacheable so caller is responsible
+for its cache maintenance. Both addresses shall be aligned on 64 bytes, Mat
+data may start at any offset in the buffer.
+
+@param paddr buffer physical address.
+@param vaddr buffer virtual address.
+@param bufSize buffer size in bytes.
+@param size Mat size.
+@param type Mat type.
+@param step Mat row stride in bytes, Mat::AUTO_STEP for a continuous Mat.
+@param offset offset of Mat data in the buffer.
+@param release callback invoked once Mat buffer is not referenced anymore.
+*/
+CV_EXPORTS Mat importPhysical(uint64 paddr, void* vaddr, size_t bufSize,
+                              Size size, int type,
+                              size_t step = Mat::AUTO_STEP, size_t offset = 0,
+                              const std::function<void()>& release = std::function<void()>());
+
+
+/**
+@brief Description of the graphic buffer backing a Mat
+
+@param valid Mat is backed by a graphic buffer, other fields are undefined if false.
+@param fd DMA-BUF file descriptor exporting the buffer, owned by the caller that
+shall close it. Negative if not requested or export failed.
+@param paddr buffer physical address.
+@param size buffer size in bytes.
+@param offset offset of Mat data in the buffer.
+@param cacheable buffer CPU mapping is cacheable.
+*/
+class CV_EXPORTS_W_SIMPLE BufferInfo
+{
+public:
+    CV_WRAP BufferInfo() : valid(false), fd(-1), paddr(0), size(0), offset(0),
+                           cacheable(false) {}
+
+    CV_PROP_RW bool valid;
+    CV_PROP_RW int fd;
+    CV_PROP_RW uint64 paddr;
+    CV_PROP_RW size_t size;
+    CV_PROP_RW size_t offset;
+    CV_PROP_RW bool cacheable;
+};
+
+
+/**
+@brief Returns description of the graphic buffer backing a Mat.
+
+Aimed at handing graphic memory backed Mat over to other devices (NPU, VPU
+encoder, display...) without copy. Before device access, CPU writes to
+cacheable buffers shall be made visible using syncForDevice().
+
+@param mat Mat to be described.
+@param exportFd export the buffer as DMA-BUF file descriptor. Each export
+creates a new file descriptor that the caller shall close (os.close() in
+Python), even when the Mat is released.
+*/
+CV_EXPORTS_W BufferInfo getBufferInfo(InputArray mat, bool exportFd = false);
+
+
+/**
+@brief Prepares graphic memory backed Mat for access by an external device.
+
+CPU cache is cleaned for the device to read CPU writes, then also invalidated
+if device writes the buffer so that CPU reads device writes afterwards.
+No-op if Mat is not backed by cacheable graphic memory.
+
+@param mat Mat to be accessed by device.
+@param deviceWrite device writes Mat content.
+*/
+CV_EXPORTS_W void syncForDevice(InputArray mat, bool deviceWrite = false);
+
+
+/**
+@brief Enables tracking of graphic buffers cache coherency state.
+
+Cache maintenance operations are then skipped when not required, e.g. for
+chained 2D operations where intermediate images are not accessed by the CPU.
+When enabled, every application CPU access to graphic memory backed Mat shall be
+declared beforehand using syncForCpu().
+Accesses by OpenCV functions not accelerated by the module must be declared as
+well, as they run on the CPU.
+
+@param flag enable (true) or disable (false) coherency tracking.
+*/
+CV_EXPORTS_W void setUseCoherencyTracking(bool flag);
+
+
+/**
+@brief Returns the activation status of coherency tracking.
+*/
+CV_EXPORTS_W bool useCoherencyTracking();
+
+
+/**
+@brief Enables 4 channels shadows of 3 channels graphic memory backed Mat.
+
+On hardware without 3 channels support, 3 channels operations are emulated
+with 4 channels intermediate buffers and software channels conversion on input
+and output of every operation. With shadows enabled, whole 3 channels graphic
+memory backed Mat keep a persistent 4 channels twin in graphic memory: chained
+operations stay in 4 channels and Mat content is only converted back when CPU
+access is declared. When enabled, every application CPU access to those Mat
+shall be declared beforehand using syncForCpu(), as well as accesses by OpenCV
+functions not accelerated by the module. Disabling shadows brings every Mat
+content up to date.
+
+@param flag enable (true) or disable (false) shadows.
+*/
+CV_EXPORTS_W void setUseShadowBuffers(bool flag);
+
+
+/**
+@brief Returns the activation status of 3 channels Mat shadows.
+*/
+CV_EXPORTS_W bool useShadowBuffers();
+
+
+/**
+@brief Declares upcoming CPU access to a Mat.
+
+Mat content is updated from its 4 channels shadow if needed, and coherency
+state is updated when tracking is enabled.
+No-op when coherency tracking and shadows are disabled, or Mat is not backed
+by graphic memory.
+@param mat Mat to be accessed by the CPU.
+@param write true if CPU writes Mat content, false for read only access.
+*/
+CV_EXPORTS_W void syncForCpu(InputArray mat, bool write = true);
+
+
+/**
+@brief Measures hardware and software paths of accelerated functions and sets
+the image size from which the hardware is used.
+
+For small images, the fixed cost of an hardware submission (cache
+maintenance, intermediate copies) makes the software implementation faster.
+Crossover size is measured per function, number of channels and memory type
+(graphic memory or system memory Mat), over a range of image sizes.
+Calibration takes a few seconds and requires acceleration to be enabled.
+*/
+CV_EXPORTS_W void calibrateDispatch();
+
+
+/**
+@brief Saves the dispatch profile (crossover sizes) to a file.
+
+@param filename profile file name (any cv::FileStorage format).
+*/
+CV_EXPORTS_W void saveDispatchProfile(const String& filename);
+
+
+/**
+@brief Loads a dispatch profile saved by saveDispatchProfile().
+
+Profile is applied only if it has been calibrated on the same SoC. Profile
+named by the OPENCV_IMX2D_DISPATCH_PROFILE environment variable is loaded when
+acceleration is enabled.
+@param filename profile file name.
+@return true if profile has been applied.
+*/
+CV_EXPORTS_W bool loadDispatchProfile(const String& filename);
+
+
+/**
+@brief Restores default dispatch profile: hardware used for every supported
+image size, except grayscale resize and transform that are executed by the
+software implementation until calibrated.
+*/
+CV_EXPORTS_W void resetDispatchProfile();
+
+
+/**
+@brief Latency statistics of a stage of an accelerated primitive.
+
+@param primitive primitive name: flip, resize, rotate, transform, cvtcolor, fill or copy.
+@param stage stage name: prepro (intermediate buffers preparation), cache
+(cache maintenance), g2d (hardware submission and completion) or postpro
+(intermediate buffers copy back).
+@param count number of measured executions.
+@param meanUs mean duration in microseconds.
+@param minUs minimum duration in microseconds.
+@param maxUs maximum duration in microseconds.
+@param p50Us median duration in microseconds.
+@param p95Us 95th percentile duration in microseconds.
+@param p99Us 99th percentile duration in microseconds.
+*/
+class CV_EXPORTS_W_SIMPLE ProfileStats
+{
+public:
+    CV_WRAP ProfileStats() : count(0), meanUs(0), minUs(0), maxUs(0),
+                             p50Us(0), p95Us(0), p99Us(0) {}
+
+    CV_PROP_RW String primitive;
+    CV_PROP_RW String stage;
+    CV_PROP_RW uint64 count;
+    CV_PROP_RW double meanUs;
+    CV_PROP_RW double minUs;
+    CV_PROP_RW double maxUs;
+    CV_PROP_RW double p50Us;
+    CV_PROP_RW double p95Us;
+    CV_PROP_RW double p99Us;
+};
+
+
+/**
+@brief Enable or disable latency measurement of accelerated primitives stages.
+
+Measurement may also be enabled at acceleration activation by setting
+OPENCV_IMX2D_PROFILER environment variable to 1.
+
+@param flag true to enable measurement.
+*/
+CV_EXPORTS_W void setUseProfiler(bool flag);
+
+
+/**
+@brief Returns true if latency measurement is enabled.
+*/
+CV_EXPORTS_W bool useProfiler();
+
+
+/**
+@brief Returns latency statistics of the stages measured since last reset.
+
+Statistics are aggregated over every thread, stages with no measurement are
+omitted.
+*/
+CV_EXPORTS_W std::vector<ProfileStats> getProfile();
+
+
+/**
+@brief Clears latency measurements.
+*/
+CV_EXPORTS_W void resetProfile();
+
+/**
+@brief Telemetry of an accelerated primitive.
+
+Calls falling back to the software implementation are counted per reason.
+Buffers counters tell accelerated calls processing system memory (heap)
+buffers through intermediate graphic buffer copies, from the ones processing
+graphic buffers in place.
+
+@param primitive primitive name: flip, resize, rotate, transform, cvtcolor, fill or copy.
+@param count number of accelerated calls.
+@param bytes input and output bytes processed by accelerated calls.
+@param inputHeap accelerated calls with input copied from system memory.
+@param inputGraphic accelerated calls with input in graphic memory.
+@param outputHeap accelerated calls with output copied to system memory.
+@param outputGraphic accelerated calls with output in graphic memory.
+@param fallbackDisabled calls with acceleration disabled.
+@param fallbackDepth calls with depth other than CV_8U.
+@param fallbackChannels calls with a number of channels not supported.
+@param fallbackInterpolation calls with interpolation other than INTER_LINEAR.
+@param fallbackInPlace calls with overlapping input and output.
+@param fallbackFlipBoth calls flipping around both axes.
+@param fallbackFormat calls with geometry or layout not supported by G2D.
+@param fallbackBuffers calls of graphic memory only primitives on system memory.
+@param fallbackDispatch calls below the dispatch size threshold.
+@param fallbackError calls failing on intermediate buffers or G2D errors.
+*/
+class CV_EXPORTS_W_SIMPLE HalStats
+{
+public:
+    CV_WRAP HalStats() : count(0), bytes(0), inputHeap(0), inputGraphic(0),
+        outputHeap(0), outputGraphic(0), fallbackDisabled(0), fallbackDepth(0),
+        fallbackChannels(0), fallbackInterpolation(0), fallbackInPlace(0),
+        fallbackFlipBoth(0), fallbackFormat(0), fallbackBuffers(0),
+        fallbackDispatch(0), fallbackError(0) {}
+
+    CV_PROP_RW String primitive;
+    CV_PROP_RW uint64 count;
+    CV_PROP_RW uint64 bytes;
+    CV_PROP_RW uint64 inputHeap;
+    CV_PROP_RW uint64 inputGraphic;
+    CV_PROP_RW uint64 outputHeap;
+    CV_PROP_RW uint64 outputGraphic;
+    CV_PROP_RW uint64 fallbackDisabled;
+    CV_PROP_RW uint64 fallbackDepth;
+    CV_PROP_RW uint64 fallbackChannels;
+    CV_PROP_RW uint64 fallbackInterpolation;
+    CV_PROP_RW uint64 fallbackInPlace;
+    CV_PROP_RW uint64 fallbackFlipBoth;
+    CV_PROP_RW uint64 fallbackFormat;
+    CV_PROP_RW uint64 fallbackBuffers;
+    CV_PROP_RW uint64 fallbackDispatch;
+    CV_PROP_RW uint64 fallbackError;
+};
+
+
+/**
+@brief Returns telemetry of every accelerated primitive.
+*/
+CV_EXPORTS_W std::vector<HalStats> getHalStats();
+
+
+/**
+@brief Clears primitives telemetry, including accelerated calls counters.
+*/
+CV_EXPORTS_W void resetHalStats();
+
+
+/**
+@brief Special values of cv::imx2d::transform() flip and rotation codes
+*/
+enum TransformFlags {
+    TRANSFORM_NO_FLIP = INT_MAX, //!< flipCode value disabling flip
+    TRANSFORM_NO_ROTATE = -1,    //!< rotateCode value disabling rotation
+};
+
+
+/**
+@brief Flips, rotates and resizes an image in a single operation.
+
+Equivalent to the sequence cv::flip(), cv::rotate() then cv::resize(), it is
+executed as a single 2D hardware operation when acceleration conditions are
+met, saving intermediate images and memory traffic. Otherwise, it falls back
+to the sequence of individual functions.
+
+@param src input image.
+@param dst output image of size dsize and same type as src.
+@param dsize output image size.
+@param flipCode flip code as in cv::flip(), TRANSFORM_NO_FLIP for none.
+@param rotateCode rotation code as in cv::rotate(), TRANSFORM_NO_ROTATE for none.
+@param interpolation interpolation method, see cv::InterpolationFlags.
+*/
+CV_EXPORTS_W void transform(InputArray src, OutputArray dst, Size dsize,
+                            int flipCode = TRANSFORM_NO_FLIP,
+                            int rotateCode = TRANSFORM_NO_ROTATE,
+                            int interpolation = INTER_LINEAR);
+
+
+/**
+@brief Crops several regions of an image and resizes them to the same size.
+
+Equivalent to a sequence of cv::resize() of each region, regions are submitted
+to the 2D hardware as a single batch when acceleration conditions are met:
+source image is prepared once and the CPU waits once for the completion of the
+whole batch. Typical use is the preprocessing of detected objects for a
+classification network.
+
+@param src input image.
+@param rois regions of interest, inside the input image.
+@param dsize output images size.
+@param dsts output images of size dsize and same type as src, one per region.
+@param interpolation interpolation method, see cv::InterpolationFlags.
+*/
+CV_EXPORTS_W void cropResizeBatch(InputArray src, const std::vector<Rect>& rois,
+                                  Size dsize, OutputArrayOfArrays dsts,
+                                  int interpolation = INTER_LINEAR);
+
+
+/**
+@brief Crops several regions of an image and resizes them into a blob.
+
+Same as cropResizeBatch(), output images being stored consecutively in a
+single NHWC blob: 4 dimensions Mat of CV_8U type and size (number of regions,
+dsize.height, dsize.width, src.channels()). Blob allocated from graphic memory
+may be passed as is to the NPU input tensor.
+
+@param src input image.
+@param rois regions of interest, inside the input image.
+@param dsize output images size.
+@param blob output blob.
+@param interpolation interpolation method, see cv::InterpolationFlags.
+*/
+CV_EXPORTS_W void cropResizeBlob(InputArray src, const std::vector<Rect>& rois,
+                                 Size dsize, OutputArray blob,
+                                 int interpolation = INTER_LINEAR);
+
+/**
+@brief Resizes an image preserving its aspect ratio, with borders.
+
+The input image is resized to the largest size that fits into dsize with the
+same aspect ratio, centered in the output image. Remaining output area is
+filled with borderValue. Scaling and borders filling are processed by the 2D
+hardware when acceleration conditions of cv::resize() are met. Typical use is
+the preprocessing of camera frames for a detection network.
+
+@param src input image.
+@param dst output image of size dsize and same type as src.
+@param dsize output image size.
+@param borderValue value of the borders pixels.
+@param interpolation interpolation method, see cv::InterpolationFlags.
+@return region of the output image holding the resized input image.
+*/
+CV_EXPORTS_W Rect resizeLetterbox(InputArray src, OutputArray dst, Size dsize,
+                                  const Scalar& borderValue = Scalar(),
+                                  int interpolation = INTER_LINEAR);
+
+
+/**
+@brief Sets all image pixels to a value.
+
+Equivalent to Mat::setTo() without mask, the fill is executed by the 2D
+hardware when the image is backed by graphic memory, so that CPU cache is not
+dirtied between accelerated operations. Typical use is the clear of a canvas.
+
+@param dst image to fill.
+@param value fill value, in channels order.
+*/
+CV_EXPORTS_W void setTo(InputOutputArray dst, const Scalar& value);
+
+
+/**
+@brief Copies an image to another one.
+
+Equivalent to Mat::copyTo() without mask, the copy is executed by the 2D
+hardware when both images are backed by graphic memory. Output may be a region
+of a larger image, typically for multi-camera mosaic composition.
+
+@param src input image.
+@param dst output image of same size and type as src.
+*/
+CV_EXPORTS_W void copyTo(InputArray src, OutputArray dst);
+
+
+/**
+@brief Asynchronous queue of i.MX 2D operations
+
+Operations enqueued on a Stream are submitted to the 2D hardware without
+waiting for their completion, so that the CPU may run other tasks while the
+accelerator processes the images. Every enqueue method returns a token that
+identifies the submission. Output images shall not be accessed before
+completion of the corresponding token.
+
+Asynchronous execution only applies to operations accelerated in place on
+graphic buffers (no intermediate copy or color conversion). Other operations
+complete before the enqueue method returns. Stream keeps references to input
+and output images until their processing is completed.
+*/
+class CV_EXPORTS_W Stream
+{
+public:
+    CV_WRAP Stream();
+    ~Stream();
+
+    /**
+    @brief Enqueue cv::resize() operation
+
+    @return token identifying the submission
+    */
+    CV_WRAP int64 resize(InputArray src, OutputArray dst, Size dsize,
+                         double fx = 0, double fy = 0,
+                         int interpolation = INTER_LINEAR);
+
+    /**
+    @brief Enqueue cv::flip() operation
+
+    @return token identifying the submission
+    */
+    CV_WRAP int64 flip(InputArray src, OutputArray dst, int flipCode);
+
+    /**
+    @brief Enqueue cv::rotate() operation
+
+    @return token identifying the submission
+    */
+    CV_WRAP int64 rotate(InputArray src, OutputArray dst, int rotateCode);
+
+    /**
+    @brief Wait for completion of a submission and of every earlier one.
+
+    @param token value returned by an enqueue method
+    */
+    CV_WRAP void wait(int64 token);
+
+    /**
+    @brief Returns true if submission is known as completed.
+
+    The 2D hardware can not be polled: completion is only reported for
+    submissions that were executed synchronously or already waited for.
+    @param token value returned by an enqueue method
+    */
+    CV_WRAP bool queryIfComplete(int64 token);
+
+    /**
+    @brief Wait for completion of every submission.
+    */
+    CV_WRAP void waitForCompletion();
+
+    class Impl;
+
+private:
+    Ptr<Impl> p;
+};
+
 }} // cv::imx2d::
 
 #endif //__OPENCV_IMX2D_HPP__
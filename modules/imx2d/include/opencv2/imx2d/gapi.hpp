@@ -0,0 +1,109 @@
+/*
+   Copyright 2023 NXP
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#ifndef __OPENCV_IMX2D_GAPI_HPP__
+#define __OPENCV_IMX2D_GAPI_HPP__
+
+#include "opencv2/opencv_modules.hpp"
+
+#ifdef HAVE_OPENCV_GAPI
+
+#include "opencv2/gapi.hpp"
+#include "opencv2/imx2d.hpp"
+
+/**
+@brief G-API operations and kernels of the i.MX 2D module
+
+Kernel package returned by kernels() runs on the 2D hardware the standard
+G-API crop operation, whose default kernel does not reach the HAL, plus the
+module operations below. Default kernels of the standard resize, flip and NV12
+to BGR/RGB conversions already call the accelerated functions, they are not
+replaced. Fused operations (transform(), cropResize()) are processed by a
+single 2D hardware operation: graphs shall use them instead of sequences of
+standard operations to save intermediate images.
+
+Graph buffers, intermediate images included, are allocated once by G-API with
+the default Mat allocator: they are backed by graphic memory when the graphic
+memory MatAllocator is enabled. In streaming mode, enclosing the 2D operations
+in a cv::gapi::island() runs them in their own thread so that they overlap
+with the CPU stages of the pipeline.
+*/
+
+namespace cv {
+namespace imx2d {
+namespace gapi {
+
+G_TYPED_KERNEL(GTransform, <cv::GMat(cv::GMat, cv::Size, int, int, int)>,
+               "org.nxp.imx2d.transform") {
+    static cv::GMatDesc outMeta(cv::GMatDesc in, cv::Size dsize, int, int, int) {
+        return in.withSize(dsize);
+    }
+};
+
+G_TYPED_KERNEL(GCropResize, <cv::GMat(cv::GMat, cv::Rect, cv::Size, int)>,
+               "org.nxp.imx2d.cropResize") {
+    static cv::GMatDesc outMeta(cv::GMatDesc in, cv::Rect, cv::Size dsize, int) {
+        return in.withSize(dsize);
+    }
+};
+
+
+/**
+@brief Flips, rotates and resizes an image in a single operation, see
+cv::imx2d::transform().
+
+@param src input image.
+@param dsize output image size.
+@param flipCode flip code as in cv::flip(), TRANSFORM_NO_FLIP for none.
+@param rotateCode rotation code as in cv::rotate(), TRANSFORM_NO_ROTATE for none.
+@param interpolation interpolation method, see cv::InterpolationFlags.
+*/
+CV_EXPORTS cv::GMat transform(const cv::GMat& src, const cv::Size& dsize,
+                              int flipCode = TRANSFORM_NO_FLIP,
+                              int rotateCode = TRANSFORM_NO_ROTATE,
+                              int interpolation = cv::INTER_LINEAR);
+
+
+/**
+@brief Crops a region of an image and resizes it in a single operation.
+
+Equivalent to cv::gapi::crop() followed by cv::gapi::resize(), without
+intermediate image.
+
+@param src input image.
+@param roi region of interest, inside the input image.
+@param dsize output image size.
+@param interpolation interpolation method, see cv::InterpolationFlags.
+*/
+CV_EXPORTS cv::GMat cropResize(const cv::GMat& src, const cv::Rect& roi,
+                               const cv::Size& dsize,
+                               int interpolation = cv::INTER_LINEAR);
+
+
+/**
+@brief Returns the kernel package of the i.MX 2D module.
+
+Package is passed to graph compilation, e.g.
+cv::compile_args(cv::imx2d::gapi::kernels()): its kernels then replace the
+default CPU one for cv::gapi::crop().
+*/
+CV_EXPORTS cv::gapi::GKernelPackage kernels();
+
+}}} // cv::imx2d::gapi::
+
+#endif // HAVE_OPENCV_GAPI
+
+#endif //__OPENCV_IMX2D_GAPI_HPP__
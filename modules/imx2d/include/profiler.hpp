@@ -34,13 +34,13 @@ public:
     virtual ~ProfilePoint() {}
 
     void enter() {
-        pointStart = std::chrono::system_clock::now();
+        pointStart = std::chrono::steady_clock::now();
     }
 
     void exit() {
-        std::chrono::system_clock::time_point pointExit;
+        std::chrono::steady_clock::time_point pointExit;
         uint64_t pointDurationUs;
-        pointExit = std::chrono::system_clock::now();
+        pointExit = std::chrono::steady_clock::now();
         pointDurationUs = std::chrono::duration_cast<std::chrono::microseconds>
                             (pointExit - pointStart).count();
         pointDurationUsAcc += pointDurationUs;
@@ -66,14 +66,14 @@ public:
 
 private:
     void resetPeriod() {
-        periodStart = std::chrono::system_clock::now();
+        periodStart = std::chrono::steady_clock::now();
         pointCount = 0ULL;
         pointDurationUsAcc = 0ULL;
         pointDurationUsMin = UINT64_MAX;
         pointDurationUsMax = 0ULL;
     }
-    std::chrono::system_clock::time_point periodStart;
-    std::chrono::system_clock::time_point pointStart;
+    std::chrono::steady_clock::time_point periodStart;
+    std::chrono::steady_clock::time_point pointStart;
     std::string name;
     uint64_t reportPeriodMs;
     uint64_t pointCount;
@@ -0,0 +1,216 @@
+/*
+   Copyright 2023 NXP
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+//#define DEBUG
+#ifdef DEBUG
+#define CV_LOG_STRIP_LEVEL (CV_LOG_LEVEL_VERBOSE + 1)
+#endif
+
+#include "perf_precomp.hpp"
+#include "perf_latency.hpp"
+#include <opencv2/core/utils/logger.hpp>
+
+#include "imx2d_common.hpp"
+
+namespace opencv_test {
+
+/*
+ Cache configurations of the pool:
+ - POOL_HIT: every size of the working set fits in the cache
+ - POOL_MIXED: half of the working set fits, hits and evictions are mixed
+ - POOL_MISS: cache holds no buffer, every allocation reaches G2D
+*/
+enum {POOL_HIT, POOL_MIXED, POOL_MISS};
+CV_ENUM(Pool_t, POOL_HIT, POOL_MIXED, POOL_MISS);
+
+enum {LOOKUP_GRAPHIC, LOOKUP_HEAP};
+CV_ENUM(Lookup_t, LOOKUP_GRAPHIC, LOOKUP_HEAP);
+
+typedef tuple<Pool_t, bool> Pool_Bool_t;
+typedef TestBaseWithParam<Pool_Bool_t> Pool_Bool;
+
+typedef tuple<int, Lookup_t> Count_Lookup_t;
+typedef TestBaseWithParam<Count_Lookup_t> Count_Lookup;
+
+
+// mixed working set: common pipelines matrixes from VGA gray to 1080p BGRA
+static const size_t poolSizes[] = {
+    640 * 480, 640 * 480 * 3, 640 * 480 * 4, 1280 * 720 * 3,
+    1280 * 720 * 4, 1920 * 1080, 1920 * 1080 * 3, 1920 * 1080 * 4,
+};
+#define POOL_SIZES_COUNT (sizeof(poolSizes) / sizeof(poolSizes[0]))
+
+// size of live buffers registered for lookups
+#define LOOKUP_BUFFER_SIZE (4 * 1024)
+// lookups timed per sample, a single one is too short for the tick counter
+#define LOOKUP_BATCH 16
+#define LOOKUP_SAMPLES 64
+
+
+static void setPoolConfig(int pool)
+{
+    imx2d::Imx2dGAllocator& allocator = imx2d::Imx2dGAllocator::getInstance();
+
+    if (pool == POOL_HIT)
+        allocator.setCacheConfig(BUFFER_CACHE_PARAMS_USAGE_MAX_DEFAULT,
+                                 BUFFER_CACHE_PARAMS_ALLOC_COUNT_MAX_DEFAULT);
+    else if (pool == POOL_MIXED)
+        allocator.setCacheConfig(BUFFER_CACHE_PARAMS_USAGE_MAX_DEFAULT,
+                                 POOL_SIZES_COUNT / 2);
+    else
+        allocator.setCacheConfig(BUFFER_CACHE_PARAMS_USAGE_MAX_DEFAULT, 0);
+}
+
+/*
+ Benchmark pool allocations: each cycle allocates the mixed sizes working set
+ then frees it, with sizes order rotated between cycles.
+ Allocation and free latency distributions are reported separately with the
+ resulting cache hit ratio.
+*/
+PERF_TEST_P(Pool_Bool, imx2dBufPoolMixedSizes,
+            testing::Combine(
+                Pool_t::all(),
+                testing::Bool()
+                )
+            )
+{
+    int pool = get<0>(GetParam());
+    bool cacheable = get<1>(GetParam());
+
+    imx2d::Imx2dGAllocator& allocator = imx2d::Imx2dGAllocator::getInstance();
+    std::vector<void*> handles(POOL_SIZES_COUNT);
+    LatencySamples allocLatency, freeLatency;
+    unsigned cycle = 0;
+
+    setPoolConfig(pool);
+
+    // warm up the cache with the working set
+    for (size_t i = 0; i < POOL_SIZES_COUNT; i++)
+        ASSERT_NE(allocator.alloc(poolSizes[i], cacheable, handles[i]), nullptr);
+    for (size_t i = 0; i < POOL_SIZES_COUNT; i++)
+        allocator.free(handles[i]);
+
+    uint64_t hits = allocator.getCacheHits(cacheable);
+    uint64_t misses = allocator.getCacheMisses(cacheable);
+
+    TEST_CYCLE_N(50)
+    {
+        for (size_t i = 0; i < POOL_SIZES_COUNT; i++)
+        {
+            size_t size = poolSizes[(i + cycle) % POOL_SIZES_COUNT];
+            int64 start = allocLatency.start();
+            void* vaddr = allocator.alloc(size, cacheable, handles[i]);
+            allocLatency.stop(start);
+            ASSERT_NE(vaddr, nullptr);
+        }
+
+        for (size_t i = 0; i < POOL_SIZES_COUNT; i++)
+        {
+            int64 start = freeLatency.start();
+            allocator.free(handles[i]);
+            freeLatency.stop(start);
+        }
+
+        cycle++;
+    }
+
+    hits = allocator.getCacheHits(cacheable) - hits;
+    misses = allocator.getCacheMisses(cacheable) - misses;
+
+    allocLatency.report("alloc");
+    freeLatency.report("free");
+    if (hits + misses)
+        CV_LOG_INFO(NULL, "hit ratio:" << (double)hits / (hits + misses));
+
+    if (pool == POOL_HIT)
+        ASSERT_EQ(misses, 0u);
+    else if (pool == POOL_MISS)
+        ASSERT_EQ(hits, 0u);
+
+    // back to default configuration
+    setPoolConfig(POOL_HIT);
+
+    SANITY_CHECK_NOTHING();
+}
+
+/*
+ Benchmark buffers repository lookup done for every HAL operand: addresses
+ within live graphic buffers, or heap addresses not matching any of them.
+*/
+PERF_TEST_P(Count_Lookup, imx2dBufRepoLookup,
+            testing::Combine(
+                testing::Values(10, 100, 1000),
+                Lookup_t::all()
+                )
+            )
+{
+    int count = get<0>(GetParam());
+    int lookup = get<1>(GetParam());
+
+    imx2d::Imx2dGAllocator& allocator = imx2d::Imx2dGAllocator::getInstance();
+    std::vector<void*> handles(count);
+    std::vector<uchar*> vaddrs(count);
+    LatencySamples latency;
+    bool found = true;
+
+    for (int i = 0; i < count; i++)
+    {
+        vaddrs[i] = static_cast<uchar*>(
+            allocator.alloc(LOOKUP_BUFFER_SIZE, true, handles[i]));
+        ASSERT_NE(vaddrs[i], nullptr);
+    }
+
+    // addresses looked up, random buffers and offsets
+    std::vector<void*> addresses(LOOKUP_BATCH);
+    std::vector<uchar> heap(LOOKUP_BUFFER_SIZE);
+    RNG& rng = theRNG();
+    for (int i = 0; i < LOOKUP_BATCH; i++)
+    {
+        int offset = rng.uniform(0, LOOKUP_BUFFER_SIZE);
+        if (lookup == LOOKUP_GRAPHIC)
+            addresses[i] = vaddrs[rng.uniform(0, count)] + offset;
+        else
+            addresses[i] = heap.data() + offset;
+    }
+
+    TEST_CYCLE_N(20)
+    {
+        for (int i = 0; i < LOOKUP_SAMPLES; i++)
+        {
+            int64 start = latency.start();
+            for (int j = 0; j < LOOKUP_BATCH; j++)
+            {
+                void* handle;
+                bool cacheable;
+                found &= (allocator.isGraphicBuffer(addresses[j], handle, cacheable) ==
+                          (lookup == LOOKUP_GRAPHIC));
+            }
+            latency.stop(start, LOOKUP_BATCH);
+        }
+    }
+
+    latency.report("lookup");
+
+    for (int i = 0; i < count; i++)
+        allocator.free(handles[i]);
+
+    ASSERT_TRUE(found);
+
+    SANITY_CHECK_NOTHING();
+}
+
+
+} // namespace
@@ -0,0 +1,164 @@
+/*
+   Copyright 2023 NXP
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+//#define DEBUG
+#ifdef DEBUG
+#define CV_LOG_STRIP_LEVEL (CV_LOG_LEVEL_VERBOSE + 1)
+#endif
+
+#include "perf_precomp.hpp"
+#include <opencv2/core/utils/logger.hpp>
+
+#include "imx2d_common.hpp"
+
+namespace opencv_test {
+
+enum {YUV_NV12, YUV_I420, YUV_YUYV};
+CV_ENUM(Yuv_t, YUV_NV12, YUV_I420, YUV_YUYV);
+enum {MATBUFFER_G2D_CACHED, MATBUFFER_G2D_UNCACHED, MATBUFFER_HEAP};
+CV_ENUM(MatBuffer_t, MATBUFFER_G2D_CACHED, MATBUFFER_G2D_UNCACHED, MATBUFFER_HEAP);
+
+typedef tuple<Yuv_t, Size, int> Yuv_Size_Dcn_t;
+typedef TestBaseWithParam<Yuv_Size_Dcn_t> Yuv_Size_Dcn;
+
+typedef tuple<Yuv_t, Size, int, MatBuffer_t> Yuv_Size_Dcn_MatBuffer_t;
+typedef TestBaseWithParam<Yuv_Size_Dcn_MatBuffer_t> Yuv_Size_Dcn_MatBuffer;
+
+
+// hardware conversion coefficients differ slightly from OpenCV ones
+#define PSNR_DB_MIN 25
+
+
+static inline unsigned getCvtColorHalCount()
+{
+    imx2d::Imx2dHal& imxHal = imx2d::Imx2dHal::getInstance();
+    imx2d::Imx2dHalCounters& counters = imxHal.counters;
+    return counters.readCount(imx2d::Imx2dHalCounters::CVT_COLOR);
+}
+
+static void yuvMatCreate(int yuvType, Size size, Mat& src)
+{
+    if (yuvType == YUV_YUYV)
+        src.create(size, CV_8UC2);
+    else
+        src.create(size.height * 3 / 2, size.width, CV_8UC1);
+
+    randu(src, Scalar::all(0), Scalar::all(255));
+}
+
+static int yuvCode(int yuvType, int dcn)
+{
+    switch (yuvType)
+    {
+    case YUV_NV12:
+        return (dcn == 3) ? COLOR_YUV2BGR_NV12 : COLOR_YUV2BGRA_NV12;
+    case YUV_I420:
+        return (dcn == 3) ? COLOR_YUV2BGR_I420 : COLOR_YUV2BGRA_I420;
+    default:
+        return (dcn == 3) ? COLOR_YUV2BGR_YUYV : COLOR_YUV2BGRA_YUYV;
+    }
+}
+
+// Benchmark IMX2D YUV to BGR(A) conversion
+PERF_TEST_P(Yuv_Size_Dcn_MatBuffer, imx2dCvtColorYuv,
+            testing::Combine(
+                Yuv_t::all(),
+                testing::Values(szVGA, sz1080p, sz2160p),
+                testing::Values(3, 4),
+                MatBuffer_t::all()
+                )
+            )
+{
+    int yuvType = get<0>(GetParam());
+    Size size = get<1>(GetParam());
+    int dcn = get<2>(GetParam());
+    int matBuffer = get<3>(GetParam());
+    int code = yuvCode(yuvType, dcn);
+    unsigned halCount;
+
+    // start with default state
+    setUseImx2d(false);
+    setUseGMatAllocator(false);
+
+    bool useAllocator = (matBuffer != MATBUFFER_HEAP);
+    bool cacheable = (matBuffer == MATBUFFER_G2D_CACHED);
+    setUseImx2d(true);
+    setGMatAllocatorParams(GMatAllocatorParams(0, cacheable));
+    setUseGMatAllocator(useAllocator);
+
+    Mat src;
+    yuvMatCreate(yuvType, size, src);
+    Mat dst = Mat::zeros(size, CV_MAKETYPE(CV_8U, dcn));
+
+    declare.in(src).out(dst);
+
+    halCount = getCvtColorHalCount();
+    TEST_CYCLE_N(20)
+    {
+        cvtColor(src, dst, code);
+        halCount++;
+    }
+    ASSERT_EQ(getCvtColorHalCount(), halCount);
+
+    setUseImx2d(false);
+    setUseGMatAllocator(false);
+
+    // Compare accelerated cvtColor() with CPU version
+    Mat golden;
+    cvtColor(src, golden, code);
+    ASSERT_EQ(getCvtColorHalCount(), halCount);
+
+    double psnr = cv::PSNR(dst, golden, cv::norm(golden, NORM_INF));
+    CV_LOG_DEBUG(NULL, "PSNR:" << psnr);
+    ASSERT_GE(psnr, PSNR_DB_MIN);
+
+    SANITY_CHECK_NOTHING();
+}
+
+
+// Benchmarks execution of CPU based YUV to BGR(A) conversion
+PERF_TEST_P(Yuv_Size_Dcn, cpuCvtColorYuv,
+            testing::Combine(
+                Yuv_t::all(),
+                testing::Values(szVGA, sz1080p, sz2160p),
+                testing::Values(3, 4)
+                )
+            )
+{
+    int yuvType = get<0>(GetParam());
+    Size size = get<1>(GetParam());
+    int dcn = get<2>(GetParam());
+    int code = yuvCode(yuvType, dcn);
+
+    // start with default state
+    setUseImx2d(false);
+    setUseGMatAllocator(false);
+
+    Mat src;
+    yuvMatCreate(yuvType, size, src);
+    Mat dst(size, CV_MAKETYPE(CV_8U, dcn));
+    declare.in(src).out(dst);
+
+    TEST_CYCLE_N(10)
+    {
+        cvtColor(src, dst, code);
+    }
+
+    SANITY_CHECK_NOTHING();
+}
+
+
+} // namespace
@@ -0,0 +1,126 @@
+/*
+   Copyright 2023 NXP
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#ifndef __OPENCV_PERF_LATENCY_HPP__
+#define __OPENCV_PERF_LATENCY_HPP__
+
+#include <algorithm>
+#include <vector>
+
+#include <opencv2/core/utils/logger.hpp>
+
+namespace opencv_test {
+
+/*
+ Latency samples of individual operations, reported as a distribution.
+ Perf framework statistics are computed per test cycle: operations nested in
+ a cycle (threads, allocation rounds...) are sampled here instead.
+ Samples are not thread-safe, threads shall merge their own instance.
+*/
+class LatencySamples
+{
+public:
+    LatencySamples() {}
+
+    static int64 start()
+    {
+        return getTickCount();
+    }
+
+    // ops: number of identical operations timed since start, when too short
+    // to be sampled individually
+    void stop(int64 start, unsigned ops = 1)
+    {
+        samples.push_back(static_cast<double>(getTickCount() - start) / ops);
+    }
+
+    void merge(const LatencySamples& other)
+    {
+        samples.insert(samples.end(), other.samples.begin(),
+                       other.samples.end());
+    }
+
+    size_t count() const
+    {
+        return samples.size();
+    }
+
+    // nearest rank percentile in microseconds
+    double percentileUs(double p) const
+    {
+        if (samples.empty())
+            return 0.;
+
+        std::vector<double> sorted(samples);
+        std::sort(sorted.begin(), sorted.end());
+
+        size_t rank = static_cast<size_t>(p / 100. * (sorted.size() - 1) + 0.5);
+        return toUs(sorted[rank]);
+    }
+
+    double meanUs() const
+    {
+        double sum = 0.;
+        for (auto s : samples)
+            sum += s;
+
+        return samples.empty() ? 0. : toUs(sum / samples.size());
+    }
+
+    // log distribution and record it as test properties (xml output)
+    void report(const std::string& name) const
+    {
+        double mean = meanUs(), p50 = percentileUs(50.), p95 = percentileUs(95.);
+        double p99 = percentileUs(99.), max = percentileUs(100.);
+
+        CV_LOG_INFO(NULL, name << " latency (us) count:" << count()
+                    << " mean:" << mean << " p50:" << p50 << " p95:" << p95
+                    << " p99:" << p99 << " max:" << max);
+
+        ::testing::Test::RecordProperty(name + "_count", cv::format("%zu", count()));
+        ::testing::Test::RecordProperty(name + "_mean_us", cv::format("%.2f", mean));
+        ::testing::Test::RecordProperty(name + "_p50_us", cv::format("%.2f", p50));
+        ::testing::Test::RecordProperty(name + "_p95_us", cv::format("%.2f", p95));
+        ::testing::Test::RecordProperty(name + "_p99_us", cv::format("%.2f", p99));
+        ::testing::Test::RecordProperty(name + "_max_us", cv::format("%.2f", max));
+    }
+
+private:
+    static double toUs(double ticks)
+    {
+        return ticks * 1e6 / getTickFrequency();
+    }
+
+    std::vector<double> samples;
+};
+
+// log stages distribution of accelerated primitives gathered by the profiler
+static inline void reportProfile()
+{
+    std::vector<ProfileStats> profile = getProfile();
+
+    for (const auto& s : profile)
+    {
+        CV_LOG_INFO(NULL, s.primitive << "/" << s.stage << " latency (us)"
+                    << " count:" << s.count << " mean:" << s.meanUs
+                    << " p50:" << s.p50Us << " p95:" << s.p95Us
+                    << " p99:" << s.p99Us << " max:" << s.maxUs);
+    }
+}
+
+} // namespace
+
+#endif
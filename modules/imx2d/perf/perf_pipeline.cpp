@@ -0,0 +1,222 @@
+/*
+   Copyright 2023 NXP
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+//#define DEBUG
+#ifdef DEBUG
+#define CV_LOG_STRIP_LEVEL (CV_LOG_LEVEL_VERBOSE + 1)
+#endif
+
+#include "perf_precomp.hpp"
+#include "perf_latency.hpp"
+#include <opencv2/core/utils/logger.hpp>
+
+#include <thread>
+
+namespace opencv_test {
+
+enum {MATBUFFER_G2D_CACHED, MATBUFFER_G2D_UNCACHED, MATBUFFER_HEAP};
+CV_ENUM(MatBuffer_t, MATBUFFER_G2D_CACHED, MATBUFFER_G2D_UNCACHED, MATBUFFER_HEAP);
+
+typedef tuple<MatType, Size, MatBuffer_t, bool> MatInfo_Size_MatBuffer_Bool_t;
+typedef TestBaseWithParam<MatInfo_Size_MatBuffer_Bool_t> MatInfo_Size_MatBuffer_Bool;
+
+typedef tuple<int, MatBuffer_t> Threads_MatBuffer_t;
+typedef TestBaseWithParam<Threads_MatBuffer_t> Threads_MatBuffer;
+
+
+#define PSNR_DB_MIN 30
+
+// capture chain of video_test: horizontal flip, 90 degrees rotation, resize
+#define PIPELINE_FLIP_CODE 1
+#define PIPELINE_ROTATE_CODE ROTATE_90_CLOCKWISE
+#define PIPELINE_DSIZE szVGA
+
+// calls per thread and per cycle for contention benchmark
+#define CONTENTION_CALLS 8
+
+
+static void setupBuffers(int matBuffer)
+{
+    // start with default state
+    setUseImx2d(false);
+    setUseGMatAllocator(false);
+
+    bool useAllocator = (matBuffer != MATBUFFER_HEAP);
+    bool cacheable = (matBuffer == MATBUFFER_G2D_CACHED);
+    setUseImx2d(true);
+    setGMatAllocatorParams(GMatAllocatorParams(0, cacheable));
+    setUseGMatAllocator(useAllocator);
+}
+
+static void cpuPipeline(const Mat& src, Mat& dst)
+{
+    Mat flipped, rotated;
+
+    flip(src, flipped, PIPELINE_FLIP_CODE);
+    rotate(flipped, rotated, PIPELINE_ROTATE_CODE);
+    resize(rotated, dst, PIPELINE_DSIZE, 0, 0, INTER_LINEAR);
+}
+
+/*
+ Benchmark capture-like pipeline: each cycle a new frame is written by CPU
+ to the source buffer (cap >> src) then flipped, rotated and resized either
+ with individual operations or a fused one.
+ Cycles latency distribution is reported along with accelerated primitives
+ stages one.
+*/
+PERF_TEST_P(MatInfo_Size_MatBuffer_Bool, imx2dPipelineCapture,
+            testing::Combine(
+                testing::Values(CV_8UC3, CV_8UC4),
+                testing::Values(sz720p, sz1080p),
+                MatBuffer_t::all(),
+                testing::Bool()
+                )
+            )
+{
+    int matType = get<0>(GetParam());
+    Size size = get<1>(GetParam());
+    int matBuffer = get<2>(GetParam());
+    bool fused = get<3>(GetParam());
+
+    // captured frames content from heap
+    Mat frame(size, matType);
+    cvtest::fillGradient(frame);
+
+    setupBuffers(matBuffer);
+
+    Mat src(size, matType), flipped(size, matType);
+    Mat rotated(Size(size.height, size.width), matType);
+    Mat dst = Mat::zeros(PIPELINE_DSIZE, matType);
+
+    declare.in(frame).out(dst);
+
+    LatencySamples latency;
+    setUseProfiler(true);
+    resetProfile();
+
+    TEST_CYCLE_N(30)
+    {
+        int64 start = latency.start();
+
+        frame.copyTo(src);
+
+        if (fused)
+        {
+            imx2d::transform(src, dst, PIPELINE_DSIZE,
+                             PIPELINE_FLIP_CODE, PIPELINE_ROTATE_CODE);
+        }
+        else
+        {
+            flip(src, flipped, PIPELINE_FLIP_CODE);
+            rotate(flipped, rotated, PIPELINE_ROTATE_CODE);
+            resize(rotated, dst, PIPELINE_DSIZE, 0, 0, INTER_LINEAR);
+        }
+
+        latency.stop(start);
+    }
+
+    latency.report("pipeline");
+    reportProfile();
+    setUseProfiler(false);
+
+    setUseImx2d(false);
+    setUseGMatAllocator(false);
+
+    // Compare accelerated pipeline with CPU one
+    Mat golden;
+    cpuPipeline(frame, golden);
+
+    double psnr = cv::PSNR(dst, golden, cv::norm(golden, NORM_INF));
+    CV_LOG_DEBUG(NULL, "PSNR:" << psnr);
+    ASSERT_GE(psnr, PSNR_DB_MIN);
+
+    SANITY_CHECK_NOTHING();
+}
+
+/*
+ Benchmark HAL contention: each cycle, threads concurrently resize their own
+ matrixes. Distribution of every resize latency is reported, a growing tail
+ with threads count shows serialization on G2D handles and locks.
+*/
+PERF_TEST_P(Threads_MatBuffer, imx2dResizeContention,
+            testing::Combine(
+                testing::Values(1, 2, 4),
+                MatBuffer_t::all()
+                )
+            )
+{
+    int threads = get<0>(GetParam());
+    int matBuffer = get<1>(GetParam());
+    int matType = CV_8UC4;
+    Size size = sz1080p;
+
+    setupBuffers(matBuffer);
+
+    std::vector<Mat> srcs(threads), dsts(threads);
+    std::vector<LatencySamples> latencies(threads);
+    for (int i = 0; i < threads; i++)
+    {
+        srcs[i].create(size, matType);
+        cvtest::fillGradient(srcs[i]);
+        dsts[i] = Mat::zeros(PIPELINE_DSIZE, matType);
+    }
+
+    declare.in(srcs[0]).out(dsts[0]);
+
+    TEST_CYCLE_N(10)
+    {
+        std::vector<std::thread> workers;
+
+        for (int i = 0; i < threads; i++)
+        {
+            workers.emplace_back([&, i]() {
+                for (int j = 0; j < CONTENTION_CALLS; j++)
+                {
+                    int64 start = latencies[i].start();
+                    resize(srcs[i], dsts[i], PIPELINE_DSIZE, 0, 0, INTER_LINEAR);
+                    latencies[i].stop(start);
+                }
+            });
+        }
+
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    LatencySamples latency;
+    for (const auto& l : latencies)
+        latency.merge(l);
+    latency.report("resize");
+
+    setUseImx2d(false);
+    setUseGMatAllocator(false);
+
+    // Every thread output shall match the CPU one
+    Mat golden;
+    resize(srcs[0], golden, PIPELINE_DSIZE, 0, 0, INTER_LINEAR);
+
+    for (int i = 0; i < threads; i++)
+    {
+        double psnr = cv::PSNR(dsts[i], golden, cv::norm(golden, NORM_INF));
+        CV_LOG_DEBUG(NULL, "thread:" << i << " PSNR:" << psnr);
+        ASSERT_GE(psnr, PSNR_DB_MIN);
+    }
+
+    SANITY_CHECK_NOTHING();
+}
+
+
+} // namespace
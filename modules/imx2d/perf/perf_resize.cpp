@@ -57,7 +57,7 @@ static inline unsigned getResizeHalCount()
 // Benchmark full matrix IMX2D resize
 PERF_TEST_P(MatInfo_Pair_MatBuffer, imx2dResizeMatrix,
             testing::Combine(
-                testing::Values(CV_8UC3, CV_8UC4),
+                testing::Values(CV_8UC1, CV_8UC3, CV_8UC4),
                 testing::Values(Size_Size_t(szVGA, sz1080p),
                                 Size_Size_t(sz1080p, sz2160p),
                                 Size_Size_t(sz1080p, szVGA),
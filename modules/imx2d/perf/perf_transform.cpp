@@ -0,0 +1,192 @@
+/*
+   Copyright 2023 NXP
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+//#define DEBUG
+#ifdef DEBUG
+#define CV_LOG_STRIP_LEVEL (CV_LOG_LEVEL_VERBOSE + 1)
+#endif
+
+#include "perf_precomp.hpp"
+#include <opencv2/core/utils/logger.hpp>
+
+#include "imx2d_common.hpp"
+
+namespace opencv_test {
+
+enum {MATBUFFER_G2D_CACHED, MATBUFFER_G2D_UNCACHED, MATBUFFER_HEAP};
+CV_ENUM(MatBuffer_t, MATBUFFER_G2D_CACHED, MATBUFFER_G2D_UNCACHED, MATBUFFER_HEAP);
+
+typedef tuple<MatType, Size> MatInfo_Size_t;
+typedef TestBaseWithParam<MatInfo_Size_t> MatInfo_Size;
+
+typedef tuple<MatType, Size, MatBuffer_t> MatInfo_Size_MatBuffer_t;
+typedef TestBaseWithParam<MatInfo_Size_MatBuffer_t> MatInfo_Size_MatBuffer;
+
+
+#define PSNR_DB_MIN 30
+
+// chain benchmarked: horizontal flip, 90 degrees rotation, half size resize
+#define TRANSFORM_FLIP_CODE 1
+#define TRANSFORM_ROTATE_CODE ROTATE_90_CLOCKWISE
+
+
+static inline unsigned getTransformHalCount()
+{
+    imx2d::Imx2dHal& imxHal = imx2d::Imx2dHal::getInstance();
+    imx2d::Imx2dHalCounters& counters = imxHal.counters;
+    return counters.readCount(imx2d::Imx2dHalCounters::TRANSFORM);
+}
+
+static inline Size getTransformSize(const Size& size)
+{
+    // output size after 90 degrees rotation and half size resize
+    return Size(size.height / 2, size.width / 2);
+}
+
+static void cpuTransform(const Mat& src, Mat& dst, Size dsize)
+{
+    Mat flipped, rotated;
+
+    flip(src, flipped, TRANSFORM_FLIP_CODE);
+    rotate(flipped, rotated, TRANSFORM_ROTATE_CODE);
+    resize(rotated, dst, dsize, 0, 0, INTER_LINEAR);
+}
+
+// Benchmark IMX2D fused flip + rotate + resize
+PERF_TEST_P(MatInfo_Size_MatBuffer, imx2dTransform,
+            testing::Combine(
+                testing::Values(CV_8UC3, CV_8UC4),
+                testing::Values(szVGA, sz1080p, sz2160p),
+                MatBuffer_t::all()
+                )
+            )
+{
+    int matType = get<0>(GetParam());
+    Size size = get<1>(GetParam());
+    int matBuffer = get<2>(GetParam());
+    Size dsize = getTransformSize(size);
+    unsigned halCount;
+
+    // start with default state
+    setUseImx2d(false);
+    setUseGMatAllocator(false);
+
+    bool useAllocator = (matBuffer != MATBUFFER_HEAP);
+    bool cacheable = (matBuffer == MATBUFFER_G2D_CACHED);
+    setUseImx2d(true);
+    setGMatAllocatorParams(GMatAllocatorParams(0, cacheable));
+    setUseGMatAllocator(useAllocator);
+
+    Mat src(size, matType);
+    cvtest::fillGradient(src);
+    Mat dst = Mat::zeros(dsize, matType);
+
+    declare.in(src).out(dst);
+
+    halCount = getTransformHalCount();
+    TEST_CYCLE_N(20)
+    {
+        imx2d::transform(src, dst, dsize, TRANSFORM_FLIP_CODE, TRANSFORM_ROTATE_CODE);
+        halCount++;
+    }
+    ASSERT_EQ(getTransformHalCount(), halCount);
+
+    setUseImx2d(false);
+    setUseGMatAllocator(false);
+
+    // Compare accelerated transform() with CPU chain
+    Mat golden;
+    cpuTransform(src, golden, dsize);
+    ASSERT_EQ(getTransformHalCount(), halCount);
+
+    double psnr = cv::PSNR(dst, golden, cv::norm(golden, NORM_INF));
+    CV_LOG_DEBUG(NULL, "PSNR:" << psnr);
+    ASSERT_GE(psnr, PSNR_DB_MIN);
+
+    SANITY_CHECK_NOTHING();
+}
+
+// Benchmark IMX2D chain of individual flip, rotate and resize
+PERF_TEST_P(MatInfo_Size_MatBuffer, imx2dTransformChain,
+            testing::Combine(
+                testing::Values(CV_8UC3, CV_8UC4),
+                testing::Values(szVGA, sz1080p, sz2160p),
+                MatBuffer_t::all()
+                )
+            )
+{
+    int matType = get<0>(GetParam());
+    Size size = get<1>(GetParam());
+    int matBuffer = get<2>(GetParam());
+    Size dsize = getTransformSize(size);
+
+    // start with default state
+    setUseImx2d(false);
+    setUseGMatAllocator(false);
+
+    bool useAllocator = (matBuffer != MATBUFFER_HEAP);
+    bool cacheable = (matBuffer == MATBUFFER_G2D_CACHED);
+    setUseImx2d(true);
+    setGMatAllocatorParams(GMatAllocatorParams(0, cacheable));
+    setUseGMatAllocator(useAllocator);
+
+    Mat src(size, matType);
+    cvtest::fillGradient(src);
+    Mat dst = Mat::zeros(dsize, matType);
+
+    declare.in(src).out(dst);
+
+    TEST_CYCLE_N(20)
+    {
+        cpuTransform(src, dst, dsize);
+    }
+
+    setUseImx2d(false);
+    setUseGMatAllocator(false);
+
+    SANITY_CHECK_NOTHING();
+}
+
+// Benchmarks execution of CPU based chain
+PERF_TEST_P(MatInfo_Size, cpuTransformChain,
+            testing::Combine(
+                testing::Values(CV_8UC3, CV_8UC4),
+                testing::Values(szVGA, sz1080p, sz2160p)
+                )
+            )
+{
+    int matType = get<0>(GetParam());
+    Size size = get<1>(GetParam());
+    Size dsize = getTransformSize(size);
+
+    // start with default state
+    setUseImx2d(false);
+    setUseGMatAllocator(false);
+
+    Mat src(size, matType), dst(dsize, matType);
+    cvtest::fillGradient(src);
+    declare.in(src).out(dst);
+
+    TEST_CYCLE_N(10)
+    {
+        cpuTransform(src, dst, dsize);
+    }
+
+    SANITY_CHECK_NOTHING();
+}
+
+
+} // namespace
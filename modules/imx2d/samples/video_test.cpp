@@ -28,6 +28,7 @@ namespace {
 PF_ENTRY_PERIOD_MS(__resize, 1000);
 PF_ENTRY_PERIOD_MS(__flip, 1000);
 PF_ENTRY_PERIOD_MS(__rotate, 1000);
+PF_ENTRY_PERIOD_MS(__transform, 1000);
 
 
 const std::string about =
@@ -47,6 +48,7 @@ const std::string keys  =
         "{rotate         | 0      | rotate mode (degrees clockwise) 0:none 1:90 2:180 3:270 }"
         "{imx2d          | true   | i.MX 2D acceleration }"
         "{alloc          | true   | i.MX 2D graphic allocator enabled }"
+        "{fused          | false  | flip, rotate and resize fused in a single operation }"
         ;
 }
 
@@ -91,10 +93,12 @@ int main(int argc, char *argv[]) {
 
     bool useImx2d = parser.get<bool>("imx2d");
     bool useCustomAllocator = parser.get<bool>("alloc");
+    bool useFused = parser.get<bool>("fused");
 
     std::cout
         << " useImx2d:" << useImx2d
         << " useCustomAllocator:" << useCustomAllocator
+        << " useFused:" << useFused
         << std::endl;
 
     cv::imx2d::setUseImx2d(useImx2d);
@@ -160,6 +164,27 @@ int main(int argc, char *argv[]) {
             continue;
         }
 
+        if (useFused) {
+            cv::Size fusedSize = dstSize;
+            if (!resize) {
+                bool transpose = (rotateMode == 1) || (rotateMode == 3);
+                fusedSize = transpose ? cv::Size(src.rows, src.cols) : src.size();
+            }
+
+            PF_ENTER(__transform);
+            cv::imx2d::transform(src, dstRsz, fusedSize,
+                                 flipMode ? flipCode : cv::imx2d::TRANSFORM_NO_FLIP,
+                                 rotateMode ? rotateCode : cv::imx2d::TRANSFORM_NO_ROTATE);
+            PF_EXIT(__transform);
+
+            cv::imshow(windowName, dstRsz);
+
+            int c = cv::pollKey();
+            if (c == 27)
+               break;
+            continue;
+        }
+
         if (flipMode) {
             PF_ENTER(__flip);
             cv::flip(src, dstFlip, flipCode);
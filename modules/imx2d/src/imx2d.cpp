@@ -14,17 +14,26 @@
    limitations under the License.
  */
 
+#include <float.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <unistd.h>
 
+#include <deque>
+#include <mutex>
+#include <sstream>
+
 #include "opencv2/core/utility.hpp"
 #include "opencv2/core/private.hpp"
 #include "opencv2/core/types_c.h"
 #include "opencv2/core.hpp"
+#include "opencv2/core/ocl.hpp"
 #include "opencv2/core/utils/logger.hpp"
+#include "opencv2/imgproc.hpp"
 #include "opencv2/imx2d.hpp"
 
 #include "imx2d_common.hpp"
+#include "imx2d_hal.hpp"
 
 #include <opencv2/core/utils/allocator_stats.impl.hpp>
 
@@ -41,6 +50,32 @@ static cv::utils::AllocatorStatistics& _getGMatAllocatorStats()
     return allocatorStats;
 }
 
+/**
+ UMat of a graphic memory backed Mat (Mat::getUMat()): buffer is wrapped by
+ OpenCL allocator as host pointer, GPU kernels then access it as any other
+ device. Mat::getUMat() always requests read and write access, so CPU cache is
+ cleaned and invalidated and buffer considered as written by the device.
+*/
+static void openclAccessPrepare(void* data0)
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+    void* handle;
+    bool cacheable;
+
+    // UMat buffer is accessed by the CPU
+    if (!ocl::useOpenCL())
+        return;
+
+    // device accesses buffer content, not its shadow
+    imx2d_shadow_sync(static_cast<const uchar*>(data0), true);
+
+    if (!allocator.isGraphicBuffer(data0, handle, cacheable) || !cacheable)
+        return;
+
+    if (allocator.syncForDevice(handle, true) != 0)
+        CV_LOG_WARNING(NULL, "Graphic buffer cache maintenance failed for UMat: " << data0);
+}
+
 
 //============================= GMatAllocator ================================
 
@@ -60,7 +95,10 @@ public:
                        UMatUsageFlags usageFlags) const CV_OVERRIDE
     {
         if(data0)
+        {
+            openclAccessPrepare(data0);
             return defaultAllocate(dims, sizes, type, data0, step, flags, usageFlags);
+        }
 
         size_t total = CV_ELEM_SIZE(type);
         for( int i = dims-1; i >= 0; i-- )
@@ -85,8 +123,10 @@ public:
         uchar* vaddr = static_cast<uchar*>(ptr);
         CV_Assert(cvAlignPtr(vaddr, CV_MALLOC_ALIGN) == vaddr);
 
+        // u->handle is left to OpenCL: UMat of Mat would otherwise get an
+        // OpenCL buffer copy instead of wrapping vaddr as host pointer
         UMatData* u = new UMatData(this);
-        u->handle = handle;
+        u->userdata = handle;
         u->data = u->origdata = vaddr;
         u->size = total;
         u->allocatorFlags_ = ALLOCATOR_FLAGS_IMX2D_BUFFER;
@@ -114,7 +154,7 @@ public:
         CV_Assert(u->allocatorFlags_ & ALLOCATOR_FLAGS_IMX2D_BUFFER);
 
         Imx2dGAllocator& gAlloc = Imx2dGAllocator::getInstance();
-        void* handle = u->handle;
+        void* handle = u->userdata;
         gAlloc.free(handle);
 
         u->origdata = 0;
@@ -147,6 +187,114 @@ private:
 };
 
 
+//============================= ImportAllocator ================================
+
+/**
+@brief MatAllocator of Mat wrapping imported external buffers
+
+Buffer import is released with the Mat buffer, then user release callback is
+invoked. Allocation requests for Mat reusing this allocator are forwarded to
+default allocator.
+*/
+class ImportAllocator CV_FINAL : public MatAllocator
+{
+public:
+    struct Import {
+        void* handle;
+        std::function<void()> release;
+    };
+
+    UMatData* allocate(int dims, const int* sizes, int type,
+                       void* data0, size_t* step, AccessFlag flags,
+                       UMatUsageFlags usageFlags) const CV_OVERRIDE
+    {
+        if(data0)
+        {
+            openclAccessPrepare(data0);
+            return Mat::getStdAllocator()->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+        }
+
+        MatAllocator* allocator = Mat::getDefaultAllocator();
+        return allocator->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+    }
+
+    bool allocate(UMatData* u, AccessFlag /*accessFlags*/, UMatUsageFlags /*usageFlags*/) const CV_OVERRIDE
+    {
+        if(!u) return false;
+        return true;
+    }
+
+    void deallocate(UMatData* u) const CV_OVERRIDE
+    {
+        if(!u)
+            return;
+
+        CV_Assert(u->urefcount == 0);
+        CV_Assert(u->refcount == 0);
+
+        Import* import = static_cast<Import*>(u->userdata);
+        Imx2dGAllocator& gAlloc = Imx2dGAllocator::getInstance();
+        gAlloc.releaseImport(import->handle);
+
+        if (import->release)
+            import->release();
+
+        delete import;
+        delete u;
+    }
+
+    static ImportAllocator& getInstance()
+    {
+        static ImportAllocator instance;
+        return instance;
+    }
+};
+
+static Mat wrapImport(void* vaddr, void* handle, size_t bufSize,
+                      Size size, int type, size_t step, size_t offset,
+                      const std::function<void()>& release)
+{
+    ImportAllocator& allocator = ImportAllocator::getInstance();
+    ImportAllocator::Import* import = nullptr;
+    UMatData* u = nullptr;
+
+    Mat m(size, type, static_cast<uchar*>(vaddr) + offset, step); // no alloc
+
+    // import is owned by the Mat only once wrapped
+    try {
+        import = new ImportAllocator::Import({handle, release});
+        u = new UMatData(&allocator);
+    } catch (...) {
+        delete import;
+        Imx2dGAllocator::getInstance().releaseImport(handle);
+        throw;
+    }
+
+    u->data = u->origdata = static_cast<uchar*>(vaddr);
+    u->size = bufSize;
+    u->userdata = import;
+    u->refcount = 1;
+
+    m.allocator = &allocator;
+    m.u = u;
+
+    return m;
+}
+
+static void checkImport(size_t bufSize, Size size, int type,
+                        size_t& step, size_t offset)
+{
+    CV_Assert(size.width > 0 && size.height > 0);
+
+    size_t minStep = size.width * CV_ELEM_SIZE(type);
+    if (step == Mat::AUTO_STEP)
+        step = minStep;
+
+    CV_Assert(step >= minStep);
+    CV_Assert(offset + (size.height - 1) * step + minStep <= bufSize);
+}
+
+
 //============================== GMatHandler ================================
 
 /**
@@ -252,80 +400,1224 @@ bool GMatHandler::isEnabled()
 }
 
 
-//============================ Public interface ===============================
+//=============================== Transform ==================================
 
-static void _setUseHal(bool flag)
+static void transformFallback(const Mat& src, OutputArray dst, Size dsize,
+                              int flipCode, int rotateCode, int interpolation)
 {
-    Imx2dHal& hal = Imx2dHal::getInstance();
+    Mat flipped, rotated;
 
-    hal.setEnable(flag);
+    if (flipCode != TRANSFORM_NO_FLIP)
+        cv::flip(src, flipped, flipCode);
+    else
+        flipped = src;
+
+    if (rotateCode != TRANSFORM_NO_ROTATE)
+        cv::rotate(flipped, rotated, rotateCode);
+    else
+        rotated = flipped;
+
+    cv::resize(rotated, dst, dsize, 0, 0, interpolation);
 }
 
-static bool _useHal()
+static void _transform(InputArray _src, OutputArray _dst, Size dsize,
+                       int flipCode, int rotateCode, int interpolation)
 {
-    Imx2dHal& hal = Imx2dHal::getInstance();
+    int flip_type, rotate_type;
+
+    CV_Assert(!_src.empty());
+    CV_Assert(dsize.width > 0 && dsize.height > 0);
+    CV_Assert((rotateCode == TRANSFORM_NO_ROTATE) ||
+              (rotateCode == ROTATE_90_CLOCKWISE) ||
+              (rotateCode == ROTATE_180) ||
+              (rotateCode == ROTATE_90_COUNTERCLOCKWISE));
+
+    Mat src = _src.getMat();
+
+    if (flipCode == TRANSFORM_NO_FLIP)
+        flip_type = IMX2D_FLIP_NONE;
+    else if (flipCode == 0)
+        flip_type = IMX2D_FLIP_VERTICAL;
+    else if (flipCode > 0)
+        flip_type = IMX2D_FLIP_HORIZONTAL;
+    else
+        flip_type = IMX2D_FLIP_BOTH;
 
-    return hal.isEnabled();
+    switch (rotateCode)
+    {
+    case ROTATE_90_CLOCKWISE:
+        rotate_type = IMX2D_ROTATE_90;
+        break;
+    case ROTATE_180:
+        rotate_type = IMX2D_ROTATE_180;
+        break;
+    case ROTATE_90_COUNTERCLOCKWISE:
+        rotate_type = IMX2D_ROTATE_270;
+        break;
+    default:
+        rotate_type = IMX2D_ROTATE_NONE;
+        break;
+    }
+
+    _dst.create(dsize, src.type());
+    Mat dst = _dst.getMat();
+
+    int ret = imx2d_transform(src.type(), src.data, src.step,
+                              src.cols, src.rows,
+                              dst.data, dst.step, dst.cols, dst.rows,
+                              flip_type, rotate_type, interpolation);
+    if (ret == CV_HAL_ERROR_OK)
+        return;
+
+    transformFallback(src, dst, dsize, flipCode, rotateCode, interpolation);
 }
 
-static void _setGMatAllocatorParams(const GMatAllocatorParams &allocParams)
+
+//============================= Crop and resize ==============================
+
+static void cropResizeFallback(const Mat& src, const std::vector<Rect>& rois,
+                               Size dsize, std::vector<Mat>& dsts,
+                               int interpolation)
 {
-    GMatHandler& handler = GMatHandler::getInstance();
+    for (size_t i = 0; i < rois.size(); i++)
+        cv::resize(src(rois[i]), dsts[i], dsize, 0, 0, interpolation);
+}
 
-    handler.setGMatAllocatorConfig(allocParams.sizeMin,
-                                   allocParams.cacheable);
+static void cropResizeImpl(const Mat& src, const std::vector<Rect>& rois,
+                           Size dsize, std::vector<Mat>& dsts,
+                           int interpolation)
+{
+    std::vector<int> rects;
+    std::vector<uchar*> data;
+    std::vector<size_t> steps;
+
+    for (size_t i = 0; i < rois.size(); i++)
+    {
+        rects.insert(rects.end(),
+                     { rois[i].x, rois[i].y, rois[i].width, rois[i].height });
+        data.push_back(dsts[i].data);
+        steps.push_back(dsts[i].step);
+    }
+
+    int ret = imx2d_crop_resize_batch(src.type(), src.data, src.step,
+                                      src.cols, src.rows,
+                                      rects.data(), static_cast<int>(rois.size()),
+                                      data.data(), steps.data(),
+                                      dsize.width, dsize.height, interpolation);
+    if (ret == CV_HAL_ERROR_OK)
+        return;
+
+    cropResizeFallback(src, rois, dsize, dsts, interpolation);
 }
 
-static void _setUseGMatAllocator(bool flag)
+static void checkCropResize(const Mat& src, const std::vector<Rect>& rois,
+                            Size dsize)
 {
-    GMatHandler& handler = GMatHandler::getInstance();
+    CV_Assert(!src.empty());
+    CV_Assert(dsize.width > 0 && dsize.height > 0);
 
-    handler.setUseGMatAllocator(flag);
+    Rect frame(0, 0, src.cols, src.rows);
+    for (size_t i = 0; i < rois.size(); i++)
+        CV_Assert(!rois[i].empty() && ((rois[i] & frame) == rois[i]));
 }
 
-static bool _useGMatAllocator()
+static void _cropResizeBatch(InputArray _src, const std::vector<Rect>& rois,
+                             Size dsize, OutputArrayOfArrays _dsts,
+                             int interpolation)
 {
-    GMatHandler& handler = GMatHandler::getInstance();
+    Mat src = _src.getMat();
+    int count = static_cast<int>(rois.size());
+    std::vector<Mat> dsts(count);
 
-    return handler.isEnabled();
+    checkCropResize(src, rois, dsize);
+
+    _dsts.create(count, 1, src.type(), -1, true);
+    for (int i = 0; i < count; i++)
+    {
+        _dsts.create(dsize, src.type(), i, true);
+        dsts[i] = _dsts.getMat(i);
+    }
+
+    if (count == 0)
+        return;
+
+    cropResizeImpl(src, rois, dsize, dsts, interpolation);
 }
 
-static void _setBufferCacheParams(const BufferCacheParams&
-                                bufferCacheParams)
+static void _cropResizeBlob(InputArray _src, const std::vector<Rect>& rois,
+                            Size dsize, OutputArray _blob,
+                            int interpolation)
 {
-    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
-    allocator.setCacheConfig(bufferCacheParams.cacheUsageMax,
-                             bufferCacheParams.cacheAllocCountMax);
+    Mat src = _src.getMat();
+    int count = static_cast<int>(rois.size());
+
+    checkCropResize(src, rois, dsize);
+
+    if (count == 0)
+    {
+        _blob.release();
+        return;
+    }
+
+    // NHWC
+    int sizes[] = { count, dsize.height, dsize.width, src.channels() };
+    _blob.create(4, sizes, src.depth());
+    Mat blob = _blob.getMat();
+    CV_Assert(blob.isContinuous());
+
+    // output images as consecutive slices of the blob
+    std::vector<Mat> dsts(count);
+    size_t imageSize = dsize.area() * src.elemSize();
+    for (int i = 0; i < count; i++)
+        dsts[i] = Mat(dsize, src.type(), blob.data + i * imageSize); // no alloc
+
+    cropResizeImpl(src, rois, dsize, dsts, interpolation);
 }
 
-void setUseImx2d(bool flag)
+//============================ Letterbox resize ==============================
+
+// largest centered rectangle of dsize with the aspect ratio of size
+static Rect letterboxRect(Size size, Size dsize)
 {
-    imx2d::_setUseHal(flag);
+    double scale = std::min(static_cast<double>(dsize.width) / size.width,
+                            static_cast<double>(dsize.height) / size.height);
+    int width = std::min(std::max(cvRound(size.width * scale), 1), dsize.width);
+    int height = std::min(std::max(cvRound(size.height * scale), 1), dsize.height);
+
+    return Rect((dsize.width - width) / 2, (dsize.height - height) / 2,
+                width, height);
 }
 
-bool useImx2d()
+static Rect _resizeLetterbox(InputArray _src, OutputArray _dst, Size dsize,
+                             const Scalar& borderValue, int interpolation)
 {
-    return imx2d::_useHal();
+    Mat src = _src.getMat();
+
+    CV_Assert(!src.empty());
+    CV_Assert(dsize.width > 0 && dsize.height > 0);
+
+    Rect rect = letterboxRect(src.size(), dsize);
+
+    _dst.create(dsize, src.type());
+    Mat dst = _dst.getMat();
+
+    // in place operation not supported
+    if (dst.data == src.data)
+        src = src.clone();
+
+    int rects[] = { rect.x, rect.y, rect.width, rect.height };
+    int ret = imx2d_resize_letterbox(src.type(), src.data, src.step,
+                                     src.cols, src.rows,
+                                     dst.data, dst.step, dst.cols, dst.rows,
+                                     rects, borderValue.val, interpolation);
+    if (ret == CV_HAL_ERROR_OK)
+        return rect;
+
+    // borders are filled outside of the HAL
+    imx2d_cpu_fallback(src.data, dst.data);
+    dst.setTo(borderValue);
+    Mat content = dst(rect);
+    cv::resize(src, content, rect.size(), 0, 0, interpolation);
+
+    return rect;
 }
 
-void setGMatAllocatorParams(const GMatAllocatorParams &allocParams)
+
+
+
+//============================== Fill and copy ===============================
+
+static void _setTo(InputOutputArray _dst, const Scalar& value)
 {
-    imx2d::_setGMatAllocatorParams(allocParams);
+    Mat dst = _dst.getMat();
+
+    if (dst.empty())
+        return;
+
+    if (dst.dims <= 2)
+    {
+        int ret = imx2d_fill(dst.type(), dst.data, dst.step,
+                             dst.cols, dst.rows, value.val);
+        if (ret == CV_HAL_ERROR_OK)
+            return;
+    }
+
+    imx2d_cpu_fallback(nullptr, dst.data);
+    dst.setTo(value);
 }
 
-void setUseGMatAllocator(bool flag)
+static void _copyTo(InputArray _src, OutputArray _dst)
 {
-    imx2d::_setUseGMatAllocator(flag);
+    Mat src = _src.getMat();
+
+    _dst.create(src.dims, src.size.p, src.type());
+    Mat dst = _dst.getMat();
+
+    if (src.empty() || (src.data == dst.data))
+        return;
+
+    if (src.dims <= 2)
+    {
+        int ret = imx2d_copy(src.type(), src.data, src.step,
+                             dst.data, dst.step, src.cols, src.rows);
+        if (ret == CV_HAL_ERROR_OK)
+            return;
+    }
+
+    imx2d_cpu_fallback(src.data, dst.data);
+    src.copyTo(dst);
 }
 
-bool useGMatAllocator()
+
+//================================= Stream ===================================
+
+/**
+@brief Stream implementation
+
+Submissions rely on dedicated G2D contexts bound to the calling thread for
+the duration of the enqueued operation. Images of pending submissions are
+referenced until their completion is observed. HAL waits for pending
+submissions before any CPU access from an enqueued operation, e.g. software
+fallback or 3 channels emulation.
+*/
+
+class Stream::Impl
 {
-    return imx2d::_useGMatAllocator();
+public:
+    Impl();
+    ~Impl();
+
+    int64 record(InputArray src, OutputArray dst);
+    void wait(int64 token);
+    bool queryIfComplete(int64 token);
+
+    Imx2dStream stream;
+
+private:
+    struct Pending {
+        uint64_t seq;
+        Mat src;
+        Mat dst;
+    };
+
+    void releaseCompletedNoLock();
+
+    std::mutex mutex;
+    std::deque<Pending> pending;
+};
+
+/**
+@brief Scoped binding of a stream to the calling thread
+*/
+class StreamBinding
+{
+public:
+    StreamBinding(Imx2dStream* stream) : previous(Imx2dStream::getCurrent())
+    {
+        Imx2dStream::setCurrent(stream);
+    }
+
+    ~StreamBinding()
+    {
+        Imx2dStream::setCurrent(previous);
+    }
+
+private:
+    Imx2dStream* previous;
+};
+
+Stream::Impl::Impl()
+{
+    if (!stream.isOpen())
+        CV_Error(Error::StsError, "i.MX 2D stream G2D context open failed");
 }
 
-void setBufferCacheParams(const BufferCacheParams& bufferCacheParams)
+Stream::Impl::~Impl()
 {
-    imx2d::_setBufferCacheParams(bufferCacheParams);
+    // hardware shall be done with referenced images before releasing them
+    int ret = stream.waitAll();
+    if (ret != 0)
+        CV_LOG_ERROR(NULL, "Stream completion failed: " << ret);
+}
+
+void Stream::Impl::releaseCompletedNoLock()
+{
+    while (!pending.empty() && stream.isComplete(pending.front().seq))
+        pending.pop_front();
+}
+
+int64 Stream::Impl::record(InputArray src, OutputArray dst)
+{
+    uint64_t seq = stream.getLastSubmission();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    releaseCompletedNoLock();
+    if (!stream.isComplete(seq))
+        pending.push_back({seq, src.getMat(), dst.getMat()});
+
+    return static_cast<int64>(seq);
+}
+
+void Stream::Impl::wait(int64 token)
+{
+    CV_Assert(token >= 0);
+
+    int ret = stream.wait(static_cast<uint64_t>(token));
+    if (ret != 0)
+        CV_Error(Error::StsError, "i.MX 2D stream completion failed");
+
+    std::unique_lock<std::mutex> lock(mutex);
+    releaseCompletedNoLock();
+}
+
+bool Stream::Impl::queryIfComplete(int64 token)
+{
+    CV_Assert(token >= 0);
+
+    return stream.isComplete(static_cast<uint64_t>(token));
+}
+
+
+Stream::Stream() : p(makePtr<Impl>())
+{
+}
+
+Stream::~Stream()
+{
+}
+
+int64 Stream::resize(InputArray src, OutputArray dst, Size dsize,
+                     double fx, double fy, int interpolation)
+{
+    // same size is a plain copy outside of HAL
+    Size ssize = src.size();
+    if ((dsize == ssize) || (dsize.empty() && (fx == 1.) && (fy == 1.)))
+        p->wait(static_cast<int64>(p->stream.getLastSubmission()));
+
+    {
+        StreamBinding binding(&p->stream);
+        cv::resize(src, dst, dsize, fx, fy, interpolation);
+    }
+    return p->record(src, dst);
+}
+
+int64 Stream::flip(InputArray src, OutputArray dst, int flipCode)
+{
+    {
+        StreamBinding binding(&p->stream);
+        cv::flip(src, dst, flipCode);
+    }
+    return p->record(src, dst);
+}
+
+int64 Stream::rotate(InputArray src, OutputArray dst, int rotateCode)
+{
+    {
+        StreamBinding binding(&p->stream);
+        cv::rotate(src, dst, rotateCode);
+    }
+    return p->record(src, dst);
+}
+
+void Stream::wait(int64 token)
+{
+    p->wait(token);
+}
+
+bool Stream::queryIfComplete(int64 token)
+{
+    return p->queryIfComplete(token);
+}
+
+void Stream::waitForCompletion()
+{
+    p->wait(static_cast<int64>(p->stream.getLastSubmission()));
+}
+
+
+//================================= Dispatch =================================
+
+// indexed by Imx2dHalCounters::Primitive
+static const char* dispatchPrimitiveNames[Imx2dHalCounters::PRIMITIVES_MAX] = {
+    "flip", "resize", "rotate", "transform", "cvtcolor", "fill", "copy" };
+
+// indexed by Imx2dDispatcher::Format
+static const int dispatchFormatChannels[Imx2dDispatcher::FORMATS_MAX] = { 1, 3, 4 };
+
+static std::string dispatchKey(int primitive, int format, int buffers)
+{
+    std::ostringstream key;
+    key << dispatchPrimitiveNames[primitive] << "_"
+        << dispatchFormatChannels[format] << "ch_"
+        << ((buffers == Imx2dDispatcher::BUFFERS_GRAPHIC) ? "graphic" : "system");
+    return key.str();
+}
+
+static Size dispatchDstSize(int primitive, Size size)
+{
+    switch (primitive)
+    {
+    case Imx2dHalCounters::FLIP:
+    case Imx2dHalCounters::CVT_COLOR:
+    case Imx2dHalCounters::FILL:
+    case Imx2dHalCounters::COPY:
+        return size;
+    case Imx2dHalCounters::RESIZE:
+        return Size(size.width / 2, size.height / 2);
+    case Imx2dHalCounters::ROTATE:
+        return Size(size.height, size.width);
+    default:
+        return Size(size.height / 2, size.width / 2);
+    }
+}
+
+// NV12 frames for colour conversion
+static void dispatchCreateSrc(int primitive, Size size, int type, Mat& src)
+{
+    if (primitive == Imx2dHalCounters::CVT_COLOR)
+        src.create(size.height * 3 / 2, size.width, CV_8UC1);
+    else
+        src.create(size, type);
+}
+
+static void dispatchRun(int primitive, const Mat& src, Mat& dst)
+{
+    switch (primitive)
+    {
+    case Imx2dHalCounters::FLIP:
+        cv::flip(src, dst, 1);
+        break;
+    case Imx2dHalCounters::RESIZE:
+        cv::resize(src, dst, dst.size());
+        break;
+    case Imx2dHalCounters::ROTATE:
+        cv::rotate(src, dst, ROTATE_90_CLOCKWISE);
+        break;
+    case Imx2dHalCounters::CVT_COLOR:
+        cv::cvtColor(src, dst, (dst.channels() == 3) ? COLOR_YUV2BGR_NV12 :
+                                                       COLOR_YUV2BGRA_NV12);
+        break;
+    case Imx2dHalCounters::FILL:
+        _setTo(dst, Scalar::all(128));
+        break;
+    case Imx2dHalCounters::COPY:
+        _copyTo(src, dst);
+        break;
+    default:
+        _transform(src, dst, dst.size(), 1, ROTATE_90_CLOCKWISE, INTER_LINEAR);
+        break;
+    }
+}
+
+// best execution time of a few runs, after a warm up run
+static double dispatchMeasure(int primitive, const Mat& src, Mat& dst)
+{
+    const int iterations = 5;
+    double best = DBL_MAX;
+
+    dispatchRun(primitive, src, dst);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        int64 start = getTickCount();
+        dispatchRun(primitive, src, dst);
+        best = std::min(best, static_cast<double>(getTickCount() - start));
+    }
+
+    return best;
+}
+
+static void _calibrateDispatch()
+{
+    Imx2dHal& hal = Imx2dHal::getInstance();
+    Imx2dDispatcher& dispatcher = hal.dispatcher;
+    const int widths[] = { 32, 64, 128, 256, 512, 1024, 1920 };
+    const int sizesCount = sizeof(widths) / sizeof(widths[0]);
+
+    if (!hal.isEnabled())
+        CV_Error(Error::StsError,
+                 "Dispatch calibration requires acceleration to be enabled");
+
+    // graphic memory Mat regardless of their size
+    static GMatAllocator gMatAllocator;
+    gMatAllocator.setCacheable(true);
+
+    for (int p = 0; p < Imx2dHalCounters::PRIMITIVES_MAX; p++)
+    {
+        auto primitive = static_cast<Imx2dHalCounters::Primitive>(p);
+
+        for (int f = 0; f < Imx2dDispatcher::FORMATS_MAX; f++)
+        {
+            auto format = static_cast<Imx2dDispatcher::Format>(f);
+            int type = CV_MAKETYPE(CV_8U, dispatchFormatChannels[f]);
+
+            // no grayscale output for colour conversion
+            if ((primitive == Imx2dHalCounters::CVT_COLOR) &&
+                (format == Imx2dDispatcher::FORMAT_1CH))
+                continue;
+
+            for (int b = 0; b < Imx2dDispatcher::BUFFERS_MAX; b++)
+            {
+                auto buffers = static_cast<Imx2dDispatcher::Buffers>(b);
+                MatAllocator* allocator = (buffers == Imx2dDispatcher::BUFFERS_GRAPHIC) ?
+                    &gMatAllocator : Mat::getStdAllocator();
+
+                // hardware used above calibrated range if always slower
+                Size largest(widths[sizesCount - 1], widths[sizesCount - 1] * 3 / 4);
+                size_t threshold = largest.area() + 1;
+                bool accelerated = true;
+
+                // crossover is the smallest size from which hardware is faster
+                // for every larger size
+                for (int i = sizesCount - 1; i >= 0; i--)
+                {
+                    Size size(widths[i], widths[i] * 3 / 4);
+                    Mat src, dst;
+                    src.allocator = allocator;
+                    dst.allocator = allocator;
+                    dispatchCreateSrc(primitive, size, type, src);
+                    dst.create(dispatchDstSize(primitive, size), type);
+                    randu(src, Scalar::all(0), Scalar::all(255));
+
+                    dispatcher.setThreshold(primitive, format, buffers,
+                                            Imx2dDispatcher::THRESHOLD_NEVER);
+                    double cpu = dispatchMeasure(primitive, src, dst);
+
+                    dispatcher.setThreshold(primitive, format, buffers, 0);
+                    unsigned count = hal.counters.readCount(primitive);
+                    double hw = dispatchMeasure(primitive, src, dst);
+
+                    if (hal.counters.readCount(primitive) == count)
+                    {
+                        accelerated = false;
+                        break;
+                    }
+
+                    if (hw > cpu)
+                        break;
+
+                    threshold = size.area();
+                }
+
+                // selection left to HAL support conditions if not accelerated
+                if (!accelerated)
+                    threshold = 0;
+
+                dispatcher.setThreshold(primitive, format, buffers, threshold);
+
+                CV_LOG_INFO(NULL, "imx2d dispatch " << dispatchKey(p, f, b)
+                            << ": " << threshold << " pixels");
+            }
+        }
+    }
+}
+
+static void _saveDispatchProfile(const String& filename)
+{
+    Imx2dHal& hal = Imx2dHal::getInstance();
+    Imx2dDispatcher& dispatcher = hal.dispatcher;
+
+    FileStorage fs(filename, FileStorage::WRITE);
+    if (!fs.isOpened())
+        CV_Error(Error::StsError, "Can't open dispatch profile " + filename);
+
+    fs << "soc" << hal.getHardwareCapabilities().getSocId();
+
+    // thresholds in pixels, -1 for primitives never sent to the hardware
+    for (int p = 0; p < Imx2dHalCounters::PRIMITIVES_MAX; p++)
+        for (int f = 0; f < Imx2dDispatcher::FORMATS_MAX; f++)
+            for (int b = 0; b < Imx2dDispatcher::BUFFERS_MAX; b++)
+            {
+                size_t threshold = dispatcher.getThreshold(
+                                    static_cast<Imx2dHalCounters::Primitive>(p),
+                                    static_cast<Imx2dDispatcher::Format>(f),
+                                    static_cast<Imx2dDispatcher::Buffers>(b));
+                int value = (threshold == Imx2dDispatcher::THRESHOLD_NEVER) ? -1 :
+                    static_cast<int>(std::min(threshold, static_cast<size_t>(INT_MAX)));
+                fs << dispatchKey(p, f, b) << value;
+            }
+}
+
+static bool _loadDispatchProfile(const String& filename)
+{
+    Imx2dHal& hal = Imx2dHal::getInstance();
+    Imx2dDispatcher& dispatcher = hal.dispatcher;
+    std::string soc;
+
+    FileStorage fs(filename, FileStorage::READ);
+    if (!fs.isOpened())
+    {
+        CV_LOG_WARNING(NULL, "Can't open dispatch profile " << filename);
+        return false;
+    }
+
+    fs["soc"] >> soc;
+    if (soc != hal.getHardwareCapabilities().getSocId())
+    {
+        CV_LOG_WARNING(NULL, "Dispatch profile " << filename
+                       << " calibrated for another SoC [" << soc << "]");
+        return false;
+    }
+
+    // thresholds missing from the profile keep their default value
+    dispatcher.reset();
+    for (int p = 0; p < Imx2dHalCounters::PRIMITIVES_MAX; p++)
+        for (int f = 0; f < Imx2dDispatcher::FORMATS_MAX; f++)
+            for (int b = 0; b < Imx2dDispatcher::BUFFERS_MAX; b++)
+            {
+                FileNode node = fs[dispatchKey(p, f, b)];
+                if (node.empty())
+                    continue;
+
+                int value = static_cast<int>(node);
+                size_t threshold = (value < 0) ? Imx2dDispatcher::THRESHOLD_NEVER :
+                                                 static_cast<size_t>(value);
+                dispatcher.setThreshold(static_cast<Imx2dHalCounters::Primitive>(p),
+                                        static_cast<Imx2dDispatcher::Format>(f),
+                                        static_cast<Imx2dDispatcher::Buffers>(b),
+                                        threshold);
+            }
+
+    return true;
+}
+
+static void _resetDispatchProfile()
+{
+    Imx2dHal& hal = Imx2dHal::getInstance();
+
+    hal.dispatcher.reset();
+}
+
+
+//================================= Profiler =================================
+
+// indexed by Imx2dProfiler::Stage
+static const char* profileStageNames[Imx2dProfiler::STAGES_MAX] = {
+    "prepro", "cache", "g2d", "postpro" };
+
+static std::vector<ProfileStats> _getProfile()
+{
+    Imx2dProfiler& profiler = Imx2dHal::getInstance().profiler;
+    std::vector<ProfileStats> profile;
+
+    for (int p = 0; p < Imx2dHalCounters::PRIMITIVES_MAX; p++)
+        for (int s = 0; s < Imx2dProfiler::STAGES_MAX; s++)
+        {
+            Imx2dProfiler::Stats stats = profiler.getStats(
+                                    static_cast<Imx2dHalCounters::Primitive>(p),
+                                    static_cast<Imx2dProfiler::Stage>(s));
+            if (stats.count == 0)
+                continue;
+
+            ProfileStats ps;
+            ps.primitive = dispatchPrimitiveNames[p];
+            ps.stage = profileStageNames[s];
+            ps.count = stats.count;
+            ps.meanUs = stats.sum / 1000. / stats.count;
+            ps.minUs = stats.min / 1000.;
+            ps.maxUs = stats.max / 1000.;
+            ps.p50Us = stats.p50 / 1000.;
+            ps.p95Us = stats.p95 / 1000.;
+            ps.p99Us = stats.p99 / 1000.;
+            profile.push_back(ps);
+        }
+
+    return profile;
+}
+
+
+//================================ HAL stats =================================
+
+static std::vector<HalStats> _getHalStats()
+{
+    Imx2dHalCounters& counters = Imx2dHal::getInstance().counters;
+    std::vector<HalStats> stats(Imx2dHalCounters::PRIMITIVES_MAX);
+
+    for (int p = 0; p < Imx2dHalCounters::PRIMITIVES_MAX; p++)
+    {
+        auto primitive = static_cast<Imx2dHalCounters::Primitive>(p);
+        HalStats& s = stats[p];
+
+        s.primitive = dispatchPrimitiveNames[p];
+        s.count = counters.readCount(primitive);
+        s.bytes = counters.readBytes(primitive);
+        s.inputHeap = counters.readBuffers(primitive, Imx2dHalCounters::BUFFER_INPUT_HEAP);
+        s.inputGraphic = counters.readBuffers(primitive, Imx2dHalCounters::BUFFER_INPUT_GRAPHIC);
+        s.outputHeap = counters.readBuffers(primitive, Imx2dHalCounters::BUFFER_OUTPUT_HEAP);
+        s.outputGraphic = counters.readBuffers(primitive, Imx2dHalCounters::BUFFER_OUTPUT_GRAPHIC);
+
+        s.fallbackDisabled = counters.readFallback(primitive, Imx2dHalCounters::REASON_DISABLED);
+        s.fallbackDepth = counters.readFallback(primitive, Imx2dHalCounters::REASON_DEPTH);
+        s.fallbackChannels = counters.readFallback(primitive, Imx2dHalCounters::REASON_CHANNELS);
+        s.fallbackInterpolation = counters.readFallback(primitive, Imx2dHalCounters::REASON_INTERPOLATION);
+        s.fallbackInPlace = counters.readFallback(primitive, Imx2dHalCounters::REASON_IN_PLACE);
+        s.fallbackFlipBoth = counters.readFallback(primitive, Imx2dHalCounters::REASON_FLIP_BOTH);
+        s.fallbackFormat = counters.readFallback(primitive, Imx2dHalCounters::REASON_FORMAT);
+        s.fallbackBuffers = counters.readFallback(primitive, Imx2dHalCounters::REASON_BUFFERS);
+        s.fallbackDispatch = counters.readFallback(primitive, Imx2dHalCounters::REASON_DISPATCH);
+        s.fallbackError = counters.readFallback(primitive, Imx2dHalCounters::REASON_ERROR);
+    }
+
+    return stats;
+}
+
+
+//============================ Public interface ===============================
+
+static void _setUseHal(bool flag)
+{
+    Imx2dHal& hal = Imx2dHal::getInstance();
+
+    hal.setEnable(flag);
+
+    // saved dispatch profile applied on activation
+    const char* profile = getenv("OPENCV_IMX2D_DISPATCH_PROFILE");
+    if (flag && profile)
+        (void)_loadDispatchProfile(profile);
+
+    // stages latency measurement requested without application change
+    const char* profiler = getenv("OPENCV_IMX2D_PROFILER");
+    if (flag && profiler && (atoi(profiler) != 0))
+        hal.profiler.setEnabled(true);
+}
+
+static bool _useHal()
+{
+    Imx2dHal& hal = Imx2dHal::getInstance();
+
+    return hal.isEnabled();
+}
+
+static void _setGMatAllocatorParams(const GMatAllocatorParams &allocParams)
+{
+    GMatHandler& handler = GMatHandler::getInstance();
+
+    handler.setGMatAllocatorConfig(allocParams.sizeMin,
+                                   allocParams.cacheable);
+}
+
+static Mat _importDmabuf(int fd, size_t bufSize, Size size, int type,
+                         size_t step, size_t offset, bool cacheable,
+                         const std::function<void()>& release)
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+    void* handle;
+
+    CV_Assert(fd >= 0);
+    checkImport(bufSize, size, type, step, offset);
+
+    void* vaddr = allocator.importDmabuf(fd, bufSize, cacheable, handle);
+    if (!vaddr)
+        CV_Error(Error::StsError, "DMA-BUF import failed");
+
+    return wrapImport(vaddr, handle, bufSize, size, type, step, offset, release);
+}
+
+static Mat _importPhysical(uint64 paddr, void* vaddr, size_t bufSize,
+                           Size size, int type, size_t step, size_t offset,
+                           const std::function<void()>& release)
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+    void* handle;
+
+    CV_Assert(vaddr);
+    checkImport(bufSize, size, type, step, offset);
+
+    vaddr = allocator.importPhysical(paddr, vaddr, bufSize, handle);
+    if (!vaddr)
+        CV_Error(Error::StsError, "Physical buffer import failed");
+
+    return wrapImport(vaddr, handle, bufSize, size, type, step, offset, release);
+}
+
+static BufferInfo _getBufferInfo(InputArray _mat, bool exportFd)
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+    BufferInfo info;
+    void* handle;
+    uint64_t paddr;
+
+    Mat mat = _mat.getMat();
+    if (mat.empty())
+        return info;
+
+    info.valid = allocator.getBufferDescription(mat.data, handle, paddr,
+                                                info.size, info.offset,
+                                                info.cacheable);
+    if (!info.valid)
+        return info;
+
+    info.paddr = static_cast<uint64>(paddr);
+    if (exportFd)
+        info.fd = allocator.exportDmabuf(handle);
+
+    return info;
+}
+
+static void _syncForDevice(InputArray _mat, bool deviceWrite)
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+    void* handle;
+    bool cacheable;
+
+    Mat mat = _mat.getMat();
+    if (mat.empty())
+        return;
+
+    // device accesses buffer content, not its shadow
+    imx2d_shadow_sync(mat.data, deviceWrite);
+
+    if (!allocator.isGraphicBuffer(mat.data, handle, cacheable) || !cacheable)
+        return;
+
+    int ret = allocator.syncForDevice(handle, deviceWrite);
+    if (ret != 0)
+        CV_Error(Error::StsError, "Graphic buffer cache maintenance failed");
+}
+
+static void _setUseCoherencyTracking(bool flag)
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+
+    allocator.setCoherencyTracking(flag);
+}
+
+static bool _useCoherencyTracking()
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+
+    return allocator.getCoherencyTracking();
+}
+
+static void _syncForCpu(InputArray _mat, bool write)
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+    void* handle;
+    bool cacheable;
+
+    Mat mat = _mat.getMat();
+    if (mat.empty())
+        return;
+
+    imx2d_shadow_sync(mat.data, write);
+
+    if (!allocator.getCoherencyTracking())
+        return;
+
+    if (!allocator.isGraphicBuffer(mat.data, handle, cacheable))
+        return;
+
+    allocator.declareCpuAccess(handle, write);
+}
+
+static void _setUseShadowBuffers(bool flag)
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+
+    allocator.setShadowMode(flag);
+
+    // buffers content is brought up to date before shadows release
+    if (!flag)
+        imx2d_shadow_release_all();
+}
+
+static bool _useShadowBuffers()
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+
+    return allocator.getShadowMode();
+}
+
+static void _setUseGMatAllocator(bool flag)
+{
+    GMatHandler& handler = GMatHandler::getInstance();
+
+    handler.setUseGMatAllocator(flag);
+}
+
+static bool _useGMatAllocator()
+{
+    GMatHandler& handler = GMatHandler::getInstance();
+
+    return handler.isEnabled();
+}
+
+static void _setBufferCacheParams(const BufferCacheParams&
+                                bufferCacheParams)
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+    allocator.setCacheConfig(bufferCacheParams.cacheUsageMax,
+                             bufferCacheParams.cacheAllocCountMax);
+}
+
+static BufferCacheStats _getBufferCacheStats(bool cacheable)
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+    BufferCacheStats stats;
+
+    stats.hits = allocator.getCacheHits(cacheable);
+    stats.misses = allocator.getCacheMisses(cacheable);
+    stats.evictions = allocator.getCacheEvictions(cacheable);
+    stats.cacheUsage = allocator.getCacheUsage(cacheable);
+    stats.cacheAllocations = allocator.getCacheAllocations(cacheable);
+
+    return stats;
+}
+
+static void _reserveBuffers(const BufferReservationParams& params)
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+
+    CV_Assert(params.sizes.size() == params.counts.size());
+
+    for (size_t i = 0; i < params.sizes.size(); i++)
+    {
+        CV_Assert(params.sizes[i] > 0 && params.counts[i] >= 0);
+        unsigned count = static_cast<unsigned>(params.counts[i]);
+
+        if (allocator.reserveBuffers(params.sizes[i], count,
+                                     params.cacheable) != count)
+            CV_Error(Error::StsNoMem, "Graphic buffers reservation failed");
+    }
+}
+
+static void _releaseReservedBuffers()
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+
+    allocator.releaseReservedBuffers();
+}
+
+static void _setCmaWatermarks(const CmaWatermarks& watermarks)
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+
+    CV_Assert(watermarks.critical <= watermarks.low);
+
+    allocator.setCmaWatermarks(watermarks.low, watermarks.critical);
+}
+
+static void _setCmaPressureCallback(const CmaPressureCallback& callback)
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+
+    if (!callback)
+    {
+        allocator.setCmaPressureCallback(Imx2dGAllocator::CmaPressureCallback());
+        return;
+    }
+
+    allocator.setCmaPressureCallback(
+        [callback](Imx2dGAllocator::CmaPressure level, size_t cmaFree) {
+            callback(static_cast<int>(level), cmaFree);
+        });
+}
+
+static CmaStatus _getCmaStatus()
+{
+    Imx2dGAllocator& allocator = Imx2dGAllocator::getInstance();
+    CmaStatus status;
+
+    (void) Imx2dGAllocator::readCmaInfo(status.total, status.free);
+    status.level = static_cast<int>(allocator.getCmaPressure());
+    status.allocFailures = allocator.getAllocFailures();
+
+    return status;
+}
+
+void transform(InputArray src, OutputArray dst, Size dsize,
+               int flipCode, int rotateCode, int interpolation)
+{
+    imx2d::_transform(src, dst, dsize, flipCode, rotateCode, interpolation);
+}
+
+void cropResizeBatch(InputArray src, const std::vector<Rect>& rois,
+                     Size dsize, OutputArrayOfArrays dsts, int interpolation)
+{
+    imx2d::_cropResizeBatch(src, rois, dsize, dsts, interpolation);
+}
+
+void cropResizeBlob(InputArray src, const std::vector<Rect>& rois,
+                    Size dsize, OutputArray blob, int interpolation)
+{
+    imx2d::_cropResizeBlob(src, rois, dsize, blob, interpolation);
+}
+
+void setTo(InputOutputArray dst, const Scalar& value)
+{
+    imx2d::_setTo(dst, value);
+}
+
+void copyTo(InputArray src, OutputArray dst)
+{
+    imx2d::_copyTo(src, dst);
+}
+
+Rect resizeLetterbox(InputArray src, OutputArray dst, Size dsize,
+                     const Scalar& borderValue, int interpolation)
+{
+    return imx2d::_resizeLetterbox(src, dst, dsize, borderValue, interpolation);
+}
+
+void setUseProfiler(bool flag)
+{
+    Imx2dHal::getInstance().profiler.setEnabled(flag);
+}
+
+bool useProfiler()
+{
+    return Imx2dHal::getInstance().profiler.isEnabled();
+}
+
+std::vector<ProfileStats> getProfile()
+{
+    return imx2d::_getProfile();
+}
+
+void resetProfile()
+{
+    Imx2dHal::getInstance().profiler.reset();
+}
+
+std::vector<HalStats> getHalStats()
+{
+    return imx2d::_getHalStats();
+}
+
+void resetHalStats()
+{
+    Imx2dHal::getInstance().counters.reset();
+}
+
+void calibrateDispatch()
+{
+    imx2d::_calibrateDispatch();
+}
+
+void saveDispatchProfile(const String& filename)
+{
+    imx2d::_saveDispatchProfile(filename);
+}
+
+bool loadDispatchProfile(const String& filename)
+{
+    return imx2d::_loadDispatchProfile(filename);
+}
+
+void resetDispatchProfile()
+{
+    imx2d::_resetDispatchProfile();
+}
+
+void setUseImx2d(bool flag)
+{
+    imx2d::_setUseHal(flag);
+}
+
+bool useImx2d()
+{
+    return imx2d::_useHal();
+}
+
+void setGMatAllocatorParams(const GMatAllocatorParams &allocParams)
+{
+    imx2d::_setGMatAllocatorParams(allocParams);
+}
+
+void setUseGMatAllocator(bool flag)
+{
+    imx2d::_setUseGMatAllocator(flag);
+}
+
+bool useGMatAllocator()
+{
+    return imx2d::_useGMatAllocator();
+}
+
+Mat importDmabuf(int fd, size_t bufSize, Size size, int type,
+                 size_t step, size_t offset, bool cacheable,
+                 const std::function<void()>& release)
+{
+    return imx2d::_importDmabuf(fd, bufSize, size, type, step, offset,
+                                cacheable, release);
+}
+
+Mat importPhysical(uint64 paddr, void* vaddr, size_t bufSize,
+                   Size size, int type, size_t step, size_t offset,
+                   const std::function<void()>& release)
+{
+    return imx2d::_importPhysical(paddr, vaddr, bufSize, size, type, step,
+                                  offset, release);
+}
+
+BufferInfo getBufferInfo(InputArray mat, bool exportFd)
+{
+    return imx2d::_getBufferInfo(mat, exportFd);
+}
+
+void syncForDevice(InputArray mat, bool deviceWrite)
+{
+    imx2d::_syncForDevice(mat, deviceWrite);
+}
+
+void setUseCoherencyTracking(bool flag)
+{
+    imx2d::_setUseCoherencyTracking(flag);
+}
+
+bool useCoherencyTracking()
+{
+    return imx2d::_useCoherencyTracking();
+}
+
+void setUseShadowBuffers(bool flag)
+{
+    imx2d::_setUseShadowBuffers(flag);
+}
+
+bool useShadowBuffers()
+{
+    return imx2d::_useShadowBuffers();
+}
+
+void syncForCpu(InputArray mat, bool write)
+{
+    imx2d::_syncForCpu(mat, write);
+}
+
+void setBufferCacheParams(const BufferCacheParams& bufferCacheParams)
+{
+    imx2d::_setBufferCacheParams(bufferCacheParams);
+}
+
+BufferCacheStats getBufferCacheStats(bool cacheable)
+{
+    return imx2d::_getBufferCacheStats(cacheable);
+}
+
+void reserveBuffers(const BufferReservationParams& params)
+{
+    imx2d::_reserveBuffers(params);
+}
+
+void releaseReservedBuffers()
+{
+    imx2d::_releaseReservedBuffers();
+}
+
+void setCmaWatermarks(const CmaWatermarks& watermarks)
+{
+    imx2d::_setCmaWatermarks(watermarks);
+}
+
+void setCmaPressureCallback(const CmaPressureCallback& callback)
+{
+    imx2d::_setCmaPressureCallback(callback);
+}
+
+CmaStatus getCmaStatus()
+{
+    return imx2d::_getCmaStatus();
 }
 
 cv::utils::AllocatorStatisticsInterface& getGMatAllocatorStats()
@@ -0,0 +1,100 @@
+/*
+   Copyright 2023 NXP
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "opencv2/imx2d/gapi.hpp"
+
+#ifdef HAVE_OPENCV_GAPI
+
+#include "opencv2/core.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/gapi/core.hpp"
+#include "opencv2/gapi/imgproc.hpp"
+#include "opencv2/gapi/cpu/gcpukernel.hpp"
+
+namespace cv {
+namespace imx2d {
+namespace gapi {
+
+/*
+ Kernels run on the CPU backend: G-API preallocates their outputs, then the
+ module functions submit the operation to the 2D hardware, or fall back to the
+ software implementation outside of acceleration conditions.
+
+ Default CPU kernels of resize, flip and NV12 conversions already call the
+ HAL accelerated functions: package only provides the kernels of operations
+ that don't reach the HAL otherwise.
+*/
+
+// Mat::copyTo() is not a HAL entry, module copy is used instead
+GAPI_OCV_KERNEL(GImx2dCrop, cv::gapi::core::GCrop)
+{
+    static void run(const cv::Mat& in, const cv::Rect& roi, cv::Mat& out)
+    {
+        cv::imx2d::copyTo(in(roi), out);
+    }
+};
+
+GAPI_OCV_KERNEL(GImx2dTransform, GTransform)
+{
+    static void run(const cv::Mat& in, cv::Size dsize, int flipCode,
+                    int rotateCode, int interpolation, cv::Mat& out)
+    {
+        cv::imx2d::transform(in, out, dsize, flipCode, rotateCode, interpolation);
+    }
+};
+
+// region is resized in place in the input graphic buffer
+GAPI_OCV_KERNEL(GImx2dCropResize, GCropResize)
+{
+    static void run(const cv::Mat& in, const cv::Rect& roi, cv::Size dsize,
+                    int interpolation, cv::Mat& out)
+    {
+        cv::resize(in(roi), out, dsize, 0, 0, interpolation);
+    }
+};
+
+
+cv::GMat transform(const cv::GMat& src, const cv::Size& dsize, int flipCode,
+                   int rotateCode, int interpolation)
+{
+    CV_Assert(dsize.width > 0 && dsize.height > 0);
+
+    return GTransform::on(src, dsize, flipCode, rotateCode, interpolation);
+}
+
+cv::GMat cropResize(const cv::GMat& src, const cv::Rect& roi,
+                    const cv::Size& dsize, int interpolation)
+{
+    CV_Assert(roi.width > 0 && roi.height > 0);
+    CV_Assert(dsize.width > 0 && dsize.height > 0);
+
+    return GCropResize::on(src, roi, dsize, interpolation);
+}
+
+cv::gapi::GKernelPackage kernels()
+{
+    static auto pkg = cv::gapi::kernels
+        < GImx2dCrop
+        , GImx2dTransform
+        , GImx2dCropResize
+        >();
+
+    return pkg;
+}
+
+}}} // cv::imx2d::gapi::
+
+#endif // HAVE_OPENCV_GAPI
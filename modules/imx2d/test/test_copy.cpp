@@ -0,0 +1,82 @@
+/*
+   Copyright 2023 NXP
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "test_precomp.hpp"
+
+namespace opencv_test { namespace {
+
+class Imx2dFillCopy : public cvtest::BaseTest
+{
+public:
+    Imx2dFillCopy(int _type) : type(_type) {}
+protected:
+    void run(int);
+    int type;
+};
+
+void Imx2dFillCopy::run(int)
+{
+    Imx2dHal& hal = Imx2dHal::getInstance();
+    const Scalar value(10, 20, 30, 40);
+    const Size tile(320, 240);
+    Mat canvas, src, expected;
+
+    setUseImx2d(true);
+    setGMatAllocatorParams(GMatAllocatorParams(0, true));
+    setUseGMatAllocator(true);
+
+    // canvas clear
+    canvas.create(tile.height * 2, tile.width * 2, type);
+    unsigned fillCount = hal.counters.readCount(Imx2dHalCounters::FILL);
+    setTo(canvas, value);
+    EXPECT_EQ(hal.counters.readCount(Imx2dHalCounters::FILL), fillCount + 1);
+
+    expected.create(canvas.size(), type);
+    expected.setTo(value);
+    EXPECT_EQ(cvtest::norm(canvas, expected, NORM_INF), 0);
+
+    // mosaic composition, tiles copied into canvas regions
+    src.create(tile, type);
+    randu(src, Scalar::all(0), Scalar::all(255));
+
+    unsigned copyCount = hal.counters.readCount(Imx2dHalCounters::COPY);
+    copyTo(src, canvas(Rect(Point(0, 0), tile)));
+    copyTo(src, canvas(Rect(Point(tile.width, tile.height), tile)));
+    EXPECT_EQ(hal.counters.readCount(Imx2dHalCounters::COPY), copyCount + 2);
+
+    src.copyTo(expected(Rect(Point(0, 0), tile)));
+    src.copyTo(expected(Rect(Point(tile.width, tile.height), tile)));
+    EXPECT_EQ(cvtest::norm(canvas, expected, NORM_INF), 0);
+
+    canvas.release();
+    src.release();
+    expected.release();
+
+    setUseGMatAllocator(false);
+    setUseImx2d(false);
+}
+
+TEST(CV_Imx2dFillCopy, gray) {
+    Imx2dFillCopy test(CV_8UC1);
+    test.safe_run();
+}
+
+TEST(CV_Imx2dFillCopy, bgra) {
+    Imx2dFillCopy test(CV_8UC4);
+    test.safe_run();
+}
+
+}} // namespace
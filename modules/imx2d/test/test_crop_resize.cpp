@@ -0,0 +1,175 @@
+/*
+   Copyright 2023 NXP
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "test_precomp.hpp"
+
+namespace opencv_test { namespace {
+
+class Imx2dCropResizeBatch : public cvtest::BaseTest
+{
+public:
+    Imx2dCropResizeBatch(bool _allocator, int _type = CV_8UC4) :
+        allocator(_allocator), type(_type) {}
+protected:
+    void run(int);
+    bool allocator;
+    int type;
+};
+
+void Imx2dCropResizeBatch::run(int)
+{
+    Imx2dHal& hal = Imx2dHal::getInstance();
+    const Size dsize(224, 224);
+    std::vector<Rect> rois = { Rect(0, 0, 640, 480), Rect(10, 20, 100, 50),
+                               Rect(300, 200, 224, 224), Rect(600, 400, 40, 80) };
+    std::vector<Mat> dsts;
+    Mat src, blob;
+
+    setUseImx2d(true);
+    setGMatAllocatorParams(GMatAllocatorParams(0, true));
+    setUseGMatAllocator(allocator);
+
+    src.create(480, 640, type);
+    randu(src, Scalar::all(0), Scalar::all(255));
+
+    // grayscale batch kept on the CPU until calibrated
+    bool accelerated = (CV_MAT_CN(type) != 1);
+    unsigned resizeCount = hal.counters.readCount(Imx2dHalCounters::RESIZE);
+    uint64_t dispatchCount = hal.counters.readFallback(Imx2dHalCounters::RESIZE,
+                                                       Imx2dHalCounters::REASON_DISPATCH);
+    cropResizeBatch(src, rois, dsize, dsts);
+    EXPECT_EQ(hal.counters.readCount(Imx2dHalCounters::RESIZE),
+              resizeCount + (accelerated ? rois.size() : 0));
+    if (!accelerated)
+        EXPECT_GT(hal.counters.readFallback(Imx2dHalCounters::RESIZE,
+                                            Imx2dHalCounters::REASON_DISPATCH),
+                  dispatchCount);
+    ASSERT_EQ(dsts.size(), rois.size());
+
+    cropResizeBlob(src, rois, dsize, blob);
+    ASSERT_EQ(blob.dims, 4);
+    EXPECT_EQ(blob.size[0], static_cast<int>(rois.size()));
+    EXPECT_EQ(blob.size[1], dsize.height);
+    EXPECT_EQ(blob.size[2], dsize.width);
+    EXPECT_EQ(blob.size[3], src.channels());
+
+    // batch results match individual resizes
+    for (size_t i = 0; i < rois.size(); i++)
+    {
+        Mat golden;
+        cv::resize(src(rois[i]), golden, dsize);
+        EXPECT_EQ(dsts[i].size(), dsize);
+        EXPECT_EQ(cvtest::norm(dsts[i], golden, NORM_INF), 0);
+
+        Mat slice(dsize, src.type(), blob.ptr(static_cast<int>(i)));
+        EXPECT_EQ(cvtest::norm(slice, golden, NORM_INF), 0);
+    }
+
+    src.release();
+    blob.release();
+    dsts.clear();
+
+    setUseGMatAllocator(false);
+    setUseImx2d(false);
+}
+
+TEST(CV_Imx2dCropResize, batchGMat) {
+    Imx2dCropResizeBatch test(true);
+    test.safe_run();
+}
+
+TEST(CV_Imx2dCropResize, batchHeap) {
+    Imx2dCropResizeBatch test(false);
+    test.safe_run();
+}
+
+TEST(CV_Imx2dCropResize, batchGray) {
+    Imx2dCropResizeBatch test(true, CV_8UC1);
+    test.safe_run();
+}
+
+class Imx2dResizeLetterbox : public cvtest::BaseTest
+{
+public:
+    Imx2dResizeLetterbox(int _type) : type(_type) {}
+protected:
+    void run(int);
+    int type;
+};
+
+void Imx2dResizeLetterbox::run(int)
+{
+    Imx2dHal& hal = Imx2dHal::getInstance();
+    const Size dsize(320, 320);
+    const Scalar borderValue(114, 114, 114, 255);
+    Mat src, dst;
+
+    setUseImx2d(true);
+    setGMatAllocatorParams(GMatAllocatorParams(0, true));
+    setUseGMatAllocator(true);
+
+    // grayscale resize kept on the CPU until calibrated
+    for (int b = 0; b < Imx2dDispatcher::BUFFERS_MAX; b++)
+        hal.dispatcher.setThreshold(Imx2dHalCounters::RESIZE,
+                                    Imx2dDispatcher::FORMAT_1CH,
+                                    static_cast<Imx2dDispatcher::Buffers>(b), 0);
+
+    src.create(480, 640, type);
+    randu(src, Scalar::all(0), Scalar::all(255));
+
+    unsigned resizeCount = hal.counters.readCount(Imx2dHalCounters::RESIZE);
+    Rect rect = resizeLetterbox(src, dst, dsize, borderValue);
+    EXPECT_EQ(hal.counters.readCount(Imx2dHalCounters::RESIZE), resizeCount + 1);
+
+    // aspect ratio preserved, image centered
+    EXPECT_EQ(rect, Rect(0, 40, 320, 240));
+    ASSERT_EQ(dst.size(), dsize);
+    ASSERT_EQ(dst.type(), type);
+
+    Mat golden;
+    cv::resize(src, golden, rect.size());
+    EXPECT_EQ(cvtest::norm(dst(rect), golden, NORM_INF), 0);
+
+    Mat border(Size(dsize.width, rect.y), type, borderValue);
+    EXPECT_EQ(cvtest::norm(dst(Rect(0, 0, dsize.width, rect.y)), border, NORM_INF), 0);
+    EXPECT_EQ(cvtest::norm(dst(Rect(0, rect.br().y, dsize.width, rect.y)), border, NORM_INF), 0);
+
+    src.release();
+    dst.release();
+    golden.release();
+    border.release();
+
+    hal.dispatcher.reset();
+    setUseGMatAllocator(false);
+    setUseImx2d(false);
+}
+
+TEST(CV_Imx2dResizeLetterbox, gray) {
+    Imx2dResizeLetterbox test(CV_8UC1);
+    test.safe_run();
+}
+
+TEST(CV_Imx2dResizeLetterbox, bgr) {
+    Imx2dResizeLetterbox test(CV_8UC3);
+    test.safe_run();
+}
+
+TEST(CV_Imx2dResizeLetterbox, bgra) {
+    Imx2dResizeLetterbox test(CV_8UC4);
+    test.safe_run();
+}
+
+}} // namespace
@@ -21,6 +21,7 @@
 
 #include "test_precomp.hpp"
 #include "opencv2/core/ocl.hpp"
+#include <thread>
 
 #include "imx2d_common.hpp" // cache snoop
 
@@ -371,7 +372,9 @@ void Imx2dBufferPoolCache::run(int)
     EXPECT_EQ(alloc.getCacheUsage(!cacheable), __PAGE_SZ * 0U);
 
     // allocate one buffer (from cache, one remaining)
+    uint64_t hits0 = alloc.getCacheHits(cacheable);
     allocateMats({__PAGE_SZ}, vmat);
+    EXPECT_EQ(alloc.getCacheHits(cacheable), hits0 + 1);
     EXPECT_EQ(alloc.getAllocations(), 1U);
     EXPECT_EQ(alloc.getCacheAllocations(cacheable), 1U);
     EXPECT_EQ(alloc.getCacheAllocations(!cacheable), 0U);
@@ -511,8 +514,14 @@ void Imx2dBufferPoolCache::run(int)
     EXPECT_EQ(alloc.getCacheAllocations(!cacheable), 0U);
     EXPECT_EQ(alloc.getCacheUsage(cacheable), __PAGE_SZ * (6U + 3U + 4U + 2U));
     EXPECT_EQ(alloc.getCacheUsage(!cacheable), __PAGE_SZ * 0U);
+    uint64_t hits = alloc.getCacheHits(cacheable);
+    uint64_t misses = alloc.getCacheMisses(cacheable);
+    uint64_t evictions = alloc.getCacheEvictions(cacheable);
     allocateMats({__PAGE_SZ * 8}, vmat);
     deallocateMats(vmat);
+    EXPECT_EQ(alloc.getCacheHits(cacheable), hits);
+    EXPECT_EQ(alloc.getCacheMisses(cacheable), misses + 1);
+    EXPECT_EQ(alloc.getCacheEvictions(cacheable), evictions + 2);
     EXPECT_EQ(alloc.getAllocations(), 0U);
     EXPECT_EQ(alloc.getCacheAllocations(cacheable), 3U);
     EXPECT_EQ(alloc.getCacheAllocations(!cacheable), 0U);
@@ -545,4 +554,647 @@ TEST(CV_Imx2dMat, poolCacheNonCacheable) {
 }
 
 
+class Imx2dBufferReservation : public Imx2dBase
+{
+protected:
+    void run(int);
+};
+
+void Imx2dBufferReservation::run(int)
+{
+    Imx2dGAllocator& alloc = Imx2dGAllocator::getInstance();
+    const size_t size = 640 * 480 * 4;
+
+    preamble();
+
+    setGMatAllocatorParams(GMatAllocatorParams(1, true));
+    setUseGMatAllocator(true);
+
+    reserveBuffers(BufferReservationParams({size}, {2}, true));
+    EXPECT_EQ(alloc.getReservedAllocations(true), 2U);
+    EXPECT_GE(alloc.getReservedUsage(true), 2 * size);
+    EXPECT_EQ(alloc.getReservedAllocations(false), 0U);
+
+    {
+        // served from reservation, not accounted as cache hit
+        uint64_t hits = alloc.getCacheHits(true);
+        uint64_t reservedHits = alloc.getReservedHits(true);
+        Mat m(480, 640, CV_8UC4);
+        EXPECT_EQ(alloc.getReservedAllocations(true), 1U);
+        EXPECT_EQ(alloc.getCacheAllocations(true), 0U);
+        EXPECT_EQ(alloc.getCacheHits(true), hits);
+        EXPECT_EQ(alloc.getReservedHits(true), reservedHits + 1);
+    }
+    // back to reservation, not to the cache
+    EXPECT_EQ(alloc.getReservedAllocations(true), 2U);
+    EXPECT_EQ(alloc.getCacheAllocations(true), 0U);
+
+    // not drained with the cache
+    setBufferCacheParams(BufferCacheParams());
+    EXPECT_EQ(alloc.getReservedAllocations(true), 2U);
+
+    {
+        // too small for reuse
+        Mat m(100, 100, CV_8UC4);
+        EXPECT_EQ(alloc.getReservedAllocations(true), 2U);
+    }
+
+    {
+        // in use buffer is unpinned by release
+        Mat m(480, 640, CV_8UC4);
+        releaseReservedBuffers();
+        EXPECT_EQ(alloc.getReservedAllocations(true), 0U);
+        EXPECT_EQ(alloc.getReservedUsage(true), 0U);
+    }
+    EXPECT_EQ(alloc.getReservedAllocations(true), 0U);
+
+    postamble();
+}
+
+TEST(CV_Imx2dMat, bufferReservation) {
+    Imx2dBufferReservation test;
+    test.safe_run();
+}
+
+
+class Imx2dMatScratchArena : public Imx2dBase
+{
+protected:
+    void run(int);
+};
+
+void Imx2dMatScratchArena::run(int)
+{
+    Imx2dGAllocator& alloc = Imx2dGAllocator::getInstance();
+    cv::imx2d::Imx2dScratchArena& arena = cv::imx2d::Imx2dScratchArena::getInstance();
+    Imx2dHal& hal = Imx2dHal::getInstance();
+
+    preamble();
+
+    setUseImx2d(true);
+    {
+        // system memory Mats: intermediate buffers served by the arena
+        Mat src(480, 640, CV_8UC4, Scalar(1, 2, 3, 4)), dst;
+        unsigned resizeCount = hal.counters.readCount(Imx2dHalCounters::RESIZE);
+        resize(src, dst, Size(320, 240));
+        EXPECT_EQ(hal.counters.readCount(Imx2dHalCounters::RESIZE), resizeCount + 1);
+        EXPECT_EQ(alloc.getAllocations(), 0U);
+        EXPECT_GE(arena.getUsage(), size_t(640 * 480 * 4 + 320 * 240 * 4));
+        EXPECT_EQ(dst.at<Vec4b>(10, 10), Vec4b(1, 2, 3, 4));
+
+        // arena buffers reused
+        size_t usage = arena.getUsage();
+        resize(src, dst, Size(320, 240));
+        EXPECT_EQ(arena.getUsage(), usage);
+    }
+    setUseImx2d(false);
+    EXPECT_EQ(arena.getUsage(), 0U);
+
+    postamble();
+}
+
+TEST(CV_Imx2dMat, scratchArena) {
+    Imx2dMatScratchArena test;
+    test.safe_run();
+}
+
+
+class Imx2dShadowBuffers : public Imx2dBase
+{
+protected:
+    void run(int);
+};
+
+void Imx2dShadowBuffers::run(int)
+{
+    Imx2dHal& hal = Imx2dHal::getInstance();
+    HardwareCapabilities& hwCaps = hal.getHardwareCapabilities();
+    if (hwCaps.hasCapability(HardwareCapabilities::THREE_CHANNELS))
+        throw SkipTestException("3 channels supported by hardware");
+
+    Mat ref, ref2;
+    Mat src(480, 640, CV_8UC3);
+    randu(src, Scalar::all(0), Scalar::all(255));
+    cv::resize(src, ref, Size(320, 240));
+    cv::flip(ref, ref2, 1);
+
+    preamble();
+
+    setUseImx2d(true);
+    setGMatAllocatorParams(GMatAllocatorParams(0, true));
+    setUseGMatAllocator(true);
+    setUseShadowBuffers(true);
+    EXPECT_TRUE(useShadowBuffers());
+
+    {
+        Mat gsrc, tmp, dst;
+        src.copyTo(gsrc);
+
+        // chained operations via shadows, content converted on CPU access
+        resize(gsrc, tmp, Size(320, 240));
+        flip(tmp, dst, 1);
+        syncForCpu(dst, false);
+        EXPECT_LE(cvtest::norm(dst, ref2, NORM_INF), 1);
+
+        // CPU write makes shadow stale
+        syncForCpu(gsrc, true);
+        gsrc.setTo(Scalar(1, 2, 3));
+        resize(gsrc, tmp, Size(320, 240));
+        syncForCpu(tmp, false);
+        EXPECT_EQ(tmp.at<Vec3b>(10, 10), Vec3b(1, 2, 3));
+
+        // disabling shadows updates Mat content
+        flip(gsrc, tmp, 0);
+        setUseShadowBuffers(false);
+        EXPECT_EQ(tmp.at<Vec3b>(10, 10), Vec3b(1, 2, 3));
+    }
+
+    EXPECT_FALSE(useShadowBuffers());
+    setUseImx2d(false);
+
+    postamble();
+}
+
+TEST(CV_Imx2dMat, shadowBuffers) {
+    Imx2dShadowBuffers test;
+    test.safe_run();
+}
+
+
+class Imx2dCoherencyTracking : public Imx2dBase
+{
+protected:
+    void run(int);
+    Imx2dGAllocator::Coherency getCoherency(const Mat& m);
+};
+
+Imx2dGAllocator::Coherency Imx2dCoherencyTracking::getCoherency(const Mat& m)
+{
+    Imx2dGAllocator& alloc = Imx2dGAllocator::getInstance();
+    void* handle;
+    bool cacheable;
+
+    EXPECT_TRUE(alloc.isGraphicBuffer(m.data, handle, cacheable));
+    return alloc.getCoherency(handle);
+}
+
+void Imx2dCoherencyTracking::run(int)
+{
+    preamble();
+
+    setUseImx2d(true);
+    setGMatAllocatorParams(GMatAllocatorParams(0, true));
+    setUseGMatAllocator(true);
+    setUseCoherencyTracking(true);
+    EXPECT_TRUE(useCoherencyTracking());
+
+    {
+        Mat src(480, 640, CV_8UC4), dst(240, 320, CV_8UC4), dst2(120, 160, CV_8UC4);
+
+        // new buffers may hold dirty CPU cache lines
+        EXPECT_EQ(getCoherency(src), Imx2dGAllocator::COHERENCY_CPU_DIRTY);
+        syncForCpu(src, true);
+        src.setTo(Scalar(1, 2, 3, 4));
+
+        // input cleaned for the device, output written by the device
+        resize(src, dst, dst.size());
+        EXPECT_EQ(getCoherency(src), Imx2dGAllocator::COHERENCY_CLEAN);
+        EXPECT_EQ(getCoherency(dst), Imx2dGAllocator::COHERENCY_DEVICE);
+
+        // chained operation input stays device owned
+        resize(dst, dst2, dst2.size());
+        EXPECT_EQ(getCoherency(dst), Imx2dGAllocator::COHERENCY_DEVICE);
+        EXPECT_EQ(getCoherency(dst2), Imx2dGAllocator::COHERENCY_DEVICE);
+
+        // CPU read then write
+        syncForCpu(dst2, false);
+        EXPECT_EQ(getCoherency(dst2), Imx2dGAllocator::COHERENCY_CLEAN);
+        EXPECT_EQ(dst2.at<Vec4b>(0, 0), Vec4b(1, 2, 3, 4));
+        syncForCpu(dst2, true);
+        EXPECT_EQ(getCoherency(dst2), Imx2dGAllocator::COHERENCY_CPU_DIRTY);
+
+        // software fallback (nearest interpolation) writes output on the CPU
+        resize(src, dst, dst.size(), 0, 0, INTER_NEAREST);
+        EXPECT_EQ(getCoherency(dst), Imx2dGAllocator::COHERENCY_CPU_DIRTY);
+    }
+
+    setUseCoherencyTracking(false);
+    EXPECT_FALSE(useCoherencyTracking());
+    setUseImx2d(false);
+
+    postamble();
+}
+
+TEST(CV_Imx2dMat, coherencyTracking) {
+    Imx2dCoherencyTracking test;
+    test.safe_run();
+}
+
+class Imx2dUMatInterop : public Imx2dBase
+{
+protected:
+    void run(int);
+};
+
+void Imx2dUMatInterop::run(int)
+{
+    if (!cv::ocl::haveOpenCL())
+        throw SkipTestException("OpenCL not available");
+
+    preamble();
+
+    bool useOpenCL = cv::ocl::useOpenCL();
+    cv::ocl::setUseOpenCL(true);
+    setUseImx2d(true);
+    setGMatAllocatorParams(GMatAllocatorParams(0, true));
+    setUseGMatAllocator(true);
+    setUseCoherencyTracking(true);
+
+    {
+        Imx2dGAllocator& alloc = Imx2dGAllocator::getInstance();
+        Mat src(480, 640, CV_8UC4), dst(480, 640, CV_8UC4), golden;
+        void* handle;
+        bool cacheable;
+
+        syncForCpu(src, true);
+        cvtest::fillGradient(src);
+        flip(src, golden, 1);
+        syncForCpu(golden, false);
+
+        {
+            UMat usrc = src.getUMat(ACCESS_READ);
+            UMat udst = dst.getUMat(ACCESS_WRITE);
+
+            // OpenCL buffers wrap graphic buffers, no copy
+            EXPECT_FALSE(usrc.u->tempCopiedUMat());
+            EXPECT_FALSE(udst.u->tempCopiedUMat());
+
+            // CPU cache handed over to the GPU
+            ASSERT_TRUE(alloc.isGraphicBuffer(dst.data, handle, cacheable));
+            EXPECT_EQ(alloc.getCoherency(handle), Imx2dGAllocator::COHERENCY_DEVICE);
+
+            // hal not involved: UMat operation runs OpenCL kernel
+            flip(usrc, udst, 1);
+        }
+
+        // GPU output processed by G2D, then read by the CPU
+        Mat resized(240, 320, CV_8UC4), goldenResized(240, 320, CV_8UC4);
+        resize(dst, resized, resized.size());
+        resize(golden, goldenResized, goldenResized.size());
+        syncForCpu(dst, false);
+        syncForCpu(resized, false);
+        syncForCpu(goldenResized, false);
+
+        EXPECT_EQ(cvtest::norm(dst, golden, NORM_INF), 0);
+        EXPECT_EQ(cvtest::norm(resized, goldenResized, NORM_INF), 0);
+    }
+
+    setUseCoherencyTracking(false);
+    setUseImx2d(false);
+    cv::ocl::setUseOpenCL(useOpenCL);
+
+    postamble();
+}
+
+TEST(CV_Imx2dMat, umatInterop) {
+    Imx2dUMatInterop test;
+    test.safe_run();
+}
+
+class Imx2dConcurrentLookup : public Imx2dBase
+{
+protected:
+    void run(int);
+};
+
+void Imx2dConcurrentLookup::run(int)
+{
+    const int nThreads = 8;
+    const int nIter = 200;
+    std::atomic<int> errors(0);
+
+    preamble();
+
+    setGMatAllocatorParams(GMatAllocatorParams(0, true));
+    setUseGMatAllocator(true);
+
+    {
+        Imx2dGAllocator& alloc = Imx2dGAllocator::getInstance();
+        Mat shared(480, 640, CV_8UC4);
+        std::vector<std::thread> threads;
+
+        // lookups run concurrently with registrations from other threads
+        for (int t = 0; t < nThreads; t++)
+        {
+            threads.push_back(std::thread([&, t]() {
+                void* handle;
+                bool cacheable;
+                for (int i = 0; i < nIter; i++)
+                {
+                    Mat local(64 + t, 64 + i % 16, CV_8UC4);
+                    Mat roi = local(Rect(1, 1, 16, 16));
+                    if (!alloc.isGraphicBuffer(roi.data, handle, cacheable) ||
+                        !alloc.isGraphicBuffer(shared.data + shared.step[0], handle, cacheable))
+                        errors++;
+                    std::vector<uchar> heap(64);
+                    if (alloc.isGraphicBuffer(heap.data(), handle, cacheable))
+                        errors++;
+                }
+            }));
+        }
+        for (auto& th : threads)
+            th.join();
+    }
+
+    EXPECT_EQ(errors.load(), 0);
+
+    postamble();
+}
+
+TEST(CV_Imx2dMat, concurrentLookup) {
+    Imx2dConcurrentLookup test;
+    test.safe_run();
+}
+
+
+class Imx2dDispatchProfile : public Imx2dBase
+{
+protected:
+    void run(int);
+};
+
+void Imx2dDispatchProfile::run(int)
+{
+    Imx2dHal& hal = Imx2dHal::getInstance();
+    Imx2dDispatcher& dispatcher = hal.dispatcher;
+    const std::string filename = cv::tempfile(".yml");
+
+    preamble();
+
+    setUseImx2d(true);
+    {
+        Mat src(480, 640, CV_8UC4, Scalar(1, 2, 3, 4)), dst;
+        Mat small(120, 160, CV_8UC4, Scalar(1, 2, 3, 4));
+
+        // profile save / load round trip
+        dispatcher.setThreshold(Imx2dHalCounters::RESIZE,
+                                Imx2dDispatcher::FORMAT_4CH,
+                                Imx2dDispatcher::BUFFERS_SYSTEM,
+                                Imx2dDispatcher::THRESHOLD_NEVER);
+        saveDispatchProfile(filename);
+        resetDispatchProfile();
+        EXPECT_EQ(dispatcher.getThreshold(Imx2dHalCounters::RESIZE,
+                                          Imx2dDispatcher::FORMAT_4CH,
+                                          Imx2dDispatcher::BUFFERS_SYSTEM), 0U);
+        EXPECT_TRUE(loadDispatchProfile(filename));
+        EXPECT_EQ(dispatcher.getThreshold(Imx2dHalCounters::RESIZE,
+                                          Imx2dDispatcher::FORMAT_4CH,
+                                          Imx2dDispatcher::BUFFERS_SYSTEM),
+                  Imx2dDispatcher::THRESHOLD_NEVER);
+        EXPECT_FALSE(loadDispatchProfile(filename + ".missing"));
+
+        // grayscale resize and transform on the CPU until calibrated
+        EXPECT_EQ(dispatcher.getThreshold(Imx2dHalCounters::RESIZE,
+                                          Imx2dDispatcher::FORMAT_1CH,
+                                          Imx2dDispatcher::BUFFERS_GRAPHIC),
+                  Imx2dDispatcher::THRESHOLD_NEVER);
+        EXPECT_EQ(dispatcher.getThreshold(Imx2dHalCounters::TRANSFORM,
+                                          Imx2dDispatcher::FORMAT_1CH,
+                                          Imx2dDispatcher::BUFFERS_SYSTEM),
+                  Imx2dDispatcher::THRESHOLD_NEVER);
+
+        // software path
+        unsigned resizeCount = hal.counters.readCount(Imx2dHalCounters::RESIZE);
+        resize(src, dst, Size(320, 240));
+        EXPECT_EQ(hal.counters.readCount(Imx2dHalCounters::RESIZE), resizeCount);
+        EXPECT_EQ(dst.at<Vec4b>(10, 10), Vec4b(1, 2, 3, 4));
+
+        // hardware used from threshold size
+        dispatcher.setThreshold(Imx2dHalCounters::RESIZE,
+                                Imx2dDispatcher::FORMAT_4CH,
+                                Imx2dDispatcher::BUFFERS_SYSTEM, 640 * 480);
+        resize(small, dst, Size(80, 60));
+        EXPECT_EQ(hal.counters.readCount(Imx2dHalCounters::RESIZE), resizeCount);
+        resize(src, dst, Size(320, 240));
+        EXPECT_EQ(hal.counters.readCount(Imx2dHalCounters::RESIZE), resizeCount + 1);
+        EXPECT_EQ(dst.at<Vec4b>(10, 10), Vec4b(1, 2, 3, 4));
+
+        resetDispatchProfile();
+    }
+    setUseImx2d(false);
+    remove(filename.c_str());
+
+    postamble();
+}
+
+TEST(CV_Imx2dMat, dispatchProfile) {
+    Imx2dDispatchProfile test;
+    test.safe_run();
+}
+
+class Imx2dStageProfiler : public Imx2dBase
+{
+protected:
+    void run(int);
+};
+
+void Imx2dStageProfiler::run(int)
+{
+    Imx2dHal& hal = Imx2dHal::getInstance();
+
+    preamble();
+
+    setUseImx2d(true);
+    {
+        Mat src(480, 640, CV_8UC4, Scalar(1, 2, 3, 4)), dst;
+        const int iterations = 10;
+
+        // disabled by default
+        EXPECT_FALSE(useProfiler());
+        resetProfile();
+        resize(src, dst, Size(320, 240));
+        EXPECT_TRUE(getProfile().empty());
+
+        setUseProfiler(true);
+        unsigned resizeCount = hal.counters.readCount(Imx2dHalCounters::RESIZE);
+        for (int i = 0; i < iterations; i++)
+            resize(src, dst, Size(320, 240));
+        bool accelerated = (hal.counters.readCount(Imx2dHalCounters::RESIZE) ==
+                            resizeCount + iterations);
+        EXPECT_TRUE(accelerated);
+
+        std::vector<ProfileStats> profile = getProfile();
+        int stages = 0;
+        for (size_t i = 0; i < profile.size(); i++)
+        {
+            const ProfileStats& s = profile[i];
+            if (s.primitive != "resize")
+                continue;
+
+            stages++;
+            EXPECT_EQ(s.count, static_cast<uint64>(iterations));
+            EXPECT_LE(s.minUs, s.p50Us);
+            EXPECT_LE(s.p50Us, s.p95Us);
+            EXPECT_LE(s.p95Us, s.p99Us);
+            EXPECT_LE(s.p99Us, s.maxUs);
+        }
+        if (accelerated)
+            EXPECT_EQ(stages, static_cast<int>(Imx2dProfiler::STAGES_MAX));
+
+        resetProfile();
+        EXPECT_TRUE(getProfile().empty());
+        setUseProfiler(false);
+    }
+    setUseImx2d(false);
+
+    postamble();
+}
+
+TEST(CV_Imx2dMat, profiler) {
+    Imx2dStageProfiler test;
+    test.safe_run();
+}
+
+class Imx2dHalTelemetry : public Imx2dBase
+{
+protected:
+    void run(int);
+};
+
+static HalStats halStats(const std::string& primitive)
+{
+    std::vector<HalStats> stats = getHalStats();
+    for (size_t i = 0; i < stats.size(); i++)
+        if (stats[i].primitive == primitive)
+            return stats[i];
+    return HalStats();
+}
+
+void Imx2dHalTelemetry::run(int)
+{
+    preamble();
+
+    setUseImx2d(true);
+    {
+        Mat src(480, 640, CV_8UC4, Scalar(1, 2, 3, 4)), dst;
+        Mat src16(480, 640, CV_16UC4, Scalar(1, 2, 3, 4));
+
+        resetHalStats();
+        EXPECT_EQ(halStats("resize").count, 0U);
+
+        // system memory buffers copied in and out
+        resize(src, dst, Size(320, 240));
+        HalStats stats = halStats("resize");
+        EXPECT_EQ(stats.count, 1U);
+        EXPECT_EQ(stats.inputHeap, 1U);
+        EXPECT_EQ(stats.outputHeap, 1U);
+        EXPECT_EQ(stats.bytes, static_cast<uint64>(640 * 480 * 4 + 320 * 240 * 4));
+
+        // rejection reasons
+        resize(src, dst, Size(320, 240), 0, 0, INTER_NEAREST);
+        resize(src16, dst, Size(320, 240));
+        stats = halStats("resize");
+        EXPECT_EQ(stats.count, 1U);
+        EXPECT_EQ(stats.fallbackInterpolation, 1U);
+        EXPECT_EQ(stats.fallbackDepth, 1U);
+
+        flip(src, src, 1);
+        EXPECT_EQ(halStats("flip").fallbackInPlace, 1U);
+
+        setUseImx2d(false);
+        resize(src, dst, Size(320, 240));
+        EXPECT_EQ(halStats("resize").fallbackDisabled, 1U);
+        setUseImx2d(true);
+
+        resetHalStats();
+    }
+    setUseImx2d(false);
+
+    postamble();
+}
+
+TEST(CV_Imx2dMat, halTelemetry) {
+    Imx2dHalTelemetry test;
+    test.safe_run();
+}
+
+class Imx2dHardwareCapabilities : public Imx2dBase
+{
+protected:
+    void run(int);
+};
+
+void Imx2dHardwareCapabilities::run(int)
+{
+    Imx2dHal& hal = Imx2dHal::getInstance();
+    HardwareCapabilities& hwCaps = hal.getHardwareCapabilities();
+
+    preamble();
+
+    ASSERT_TRUE(hwCaps.hasSupport());
+    ASSERT_FALSE(hwCaps.getEngines().empty());
+    EXPECT_TRUE(hwCaps.hasFormat(HardwareCapabilities::FORMAT_RGBA));
+    EXPECT_EQ(hwCaps.hasFormat(HardwareCapabilities::FORMAT_RGB),
+              hwCaps.hasCapability(HardwareCapabilities::THREE_CHANNELS));
+
+    postamble();
+}
+
+TEST(CV_Imx2dMat, hardwareCapabilities) {
+    Imx2dHardwareCapabilities test;
+    test.safe_run();
+}
+
+class Imx2dCmaPressure : public Imx2dBase
+{
+protected:
+    void run(int);
+};
+
+void Imx2dCmaPressure::run(int)
+{
+    std::vector<int> levels;
+    size_t lastFree = 0;
+
+    preamble();
+
+    CmaStatus status = getCmaStatus();
+    if (status.total == 0)
+        throw SkipTestException("CMA not reported by the kernel");
+    EXPECT_LE(status.free, status.total);
+
+    setCmaPressureCallback([&levels, &lastFree](int level, size_t cmaFree) {
+        levels.push_back(level);
+        lastFree = cmaFree;
+    });
+    // whole CMA area as critical watermark, every allocation is under pressure
+    setCmaWatermarks(CmaWatermarks(status.total + 1, status.total + 1));
+
+    setUseGMatAllocator(true);
+    {
+        // size not matching cached buffers, allocated from the kernel
+        Mat m(1013, 1019, CV_8UC3);
+        Mat n(1013, 1019, CV_8UC3);
+        EXPECT_EQ(getCmaStatus().level, CMA_PRESSURE_CRITICAL);
+    }
+    setUseGMatAllocator(false);
+
+    // level transitions notified once
+    ASSERT_EQ(levels.size(), 1U);
+    EXPECT_EQ(levels[0], CMA_PRESSURE_CRITICAL);
+    EXPECT_LE(lastFree, status.total);
+
+    setCmaWatermarks(CmaWatermarks());
+    setCmaPressureCallback(CmaPressureCallback());
+    EXPECT_EQ(getCmaStatus().level, CMA_PRESSURE_NONE);
+
+    postamble();
+}
+
+TEST(CV_Imx2dMat, cmaPressure) {
+    Imx2dCmaPressure test;
+    test.safe_run();
+}
+
+
 }} // namespace
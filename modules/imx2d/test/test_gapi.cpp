@@ -0,0 +1,126 @@
+/*
+   Copyright 2023 NXP
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "test_precomp.hpp"
+
+#include "opencv2/imx2d/gapi.hpp"
+
+#ifdef HAVE_OPENCV_GAPI
+
+#include "opencv2/gapi/core.hpp"
+
+namespace opencv_test { namespace {
+
+class Imx2dGapiKernels : public cvtest::BaseTest
+{
+public:
+    Imx2dGapiKernels(bool _allocator) : allocator(_allocator) {}
+protected:
+    void run(int);
+    bool allocator;
+};
+
+void Imx2dGapiKernels::run(int)
+{
+    Imx2dHal& hal = Imx2dHal::getInstance();
+    const Size dsize(320, 240);
+    const Rect roi(100, 50, 320, 200);
+    Mat src, fused, cropped, cropResized;
+
+    setUseImx2d(true);
+    setGMatAllocatorParams(GMatAllocatorParams(0, true));
+    setUseGMatAllocator(allocator);
+
+    src.create(480, 640, CV_8UC4);
+    randu(src, Scalar::all(0), Scalar::all(255));
+
+    {
+        cv::GMat in;
+        cv::GMat t = cv::imx2d::gapi::transform(in, dsize, 1, ROTATE_90_CLOCKWISE);
+        cv::GMat c = cv::gapi::crop(in, roi);
+        cv::GMat cr = cv::imx2d::gapi::cropResize(in, roi, dsize);
+        cv::GComputation graph(cv::GIn(in), cv::GOut(t, c, cr));
+
+        // fused operations reach the 2D hardware as a single submission
+        unsigned transformCount = hal.counters.readCount(Imx2dHalCounters::TRANSFORM);
+        unsigned resizeCount = hal.counters.readCount(Imx2dHalCounters::RESIZE);
+        unsigned flipCount = hal.counters.readCount(Imx2dHalCounters::FLIP);
+        unsigned copyCount = hal.counters.readCount(Imx2dHalCounters::COPY);
+        graph.apply(cv::gin(src), cv::gout(fused, cropped, cropResized),
+                    cv::compile_args(cv::imx2d::gapi::kernels()));
+
+        if (allocator)
+        {
+            EXPECT_EQ(hal.counters.readCount(Imx2dHalCounters::TRANSFORM),
+                      transformCount + 1);
+            EXPECT_EQ(hal.counters.readCount(Imx2dHalCounters::RESIZE),
+                      resizeCount + 1);
+            EXPECT_EQ(hal.counters.readCount(Imx2dHalCounters::FLIP), flipCount);
+            EXPECT_EQ(hal.counters.readCount(Imx2dHalCounters::COPY), copyCount + 1);
+        }
+    }
+
+    // graph results match module functions
+    Mat golden;
+    cv::imx2d::transform(src, golden, dsize, 1, ROTATE_90_CLOCKWISE);
+    EXPECT_EQ(fused.size(), dsize);
+    EXPECT_EQ(cvtest::norm(fused, golden, NORM_INF), 0);
+
+    EXPECT_EQ(cvtest::norm(cropped, src(roi), NORM_INF), 0);
+
+    cv::resize(src(roi), golden, dsize);
+    EXPECT_EQ(cvtest::norm(cropResized, golden, NORM_INF), 0);
+
+    {
+        cv::GMat in;
+        cv::GMat out = cv::gapi::flip(in, 0);
+        cv::GComputation graph(in, out);
+        Mat flipped;
+
+        // default kernel of the standard operation reaches the HAL
+        unsigned flipCount = hal.counters.readCount(Imx2dHalCounters::FLIP);
+        graph.apply(src, flipped, cv::compile_args(cv::imx2d::gapi::kernels()));
+        if (allocator)
+            EXPECT_EQ(hal.counters.readCount(Imx2dHalCounters::FLIP), flipCount + 1);
+
+        cv::flip(src, golden, 0);
+        EXPECT_EQ(cvtest::norm(flipped, golden, NORM_INF), 0);
+    }
+
+    src.release();
+    fused.release();
+    cropped.release();
+    cropResized.release();
+    golden.release();
+
+    setUseGMatAllocator(false);
+    setUseImx2d(false);
+}
+
+TEST(CV_Imx2dGapi, kernelsGMat) {
+    Imx2dGapiKernels test(true);
+    test.safe_run();
+}
+
+TEST(CV_Imx2dGapi, kernelsStd) {
+    Imx2dGapiKernels test(false);
+    test.safe_run();
+}
+
+
+}} // namespace
+
+#endif // HAVE_OPENCV_GAPI
@@ -0,0 +1,208 @@
+/*
+   Copyright 2023 NXP
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "test_precomp.hpp"
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/dma-heap.h>
+
+namespace opencv_test { namespace {
+
+#define DMA_HEAP_CMA_PATH "/dev/dma_heap/linux,cma"
+
+static int dmabufAlloc(size_t size)
+{
+    struct dma_heap_allocation_data data = {};
+    int heap, ret;
+
+    heap = open(DMA_HEAP_CMA_PATH, O_RDWR | O_CLOEXEC);
+    if (heap < 0)
+        return -1;
+
+    data.len = size;
+    data.fd_flags = O_RDWR | O_CLOEXEC;
+    ret = ioctl(heap, DMA_HEAP_IOCTL_ALLOC, &data);
+    close(heap);
+
+    return (ret < 0) ? -1 : static_cast<int>(data.fd);
+}
+
+class Imx2dImportDmabuf : public cvtest::BaseTest
+{
+protected:
+    void run(int);
+};
+
+void Imx2dImportDmabuf::run(int)
+{
+    Imx2dGAllocator& alloc = Imx2dGAllocator::getInstance();
+    const Size size(640, 480);
+    const size_t bufSize = size.area() * 4;
+    bool released = false;
+    unsigned allocations, cacheAllocations;
+
+    int fd = dmabufAlloc(bufSize);
+    if (fd < 0)
+        throw SkipTestException("DMA-BUF heap not available");
+
+    setUseImx2d(true);
+    setGMatAllocatorParams(GMatAllocatorParams(0, true));
+    setUseGMatAllocator(true);
+
+    // size larger than the exported buffer is rejected and not leaked
+    allocations = alloc.getAllocations();
+    EXPECT_ANY_THROW(importDmabuf(fd, bufSize * 2, Size(640, 960), CV_8UC4,
+                                  Mat::AUTO_STEP, 0, true,
+                                  [&released]() { released = true; }));
+    EXPECT_FALSE(released);
+    EXPECT_EQ(alloc.getAllocations(), allocations);
+
+    {
+        Mat src = importDmabuf(fd, bufSize, size, CV_8UC4, Mat::AUTO_STEP, 0, true,
+                               [&released]() { released = true; });
+        Mat dst(size / 2, CV_8UC4);
+        void* handle;
+        bool cacheable;
+
+        // imported buffer is registered but not accounted as allocation
+        EXPECT_TRUE(alloc.isGraphicBuffer(src.data, handle, cacheable));
+        EXPECT_TRUE(cacheable);
+        EXPECT_EQ(alloc.getAllocations(), allocations + 1); // dst only
+
+        src.setTo(Scalar(1, 2, 3, 4));
+
+        // no intermediate buffer allocated for the imported input
+        cacheAllocations = alloc.getCacheAllocations(true);
+        resize(src, dst, dst.size());
+        EXPECT_EQ(alloc.getCacheAllocations(true), cacheAllocations);
+        EXPECT_EQ(dst.at<Vec4b>(0, 0), Vec4b(1, 2, 3, 4));
+
+        EXPECT_FALSE(released);
+    }
+    EXPECT_TRUE(released);
+    EXPECT_EQ(alloc.getAllocations(), allocations);
+
+    close(fd);
+
+    setUseGMatAllocator(false);
+    setUseImx2d(false);
+}
+
+TEST(CV_Imx2dImport, dmabuf) {
+    Imx2dImportDmabuf test;
+    test.safe_run();
+}
+
+
+class Imx2dBufferInfo : public cvtest::BaseTest
+{
+protected:
+    void run(int);
+};
+
+void Imx2dBufferInfo::run(int)
+{
+    setGMatAllocatorParams(GMatAllocatorParams(0, true));
+    setUseGMatAllocator(true);
+
+    {
+        Mat m(480, 640, CV_8UC3, Scalar(1, 2, 3));
+        BufferInfo info = getBufferInfo(m, true);
+        ASSERT_TRUE(info.valid);
+        EXPECT_NE(info.paddr, 0ULL);
+        EXPECT_GE(info.size, m.total() * m.elemSize());
+        EXPECT_EQ(info.offset, 0U);
+        EXPECT_TRUE(info.cacheable);
+        ASSERT_GE(info.fd, 0);
+
+        // ROI offset in the backing buffer
+        Mat roi = m(Rect(10, 20, 100, 100));
+        BufferInfo roiInfo = getBufferInfo(roi);
+        ASSERT_TRUE(roiInfo.valid);
+        EXPECT_EQ(roiInfo.paddr, info.paddr);
+        EXPECT_EQ(roiInfo.offset, static_cast<size_t>(roi.data - m.data));
+        EXPECT_LT(roiInfo.fd, 0);
+
+        // exported buffer content seen by an importer
+        syncForDevice(m);
+        Mat imported = importDmabuf(info.fd, info.size, m.size(), m.type());
+        EXPECT_EQ(cvtest::norm(imported, m, NORM_INF), 0);
+        imported.release();
+        close(info.fd);
+    }
+
+    setUseGMatAllocator(false);
+
+    // system memory Mat
+    Mat heap(480, 640, CV_8UC3);
+    EXPECT_FALSE(getBufferInfo(heap).valid);
+}
+
+TEST(CV_Imx2dImport, bufferInfo) {
+    Imx2dBufferInfo test;
+    test.safe_run();
+}
+
+
+class Imx2dImportPhysical : public cvtest::BaseTest
+{
+protected:
+    void run(int);
+};
+
+void Imx2dImportPhysical::run(int)
+{
+    Imx2dGAllocator& alloc = Imx2dGAllocator::getInstance();
+    bool released = false;
+
+    setGMatAllocatorParams(GMatAllocatorParams(0, true));
+    setUseGMatAllocator(true);
+
+    {
+        Mat m(480, 640, CV_8UC4, Scalar(1, 2, 3, 4));
+        BufferInfo info = getBufferInfo(m, false);
+        ASSERT_TRUE(info.valid);
+        size_t size = m.total() * m.elemSize();
+
+        // invalid addresses or size
+        EXPECT_ANY_THROW(importPhysical(info.paddr, m.data, 0, m.size(), m.type()));
+        EXPECT_ANY_THROW(importPhysical(info.paddr + 1, m.data + 1, size - 1,
+                                        Size(16, 16), m.type()));
+
+        // range overlapping a registered buffer is rejected and not leaked
+        EXPECT_ANY_THROW(importPhysical(info.paddr, m.data, size, m.size(), m.type(),
+                                        Mat::AUTO_STEP, 0,
+                                        [&released]() { released = true; }));
+        EXPECT_FALSE(released);
+
+        void* handle;
+        bool cacheable;
+        ASSERT_TRUE(alloc.isGraphicBuffer(m.data, handle, cacheable));
+        EXPECT_TRUE(cacheable);
+        EXPECT_EQ(getBufferInfo(m, false).paddr, info.paddr);
+    }
+
+    setUseGMatAllocator(false);
+}
+
+TEST(CV_Imx2dImport, physical) {
+    Imx2dImportPhysical test;
+    test.safe_run();
+}
+
+}} // namespace
@@ -0,0 +1,141 @@
+/*
+   Copyright 2023 NXP
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "test_precomp.hpp"
+
+namespace opencv_test { namespace {
+
+class Imx2dStreamOps : public cvtest::BaseTest
+{
+public:
+    Imx2dStreamOps(bool _allocator) : allocator(_allocator) {}
+protected:
+    void run(int);
+    bool allocator;
+};
+
+void Imx2dStreamOps::run(int)
+{
+    Mat src, dst_sync, resized, flipped, rotated;
+
+    setUseImx2d(true);
+    setGMatAllocatorParams(GMatAllocatorParams(0, true));
+    setUseGMatAllocator(allocator);
+
+    src.create(480, 640, CV_8UC4);
+    randu(src, Scalar::all(0), Scalar::all(255));
+
+    {
+        Stream stream;
+        int64 t0 = stream.resize(src, resized, Size(320, 240));
+        int64 t1 = stream.flip(src, flipped, 0);
+        int64 t2 = stream.rotate(src, rotated, ROTATE_90_CLOCKWISE);
+        EXPECT_LE(t0, t1);
+        EXPECT_LE(t1, t2);
+
+        // waiting for latest token completes every earlier submission
+        stream.wait(t2);
+        EXPECT_TRUE(stream.queryIfComplete(t0));
+        EXPECT_TRUE(stream.queryIfComplete(t1));
+        EXPECT_TRUE(stream.queryIfComplete(t2));
+    }
+
+    // asynchronous results match synchronous execution
+    cv::resize(src, dst_sync, Size(320, 240));
+    EXPECT_EQ(cvtest::norm(resized, dst_sync, NORM_INF), 0);
+    cv::flip(src, dst_sync, 0);
+    EXPECT_EQ(cvtest::norm(flipped, dst_sync, NORM_INF), 0);
+    cv::rotate(src, dst_sync, ROTATE_90_CLOCKWISE);
+    EXPECT_EQ(cvtest::norm(rotated, dst_sync, NORM_INF), 0);
+
+    src.release();
+    dst_sync.release();
+    resized.release();
+    flipped.release();
+    rotated.release();
+
+    setUseGMatAllocator(false);
+    setUseImx2d(false);
+}
+
+TEST(CV_Imx2dStream, opsGMat) {
+    Imx2dStreamOps test(true);
+    test.safe_run();
+}
+
+TEST(CV_Imx2dStream, opsHeap) {
+    Imx2dStreamOps test(false);
+    test.safe_run();
+}
+
+class Imx2dStreamFallback : public cvtest::BaseTest
+{
+public:
+    Imx2dStreamFallback(bool _allocator) : allocator(_allocator) {}
+protected:
+    void run(int);
+    bool allocator;
+};
+
+void Imx2dStreamFallback::run(int)
+{
+    Mat src, resized, nearest, flipped, both, golden;
+
+    setUseImx2d(true);
+    setGMatAllocatorParams(GMatAllocatorParams(0, true));
+    setUseGMatAllocator(allocator);
+
+    src.create(480, 640, CV_8UC4);
+    randu(src, Scalar::all(0), Scalar::all(255));
+
+    {
+        // software implementation reads outputs of deferred blits
+        Stream stream;
+        stream.resize(src, resized, Size(320, 240));
+        stream.resize(resized, nearest, Size(160, 120), 0, 0, INTER_NEAREST);
+        stream.flip(src, flipped, 0);
+        stream.flip(flipped, both, -1);
+        stream.waitForCompletion();
+    }
+
+    cv::resize(src, golden, Size(320, 240));
+    cv::resize(golden, golden, Size(160, 120), 0, 0, INTER_NEAREST);
+    EXPECT_EQ(cvtest::norm(nearest, golden, NORM_INF), 0);
+    cv::flip(src, golden, 1);
+    EXPECT_EQ(cvtest::norm(both, golden, NORM_INF), 0);
+
+    src.release();
+    resized.release();
+    nearest.release();
+    flipped.release();
+    both.release();
+    golden.release();
+
+    setUseGMatAllocator(false);
+    setUseImx2d(false);
+}
+
+TEST(CV_Imx2dStream, fallbackGMat) {
+    Imx2dStreamFallback test(true);
+    test.safe_run();
+}
+
+TEST(CV_Imx2dStream, fallbackHeap) {
+    Imx2dStreamFallback test(false);
+    test.safe_run();
+}
+
+}} // namespace
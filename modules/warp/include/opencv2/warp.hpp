@@ -19,6 +19,9 @@
 
 #include <opencv2/core.hpp>
 
+#include <deque>
+#include <map>
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wshadow"
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -34,6 +37,47 @@ namespace cv { namespace warp {
 //! @addtogroup warp
 //! @{
 
+/**
+ * @brief Memory mode of the Warper queues
+ *
+ * - WARPER_MEMORY_MMAP: images are copied from and to driver buffers.
+ * - WARPER_MEMORY_DMABUF: images backed by graphic buffers (imx2d GMat or
+ *   imported DMA-BUF) are processed without copy. Each image shall start at
+ *   the beginning of its buffer, so multiple images must be passed as a vector
+ *   of Mat. Single plane formats only (NV12, not NV12M).
+ */
+enum WarperMemoryMode {
+    WARPER_MEMORY_MMAP = 0,
+    WARPER_MEMORY_DMABUF = 1,
+};
+
+/**
+ * @brief Build the DW100 dewarping vertex map undistorting a camera, for
+ * Warper::setMap().
+ *
+ * Source coordinates are computed for the 16x16 pixels blocks vertices only,
+ * as initUndistortRectifyMap() would for those pixels. Maps are cached on disk
+ * when a cache directory is given (or set by OPENCV_WARP_MAP_CACHE environment
+ * variable): files are named by a hash of every parameter and loaded with a
+ * single mmap. Maps loaded from cache are privately mapped, writes do not
+ * reach the file.
+ * @param cameraMatrix Input camera matrix
+ * @param distCoeffs Distortion coefficients (k1, k2, p1, p2[, k3[, k4, k5,
+ * k6]]), empty for none
+ * @param inSize Input stream size in pixels
+ * @param outSize Output stream size in pixels
+ * @param R Optional rectification transformation, identity if empty
+ * @param newCameraMatrix Camera matrix of the output, cameraMatrix scaled to
+ * outSize if empty
+ * @param cacheDir Directory of cached maps, no cache if empty
+ * @return CV_32SC1 vertex map
+ */
+CV_EXPORTS_W Mat buildVertexMap(InputArray cameraMatrix, InputArray distCoeffs,
+                                Size inSize, Size outSize,
+                                InputArray R = noArray(),
+                                InputArray newCameraMatrix = noArray(),
+                                const String& cacheDir = String());
+
 class CV_EXPORTS_W Warper
 {
 public:
@@ -41,8 +85,10 @@ public:
      * @brief Initialize the Warper.
      * @param index V4L2 M2M DW100 device node
      * @param image_count Number of images to process per I/O calls
+     * @param memory Queues memory mode, see WarperMemoryMode
      */
-    CV_WRAP Warper(int index, int image_count = 1);
+    CV_WRAP Warper(int index, int image_count = 1,
+                   int memory = WARPER_MEMORY_MMAP);
     ~Warper();
     /**
      * @brief Set input stream format.
@@ -60,15 +106,73 @@ public:
     CV_WRAP int setOutputFormat(unsigned width, unsigned height, int fourcc);
     /**
      * @brief Set dewarping mapping look-Up table.
+     *
+     * May be called while streaming, with a map matching the formats: the map
+     * applies from next processed frame, frames pending with enqueue() may be
+     * processed with either maps.
      * @param map Dewarping mapping Look-Up table array
      */
     CV_WRAP int setMap(InputArray map);
     /**
      * @brief Compute the output image
+     *
+     * Images are shaped after their format: planes stacked as rows of
+     * bytesperline bytes, CV_8UC2 elements for packed YUV 4:2:2 (YUYV...)
+     * and CV_8UC1 otherwise, e.g. a 1920x1080 NV12 image is a 1620x1920
+     * CV_8UC1 Mat. Multi-planar formats (NV12M...) planes are consecutive.
+     * A batch of images is a vector of Mats, or a Mat with one image per row.
      * @param inImg Input array of streams
-     * @param inImg Output array of streams
+     * @param outImg Output array of streams
      */
     CV_WRAP void warp(InputArray inImg, OutputArray outImg);
+    /**
+     * @brief Compute the output images without copying them from driver
+     * buffers (WARPER_MEMORY_MMAP mode only)
+     *
+     * Each output is a Mat shaped as warp() ones wrapping a capture buffer,
+     * queued back to the device once the Mat is released. Single plane
+     * formats only. Processing stalls
+     * when all image_count buffers are held by the application.
+     * @param inImg Input array of streams
+     * @param outImgs Output streams
+     */
+    CV_WRAP void warpMapped(InputArray inImg, CV_OUT std::vector<Mat>& outImgs);
+    /**
+     * @brief Set the number of device buffers per queue, for the streaming
+     * API to keep frames queued while the application does other work.
+     * Must be called before streaming starts.
+     * @param depth Number of buffers, at least image_count
+     */
+    CV_WRAP int setQueueDepth(int depth);
+    /**
+     * @brief Queue a frame for processing without waiting for its completion
+     *
+     * Must not be mixed with warp() calls while frames are pending.
+     * @param frame Input frame
+     * @param dst Output frame backed by a graphic buffer the device writes to
+     * (WARPER_MEMORY_DMABUF mode only). Input and output frames are referenced
+     * until dequeued.
+     * @return false if all buffers are pending
+     */
+    CV_WRAP bool enqueue(InputArray frame, InputOutputArray dst = noArray());
+    /**
+     * @brief Dequeue the oldest processed frame
+     * @param frame Output frame, shaped as warp() outputs in MMAP mode or dst
+     * frame given to enqueue() in DMABUF mode
+     * @param timeoutMs Wait timeout in milliseconds, -1 waits indefinitely
+     * and 0 returns immediately
+     * @return false if no frame was processed within the timeout
+     */
+    CV_WRAP bool dequeue(OutputArray frame, int timeoutMs = -1);
+    /**
+     * @brief Number of frames enqueued and not dequeued yet
+     */
+    CV_WRAP unsigned getPending();
+    /**
+     * @brief File descriptor of the device, readable (POLLIN) once a frame
+     * can be dequeued. Aimed at event loops (poll, epoll).
+     */
+    CV_WRAP int getFd();
     /**
      * @brief Start streaming operations
      */
@@ -88,16 +192,34 @@ public:
     CV_WRAP unsigned getOutputSizeimage();
 
 private:
+    struct CaptureState;
+
     int setFormat(bool isCapture, unsigned width, unsigned height, int fourcc);
     int write(InputArrayOfArrays images);
     int read(OutputArrayOfArrays images);
+    int readMapped(unsigned nimages, std::vector<Mat>& images);
+    int queue_capture(OutputArrayOfArrays images);
+    int write_image(unsigned index, const Mat& image);
+    int queue_capture_image(unsigned index, const Mat& image);
+    int copy_capture(cv4l_buffer& buf, Mat& image);
+    int wait_dequeue(cv4l_buffer& buf);
+    bool reclaim_output(int timeoutMs);
+    void reclaim_outputs();
     int setup_input_queue();
     int setup_output_queue();
+    void setup_streaming();
     struct v4l2_capability vcap;
     struct v4l2_format inFmt;
     struct v4l2_format outFmt;
     Mat mapping;
     int buf_count;
+    int memory;
+    std::shared_ptr<CaptureState> captureState;
+    std::deque<unsigned> freeOutputs;
+    std::deque<unsigned> freeCaptures;
+    std::map<unsigned, Mat> pendingInputs;
+    std::map<unsigned, Mat> pendingCaptures;
+    unsigned pending;
     bool isStreaming;
     cv4l_fd c_fd;
     cv4l_queue qin;
@@ -105,6 +227,102 @@ private:
 
 };
 
+/**
+ * @brief Time-slices several logical streams on a single DW100 device
+ *
+ * Each stream has its own formats and map. Frames submitted per stream are
+ * processed by process() calls, each one serving a batch of frames of a
+ * stream in round robin order. Device context is switched between batches:
+ * streams sharing formats only switch the map, device buffers are kept
+ * allocated. Format switches restart streaming, in WARPER_MEMORY_DMABUF mode
+ * frames buffers are application graphic buffers and are not reallocated.
+ */
+class CV_EXPORTS_W WarpScheduler
+{
+public:
+    /**
+     * @brief Initialize the scheduler.
+     * @param index V4L2 M2M DW100 device node
+     * @param batch Maximum number of frames of a stream processed per slice
+     * @param memory Queues memory mode, see WarperMemoryMode
+     */
+    CV_WRAP WarpScheduler(int index, int batch = 4,
+                          int memory = WARPER_MEMORY_MMAP);
+    /**
+     * @brief Add a logical stream.
+     * @param inWidth Input stream width in pixels
+     * @param inHeight Input stream height in pixels
+     * @param inFourcc Input stream fourcc code
+     * @param outWidth Output stream width in pixels
+     * @param outHeight Output stream height in pixels
+     * @param outFourcc Output stream fourcc code
+     * @param map Dewarping mapping Look-Up table array
+     * @return stream identifier
+     */
+    CV_WRAP int addStream(unsigned inWidth, unsigned inHeight, int inFourcc,
+                          unsigned outWidth, unsigned outHeight, int outFourcc,
+                          InputArray map);
+    /**
+     * @brief Replace the map of a stream, applied from its next slice.
+     */
+    CV_WRAP void setStreamMap(int stream, InputArray map);
+    /**
+     * @brief Submit a frame of a stream for processing.
+     * @param stream Stream identifier
+     * @param frame Input frame, referenced until processed
+     * @param dst Output frame backed by a graphic buffer (WARPER_MEMORY_DMABUF
+     * mode only)
+     */
+    CV_WRAP void submit(int stream, InputArray frame, InputOutputArray dst = noArray());
+    /**
+     * @brief Process a slice of frames of the next stream in round robin order.
+     *
+     * A slice interrupted by the timeout is resumed by next call, before any
+     * context switch.
+     * @param timeoutMs Wait timeout per frame in milliseconds, -1 waits
+     * indefinitely
+     * @return number of frames processed
+     */
+    CV_WRAP int process(int timeoutMs = -1);
+    /**
+     * @brief Retrieve the oldest processed frame of a stream.
+     * @return false if no processed frame is available
+     */
+    CV_WRAP bool retrieve(int stream, OutputArray frame);
+    /**
+     * @brief Number of context switches changing formats, restarting streaming
+     */
+    CV_WRAP unsigned getFormatSwitches();
+    /**
+     * @brief Number of context switches changing the map only
+     */
+    CV_WRAP unsigned getMapSwitches();
+
+private:
+    struct Stream {
+        unsigned inWidth, inHeight, inFourcc;
+        unsigned outWidth, outHeight, outFourcc;
+        Mat map;
+        std::deque<Mat> inputs;
+        std::deque<Mat> dsts;
+        std::deque<Mat> outputs;
+    };
+
+    void switchTo(int stream);
+
+    Ptr<Warper> warper;
+    std::vector<Stream> streams;
+    unsigned batch;
+    int memory;
+    int current;
+    int configured;
+    bool mapDirty;
+    unsigned slice;
+    unsigned inflight;
+    unsigned formatSwitches;
+    unsigned mapSwitches;
+};
+
 #define DEFAULT_WIDTH 640
 #define DEFAULT_HEIGHT 480
 #define DEFAULT_FOURCC V4L2_PIX_FMT_YUYV
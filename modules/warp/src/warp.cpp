@@ -20,20 +20,226 @@
 #include "opencv2/core.hpp"
 #include <opencv2/core/utils/logger.hpp>
 #include <opencv2/warp.hpp>
+#include "opencv2/opencv_modules.hpp"
+#ifdef HAVE_OPENCV_IMX2D
+#include <opencv2/imx2d.hpp>
+#endif
 
+#include <functional>
+#include <algorithm>
+#include <mutex>
 
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
 #include <stdint.h>
 
 #include <linux/dw100.h>
 
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace cv {
 namespace warp {
 
-Warper::Warper(int index, int image_count)
-    :buf_count(image_count), isStreaming(false)
+/**
+ * Capture queue state shared with Mats wrapping its buffers, so that buffers
+ * released after Warper destruction are not queued back.
+ */
+struct Warper::CaptureState {
+    std::mutex mutex;
+    cv4l_fd *fd;
+    cv4l_queue *queue;
+    unsigned mapped;
+    bool alive;
+};
+
+/**
+ * MatAllocator of Mats wrapping buffers not owned by OpenCV (capture buffers,
+ * mapped files): release callback is invoked at Mat buffer release.
+ * Allocation requests for Mat reusing this allocator are forwarded to default
+ * allocator.
+ */
+class BufferAllocator CV_FINAL : public MatAllocator
+{
+public:
+    struct Buffer {
+        std::function<void()> release;
+    };
+
+    UMatData* allocate(int dims, const int* sizes, int type,
+                       void* data0, size_t* step, AccessFlag flags,
+                       UMatUsageFlags usageFlags) const CV_OVERRIDE
+    {
+        MatAllocator* allocator = Mat::getDefaultAllocator();
+        return allocator->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+    }
+
+    bool allocate(UMatData* u, AccessFlag /*accessFlags*/, UMatUsageFlags /*usageFlags*/) const CV_OVERRIDE
+    {
+        if(!u) return false;
+        return true;
+    }
+
+    void deallocate(UMatData* u) const CV_OVERRIDE
+    {
+        if(!u)
+            return;
+
+        CV_Assert(u->urefcount == 0);
+        CV_Assert(u->refcount == 0);
+
+        Buffer* buffer = static_cast<Buffer*>(u->userdata);
+        buffer->release();
+
+        delete buffer;
+        delete u;
+    }
+
+    static BufferAllocator& getInstance()
+    {
+        static BufferAllocator instance;
+        return instance;
+    }
+};
+
+static Mat wrapBuffer(void *base, size_t size, int rows, int cols, int type,
+                      size_t offset, const std::function<void()>& release)
+{
+    BufferAllocator& allocator = BufferAllocator::getInstance();
+
+    Mat m(rows, cols, type, static_cast<uchar*>(base) + offset); // no alloc
+
+    UMatData* u = new UMatData(&allocator);
+    u->data = u->origdata = static_cast<uchar*>(base);
+    u->size = size;
+    u->userdata = new BufferAllocator::Buffer({release});
+    u->refcount = 1;
+
+    m.allocator = &allocator;
+    m.u = u;
+
+    return m;
+}
+
+/**
+ * Images are elements of a vector, a single Mat of imageSize bytes (any shape)
+ * or rows of a Mat.
+ */
+static unsigned image_count(InputArrayOfArrays images, size_t imageSize)
+{
+    if (images.isMatVector())
+        return images.total();
+
+    Mat m = images.getMat();
+    if (m.total() * m.elemSize() == imageSize)
+        return 1;
+
+    return m.rows;
+}
+
+static Mat image_at(InputArrayOfArrays images, unsigned i, unsigned count)
+{
+    if (images.isMatVector() || (count > 1))
+        return images.getMat(i);
+
+    return images.getMat();
+}
+
+static unsigned format_sizeimage(const struct v4l2_format& fmt)
+{
+    unsigned size = 0;
+
+    for (unsigned j = 0; j < fmt.fmt.pix_mp.num_planes; j++)
+        size += fmt.fmt.pix_mp.plane_fmt[j].sizeimage;
+
+    return size;
+}
+
+/**
+ * Shape of a Mat holding an image of the format: planes are stacked as rows
+ * of bytesperline bytes, packed YUV 4:2:2 pixels are 2 channels elements.
+ */
+static void format_shape(const struct v4l2_format& fmt, int& rows, int& cols,
+                         int& type)
+{
+    const struct v4l2_pix_format_mplane& pix = fmt.fmt.pix_mp;
+    unsigned bpl = pix.plane_fmt[0].bytesperline;
+
+    switch (pix.pixelformat) {
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_YVYU:
+    case V4L2_PIX_FMT_UYVY:
+    case V4L2_PIX_FMT_VYUY:
+        type = CV_8UC2;
+        break;
+    default:
+        type = CV_8UC1;
+        break;
+    }
+
+    // no line layout, e.g. compressed formats
+    if (bpl == 0) {
+        rows = 1;
+        cols = format_sizeimage(fmt);
+        type = CV_8UC1;
+        return;
+    }
+
+    rows = 0;
+    for (unsigned j = 0; j < pix.num_planes; j++)
+        rows += pix.plane_fmt[j].sizeimage / pix.plane_fmt[j].bytesperline;
+    cols = bpl / CV_ELEM_SIZE(type);
+}
+
+#ifdef HAVE_OPENCV_IMX2D
+/**
+ * DMA-BUF exporting the graphic buffer of an image, -1 on error.
+ * Synchronize CPU cache for device access and read only if !deviceWrite.
+ */
+static int export_image(const Mat& image, bool deviceWrite, size_t& size)
+{
+    imx2d::BufferInfo info = imx2d::getBufferInfo(image, true);
+
+    if (!info.valid) {
+        CV_LOG_ERROR(NULL, "Image " << static_cast<void*>(image.data)
+                     << " not backed by a graphic buffer");
+        return -1;
+    }
+
+    if (info.offset) {
+        CV_LOG_ERROR(NULL, "Image " << static_cast<void*>(image.data)
+                     << " not at the start of its graphic buffer");
+        if (info.fd >= 0)
+            close(info.fd);
+        return -1;
+    }
+
+    if (info.fd < 0) {
+        CV_LOG_ERROR(NULL, "Error while exporting image buffer");
+        return -1;
+    }
+
+    imx2d::syncForDevice(image, deviceWrite);
+    size = info.size;
+
+    return info.fd;
+}
+#else
+static int export_image(const Mat& image, bool deviceWrite, size_t& size)
+{
+    CV_UNUSED(image); CV_UNUSED(deviceWrite); CV_UNUSED(size);
+    CV_LOG_ERROR(NULL, "DMA-BUF images require imx2d module");
+    return -1;
+}
+#endif
+
+Warper::Warper(int index, int image_count, int _memory)
+    :buf_count(image_count), memory(_memory), pending(0), isStreaming(false)
 {
     String deviceName = cv::format("/dev/video%d", index);
 
@@ -52,12 +258,36 @@ Warper::Warper(int index, int image_count)
     setFormat(false, DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_FOURCC);
     setFormat(true, DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_FOURCC);
 
-    qin.init(c_fd.g_type(), V4L2_MEMORY_MMAP);
-    qout.init(v4l_type_invert(c_fd.g_type()), V4L2_MEMORY_MMAP);
+    unsigned v4l2Memory;
+    if (memory == WARPER_MEMORY_MMAP) {
+        v4l2Memory = V4L2_MEMORY_MMAP;
+    } else if (memory == WARPER_MEMORY_DMABUF) {
+#ifndef HAVE_OPENCV_IMX2D
+        CV_Error(CV_StsNotImplemented, "DMABUF memory mode requires imx2d module");
+#endif
+        v4l2Memory = V4L2_MEMORY_DMABUF;
+    } else {
+        CV_Error(CV_StsBadArg, "Invalid memory mode");
+    }
+
+    qin.init(c_fd.g_type(), v4l2Memory);
+    qout.init(v4l_type_invert(c_fd.g_type()), v4l2Memory);
+
+    captureState = std::make_shared<CaptureState>();
+    captureState->fd = &c_fd;
+    captureState->queue = &qin;
+    captureState->mapped = 0;
+    captureState->alive = true;
 }
 
 Warper::~Warper()
 {
+    // Mats still wrapping capture buffers remain mapped
+    {
+        std::lock_guard<std::mutex> lock(captureState->mutex);
+        captureState->alive = false;
+    }
+
     if (c_fd.g_fd() != -1)
         c_fd.close();
 }
@@ -117,7 +347,7 @@ unsigned int Warper::getInputFourcc()
 
 unsigned int Warper::getInputSizeimage()
 {
-    return inFmt.fmt.pix_mp.plane_fmt[0].sizeimage;
+    return format_sizeimage(inFmt);
 }
 
 unsigned int Warper::getOutputWidth()
@@ -137,7 +367,7 @@ unsigned int Warper::getOutputFourcc()
 
 unsigned int Warper::getOutputSizeimage()
 {
-    return outFmt.fmt.pix_mp.plane_fmt[0].sizeimage;
+    return format_sizeimage(outFmt);
 }
 
 int Warper::setInputFormat(unsigned width, unsigned height, int fourcc)
@@ -160,9 +390,6 @@ int Warper::setMap(InputArray &map)
     uint32_t *data;
     Mat mapMat = map.getMat();
 
-    if (isStreaming)
-        return 1;
-
     CV_Assert(mapMat.type() == CV_32SC1);
 
     data = reinterpret_cast<uint32_t*>(mapMat.data);
@@ -192,60 +419,151 @@ int Warper::setMap(InputArray &map)
     return ret;
 }
 
+int Warper::setQueueDepth(int depth)
+{
+    if (isStreaming)
+        return 1;
+
+    CV_Assert(depth >= 1);
+    buf_count = depth;
+
+    return 0;
+}
+
+int Warper::write_image(unsigned index, const Mat& image)
+{
+    cv4l_buffer buf(qout);
+    unsigned imagesz = image.total() * image.elemSize();
+    unsigned read = 0;
+
+    if (memory == WARPER_MEMORY_DMABUF) {
+        size_t size;
+        int fd, ret;
+
+        CV_Assert(imagesz == getInputSizeimage());
+
+        fd = export_image(image, false, size);
+        if (fd < 0)
+            return 1;
+
+        buf.init(qout, index);
+        buf.s_field(V4L2_FIELD_NONE);
+        buf.s_fd(fd);
+        buf.s_length(size);
+        buf.s_bytesused(imagesz);
+        buf.s_timestamp_clock();
+
+        // queued buffer holds its own DMA-BUF reference
+        ret = c_fd.qbuf(buf);
+        close(fd);
+        if (ret) {
+            CV_LOG_ERROR(NULL, "Error " << errno << " while queuing output buffer");
+            return 1;
+        }
+
+        return 0;
+    }
+
+    if (c_fd.querybuf(buf, index)) {
+        CV_LOG_ERROR(NULL, "Error " << errno << " while querying output buffer");
+        return 1;
+    }
+
+    buf.update(qout, index);
+    buf.s_field(V4L2_FIELD_NONE);
+
+    CV_Assert(image.isContinuous());
+
+    // planes are consecutive in the image, each one at its buffer start
+    for (unsigned j = 0; j < qout.g_num_planes(); j++) {
+        unsigned char *pbuf =
+            static_cast<unsigned char *>(qout.g_dataptr(buf.g_index(), j));
+        unsigned plane_len = inFmt.fmt.pix_mp.plane_fmt[j].sizeimage;
+        const void *image_ptr = image.ptr() + read;
+
+        CV_Assert(plane_len <= qout.g_length(j));
+        CV_Assert(read + plane_len <= imagesz);
+
+        CV_LOG_INFO(NULL, "Writing "
+                << plane_len << " bytes"
+                << " from " << image_ptr
+                << " to " << static_cast<void *>(pbuf));
+        memcpy(pbuf, image_ptr, plane_len);
+        read += plane_len;
+        buf.s_bytesused(plane_len, j);
+    }
+    CV_Assert(imagesz == read);
+
+    buf.s_timestamp_clock();
+
+    if (c_fd.qbuf(buf)) {
+        CV_LOG_ERROR(NULL, "Error " << errno << " while queuing output buffer");
+        return 1;
+    }
+
+    return 0;
+}
+
 int Warper::write(InputArrayOfArrays images)
 {
-    unsigned nimages = images.rows();
+    unsigned nimages = image_count(images, getInputSizeimage());
 
     CV_Assert(nimages <= qout.g_buffers());
 
     CV_LOG_INFO(NULL, "Writing...");
     for (unsigned i = 0; i < nimages; i++) {
-        cv4l_buffer buf(qout);
-        Mat image = images.getMat(i);
-        unsigned imagesz = image.total() * image.elemSize();
-        unsigned read = 0;
-        if (c_fd.querybuf(buf, i)) {
-            CV_LOG_ERROR(NULL, "Error " << errno << " while querying output buffer");
+        if (write_image(i, image_at(images, i, nimages)))
             return 1;
-        }
+    }
 
-        buf.update(qout, i);
-        buf.s_field(V4L2_FIELD_NONE);
+    return 0;
+}
 
-        for (unsigned j = 0; j < qout.g_num_planes(); j++) {
-            unsigned char *pbuf =
-                static_cast<unsigned char *>(qout.g_dataptr(buf.g_index(), j));
-            unsigned buf_len = qout.g_length(j);
-            void *image_ptr = image.ptr() + read;
-            pbuf += read;
-
-            CV_LOG_INFO(NULL, "Writing "
-                    << buf_len << " bytes"
-                    << " from " << image_ptr
-                    << " to " << pbuf);
-            memcpy(pbuf, image_ptr, buf_len);
-            read += buf_len;
-            buf.s_bytesused(buf_len);
-        }
-        CV_Assert(imagesz == read);
+int Warper::queue_capture_image(unsigned index, const Mat& image)
+{
+    cv4l_buffer buf(qin, index);
+    size_t size;
+    int fd, ret;
 
-        buf.s_timestamp_clock();
+    CV_Assert(image.total() * image.elemSize() == getOutputSizeimage());
 
-        if (c_fd.qbuf(buf)) {
-            CV_LOG_ERROR(NULL, "Error " << errno << " while queuing output buffer");
+    fd = export_image(image, true, size);
+    if (fd < 0)
+        return 1;
+
+    buf.s_fd(fd);
+    buf.s_length(size);
+
+    // queued buffer holds its own DMA-BUF reference
+    ret = c_fd.qbuf(buf);
+    close(fd);
+    if (ret) {
+        CV_LOG_ERROR(NULL, "Error " << errno << " while queuing input buffer");
+        return 1;
+    }
+
+    return 0;
+}
+
+int Warper::queue_capture(OutputArrayOfArrays images)
+{
+    unsigned nimages = image_count(images, getOutputSizeimage());
+
+    CV_Assert(nimages <= qin.g_buffers());
+
+    for (unsigned i = 0; i < nimages; i++) {
+        if (queue_capture_image(i, image_at(images, i, nimages)))
             return 1;
-        }
     }
 
     return 0;
 }
 
-int Warper::read(OutputArrayOfArrays images)
+int Warper::wait_dequeue(cv4l_buffer& buf)
 {
     int ret;
-    unsigned nimages = images.rows();
     int fd = c_fd.g_fd();
-    char msg[1024];
+    cv4l_buffer bufOut(qout);
 
     fd_set fds[2];
     fd_set *rd_fds = &fds[0];
@@ -256,97 +574,314 @@ int Warper::read(OutputArrayOfArrays images)
     tv.tv_sec = 1;
     tv.tv_usec = 0;
 
+    if (rd_fds) {
+        FD_ZERO(rd_fds);
+        FD_SET(fd, rd_fds);
+    }
+
+    if (wr_fds) {
+        FD_ZERO(wr_fds);
+        FD_SET(fd, wr_fds);
+    }
+
+    ret = select(fd + 1, rd_fds, wr_fds, nullptr, &tv);
+    if (ret == 0) {
+        CV_LOG_ERROR(NULL, "Timeout while reading");
+        return 1;
+    } else if (ret < 0) {
+        CV_LOG_ERROR(NULL, "Error on select");
+        return 1;
+    }
+
+    if (!FD_ISSET(fd, rd_fds)) {
+        CV_LOG_ERROR(NULL, "Fd should be ready for read operation !");
+        return 1;
+    }
+
+    if (!FD_ISSET(fd, wr_fds)) {
+        CV_LOG_ERROR(NULL, "Fd should be ready for write operation !");
+        return 1;
+    }
+
+    ret = c_fd.dqbuf(buf);
+    if (ret == EAGAIN) {
+        CV_LOG_ERROR(NULL, "Error while dequeue-ing capture buffer");
+        return 1;
+    }
+
+    ret = c_fd.dqbuf(bufOut);
+    if (ret == EAGAIN) {
+        CV_LOG_ERROR(NULL, "Error while dequeue-ing output buffer");
+        return 1;
+    }
+
+    return 0;
+}
+
+int Warper::copy_capture(cv4l_buffer& buf, Mat& image)
+{
+    unsigned imagesz = image.total() * image.elemSize();
+    unsigned written = 0;
+    char msg[1024];
+
+    CV_LOG_INFO(NULL, "Reading from " << buf.g_index());
+    for (unsigned j = 0; j < qin.g_num_planes(); j++) {
+        unsigned used = buf.g_bytesused(j);
+        unsigned offset = buf.g_data_offset(j);
+        unsigned char *pbuf =
+            static_cast<unsigned char *>(qin.g_dataptr(buf.g_index(), j));
+        void *image_ptr = image.ptr() + written;
+        used -= offset;
+        pbuf += offset;
+
+        sprintf(msg, " Writing image from %p to %p", pbuf, image_ptr);
+        CV_LOG_INFO(NULL, msg);
+        memcpy(image_ptr, pbuf, used);
+        written += used;
+    }
+
+    CV_Assert(imagesz == written);
+
+    if (c_fd.qbuf(buf)) {
+        CV_LOG_ERROR(NULL, "Error " << errno << " while queuing input buffer");
+        return 1;
+    }
+
+    return 0;
+}
+
+int Warper::read(OutputArrayOfArrays images)
+{
+    unsigned nimages = image_count(images, getOutputSizeimage());
+
     CV_Assert(nimages <= qin.g_buffers());
 
     for (unsigned i = 0; i < nimages; i++) {
         cv4l_buffer buf(qin);
-        cv4l_buffer bufOut(qout);
 
-        Mat image = images.getMat(i);
-        unsigned imagesz = image.total() * image.elemSize();
-        unsigned written = 0;
-
-        if (rd_fds) {
-            FD_ZERO(rd_fds);
-            FD_SET(fd, rd_fds);
-        }
+        if (wait_dequeue(buf))
+            return 1;
 
-        if (wr_fds) {
-            FD_ZERO(wr_fds);
-            FD_SET(fd, wr_fds);
+        // device writes directly to images buffers
+        if (memory == WARPER_MEMORY_DMABUF) {
+            CV_LOG_INFO(NULL, "Read " << buf.g_bytesused() << " bytes into "
+                        << buf.g_index());
+            continue;
         }
 
-        ret = select(fd + 1, rd_fds, wr_fds, nullptr, &tv);
-        if (ret == 0) {
-            CV_LOG_ERROR(NULL, "Timeout while reading");
+        Mat image = image_at(images, i, nimages);
+        if (copy_capture(buf, image))
             return 1;
-        } else if (ret < 0) {
-            CV_LOG_ERROR(NULL, "Error on select");
-            return 1;
-        }
+    }
 
-        if (!FD_ISSET(fd, rd_fds)) {
-            CV_LOG_ERROR(NULL, "Fd should be ready for read operation !");
-            return 1;
-        }
+    return 0;
+}
 
-        if (!FD_ISSET(fd, wr_fds)) {
-            CV_LOG_ERROR(NULL, "Fd should be ready for write operation !");
-            return 1;
-        }
+int Warper::readMapped(unsigned nimages, std::vector<Mat>& images)
+{
+    CV_Assert(nimages <= qin.g_buffers());
 
-        ret = c_fd.dqbuf(buf);
-        if (ret == EAGAIN) {
-            CV_LOG_ERROR(NULL, "Error while dequeue-ing capture buffer");
-            return 1;
-        }
+    // planes of an image could not be wrapped as a single Mat
+    if (qin.g_num_planes() != 1)
+        CV_Error(CV_StsBadArg, "Mapped outputs require single plane formats (e.g. NV12)");
+
+    int rows, cols, type;
+    format_shape(outFmt, rows, cols, type);
+
+    images.clear();
+
+    for (unsigned i = 0; i < nimages; i++) {
+        cv4l_buffer buf(qin);
 
-        ret = c_fd.dqbuf(bufOut);
-        if (ret == EAGAIN) {
-            CV_LOG_ERROR(NULL, "Error while dequeue-ing output buffer");
+        if (wait_dequeue(buf))
             return 1;
+
+        unsigned index = buf.g_index();
+        unsigned used = buf.g_bytesused();
+        unsigned offset = buf.g_data_offset();
+        unsigned char *pbuf =
+            static_cast<unsigned char *>(qin.g_dataptr(index, 0));
+
+        CV_LOG_INFO(NULL, "Mapping " << index);
+
+        std::shared_ptr<CaptureState> state = captureState;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->mapped++;
         }
 
-        CV_LOG_INFO(NULL, "Reading from " << buf.g_index());
-        for (unsigned j = 0; j < qin.g_num_planes(); j++) {
-            unsigned used = buf.g_bytesused(j);
-            unsigned offset = buf.g_data_offset(j);
-            unsigned char *pbuf =
-                static_cast<unsigned char *>(qin.g_dataptr(buf.g_index(), j));
-            void *image_ptr = image.ptr() + written;
-            used -= offset;
-            pbuf += offset;
-
-            sprintf(msg, " Writing image from %p to %p", pbuf, image_ptr);
-            CV_LOG_INFO(NULL, msg);
-            memcpy(image_ptr, pbuf, used);
-            written += used;
+        // shaped after the output format when the whole image was produced
+        int mrows = 1, mcols = used - offset, mtype = CV_8UC1;
+        if (used - offset == getOutputSizeimage()) {
+            mrows = rows;
+            mcols = cols;
+            mtype = type;
         }
 
-        CV_Assert(imagesz == written);
+        images.push_back(wrapBuffer(pbuf, used, mrows, mcols, mtype, offset, [state, index]() {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->mapped--;
+            if (!state->alive)
+                return;
 
-        if (c_fd.qbuf(buf)) {
-            CV_LOG_ERROR(NULL, "Error " << errno << " while queuing input buffer");
-            return 1;
-        }
+            cv4l_buffer requeued(*state->queue, index);
+            if (state->fd->qbuf(requeued))
+                CV_LOG_ERROR(NULL, "Error " << errno << " while queuing input buffer");
+        }));
     }
 
     return 0;
 }
 
+/**
+ * Dequeue a processed output buffer (device input) back to the free list.
+ * Output buffers complete along with capture ones but the streaming API
+ * reclaims them lazily, when a buffer is needed by enqueue().
+ */
+bool Warper::reclaim_output(int timeoutMs)
+{
+    struct pollfd pfd = { c_fd.g_fd(), POLLOUT, 0 };
+    cv4l_buffer bufOut(qout);
+
+    if ((poll(&pfd, 1, timeoutMs) <= 0) || !(pfd.revents & POLLOUT))
+        return false;
+
+    if (c_fd.dqbuf(bufOut))
+        return false;
+
+    freeOutputs.push_back(bufOut.g_index());
+    pendingInputs.erase(bufOut.g_index());
+
+    return true;
+}
+
+// batch calls use every output buffer
+void Warper::reclaim_outputs()
+{
+    while ((freeOutputs.size() < qout.g_buffers()) && reclaim_output(1000))
+        ;
+}
+
+bool Warper::enqueue(InputArray frame, InputOutputArray dst)
+{
+    unsigned outIndex, capIndex = 0;
+    Mat image = frame.getMat();
+
+    setup_streaming();
+
+    CV_Assert(image.total() * image.elemSize() == getInputSizeimage());
+
+    if (freeOutputs.empty() && !reclaim_output(0))
+        return false;
+
+    if (memory == WARPER_MEMORY_DMABUF) {
+        CV_Assert(!dst.empty());
+        CV_Assert(dst.getMat().total() * dst.getMat().elemSize() ==
+                  getOutputSizeimage());
+        if (freeCaptures.empty())
+            return false;
+
+        capIndex = freeCaptures.front();
+    }
+
+    // capture buffer queued last: a queued capture can't be taken back
+    // without stopping the stream
+    outIndex = freeOutputs.front();
+    if (write_image(outIndex, image))
+        CV_Error(CV_StsBadArg, "Error while writing input image");
+
+    freeOutputs.pop_front();
+    if (memory == WARPER_MEMORY_DMABUF) {
+        // queued output buffer tracked until reclaimed, even on error below
+        pendingInputs[outIndex] = image;
+
+        if (queue_capture_image(capIndex, dst.getMat()))
+            CV_Error(CV_StsBadArg, "Error while queuing output image");
+
+        freeCaptures.pop_front();
+        pendingCaptures[capIndex] = dst.getMat();
+    }
+
+    pending++;
+
+    return true;
+}
+
+bool Warper::dequeue(OutputArray frame, int timeoutMs)
+{
+    struct pollfd pfd = { c_fd.g_fd(), POLLIN, 0 };
+    cv4l_buffer buf(qin);
+
+    if (!pending)
+        return false;
+
+    if ((poll(&pfd, 1, timeoutMs) <= 0) || !(pfd.revents & POLLIN))
+        return false;
+
+    if (c_fd.dqbuf(buf)) {
+        CV_LOG_ERROR(NULL, "Error " << errno << " while dequeue-ing capture buffer");
+        return false;
+    }
+
+    pending--;
+
+    // output buffer completed along with the capture one
+    (void) reclaim_output(0);
+
+    if (memory == WARPER_MEMORY_DMABUF) {
+        unsigned index = buf.g_index();
+
+        frame.assign(pendingCaptures[index]);
+        pendingCaptures.erase(index);
+        freeCaptures.push_back(index);
+
+        return true;
+    }
+
+    int rows, cols, type;
+    format_shape(outFmt, rows, cols, type);
+    frame.create(rows, cols, type);
+    Mat image = frame.getMat();
+    if (copy_capture(buf, image))
+        CV_Error(CV_StsBadArg, "Error while reading output image");
+
+    return true;
+}
+
+unsigned Warper::getPending()
+{
+    return pending;
+}
+
+int Warper::getFd()
+{
+    return c_fd.g_fd();
+}
+
 
 int Warper::setup_input_queue()
 {
     if (qin.reqbufs(&c_fd, buf_count))
         CV_Error(CV_StsBadArg, "Error while requesting in buffers");
 
-    if (qin.obtain_bufs(&c_fd))
-        CV_Error(CV_StsBadArg, "Error while mapping in buffers");
+    // DMA-BUF buffers are provided and queued along with images
+    if (memory == WARPER_MEMORY_MMAP) {
+        if (qin.obtain_bufs(&c_fd))
+            CV_Error(CV_StsBadArg, "Error while mapping in buffers");
+
+        if (qin.queue_all(&c_fd))
+            CV_Error(CV_StsBadArg, "Error while queue-ing in buffers");
+    }
 
-    if (qin.queue_all(&c_fd))
-        CV_Error(CV_StsBadArg, "Error while queue-ing in buffers");
+    // images are exported as a single DMA-BUF
+    if ((memory == WARPER_MEMORY_DMABUF) && (qin.g_num_planes() != 1))
+        CV_Error(CV_StsBadArg, "DMABUF memory mode requires single plane formats (e.g. NV12)");
 
-    CV_Assert(qin.g_num_planes() == 1);
+    freeCaptures.clear();
+    if (memory == WARPER_MEMORY_DMABUF) {
+        for (unsigned i = 0; i < qin.g_buffers(); i++)
+            freeCaptures.push_back(i);
+    }
 
     return 0;
 }
@@ -356,14 +891,31 @@ int Warper::setup_output_queue()
     if (qout.reqbufs(&c_fd, buf_count))
         CV_Error(CV_StsBadArg, "Error while requesting out buffers");
 
-    if (qout.obtain_bufs(&c_fd))
-        CV_Error(CV_StsBadArg, "Error while mapping out buffers");
+    if (memory == WARPER_MEMORY_MMAP) {
+        if (qout.obtain_bufs(&c_fd))
+            CV_Error(CV_StsBadArg, "Error while mapping out buffers");
+    }
+
+    if ((memory == WARPER_MEMORY_DMABUF) && (qout.g_num_planes() != 1))
+        CV_Error(CV_StsBadArg, "DMABUF memory mode requires single plane formats (e.g. NV12)");
 
-    CV_Assert(qout.g_num_planes() == 1);
+    freeOutputs.clear();
+    for (unsigned i = 0; i < qout.g_buffers(); i++)
+        freeOutputs.push_back(i);
 
     return 0;
 }
 
+void Warper::setup_streaming()
+{
+    if (isStreaming)
+        return;
+
+    setup_input_queue();
+    setup_output_queue();
+    start_streaming();
+}
+
 int Warper::start_streaming()
 {
     if (isStreaming)
@@ -385,12 +937,27 @@ int Warper::stop_streaming()
     if (!isStreaming)
         return 0;
 
+    // buffers unmapping would leave Mats from warpMapped() dangling
+    {
+        std::lock_guard<std::mutex> lock(captureState->mutex);
+        if (captureState->mapped) {
+            CV_LOG_ERROR(NULL, captureState->mapped
+                         << " mapped output(s) still referenced");
+            return 1;
+        }
+    }
+
     c_fd.streamoff(qin.g_type());
     c_fd.streamoff(qout.g_type());
 
     qin.free(&c_fd);
     qout.free(&c_fd);
 
+    // pending frames are dropped by stream off
+    pending = 0;
+    pendingInputs.clear();
+    pendingCaptures.clear();
+
     isStreaming = false;
 
     return 0;
@@ -398,25 +965,40 @@ int Warper::stop_streaming()
 
 void Warper::warp(InputArrayOfArrays inputImages, OutputArrayOfArrays outputImages)
 {
-    if (!isStreaming) {
-        setup_input_queue();
-        setup_output_queue();
-        start_streaming();
-    }
+    unsigned nimages = image_count(inputImages, getInputSizeimage());
+    int rows, cols, type;
+
+    setup_streaming();
+    CV_Assert(pending == 0);
+    reclaim_outputs();
+
     CV_LOG_INFO(NULL, "Input dims: " << inputImages.dims() \
         << " channels: " << inputImages.channels() \
         << " ImageSize: " << getInputSizeimage() \
         << " cols: " << inputImages.cols() \
         << " rows: " << inputImages.rows());
 
-    //TODO: Handle scaling
-    outputImages.create(inputImages.rows(), getOutputSizeimage(), inputImages.type());
+    // output images are shaped after the output format, a batch in a single
+    // Mat holds an image per row
+    format_shape(outFmt, rows, cols, type);
+    if (outputImages.isMatVector()) {
+        outputImages.create(nimages, 1, type);
+        for (unsigned i = 0; i < nimages; i++)
+            outputImages.create(rows, cols, type, i);
+    } else if (nimages == 1) {
+        outputImages.create(rows, cols, type);
+    } else {
+        outputImages.create(nimages, getOutputSizeimage(), CV_8UC1);
+    }
     CV_LOG_INFO(NULL, "Output dims: " << outputImages.dims() \
         << " channels: " << outputImages.channels() \
         << " ImageSize: " << getOutputSizeimage() \
         << " cols: " << outputImages.cols() \
         << " rows: " << outputImages.rows());
 
+    if ((memory == WARPER_MEMORY_DMABUF) && queue_capture(outputImages))
+        CV_Error(CV_StsBadArg, "Error while queuing output image");
+
     if (write(inputImages))
         CV_Error(CV_StsBadArg, "Error while writing input image");
 
@@ -424,5 +1006,497 @@ void Warper::warp(InputArrayOfArrays inputImages, OutputArrayOfArrays outputImag
         CV_Error(CV_StsBadArg, "Error while reading output image");
 }
 
+void Warper::warpMapped(InputArrayOfArrays inputImages, std::vector<Mat>& outputImages)
+{
+    if (memory != WARPER_MEMORY_MMAP)
+        CV_Error(CV_StsBadArg, "Mapped outputs require MMAP memory mode");
+
+    setup_streaming();
+    CV_Assert(pending == 0);
+    reclaim_outputs();
+
+    if (write(inputImages))
+        CV_Error(CV_StsBadArg, "Error while writing input image");
+
+    if (readMapped(image_count(inputImages, getInputSizeimage()), outputImages))
+        CV_Error(CV_StsBadArg, "Error while reading output image");
+}
+
+
+WarpScheduler::WarpScheduler(int index, int _batch, int _memory)
+    :batch(_batch), memory(_memory), current(-1), configured(-1),
+     mapDirty(false), slice(0), inflight(0), formatSwitches(0), mapSwitches(0)
+{
+    CV_Assert(_batch >= 1);
+
+    warper = makePtr<Warper>(index, _batch, _memory);
+}
+
+int WarpScheduler::addStream(unsigned inWidth, unsigned inHeight, int inFourcc,
+                             unsigned outWidth, unsigned outHeight, int outFourcc,
+                             InputArray map)
+{
+    Stream stream;
+
+    CV_Assert(!map.empty());
+
+    stream.inWidth = inWidth;
+    stream.inHeight = inHeight;
+    stream.inFourcc = inFourcc;
+    stream.outWidth = outWidth;
+    stream.outHeight = outHeight;
+    stream.outFourcc = outFourcc;
+    map.getMat().copyTo(stream.map);
+
+    streams.push_back(stream);
+
+    return static_cast<int>(streams.size()) - 1;
+}
+
+void WarpScheduler::setStreamMap(int stream, InputArray map)
+{
+    CV_Assert(stream >= 0 && stream < static_cast<int>(streams.size()));
+    CV_Assert(!map.empty());
+
+    map.getMat().copyTo(streams[stream].map);
+    if (stream == configured)
+        mapDirty = true;
+}
+
+void WarpScheduler::submit(int stream, InputArray frame, InputOutputArray dst)
+{
+    CV_Assert(stream >= 0 && stream < static_cast<int>(streams.size()));
+
+    streams[stream].inputs.push_back(frame.getMat());
+    if (memory == WARPER_MEMORY_DMABUF) {
+        CV_Assert(!dst.empty());
+        streams[stream].dsts.push_back(dst.getMat());
+    }
+}
+
+void WarpScheduler::switchTo(int stream)
+{
+    Stream& next = streams[stream];
+
+    if ((stream == configured) && !mapDirty)
+        return;
+
+    bool sameFormats = false;
+    if (configured >= 0) {
+        const Stream& prev = streams[configured];
+        sameFormats = (prev.inWidth == next.inWidth) &&
+                      (prev.inHeight == next.inHeight) &&
+                      (prev.inFourcc == next.inFourcc) &&
+                      (prev.outWidth == next.outWidth) &&
+                      (prev.outHeight == next.outHeight) &&
+                      (prev.outFourcc == next.outFourcc);
+    }
+
+    if (!sameFormats) {
+        CV_LOG_INFO(NULL, "Switching formats to stream " << stream);
+
+        if (warper->stop_streaming())
+            CV_Error(CV_StsError, "Error while stopping streaming");
+
+        if (warper->setInputFormat(next.inWidth, next.inHeight, next.inFourcc) ||
+            warper->setOutputFormat(next.outWidth, next.outHeight, next.outFourcc))
+            CV_Error(CV_StsBadArg, "Error while setting stream formats");
+
+        formatSwitches++;
+    } else {
+        mapSwitches++;
+    }
+
+    // queues are set up by first enqueue, set map after formats
+    if (warper->setMap(next.map))
+        CV_Error(CV_StsBadArg, "Error while setting stream map");
+
+    configured = stream;
+    mapDirty = false;
+}
+
+int WarpScheduler::process(int timeoutMs)
+{
+    int count = static_cast<int>(streams.size());
+    int done = 0;
+
+    // new slice only once previous one is complete
+    if (!inflight && !slice) {
+        int next = -1;
+
+        for (int k = 1; k <= count; k++) {
+            int s = (current + k + count) % count;
+            if (!streams[s].inputs.empty()) {
+                next = s;
+                break;
+            }
+        }
+
+        if (next < 0)
+            return 0;
+
+        switchTo(next);
+        current = next;
+        slice = std::min<size_t>(batch, streams[next].inputs.size());
+    }
+
+    Stream& stream = streams[current];
+
+    // keep device busy: enqueue while buffers are free, dequeue as completed
+    while (inflight || slice) {
+        while (slice) {
+            Mat dst;
+            if (memory == WARPER_MEMORY_DMABUF)
+                dst = stream.dsts.front();
+
+            if (!warper->enqueue(stream.inputs.front(), dst))
+                break;
+
+            stream.inputs.pop_front();
+            if (memory == WARPER_MEMORY_DMABUF)
+                stream.dsts.pop_front();
+            inflight++;
+            slice--;
+        }
+
+        Mat out;
+        if (!warper->dequeue(out, timeoutMs))
+            break;
+
+        stream.outputs.push_back(out);
+        inflight--;
+        done++;
+    }
+
+    return done;
+}
+
+bool WarpScheduler::retrieve(int stream, OutputArray frame)
+{
+    CV_Assert(stream >= 0 && stream < static_cast<int>(streams.size()));
+
+    std::deque<Mat>& outputs = streams[stream].outputs;
+    if (outputs.empty())
+        return false;
+
+    frame.assign(outputs.front());
+    outputs.pop_front();
+
+    return true;
+}
+
+unsigned WarpScheduler::getFormatSwitches()
+{
+    return formatSwitches;
+}
+
+unsigned WarpScheduler::getMapSwitches()
+{
+    return mapSwitches;
+}
+
+
+/**
+ * DW100 vertex map: for every vertex of a 16x16 pixels blocks grid of the
+ * output image, source image coordinates in UQ12.4 fixed point, y in the 16
+ * most significant bits and x in the 16 least significant ones.
+ */
+#define DW100_BLOCK_SIZE 16
+#define DW100_UQ12_4_ONE 16.f
+
+#define VERTEX_MAP_MAGIC 0x4d565744 // "DWVM"
+#define VERTEX_MAP_VERSION 1
+
+// Vertices rows computed per parallel band
+#define VERTEX_MAP_BAND_ROWS 8
+
+struct VertexMapHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t keyLength;
+    uint32_t reserved;
+};
+
+struct VertexMapModel {
+    float ir[9];          // inverse of new camera matrix * rectification
+    float fx, fy, cx, cy; // camera matrix
+    float k[8];           // k1, k2, p1, p2, k3, k4, k5, k6
+    float xqMax, yqMax;   // source image bounds
+};
+
+static inline uint32_t vertex_map_entry(const VertexMapModel& m, float u, float v)
+{
+    float X = m.ir[0] * u + m.ir[1] * v + m.ir[2];
+    float Y = m.ir[3] * u + m.ir[4] * v + m.ir[5];
+    float W = m.ir[6] * u + m.ir[7] * v + m.ir[8];
+    float x = X / W, y = Y / W;
+
+    float x2 = x * x, y2 = y * y, r2 = x2 + y2, xy2 = 2.f * x * y;
+    float kr = (1.f + ((m.k[4] * r2 + m.k[1]) * r2 + m.k[0]) * r2) /
+               (1.f + ((m.k[7] * r2 + m.k[6]) * r2 + m.k[5]) * r2);
+    float xd = x * kr + m.k[2] * xy2 + m.k[3] * (r2 + 2.f * x2);
+    float yd = y * kr + m.k[2] * (r2 + 2.f * y2) + m.k[3] * xy2;
+
+    float xq = (m.fx * xd + m.cx) * DW100_UQ12_4_ONE;
+    float yq = (m.fy * yd + m.cy) * DW100_UQ12_4_ONE;
+    xq = std::min(std::max(xq, 0.f), m.xqMax);
+    yq = std::min(std::max(yq, 0.f), m.yqMax);
+
+    return (static_cast<uint32_t>(cvRound(yq)) << 16) |
+           static_cast<uint32_t>(cvRound(xq));
+}
+
+static void vertex_map_row(const VertexMapModel& m, int row, uint32_t* dst, int width)
+{
+    float v = static_cast<float>(row * DW100_BLOCK_SIZE);
+    int j = 0;
+
+    // vdivq_f32() and vcvtnq_u32_f32() are AArch64 only
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    const float32x4_t step = { 0.f, 1.f * DW100_BLOCK_SIZE,
+                               2.f * DW100_BLOCK_SIZE, 3.f * DW100_BLOCK_SIZE };
+    const float32x4_t one = vdupq_n_f32(1.f), two = vdupq_n_f32(2.f);
+    const float32x4_t zero = vdupq_n_f32(0.f);
+    const float32x4_t cX = vdupq_n_f32(m.ir[1] * v + m.ir[2]);
+    const float32x4_t cY = vdupq_n_f32(m.ir[4] * v + m.ir[5]);
+    const float32x4_t cW = vdupq_n_f32(m.ir[7] * v + m.ir[8]);
+
+    for (; j <= width - 4; j += 4)
+    {
+        float32x4_t u = vaddq_f32(vdupq_n_f32(static_cast<float>(j * DW100_BLOCK_SIZE)), step);
+        float32x4_t W = vmlaq_n_f32(cW, u, m.ir[6]);
+        float32x4_t iW = vdivq_f32(one, W);
+        float32x4_t x = vmulq_f32(vmlaq_n_f32(cX, u, m.ir[0]), iW);
+        float32x4_t y = vmulq_f32(vmlaq_n_f32(cY, u, m.ir[3]), iW);
+
+        float32x4_t x2 = vmulq_f32(x, x), y2 = vmulq_f32(y, y);
+        float32x4_t r2 = vaddq_f32(x2, y2);
+        float32x4_t xy2 = vmulq_f32(two, vmulq_f32(x, y));
+
+        float32x4_t num = vmlaq_f32(vdupq_n_f32(m.k[1]), r2, vdupq_n_f32(m.k[4]));
+        num = vmlaq_f32(vdupq_n_f32(m.k[0]), r2, num);
+        num = vmlaq_f32(one, r2, num);
+        float32x4_t den = vmlaq_f32(vdupq_n_f32(m.k[6]), r2, vdupq_n_f32(m.k[7]));
+        den = vmlaq_f32(vdupq_n_f32(m.k[5]), r2, den);
+        den = vmlaq_f32(one, r2, den);
+        float32x4_t kr = vdivq_f32(num, den);
+
+        float32x4_t xd = vmulq_f32(x, kr);
+        xd = vmlaq_n_f32(xd, xy2, m.k[2]);
+        xd = vmlaq_n_f32(xd, vmlaq_f32(r2, two, x2), m.k[3]);
+        float32x4_t yd = vmulq_f32(y, kr);
+        yd = vmlaq_n_f32(yd, vmlaq_f32(r2, two, y2), m.k[2]);
+        yd = vmlaq_n_f32(yd, xy2, m.k[3]);
+
+        float32x4_t xq = vmulq_n_f32(vmlaq_n_f32(vdupq_n_f32(m.cx), xd, m.fx), DW100_UQ12_4_ONE);
+        float32x4_t yq = vmulq_n_f32(vmlaq_n_f32(vdupq_n_f32(m.cy), yd, m.fy), DW100_UQ12_4_ONE);
+        xq = vminq_f32(vmaxq_f32(xq, zero), vdupq_n_f32(m.xqMax));
+        yq = vminq_f32(vmaxq_f32(yq, zero), vdupq_n_f32(m.yqMax));
+
+        uint32x4_t entry = vorrq_u32(vshlq_n_u32(vcvtnq_u32_f32(yq), 16),
+                                     vcvtnq_u32_f32(xq));
+        vst1q_u32(dst + j, entry);
+    }
+#endif
+
+    for (; j < width; j++)
+        dst[j] = vertex_map_entry(m, static_cast<float>(j * DW100_BLOCK_SIZE), v);
+}
+
+// FNV-1a hash of the map key
+static uint64_t vertex_map_hash(const std::vector<double>& key)
+{
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(key.data());
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < key.size() * sizeof(double); i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+static String vertex_map_path(const String& dir, const std::vector<double>& key)
+{
+    return cv::format("%s/dw100_vertex_map_%016llx.bin", dir.c_str(),
+                      static_cast<unsigned long long>(vertex_map_hash(key)));
+}
+
+/**
+ * Map the cached file of a map, empty Mat if missing or not matching.
+ * Pages are mapped privately: Mat writes do not reach the file.
+ */
+static Mat vertex_map_load(const String& path, const std::vector<double>& key,
+                           int width, int height)
+{
+    size_t keySize = key.size() * sizeof(double);
+    size_t dataSize = static_cast<size_t>(width) * height * sizeof(uint32_t);
+    size_t size = sizeof(VertexMapHeader) + keySize + dataSize;
+    struct stat st;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return Mat();
+
+    if (fstat(fd, &st) || (static_cast<size_t>(st.st_size) != size)) {
+        close(fd);
+        return Mat();
+    }
+
+    void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return Mat();
+
+    const VertexMapHeader* header = static_cast<const VertexMapHeader*>(base);
+    const uint8_t* fileKey = static_cast<const uint8_t*>(base) + sizeof(VertexMapHeader);
+
+    // full key compared, hash only names the file
+    if ((header->magic != VERTEX_MAP_MAGIC) ||
+        (header->version != VERTEX_MAP_VERSION) ||
+        (header->width != static_cast<uint32_t>(width)) ||
+        (header->height != static_cast<uint32_t>(height)) ||
+        (header->keyLength != key.size()) ||
+        memcmp(fileKey, key.data(), keySize)) {
+        CV_LOG_WARNING(NULL, "Ignoring stale vertex map cache " << path);
+        munmap(base, size);
+        return Mat();
+    }
+
+    CV_LOG_INFO(NULL, "Loaded vertex map from " << path);
+
+    return wrapBuffer(base, size, height, width, CV_32SC1,
+                      sizeof(VertexMapHeader) + keySize,
+                      [base, size]() { munmap(base, size); });
+}
+
+// best effort, written to a temporary file renamed once complete
+static void vertex_map_store(const String& path, const std::vector<double>& key,
+                             const Mat& map)
+{
+    VertexMapHeader header = { VERTEX_MAP_MAGIC, VERTEX_MAP_VERSION,
+                               static_cast<uint32_t>(map.cols),
+                               static_cast<uint32_t>(map.rows),
+                               static_cast<uint32_t>(key.size()), 0 };
+    String tmpPath = cv::format("%s.%d", path.c_str(), getpid());
+    bool ok;
+
+    CV_Assert(map.isContinuous());
+
+    FILE* f = fopen(tmpPath.c_str(), "wb");
+    if (!f) {
+        CV_LOG_WARNING(NULL, "Unable to create vertex map cache " << tmpPath);
+        return;
+    }
+
+    ok = (fwrite(&header, sizeof(header), 1, f) == 1) &&
+         (fwrite(key.data(), sizeof(double), key.size(), f) == key.size()) &&
+         (fwrite(map.data, map.elemSize(), map.total(), f) == map.total());
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || rename(tmpPath.c_str(), path.c_str())) {
+        CV_LOG_WARNING(NULL, "Unable to write vertex map cache " << path);
+        unlink(tmpPath.c_str());
+    }
+}
+
+Mat buildVertexMap(InputArray cameraMatrix, InputArray distCoeffs,
+                   Size inSize, Size outSize, InputArray R,
+                   InputArray newCameraMatrix, const String& cacheDir)
+{
+    Matx33d K, P, Rm = Matx33d::eye();
+    double k[8] = {};
+
+    CV_Assert(inSize.width > 0 && inSize.height > 0);
+    CV_Assert(outSize.width > 0 && outSize.height > 0);
+    CV_Assert(cameraMatrix.total() == 9);
+    cameraMatrix.getMat().convertTo(K, CV_64F);
+
+    if (!distCoeffs.empty()) {
+        Mat d;
+        size_t n = distCoeffs.total();
+        CV_Assert(n == 4 || n == 5 || n == 8);
+        distCoeffs.getMat().reshape(1, 1).convertTo(d, CV_64F);
+        for (size_t i = 0; i < n; i++)
+            k[i] = d.at<double>(static_cast<int>(i));
+    }
+
+    if (!R.empty()) {
+        CV_Assert(R.total() == 9);
+        R.getMat().convertTo(Rm, CV_64F);
+    }
+
+    // default: camera matrix scaled to output image
+    if (!newCameraMatrix.empty()) {
+        CV_Assert(newCameraMatrix.total() == 9);
+        newCameraMatrix.getMat().convertTo(P, CV_64F);
+    } else {
+        double sx = static_cast<double>(outSize.width) / inSize.width;
+        double sy = static_cast<double>(outSize.height) / inSize.height;
+        P = Matx33d(K(0, 0) * sx, K(0, 1) * sx, K(0, 2) * sx,
+                    0., K(1, 1) * sy, K(1, 2) * sy,
+                    0., 0., 1.);
+    }
+
+    CV_Assert(inSize.width * DW100_UQ12_4_ONE <= 0xffff);
+    CV_Assert(inSize.height * DW100_UQ12_4_ONE <= 0xffff);
+
+    int width = (outSize.width + DW100_BLOCK_SIZE - 1) / DW100_BLOCK_SIZE + 1;
+    int height = (outSize.height + DW100_BLOCK_SIZE - 1) / DW100_BLOCK_SIZE + 1;
+
+    // every input of the map computation
+    std::vector<double> key = {
+        static_cast<double>(inSize.width), static_cast<double>(inSize.height),
+        static_cast<double>(outSize.width), static_cast<double>(outSize.height),
+    };
+    key.insert(key.end(), K.val, K.val + 9);
+    key.insert(key.end(), k, k + 8);
+    key.insert(key.end(), Rm.val, Rm.val + 9);
+    key.insert(key.end(), P.val, P.val + 9);
+
+    String dir = cacheDir;
+    if (dir.empty()) {
+        const char* env = getenv("OPENCV_WARP_MAP_CACHE");
+        if (env)
+            dir = env;
+    }
+
+    String path;
+    if (!dir.empty()) {
+        path = vertex_map_path(dir, key);
+        Mat cached = vertex_map_load(path, key, width, height);
+        if (!cached.empty())
+            return cached;
+    }
+
+    VertexMapModel model;
+    Matx33d iR = (P * Rm).inv(DECOMP_LU);
+    for (int i = 0; i < 9; i++)
+        model.ir[i] = static_cast<float>(iR.val[i]);
+    model.fx = static_cast<float>(K(0, 0));
+    model.fy = static_cast<float>(K(1, 1));
+    model.cx = static_cast<float>(K(0, 2));
+    model.cy = static_cast<float>(K(1, 2));
+    for (int i = 0; i < 8; i++)
+        model.k[i] = static_cast<float>(k[i]);
+    model.xqMax = (inSize.width - 1) * DW100_UQ12_4_ONE;
+    model.yqMax = (inSize.height - 1) * DW100_UQ12_4_ONE;
+
+    Mat map(height, width, CV_32SC1);
+
+    parallel_for_(Range(0, height), [&](const Range& range) {
+        for (int row = range.start; row < range.end; row++)
+            vertex_map_row(model, row, map.ptr<uint32_t>(row), width);
+    }, std::max(1, height / VERTEX_MAP_BAND_ROWS));
+
+    if (!path.empty())
+        vertex_map_store(path, key, map);
+
+    return map;
+}
+
 
 }} //cv::warp